@@ -57,10 +57,10 @@ $(BIN):$(LINK_OBJ)
 
 ifeq ($(BUILD_SO), true)
 # gcc -o 是生成so
-	$(CC) -fPIC -shared -o $@.so $^
+	$(CC) -fPIC -shared -o $@.so $^ -lpthread
 else
 # gcc -o 是生成可执行文件
-	$(CC) -o $@ $^
+	$(CC) -o $@ $^ -lpthread
 endif
 
 #----------------------------------------------------------------1end-------------------
@@ -36,90 +36,111 @@ static void build_command_header(byte* command, ushort command_len, byte command
 	command[18] = 0x01;
 }
 
-// Build core packet from address
-byte_array_info build_read_byte_command(siemens_s7_address_data address)
+// Fill one 12-byte ANY pointer item of a Read Var request
+static void build_read_item(byte* item, siemens_s7_address_data address, bool is_bit)
 {
-	const ushort command_len = 19 + 12;	// head + block
-	byte* command = (byte*)malloc(command_len);
-	if (command == NULL)
-		return (byte_array_info) { 0 };
-
-	build_command_header(command, command_len, 0x04);
-
 	// Specify valid value type
-	command[19] = 0x12;
+	item[0] = 0x12;
 	// Address access length for this request
-	command[20] = 0x0A;
+	item[1] = 0x0A;
 	// Syntax tag, ANY
-	command[21] = 0x10;
+	item[2] = 0x10;
+	if (is_bit)
+	{
+		// Data read: bit mode
+		item[3] = 0x01;
+		// Number of data items to access
+		item[4] = 0x00;
+		item[5] = 0x01;
+	}
 	// Unit: word
-	if (address.data_code == 0x1E || address.data_code == 0x1F)
+	else if (address.data_code == 0x1E || address.data_code == 0x1F)
+	{
+		item[3] = address.data_code;
+		// Number of data items to access
+		item[4] = (byte)(address.length / 2 / 256);
+		item[5] = (byte)(address.length / 2 % 256);
+	}
+	else if (address.data_code == 0x06 || address.data_code == 0x07)
 	{
-		command[22] = address.data_code;
+		item[3] = 0x04;
 		// Number of data items to access
-		command[23] = (byte)(address.length / 2 / 256);
-		command[24] = (byte)(address.length / 2 % 256);
+		item[4] = (byte)(address.length / 2 / 256);
+		item[5] = (byte)(address.length / 2 % 256);
 	}
 	else
 	{
-		if (address.data_code == 0x06 || address.data_code == 0x07)
-		{
-			// Number of data items to access
-			command[22] = 0x04;
-			command[23] = (byte)(address.length / 2 / 256);
-			command[24] = (byte)(address.length / 2 % 256);
-		}
-		else
-		{
-			command[22] = 0x02;
-			// Number of data items to access
-			command[23] = (byte)(address.length / 256);
-			command[24] = (byte)(address.length % 256);
-		}
+		item[3] = 0x02;
+		// Number of data items to access
+		item[4] = (byte)(address.length / 256);
+		item[5] = (byte)(address.length % 256);
 	}
 	// DB block number
-	command[25] = (byte)(address.db_block / 256);
-	command[26] = (byte)(address.db_block % 256);
+	item[6] = (byte)(address.db_block / 256);
+	item[7] = (byte)(address.db_block % 256);
 	// Data type to access
-	command[27] = address.data_code;
+	item[8] = address.data_code;
 	// Offset position
-	command[28] = (byte)(address.address_start / 256 / 256 % 256);
-	command[29] = (byte)(address.address_start / 256 % 256);
-	command[30] = (byte)(address.address_start % 256);
+	item[9] = (byte)(address.address_start / 256 / 256 % 256);
+	item[10] = (byte)(address.address_start / 256 % 256);
+	item[11] = (byte)(address.address_start % 256);
+}
+
+// Read Var request of one item, S7_READ_REQUEST_SIZE bytes
+void build_read_request(byte* command, siemens_s7_address_data address, bool is_bit)
+{
+	build_command_header(command, S7_READ_REQUEST_SIZE, 0x04);
+	build_read_item(command + 19, address, is_bit);
+}
+
+static byte_array_info build_read_command(const s7_conn_t* conn, siemens_s7_address_data address, bool is_bit)
+{
+	byte* command = s7_frame_alloc(conn, S7_READ_REQUEST_SIZE);
+	if (command == NULL)
+		return (byte_array_info) { 0 };
+
+	build_read_request(command, address, is_bit);
 
 	byte_array_info ret = { 0 };
 	ret.data = command;
-	ret.length = command_len;
+	ret.length = S7_READ_REQUEST_SIZE;
 	return ret;
 }
 
-byte_array_info build_read_bit_command(siemens_s7_address_data address)
+// Build core packet from address
+byte_array_info build_read_byte_command(const s7_conn_t* conn, siemens_s7_address_data address)
+{
+	return build_read_command(conn, address, false);
+}
+
+byte_array_info build_read_bit_command(const s7_conn_t* conn, siemens_s7_address_data address)
+{
+	return build_read_command(conn, address, true);
+}
+
+// Largest payload one Read Var response can carry for a single item
+int s7_read_chunk_size(int pdu_size)
 {
-	const ushort command_len = 19 + 12;	// head + block
-	byte* command = (byte*)malloc(command_len);
+	// Keep chunks even so word-based areas (AI/AQ, timers, counters) never split a word.
+	return (pdu_size - S7_RESPONSE_HEADER_SIZE - S7_ITEM_DATA_HEADER_SIZE) & ~1;
+}
+
+// Build one Read Var request carrying several items; the caller sizes the batch against the PDU
+byte_array_info build_read_multi_command(const s7_conn_t* conn, const s7_request_item* items, int count)
+{
+	if (items == NULL || count <= 0 || count > 255)
+		return (byte_array_info) { 0 };
+
+	const ushort command_len = (ushort)(19 + S7_ITEM_SPEC_SIZE * count);
+	byte* command = s7_frame_alloc(conn, command_len);
 	if (command == NULL)
 		return (byte_array_info) { 0 };
 
 	build_command_header(command, command_len, 0x04);
-
-	// Read address prefix
-	command[19] = 0x12;
-	command[20] = 0x0A;
-	command[21] = 0x10;
-	// Data read: bit mode
-	command[22] = 0x01;
-	// Number of data items to access
-	command[23] = 0x00;
-	command[24] = 0x01;
-	// DB block number
-	command[25] = (byte)(address.db_block / 256);
-	command[26] = (byte)(address.db_block % 256);
-	// Data type to access
-	command[27] = address.data_code;
-	// Offset position
-	command[28] = (byte)(address.address_start / 256 / 256 % 256);
-	command[29] = (byte)(address.address_start / 256 % 256);
-	command[30] = (byte)(address.address_start % 256);
+	// Number of items in this request
+	command[18] = (byte)count;
+	for (int i = 0; i < count; i++)
+		build_read_item(command + 19 + S7_ITEM_SPEC_SIZE * i, items[i].address, items[i].is_bit);
 
 	byte_array_info ret = { 0 };
 	ret.data = command;
@@ -127,66 +148,103 @@ byte_array_info build_read_bit_command(siemens_s7_address_data address)
 	return ret;
 }
 
-byte_array_info build_write_byte_command(siemens_s7_address_data address, byte_array_info value)
+// Bytes one item occupies in a Read Var response, including the fill byte after odd payloads
+int s7_read_item_response_size(const s7_request_item* item)
 {
-	int val_len = 0;
-	if (value.data != NULL)
-		val_len = value.length;
-
-	const ushort command_len = 35 + val_len;
-	byte* command = (byte*)malloc(command_len);
-	if (command == NULL)
-		return (byte_array_info) { 0 };
-
-	build_command_header(command, command_len, 0x05);
+	int data_len = item->is_bit ? 1 : item->address.length;
+	return S7_ITEM_DATA_HEADER_SIZE + data_len + (data_len % 2);
+}
 
-	// Write length + 4
-	command[15] = (byte)((4 + val_len) / 256);
-	command[16] = (byte)((4 + val_len) % 256);
-	// Read/write instruction
-	command[17] = 0x05;
-	// Number of data blocks to write
-	command[18] = 0x01;
-	// Fixed, return data length
-	command[19] = 0x12;
-	command[20] = 0x0A;
-	command[21] = 0x10;
-	if (address.data_code == 0x06 || address.data_code == 0x07)
+// Fill one 12-byte ANY pointer item of a Write Var request
+static void build_write_item(byte* item, siemens_s7_address_data address, bool is_bit, int val_len)
+{
+	item[0] = 0x12;
+	item[1] = 0x0A;
+	item[2] = 0x10;
+	if (is_bit)
+	{
+		// Write mode: 1=bitwise, 2=byte, 4=word
+		item[3] = 0x01;
+		// Number of data items to write
+		item[4] = (byte)(val_len / 256);
+		item[5] = (byte)(val_len % 256);
+	}
+	else if (address.data_code == 0x06 || address.data_code == 0x07)
 	{
 		// Write mode: 1=bitwise, 2=byte, 4=word
-		command[22] = 0x04;
+		item[3] = 0x04;
 		// Number of data items to write
-		command[23] = (byte)(val_len / 2 / 256);
-		command[24] = (byte)(val_len / 2 % 256);
+		item[4] = (byte)(val_len / 2 / 256);
+		item[5] = (byte)(val_len / 2 % 256);
 	}
 	else
 	{
 		// Write mode: 1=bitwise, 2=byte, 4=word
-		command[22] = 0x02;
+		item[3] = 0x02;
 		// Number of data items to write
-		command[23] = (byte)(val_len / 256);
-		command[24] = (byte)(val_len % 256);
+		item[4] = (byte)(val_len / 256);
+		item[5] = (byte)(val_len % 256);
 	}
 	// DB block number
-	command[25] = (byte)(address.db_block / 256);
-	command[26] = (byte)(address.db_block % 256);
+	item[6] = (byte)(address.db_block / 256);
+	item[7] = (byte)(address.db_block % 256);
 	// Data type to write
-	command[27] = address.data_code;
+	item[8] = address.data_code;
 	// Offset position
-	command[28] = (byte)(address.address_start / 256 / 256 % 256); ;
-	command[29] = (byte)(address.address_start / 256 % 256);
-	command[30] = (byte)(address.address_start % 256);
-	// Write by word
-	command[31] = 0x00;
-	command[32] = 0x04;
-	// Bit-count length
-	command[33] = (byte)(val_len * 8 / 256);
-	command[34] = (byte)(val_len * 8 % 256);
+	item[9] = (byte)(address.address_start / 256 / 256 % 256);
+	item[10] = (byte)(address.address_start / 256 % 256);
+	item[11] = (byte)(address.address_start % 256);
+}
 
-	if (value.data != NULL)
+// Fill the data part of one Write Var item: return code, transport size, length and payload
+static void build_write_item_data(byte* item_data, siemens_s7_address_data address, bool is_bit, const byte* value, int val_len)
+{
+	item_data[0] = 0x00;
+	if (is_bit)
 	{
-		memcpy(command + 35, value.data, val_len);
+		// Bitwise write
+		item_data[1] = address.data_code == 0x1C ? 0x09 : 0x03;
+		// Bit-count length
+		item_data[2] = (byte)(val_len / 256);
+		item_data[3] = (byte)(val_len % 256);
 	}
+	else
+	{
+		// Write by word
+		item_data[1] = 0x04;
+		// Bit-count length
+		item_data[2] = (byte)(val_len * 8 / 256);
+		item_data[3] = (byte)(val_len * 8 % 256);
+	}
+
+	if (value != NULL && val_len > 0)
+		memcpy(item_data + S7_ITEM_DATA_HEADER_SIZE, value, val_len);
+}
+
+// Write Var request of one item up to its data; the val_len data bytes follow it on the wire
+void build_write_header(byte* command, siemens_s7_address_data address, bool is_bit, int val_len)
+{
+	build_command_header(command, (ushort)(S7_WRITE_HEADER_SIZE + val_len), 0x05);
+
+	// Write length + 4
+	command[13] = 0x00;
+	command[14] = 0x0E;
+	command[15] = (byte)((4 + val_len) / 256);
+	command[16] = (byte)((4 + val_len) % 256);
+	build_write_item(command + 19, address, is_bit, val_len);
+	build_write_item_data(command + 31, address, is_bit, NULL, val_len);
+}
+
+static byte_array_info build_write_command(const s7_conn_t* conn, siemens_s7_address_data address, bool is_bit, const byte* value, int val_len)
+{
+	const ushort command_len = S7_WRITE_HEADER_SIZE + val_len;
+	byte* command = s7_frame_alloc(conn, command_len);
+	if (command == NULL)
+		return (byte_array_info) { 0 };
+
+	build_write_header(command, address, is_bit, val_len);
+	if (val_len > 0)
+		memcpy(command + S7_WRITE_HEADER_SIZE, value, val_len);
 
 	byte_array_info ret = { 0 };
 	ret.data = command;
@@ -194,59 +252,84 @@ byte_array_info build_write_byte_command(siemens_s7_address_data address, byte_a
 	return ret;
 }
 
-byte_array_info build_write_bit_command(siemens_s7_address_data address, bool value)
+byte_array_info build_write_byte_command(const s7_conn_t* conn, siemens_s7_address_data address, byte_array_info value)
+{
+	int val_len = 0;
+	if (value.data != NULL)
+		val_len = value.length;
+	return build_write_command(conn, address, false, value.data, val_len);
+}
+
+byte_array_info build_write_bit_command(const s7_conn_t* conn, siemens_s7_address_data address, bool value)
 {
 	byte buffer[1] = { 0 };
-	ushort buffer_len = sizeof(buffer);
 	buffer[0] = value ? (byte)0x01 : (byte)0x00;
+	return build_write_command(conn, address, true, buffer, sizeof(buffer));
+}
+
+// Bytes one item occupies in the data part of a Write Var request, including the fill byte after odd payloads
+int s7_write_item_request_size(const s7_request_item* item)
+{
+	int data_len = item->is_bit ? 1 : item->address.length;
+	return S7_ITEM_DATA_HEADER_SIZE + data_len + (data_len % 2);
+}
+
+int s7_write_chunk_size(int pdu_size)
+{
+	return (pdu_size - S7_REQUEST_HEADER_SIZE - S7_ITEM_SPEC_SIZE - S7_ITEM_DATA_HEADER_SIZE) & ~1;
+}
+
+// Build one Write Var request carrying several heterogeneous items; the caller sizes the batch against the PDU
+byte_array_info build_write_multi_command(const s7_conn_t* conn, const s7_request_item* items, int count)
+{
+	if (items == NULL || count <= 0 || count > 255)
+		return (byte_array_info) { 0 };
+
+	int param_len = 2 + S7_ITEM_SPEC_SIZE * count;
+	int data_len = 0;
+	for (int i = 0; i < count; i++)
+	{
+		data_len += s7_write_item_request_size(&items[i]);
+		// The last item carries no fill byte.
+		if (i == count - 1 && ((items[i].is_bit ? 1 : items[i].address.length) % 2) == 1)
+			data_len--;
+	}
 
-	const ushort command_len = 35 + buffer_len;
-	byte* command = (byte*)malloc(command_len);
+	int total_len = 17 + param_len + data_len;
+	if (total_len > 0xFFFF)
+		return (byte_array_info) { 0 };
+
+	const ushort command_len = (ushort)total_len;
+	byte* command = s7_frame_alloc(conn, command_len);
 	if (command == NULL)
 		return (byte_array_info) { 0 };
 
 	build_command_header(command, command_len, 0x05);
-
-	// Write length + 4
-	command[15] = (byte)((4 + buffer_len) / 256);
-	command[16] = (byte)((4 + buffer_len) % 256);
-	// Command start marker
-	command[17] = 0x05;
+	command[13] = (byte)(param_len / 256);
+	command[14] = (byte)(param_len % 256);
+	command[15] = (byte)(data_len / 256);
+	command[16] = (byte)(data_len % 256);
 	// Number of data blocks to write
-	command[18] = 0x01;
-	command[19] = 0x12;
-	command[20] = 0x0A;
-	command[21] = 0x10;
-	// Write mode: 1=bitwise, 2=byte, 4=word
-	command[22] = 0x01;
-	// Number of data items to write
-	command[23] = (byte)(buffer_len / 256);
-	command[24] = (byte)(buffer_len % 256);
-	// DB block number
-	command[25] = (byte)(address.db_block / 256);
-	command[26] = (byte)(address.db_block % 256);
-	// Data type to write
-	command[27] = address.data_code;
-	// Offset position
-	command[28] = (byte)(address.address_start / 256 / 256);
-	command[29] = (byte)(address.address_start / 256);
-	command[30] = (byte)(address.address_start % 256);
-	// Bitwise write
-	if (address.data_code == 0x1C)
-	{
-		command[31] = 0x00;
-		command[32] = 0x09;
-	}
-	else
+	command[18] = (byte)count;
+
+	int pos = 17 + param_len;
+	for (int i = 0; i < count; i++)
 	{
-		command[31] = 0x00;
-		command[32] = 0x03;
-	}
-	// Bit-count length
-	command[33] = (byte)(buffer_len / 256);
-	command[34] = (byte)(buffer_len % 256);
+		byte bit_value = 0;
+		int val_len = items[i].is_bit ? 1 : items[i].address.length;
+		const byte* value = items[i].data;
+		if (items[i].is_bit)
+		{
+			bit_value = (value != NULL && value[0] != 0) ? 0x01 : 0x00;
+			value = &bit_value;
+		}
 
-	memcpy(command + 35, buffer, buffer_len);
+		build_write_item(command + 19 + S7_ITEM_SPEC_SIZE * i, items[i].address, items[i].is_bit, val_len);
+		build_write_item_data(command + pos, items[i].address, items[i].is_bit, value, val_len);
+		pos += S7_ITEM_DATA_HEADER_SIZE + val_len;
+		if ((val_len % 2) == 1 && i != count - 1)
+			command[pos++] = 0x00;
+	}
 
 	byte_array_info ret = { 0 };
 	ret.data = command;
@@ -255,7 +338,7 @@ byte_array_info build_write_bit_command(siemens_s7_address_data address, bool va
 }
 
 // Extract actual data content from the S7 protocol response when reading a BOOL value
-s7_error_code_e s7_analysis_read_bit(byte_array_info response, byte_array_info* ret)
+s7_error_code_e s7_analysis_read_bit_into(byte_array_info response, byte* value)
 {
 	s7_error_code_e ret_code = S7_ERROR_CODE_SUCCESS;
 	if (response.length == 0)
@@ -288,14 +371,7 @@ s7_error_code_e s7_analysis_read_bit(byte_array_info response, byte_array_info*
 			}
 		}
 
-		ret->data = (byte*)malloc(1);
-		if (ret->data == NULL)
-		{
-			return S7_ERROR_CODE_MALLOC_FAILED;
-		}
-		memset(ret->data, 0, 1);
-		memcpy(ret->data, buffer, 1);
-		ret->length = 1;
+		*value = buffer[0];
 	}
 	else
 	{
@@ -305,14 +381,32 @@ s7_error_code_e s7_analysis_read_bit(byte_array_info response, byte_array_info*
 	return ret_code;
 }
 
-s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info* ret)
+s7_error_code_e s7_analysis_read_bit(const s7_conn_t* conn, byte_array_info response, byte_array_info* ret)
+{
+	if (response.length == 0)
+		return S7_ERROR_CODE_FAILED;
+
+	byte value = 0;
+	s7_error_code_e ret_code = s7_analysis_read_bit_into(response, &value);
+	if (ret_code == S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED)
+		return ret_code;
+
+	ret->data = s7_frame_alloc(conn, 1);
+	if (ret->data == NULL)
+		return S7_ERROR_CODE_MALLOC_FAILED;
+	ret->data[0] = value;
+	ret->length = 1;
+	return ret_code;
+}
+
+// Copy the payload of a Read Var response into buffer; *length receives the bytes copied
+s7_error_code_e s7_analysis_read_byte_into(byte_array_info response, byte* buffer, int capacity, int* length)
 {
 	s7_error_code_e ret_code = S7_ERROR_CODE_SUCCESS;
 	if (response.length == 0)
 		return S7_ERROR_CODE_FAILED;
 
 	int i = 0, j = 0;
-	byte buffer[1024] = { 0 };
 	int buffer_length = 0;
 	int temp_index = 0;
 	if (response.length >= MIN_HEADER_SIZE)
@@ -322,6 +416,11 @@ s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info*
 			if (response.data[i] == 0xFF && response.data[i + 1] == 0x04)
 			{
 				int count = (response.data[i + 2] * 256 + response.data[i + 3]) / 8;
+				if (i + 4 + count > response.length || buffer_length + count > capacity)
+				{
+					ret_code = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+					break;
+				}
 				memcpy(buffer + buffer_length, response.data + i + 4, count);
 				buffer_length += count;
 
@@ -330,6 +429,13 @@ s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info*
 			else if (response.data[i] == 0xFF && response.data[i + 1] == 0x09)
 			{
 				int count = response.data[i + 2] * 256 + response.data[i + 3];
+				// Timers and counters come as 3- or 5-byte records of which two bytes are the value.
+				int written = (count % 3 == 0 ? count / 3 : count / 5) * 2;
+				if (i + 4 + count > response.length || buffer_length + written > capacity)
+				{
+					ret_code = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+					break;
+				}
 				if (count % 3 == 0)
 				{
 					for (j = 0; j < count / 3; j++)
@@ -358,14 +464,7 @@ s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info*
 				ret_code = S7_ERROR_CODE_ERROR_000A;
 		}
 
-		ret->data = (byte*)malloc(buffer_length);
-		if (ret->data == NULL)
-		{
-			return S7_ERROR_CODE_MALLOC_FAILED;
-		}
-		memset(ret->data, 0, buffer_length);
-		memcpy(ret->data, buffer, buffer_length);
-		ret->length = buffer_length;
+		*length = buffer_length;
 	}
 	else
 	{
@@ -374,14 +473,31 @@ s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info*
 	return ret_code;
 }
 
+s7_error_code_e s7_analysis_read_byte(const s7_conn_t* conn, byte_array_info response, byte_array_info* ret)
+{
+	if (response.length == 0)
+		return S7_ERROR_CODE_FAILED;
+	if (response.length < MIN_HEADER_SIZE)
+		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+
+	// The payload is never larger than the frame, so size the buffer from the response.
+	byte* buffer = s7_frame_alloc(conn, response.length);
+	if (buffer == NULL)
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	int length = 0;
+	s7_error_code_e ret_code = s7_analysis_read_byte_into(response, buffer, response.length, &length);
+	ret->data = buffer;
+	ret->length = length;
+	return ret_code;
+}
+
 s7_error_code_e s7_analysis_write(byte_array_info response)
 {
 	s7_error_code_e ret_code = S7_ERROR_CODE_SUCCESS;
 	if (response.length == 0)
 		return S7_ERROR_CODE_FAILED;
 
-	byte buffer[1024] = { 0 };
-	int buffer_length = 0;
 	if (response.length > 21)
 	{
 		byte code = response.data[21];
@@ -395,6 +511,494 @@ s7_error_code_e s7_analysis_write(byte_array_info response)
 	return ret_code;
 }
 
+s7_error_code_e s7_item_return_code_to_error(byte code)
+{
+	switch (code)
+	{
+	case 0xFF:
+		return S7_ERROR_CODE_SUCCESS;
+	case 0x05:
+		return S7_ERROR_CODE_READ_LENGTH_OVER_PLC_ASSIGN;
+	case 0x06:
+		return S7_ERROR_CODE_ERROR_0006;
+	case 0x0A:
+		return S7_ERROR_CODE_ERROR_000A;
+	default:
+		return S7_ERROR_CODE_UNKOWN;
+	}
+}
+
+// Walk the data items of a multi-item Read Var response and copy each payload into its item buffer
+s7_error_code_e s7_analysis_read_multi(byte_array_info response, s7_request_item* items, int count, s7_error_code_e* results)
+{
+	if (response.length == 0 || items == NULL || results == NULL)
+		return S7_ERROR_CODE_FAILED;
+
+	if (response.length < MIN_HEADER_SIZE)
+		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+
+	// Header error class/code reject the whole job, e.g. when the request exceeds the PDU.
+	if (response.data[17] != 0x00 || response.data[18] != 0x00)
+	{
+		for (int i = 0; i < count; i++)
+			results[i] = S7_ERROR_CODE_FW_ERROR;
+		return S7_ERROR_CODE_FW_ERROR;
+	}
+
+	if (response.data[20] != count)
+	{
+		for (int i = 0; i < count; i++)
+			results[i] = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+		return S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+	}
+
+	int pos = 21;
+	for (int i = 0; i < count; i++)
+	{
+		if (pos + S7_ITEM_DATA_HEADER_SIZE > response.length)
+		{
+			for (; i < count; i++)
+				results[i] = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+			return S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+		}
+
+		byte code = response.data[pos];
+		byte transport = response.data[pos + 1];
+		int data_len = response.data[pos + 2] * 256 + response.data[pos + 3];
+		// BIT, BYTE/WORD/DWORD and INT report their length in bits; octet strings in bytes.
+		if (transport == 0x03 || transport == 0x04 || transport == 0x05)
+			data_len = (data_len + 7) / 8;
+
+		if (pos + S7_ITEM_DATA_HEADER_SIZE + data_len > response.length)
+		{
+			for (; i < count; i++)
+				results[i] = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+			return S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+		}
+
+		// A short item would leave the tail of the caller's buffer stale, so it fails like a short single read.
+		int wanted = items[i].is_bit ? 1 : items[i].address.length;
+		results[i] = s7_item_return_code_to_error(code);
+		if (results[i] == S7_ERROR_CODE_SUCCESS && data_len < wanted)
+			results[i] = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+		if (results[i] == S7_ERROR_CODE_SUCCESS && items[i].data != NULL)
+			memcpy(items[i].data, response.data + pos + S7_ITEM_DATA_HEADER_SIZE, wanted);
+
+		pos += S7_ITEM_DATA_HEADER_SIZE + data_len;
+		if ((data_len % 2) == 1 && i != count - 1)
+			pos++;
+	}
+
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+// A Write Var response carries one return code byte per item
+s7_error_code_e s7_analysis_write_multi(byte_array_info response, int count, s7_error_code_e* results)
+{
+	if (response.length == 0 || results == NULL)
+		return S7_ERROR_CODE_FAILED;
+
+	if (response.length < MIN_HEADER_SIZE)
+		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+
+	s7_error_code_e ret_code = S7_ERROR_CODE_SUCCESS;
+	if (response.data[17] != 0x00 || response.data[18] != 0x00)
+		ret_code = S7_ERROR_CODE_FW_ERROR;
+	else if (response.data[20] != count || response.length < 21 + count)
+		ret_code = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (ret_code != S7_ERROR_CODE_SUCCESS)
+		{
+			results[i] = ret_code;
+			continue;
+		}
+
+		byte code = response.data[21 + i];
+		results[i] = s7_item_return_code_to_error(code);
+		if (results[i] == S7_ERROR_CODE_UNKOWN)
+			results[i] = S7_ERROR_CODE_WRITE_ERROR;
+	}
+	return ret_code;
+}
+
+void s7_rx_reset(s7_rx_buffer* rx)
+{
+	rx->start = 0;
+	rx->end = 0;
+}
+
+// Hand out the next complete TPKT frame already received; S7_ERROR_CODE_WOULD_BLOCK when more bytes are needed,
+// with room made for them behind rx->end
+s7_error_code_e s7_rx_take_frame(s7_rx_buffer* rx, byte_array_info* frame)
+{
+	int have = rx->end - rx->start;
+	int need = 4;
+	if (have >= 4)
+	{
+		const byte* header = rx->data + rx->start;
+		need = ((int)header[2] << 8) | (int)header[3];
+		// Reject frames that are not valid TPKT packets; the rest of the stream is unusable then.
+		if (header[0] != 0x03 || header[1] != 0x00 || need < S7_TPKT_MIN_SIZE || need > S7_RX_BUFFER_SIZE)
+		{
+			s7_rx_reset(rx);
+			return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+		}
+
+		if (have >= need)
+		{
+			frame->data = rx->data + rx->start;
+			frame->length = need;
+			rx->start += need;
+			return S7_ERROR_CODE_SUCCESS;
+		}
+	}
+
+	// Frames handed out before are no longer referenced; move the partial one to the front if it would not fit.
+	if (have == 0)
+		s7_rx_reset(rx);
+	else if (rx->start + need > S7_RX_BUFFER_SIZE)
+	{
+		memmove(rx->data, rx->data + rx->start, have);
+		rx->start = 0;
+		rx->end = have;
+	}
+	return S7_ERROR_CODE_WOULD_BLOCK;
+}
+
+// Hand out the next complete TPKT frame; every recv takes as much as the socket has, so frames that
+// arrived in one segment are parsed without touching the socket again
+s7_error_code_e s7_rx_next_frame(int fd, s7_rx_buffer* rx, byte_array_info* frame)
+{
+	if (fd < 0 || rx == NULL || frame == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	while (true)
+	{
+		s7_error_code_e ret = s7_rx_take_frame(rx, frame);
+		if (ret != S7_ERROR_CODE_WOULD_BLOCK)
+			return ret;
+
+		int received = socket_recv_data_one_loop(fd, rx->data + rx->end, S7_RX_BUFFER_SIZE - rx->end);
+		if (received <= 0)
+		{
+			s7_rx_reset(rx);
+			return S7_ERROR_CODE_FAILED;
+		}
+		rx->end += received;
+	}
+}
+
+s7_error_code_e s7_read_response(s7_conn_t* conn, byte_array_info* response)
+{
+	if (conn == NULL || conn->fd < 0 || response == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_error_code_e ret = s7_rx_next_frame(conn->fd, &conn->rx, response);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	// Basic COTP + S7 signature check prevents treating arbitrary TCP data as S7 responses.
+	const byte* temp = response->data;
+	if (response->length < MIN_HEADER_SIZE || temp[4] != 0x02 || temp[5] != 0xF0 || temp[6] != 0x80 || temp[7] != 0x32)
+	{
+		s7_rx_reset(&conn->rx);
+		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+	}
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+s7_error_code_e s7_copy_frame(const s7_conn_t* conn, const byte_array_info* view, byte_array_info* copy)
+{
+	copy->data = s7_frame_alloc(conn, view->length);
+	if (copy->data == NULL)
+	{
+		copy->length = 0;
+		return S7_ERROR_CODE_MALLOC_FAILED;
+	}
+	memcpy(copy->data, view->data, view->length);
+	copy->length = view->length;
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+// Keep a matched response: copied into the caller's buffer when the job has one, into a new frame otherwise
+s7_error_code_e s7_store_response(const s7_conn_t* conn, s7_pdu_job* job, const byte_array_info* view)
+{
+	if (job->response_buffer.data == NULL)
+		return s7_copy_frame(conn, view, &job->response);
+	if (view->length > job->response_buffer.length)
+		return S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
+
+	memcpy(job->response_buffer.data, view->data, view->length);
+	job->response.data = job->response_buffer.data;
+	job->response.length = view->length;
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+ushort s7_next_pdu_reference(s7_conn_t* conn)
+{
+	// Zero is left out so a freshly zeroed frame never matches a live request.
+	if (++conn->pdu_reference == 0)
+		conn->pdu_reference = 1;
+	return conn->pdu_reference;
+}
+
+// Keep up to the negotiated number of requests in flight and pair every response with its request by PDU reference
+s7_error_code_e s7_exchange_pipelined(s7_conn_t* conn, s7_pdu_job* jobs, int count)
+{
+	if (conn == NULL || conn->fd < 0 || jobs == NULL || count <= 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	int fd = conn->fd;
+	int window = s7_conn_get_parallel_jobs(conn);
+	if (window < 1)
+		window = 1;
+
+	for (int i = 0; i < count; i++)
+	{
+		jobs[i].response.data = NULL;
+		jobs[i].response.length = 0;
+		jobs[i].result = S7_ERROR_CODE_UNKOWN;
+		if (jobs[i].request.data == NULL || jobs[i].request.length < MIN_HEADER_SIZE - 2 ||
+			(jobs[i].payload.length > 0 && jobs[i].payload.data == NULL))
+			return S7_ERROR_CODE_INVALID_PARAMETER;
+	}
+
+	s7_error_code_e ret = S7_ERROR_CODE_SUCCESS;
+	int next_send = 0, completed = 0, in_flight = 0;
+	socket_buffer parts[S7_SEND_GATHER_PARTS];
+	while (completed < count)
+	{
+		// Every frame the window allows goes out in one gather write, payloads straight from the caller's memory.
+		int part_count = 0;
+		while (in_flight < window && next_send < count && part_count + 2 <= S7_SEND_GATHER_PARTS)
+		{
+			s7_pdu_job* job = &jobs[next_send];
+			job->pdu_reference = s7_next_pdu_reference(conn);
+			job->request.data[11] = (byte)(job->pdu_reference / 256);
+			job->request.data[12] = (byte)(job->pdu_reference % 256);
+			parts[part_count].data = job->request.data;
+			parts[part_count++].length = job->request.length;
+			if (job->payload.length > 0)
+			{
+				parts[part_count].data = job->payload.data;
+				parts[part_count++].length = job->payload.length;
+			}
+			next_send++;
+			in_flight++;
+		}
+
+		int need_send = 0;
+		for (int i = 0; i < part_count; i++)
+			need_send += parts[i].length;
+		if (part_count > 0 && socket_send_gather(fd, parts, part_count) != need_send)
+		{
+			ret = S7_ERROR_CODE_SOCKET_SEND_FAILED;
+			break;
+		}
+
+		byte_array_info response = { 0 };
+		ret = s7_read_response(conn, &response);
+		if (ret != S7_ERROR_CODE_SUCCESS)
+			break;
+
+		ushort reference = (ushort)(response.data[11] * 256 + response.data[12]);
+		s7_pdu_job* owner = NULL;
+		for (int i = 0; i < next_send && owner == NULL; i++)
+		{
+			if (jobs[i].response.data == NULL && jobs[i].pdu_reference == reference)
+				owner = &jobs[i];
+		}
+
+		// Late answers to requests abandoned after a timeout carry an unknown reference; drop them.
+		if (owner == NULL)
+			continue;
+
+		// The view is only good until the next read, and jobs are decoded once all of them are answered.
+		ret = s7_store_response(conn, owner, &response);
+		if (ret != S7_ERROR_CODE_SUCCESS)
+			break;
+		owner->result = S7_ERROR_CODE_SUCCESS;
+		in_flight--;
+		completed++;
+	}
+
+	if (ret != S7_ERROR_CODE_SUCCESS)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (jobs[i].response.data == NULL)
+				jobs[i].result = ret;
+		}
+	}
+	return ret;
+}
+
+// Send one request frame and receive its response; the caller releases response->data
+s7_error_code_e s7_exchange(s7_conn_t* conn, byte_array_info* request, byte_array_info* response)
+{
+	s7_pdu_job job = { 0 };
+	job.request = *request;
+
+	s7_error_code_e ret = s7_exchange_pipelined(conn, &job, 1);
+	*response = job.response;
+	return ret;
+}
+
+// Decode every answered job into the items of its batch; a failed job marks its whole batch
+void s7_decode_jobs(s7_pdu_job* jobs, int job_count, s7_request_item* items, const int* batch_start, s7_error_code_e* results, bool is_write)
+{
+	for (int i = 0; i < job_count; i++)
+	{
+		int first = batch_start[i];
+		int count = batch_start[i + 1] - first;
+		if (jobs[i].result != S7_ERROR_CODE_SUCCESS)
+		{
+			for (int j = 0; j < count; j++)
+				results[first + j] = jobs[i].result;
+			continue;
+		}
+
+		if (is_write)
+			s7_analysis_write_multi(jobs[i].response, count, results + first);
+		else
+			s7_analysis_read_multi(jobs[i].response, items + first, count, results + first);
+		RELEASE_FRAME(jobs[i].response.data);
+	}
+}
+
+static void s7_transfer_release(s7_transfer* transfer)
+{
+	for (int i = 0; transfer->jobs != NULL && i < transfer->batch_count; i++)
+		RELEASE_FRAME(transfer->jobs[i].request.data);
+	RELEASE_DATA(transfer->requests);
+	RELEASE_DATA(transfer->batch_results);
+	RELEASE_DATA(transfer->request_index);
+	RELEASE_DATA(transfer->batch_start);
+	RELEASE_DATA(transfer->jobs);
+}
+
+// Parse every item and pack as many as fit into each PDU, request and response direction, one frame per batch.
+// Items that cannot be sent get their result here; the frames are ready for s7_exchange_pipelined() on success.
+static s7_error_code_e s7_transfer_alloc(s7_transfer* transfer, const s7_conn_t* conn, int count, bool is_write)
+{
+	memset(transfer, 0, sizeof(s7_transfer));
+	transfer->is_write = is_write;
+	transfer->request_budget = conn->pdu_size - S7_REQUEST_HEADER_SIZE;
+	transfer->response_budget = conn->pdu_size - S7_RESPONSE_HEADER_SIZE;
+	transfer->requests = (s7_request_item*)malloc(sizeof(s7_request_item) * count);
+	transfer->batch_results = (s7_error_code_e*)malloc(sizeof(s7_error_code_e) * count);
+	transfer->request_index = (int*)malloc(sizeof(int) * count);
+	transfer->batch_start = (int*)malloc(sizeof(int) * (count + 1));
+	transfer->jobs = (s7_pdu_job*)calloc(count, sizeof(s7_pdu_job));
+	if (transfer->requests == NULL || transfer->batch_results == NULL || transfer->request_index == NULL ||
+		transfer->batch_start == NULL || transfer->jobs == NULL)
+	{
+		s7_transfer_release(transfer);
+		return S7_ERROR_CODE_MALLOC_FAILED;
+	}
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+// Append a parsed item to the current batch, starting a new one once it would overflow either direction of the PDU
+static s7_error_code_e s7_transfer_add(s7_transfer* transfer, const s7_request_item* item, int index)
+{
+	int request_size = S7_ITEM_SPEC_SIZE + (transfer->is_write ? s7_write_item_request_size(item) : 0);
+	int response_size = transfer->is_write ? 1 : s7_read_item_response_size(item);
+	if (request_size > transfer->request_budget || response_size > transfer->response_budget)
+		return S7_ERROR_CODE_PDU_SIZE_EXCEEDED;
+
+	if (transfer->batch_count == 0 || transfer->request_used + request_size > transfer->request_budget ||
+		transfer->response_used + response_size > transfer->response_budget)
+	{
+		transfer->batch_start[transfer->batch_count++] = transfer->request_count;
+		transfer->request_used = transfer->response_used = 0;
+	}
+
+	transfer->requests[transfer->request_count] = *item;
+	transfer->request_index[transfer->request_count++] = index;
+	transfer->request_used += request_size;
+	transfer->response_used += response_size;
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+static s7_error_code_e s7_transfer_build(s7_transfer* transfer, const s7_conn_t* conn, s7_error_code_e* results)
+{
+	transfer->batch_start[transfer->batch_count] = transfer->request_count;
+	for (int i = 0; i < transfer->batch_count; i++)
+	{
+		s7_request_item* first = transfer->requests + transfer->batch_start[i];
+		int batch_size = transfer->batch_start[i + 1] - transfer->batch_start[i];
+		transfer->jobs[i].request = transfer->is_write ? build_write_multi_command(conn, first, batch_size) : build_read_multi_command(conn, first, batch_size);
+		if (transfer->jobs[i].request.data == NULL)
+		{
+			for (int j = 0; j < transfer->request_count; j++)
+				results[transfer->request_index[j]] = S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
+			s7_transfer_release(transfer);
+			return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
+		}
+	}
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+s7_error_code_e s7_transfer_prepare(s7_transfer* transfer, const s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write)
+{
+	s7_error_code_e ret = s7_transfer_alloc(transfer, conn, count, is_write);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	for (int i = 0; i < count; i++)
+	{
+		s7_request_item item = { 0 };
+		results[i] = S7_ERROR_CODE_SUCCESS;
+		if (items[i].address == NULL || items[i].data == NULL || (!items[i].is_bit && items[i].length <= 0))
+		{
+			results[i] = S7_ERROR_CODE_INVALID_PARAMETER;
+			continue;
+		}
+		if (!s7_analysis_address(items[i].address, items[i].is_bit ? 1 : items[i].length, &item.address))
+		{
+			results[i] = S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+			continue;
+		}
+		item.is_bit = items[i].is_bit;
+		item.data = items[i].data;
+		results[i] = s7_transfer_add(transfer, &item, i);
+	}
+	return s7_transfer_build(transfer, conn, results);
+}
+
+// Same as s7_transfer_prepare() for items whose addresses are already parsed
+s7_error_code_e s7_transfer_prepare_items(s7_transfer* transfer, const s7_conn_t* conn, const s7_request_item* items, int count, s7_error_code_e* results, bool is_write)
+{
+	s7_error_code_e ret = s7_transfer_alloc(transfer, conn, count, is_write);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	for (int i = 0; i < count; i++)
+		results[i] = s7_transfer_add(transfer, &items[i], i);
+	return s7_transfer_build(transfer, conn, results);
+}
+
+// Decode the exchanged frames into results and release the transfer; returns the transport error or the first failing item
+s7_error_code_e s7_transfer_complete(s7_transfer* transfer, s7_error_code_e ret, s7_error_code_e* results, int count)
+{
+	s7_decode_jobs(transfer->jobs, transfer->batch_count, transfer->requests, transfer->batch_start, transfer->batch_results, transfer->is_write);
+	for (int i = 0; i < transfer->request_count; i++)
+		results[transfer->request_index[i]] = transfer->batch_results[i];
+	s7_transfer_release(transfer);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (results[i] != S7_ERROR_CODE_SUCCESS)
+			return results[i];
+	}
+	return S7_ERROR_CODE_SUCCESS;
+}
+
 bool read_data_from_core_server(int fd, byte_array_info send, byte_array_info* ret)
 {
 	bool is_ok = false;
@@ -9,14 +9,78 @@
 #define __H_SIEMENS_HELPER_H__
 #include "siemens_s7_comm.h"
 
-byte_array_info build_read_byte_command(siemens_s7_address_data address);
-byte_array_info build_read_bit_command(siemens_s7_address_data address);
-byte_array_info build_write_byte_command(siemens_s7_address_data address, byte_array_info value);
-byte_array_info build_write_bit_command(siemens_s7_address_data address, bool value);
+// Frames come from the connection's allocator (conn may be NULL for the process default) and remember it for release
+byte* s7_frame_alloc(const s7_conn_t* conn, int size);
+void s7_frame_release(void* frame);
+#define RELEASE_FRAME(frame) do { if ((frame) != NULL) { s7_frame_release(frame); (frame) = NULL; } } while(0)
 
-s7_error_code_e s7_analysis_read_bit(byte_array_info resposne, byte_array_info* ret);
-s7_error_code_e s7_analysis_read_byte(byte_array_info response, byte_array_info* ret);
+typedef struct _tag_s7_pdu_job {
+	byte_array_info request;	// Request frame; its PDU reference is assigned when it is sent
+	byte_array_info payload;	// Optional data sent right behind request from the caller's memory, counted in its TPKT length
+	byte_array_info response;	// Matched response frame, released by the caller unless it points into response_buffer
+	byte_array_info response_buffer;	// Optional caller storage the response is copied into instead of the heap
+	ushort	pdu_reference;		// Reference the response is matched against
+	s7_error_code_e result;		// Transport result of this job
+}s7_pdu_job;
+
+typedef struct _tag_s7_transfer {
+	s7_request_item* requests;			// Items that passed validation, in frame order
+	int*	request_index;				// Caller item of every request
+	int*	batch_start;				// First request of every frame, batch_count + 1 entries
+	s7_error_code_e* batch_results;		// Decoded result of every request
+	s7_pdu_job* jobs;					// One request frame per batch
+	int		request_count;
+	int		batch_count;
+	int		request_budget;				// Request and response bytes a frame may carry beyond its headers
+	int		response_budget;
+	int		request_used;				// Bytes taken in the batch being filled
+	int		response_used;
+	bool	is_write;
+}s7_transfer;
+
+byte_array_info build_read_byte_command(const s7_conn_t* conn, siemens_s7_address_data address);
+byte_array_info build_read_bit_command(const s7_conn_t* conn, siemens_s7_address_data address);
+void build_read_request(byte* command, siemens_s7_address_data address, bool is_bit); //S7_READ_REQUEST_SIZE bytes
+byte_array_info build_write_byte_command(const s7_conn_t* conn, siemens_s7_address_data address, byte_array_info value);
+byte_array_info build_write_bit_command(const s7_conn_t* conn, siemens_s7_address_data address, bool value);
+void build_write_header(byte* command, siemens_s7_address_data address, bool is_bit, int val_len); //S7_WRITE_HEADER_SIZE bytes
+byte_array_info build_read_multi_command(const s7_conn_t* conn, const s7_request_item* items, int count);
+int s7_read_item_response_size(const s7_request_item* item);
+int s7_read_chunk_size(int pdu_size);
+byte_array_info build_write_multi_command(const s7_conn_t* conn, const s7_request_item* items, int count);
+int s7_write_item_request_size(const s7_request_item* item);
+int s7_write_chunk_size(int pdu_size);
+
+s7_error_code_e s7_analysis_read_bit(const s7_conn_t* conn, byte_array_info resposne, byte_array_info* ret); //ret->data is a frame
+s7_error_code_e s7_analysis_read_byte(const s7_conn_t* conn, byte_array_info response, byte_array_info* ret); //ret->data is a frame
+s7_error_code_e s7_analysis_read_bit_into(byte_array_info response, byte* value);
+s7_error_code_e s7_analysis_read_byte_into(byte_array_info response, byte* buffer, int capacity, int* length);
 s7_error_code_e s7_analysis_write(byte_array_info response);
+s7_error_code_e s7_analysis_read_multi(byte_array_info response, s7_request_item* items, int count, s7_error_code_e* results);
+s7_error_code_e s7_analysis_write_multi(byte_array_info response, int count, s7_error_code_e* results);
+s7_error_code_e s7_item_return_code_to_error(byte code);
+
+void s7_rx_reset(s7_rx_buffer* rx);
+s7_error_code_e s7_rx_take_frame(s7_rx_buffer* rx, byte_array_info* frame); //no socket I/O; S7_ERROR_CODE_WOULD_BLOCK until a frame is complete
+s7_error_code_e s7_rx_next_frame(int fd, s7_rx_buffer* rx, byte_array_info* frame); //frame is a view, valid until the next call
+s7_error_code_e s7_read_response(s7_conn_t* conn, byte_array_info* response); //view into conn->rx, see s7_rx_next_frame()
+s7_error_code_e s7_copy_frame(const s7_conn_t* conn, const byte_array_info* view, byte_array_info* copy); //the caller releases copy->data with RELEASE_FRAME
+s7_error_code_e s7_store_response(const s7_conn_t* conn, s7_pdu_job* job, const byte_array_info* view); //into job->response_buffer when set
+s7_error_code_e s7_exchange(s7_conn_t* conn, byte_array_info* request, byte_array_info* response);
+s7_error_code_e s7_exchange_pipelined(s7_conn_t* conn, s7_pdu_job* jobs, int count);
+ushort s7_next_pdu_reference(s7_conn_t* conn);
+void s7_decode_jobs(s7_pdu_job* jobs, int job_count, s7_request_item* items, const int* batch_start, s7_error_code_e* results, bool is_write);
+s7_error_code_e s7_transfer_prepare(s7_transfer* transfer, const s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write);
+s7_error_code_e s7_transfer_prepare_items(s7_transfer* transfer, const s7_conn_t* conn, const s7_request_item* items, int count, s7_error_code_e* results, bool is_write);
+s7_error_code_e s7_transfer_complete(s7_transfer* transfer, s7_error_code_e ret, s7_error_code_e* results, int count);
+
+// Exchanges routed through the connection's I/O owner while it is shared between threads
+s7_error_code_e s7_conn_exchange(s7_conn_t* conn, s7_pdu_job* jobs, int count);
+s7_error_code_e s7_conn_roundtrip(s7_conn_t* conn, byte_array_info* request, byte_array_info* response);
+
+// Access by an address parsed up front: byte ranges of any length are split by PDU, bit items carry one byte 0/1
+s7_error_code_e s7_read_parsed(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, byte* buffer);
+s7_error_code_e s7_write_parsed(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, const byte* data);
 
 bool read_data_from_core_server(int fd, byte_array_info send, byte_array_info* ret);
 bool send_data_to_core_server(int fd, byte_array_info send);
@@ -12,6 +12,7 @@
 #include "socket.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 #ifdef _WIN32
 #include <winsock2.h>
@@ -24,121 +25,149 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #endif
+#include "siemens_s7_queue.h"
 
-siemens_plc_types_e current_plc = S1200;
-ushort word_length = 2;
-int port = 102;
-char ip_address[64] = { 0 };
+// Settings of the set_plc_* functions; every s7_connect() copies them into a new connection context.
+// Connects on other threads may rebuild it at any time, so it is only touched under g_conn_template_lock.
+static s7_conn_t g_conn_template;
+static bool g_conn_template_ready = false;
+static s7_mutex g_conn_template_lock = S7_MUTEX_INITIALIZER;
 
-void s7_initialization(siemens_plc_types_e plc, char* ip)
+// The template starts as an S7-1200 and is rebuilt whenever s7_connect() targets another PLC family; lock held
+static s7_conn_t* s7_conn_template(void)
 {
-	word_length = 2;
-	strcpy(ip_address, ip);
-	current_plc = plc;
-
-	switch (plc)
+	if (!g_conn_template_ready)
 	{
-	case S1200:
-		g_plc_head1[21] = 0;
-		break;
-
-	case S300:
-		g_plc_head1[21] = 2;
-		break;
-
-	case S400:
-		g_plc_head1[21] = 3;
-		g_plc_head1[17] = 0x00;
-		break;
-
-	case S1500:
-		g_plc_head1[21] = 0;
-		break;
-
-	case S200Smart:
-		memcpy(g_plc_head1, g_plc_head1_200smart, sizeof(g_plc_head1));
-		memcpy(g_plc_head2, g_plc_head2_200smart, sizeof(g_plc_head2));
-		break;
-
-	case S200:
-		memcpy(g_plc_head1, g_plc_head1_200, sizeof(g_plc_head1));
-		memcpy(g_plc_head2, g_plc_head2_200, sizeof(g_plc_head2));
-		break;
-
-	default:
-		g_plc_head1[18] = 0;
-		break;
+		s7_conn_init(&g_conn_template, S1200);
+		g_conn_template_ready = true;
 	}
+	return &g_conn_template;
 }
 
 bool s7_connect(char* ip_addr, int port, siemens_plc_types_e plc, int* fd)
 {
-	bool ret = false;
-	int temp_fd = -1;
-	temp_fd = socket_open_tcp_client_socket(ip_addr, port);
-	s7_initialization(plc, ip_addr);
-	*fd = temp_fd;
+	return s7_connect_ex(ip_addr, port, plc, NULL, fd);
+}
 
-	if (temp_fd >= 0)
-		ret = initialization_on_connect(temp_fd);
+bool s7_connect_ex(char* ip_addr, int port, siemens_plc_types_e plc, const s7_connect_options* options, int* fd)
+{
+	if (fd == NULL)
+		return false;
 
-	if (!ret && temp_fd >= 0)
+	*fd = -1;
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_t* settings = s7_conn_template();
+	if (settings->plc != plc)
 	{
-		socket_close_tcp_socket(temp_fd);
-		*fd = -1;
+		s7_mutex_destroy(&settings->allocator_lock);
+		s7_conn_init(settings, plc);
 	}
-	return ret;
+	s7_conn_t* conn = s7_conn_create_from(settings);
+	s7_mutex_unlock(&g_conn_template_lock);
+	if (conn == NULL)
+		return false;
+
+	conn->legacy_owned = true;
+	if (!s7_conn_connect(conn, ip_addr, port, options))
+	{
+		s7_conn_destroy(conn);
+		return false;
+	}
+
+	// The process-wide getters report the most recent connection.
+	s7_mutex_lock(&g_conn_template_lock);
+	settings = s7_conn_template();
+	settings->pdu_size = conn->pdu_size;
+	settings->max_amq_calling = conn->max_amq_calling;
+	settings->max_amq_called = conn->max_amq_called;
+	s7_mutex_unlock(&g_conn_template_lock);
+	*fd = conn->fd;
+	return true;
 }
 
 bool s7_disconnect(int fd)
 {
-	socket_close_tcp_socket(fd);
+	s7_conn_t* conn = s7_conn_find(fd);
+	if (conn == NULL)
+		socket_close_tcp_socket(fd);
+	else if (conn->legacy_owned)
+		s7_conn_destroy(conn);
+	else
+		s7_conn_disconnect(conn);
 	return true;
 }
 
 //////////////////////////////////////////////////////////////////////////
-s7_error_code_e s7_read_response(int fd, byte_array_info* response, int* read_count)
+static int s7_max_read_chunk(const s7_conn_t* conn)
 {
-	if (fd < 0 || read_count == NULL || response == NULL)
-		return S7_ERROR_CODE_INVALID_PARAMETER;
-
-	byte header[4] = { 0 };
-	int header_size = socket_recv_data(fd, header, 4);
-	if (header_size != 4)
-		return S7_ERROR_CODE_FAILED;
+	return s7_read_chunk_size(conn->pdu_size);
+}
 
-	int packet_size = ((int)header[2] << 8) | (int)header[3];
-	// Reject frames that are not valid TPKT packets before reading the body.
-	if (header[0] != 0x03 || header[1] != 0x00 || packet_size < MIN_HEADER_SIZE)
-		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+static int s7_max_write_chunk(const s7_conn_t* conn)
+{
+	return s7_write_chunk_size(conn->pdu_size);
+}
 
-	byte* temp = (byte*)malloc(packet_size);
-	if (temp == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
+// Send every job back-to-back within the negotiated window, then decode each response into its items
+static s7_error_code_e s7_run_jobs(s7_conn_t* conn, s7_pdu_job* jobs, int job_count, s7_request_item* items, int* batch_start,
+	s7_error_code_e* results, bool is_write)
+{
+	s7_error_code_e ret = s7_conn_exchange(conn, jobs, job_count);
+	s7_decode_jobs(jobs, job_count, items, batch_start, results, is_write);
+	return ret;
+}
 
-	memcpy(temp, header, 4);
-	if (packet_size > 4)
+// Move a byte range larger than one PDU as consecutive chunks, read straight into or written straight from buffer
+static s7_error_code_e s7_transfer_chunked(s7_conn_t* conn, siemens_s7_address_data address_data, byte* buffer, bool is_write)
+{
+	int max_chunk = is_write ? s7_max_write_chunk(conn) : s7_max_read_chunk(conn);
+	if (max_chunk <= 0)
+		return S7_ERROR_CODE_PDU_SIZE_EXCEEDED;
+
+	int chunk_count = (address_data.length + max_chunk - 1) / max_chunk;
+	s7_request_item* items = (s7_request_item*)calloc(chunk_count, sizeof(s7_request_item));
+	s7_pdu_job* jobs = (s7_pdu_job*)calloc(chunk_count, sizeof(s7_pdu_job));
+	s7_error_code_e* results = (s7_error_code_e*)calloc(chunk_count, sizeof(s7_error_code_e));
+	int* batch_start = (int*)calloc(chunk_count + 1, sizeof(int));
+	s7_error_code_e ret = S7_ERROR_CODE_SUCCESS;
+	if (items == NULL || jobs == NULL || results == NULL || batch_start == NULL)
+		ret = S7_ERROR_CODE_MALLOC_FAILED;
+
+	for (int i = 0; i < chunk_count && ret == S7_ERROR_CODE_SUCCESS; i++)
 	{
-		int body_size = socket_recv_data(fd, temp + 4, packet_size - 4);
-		if (body_size != packet_size - 4)
-		{
-			RELEASE_DATA(temp);
-			return S7_ERROR_CODE_FAILED;
-		}
+		int offset = i * max_chunk;
+		s7_request_item* item = &items[i];
+		item->address = address_data;
+		item->address.length = address_data.length - offset < max_chunk ? address_data.length - offset : max_chunk;
+		// Timers and counters are addressed by element index, every other area by bit offset.
+		if (address_data.data_code == 0x1E || address_data.data_code == 0x1F)
+			item->address.address_start += offset / 2;
+		else
+			item->address.address_start += offset * 8;
+		item->data = buffer + offset;
+
+		jobs[i].request = is_write ? build_write_multi_command(conn, item, 1) : build_read_multi_command(conn, item, 1);
+		batch_start[i + 1] = i + 1;
+		if (jobs[i].request.data == NULL)
+			ret = S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
 	}
 
-	// Basic COTP + S7 signature check prevents treating arbitrary TCP data as S7 responses.
-	if (temp[4] != 0x02 || temp[5] != 0xF0 || temp[6] != 0x80 || temp[7] != 0x32)
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		ret = s7_run_jobs(conn, jobs, chunk_count, items, batch_start, results, is_write);
+
+	for (int i = 0; i < chunk_count && ret == S7_ERROR_CODE_SUCCESS; i++)
 	{
-		RELEASE_DATA(temp);
-		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+		if (results[i] != S7_ERROR_CODE_SUCCESS)
+			ret = results[i];
 	}
 
-	response->data = temp;
-	response->length = packet_size;
-	*read_count = packet_size;
-
-	return S7_ERROR_CODE_SUCCESS;
+	for (int i = 0; jobs != NULL && i < chunk_count; i++)
+		RELEASE_FRAME(jobs[i].request.data);
+	RELEASE_DATA(items);
+	RELEASE_DATA(jobs);
+	RELEASE_DATA(results);
+	RELEASE_DATA(batch_start);
+	return ret;
 }
 
 static s7_error_code_e s7_read_data(int fd, const char* address, int length, byte_array_info* out_bytes, bool is_bit)
@@ -150,37 +179,95 @@ static s7_error_code_e s7_read_data(int fd, const char* address, int length, byt
 	if (!s7_analysis_address(address, length, &address_data))
 		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
 
+	// Ranges beyond one PDU are split transparently and reassembled in a single output buffer.
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	if (!is_bit && length > s7_max_read_chunk(conn))
+	{
+		byte* buffer = s7_frame_alloc(conn, length);
+		if (buffer == NULL)
+			return S7_ERROR_CODE_MALLOC_FAILED;
+
+		s7_error_code_e ret = s7_transfer_chunked(conn, address_data, buffer, false);
+		if (ret != S7_ERROR_CODE_SUCCESS)
+		{
+			RELEASE_FRAME(buffer);
+			return ret;
+		}
+		out_bytes->data = buffer;
+		out_bytes->length = length;
+		return ret;
+	}
+
 	s7_error_code_e ret = S7_ERROR_CODE_UNKOWN;
-	byte_array_info core_cmd = is_bit ? build_read_bit_command(address_data) : build_read_byte_command(address_data);
+	byte_array_info core_cmd = is_bit ? build_read_bit_command(conn, address_data) : build_read_byte_command(conn, address_data);
 	if (core_cmd.data == NULL)
 		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
 
-	if (!try_send_data_to_server(fd, &core_cmd, NULL)) {
-		RELEASE_DATA(core_cmd.data);
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-	RELEASE_DATA(core_cmd.data);
-
 	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	ret = s7_conn_roundtrip(conn, &core_cmd, &response);
+	RELEASE_FRAME(core_cmd.data);
+	int recv_size = response.length;
 	if (ret != S7_ERROR_CODE_SUCCESS)
 	{
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return ret;
 	}
 
 	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
-	ret = is_bit ? s7_analysis_read_bit(response, out_bytes) : s7_analysis_read_byte(response, out_bytes);
-	RELEASE_DATA(response.data);
+	ret = is_bit ? s7_analysis_read_bit(conn, response, out_bytes) : s7_analysis_read_byte(conn, response, out_bytes);
+	RELEASE_FRAME(response.data);
+
+	return ret;
+}
+
+// Read one value of a known size into value without touching the heap: the request and the response both live on the stack
+static s7_error_code_e s7_read_range(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, byte* value)
+{
+	int length = address_data.length;
+	byte request[S7_READ_REQUEST_SIZE];
+	byte response[S7_MAX_RESPONSE_SIZE];
+	s7_pdu_job job = { 0 };
+	build_read_request(request, address_data, is_bit);
+	job.request.data = request;
+	job.request.length = sizeof(request);
+	job.response_buffer.data = response;
+	job.response_buffer.length = sizeof(response);
+
+	s7_error_code_e ret = s7_conn_exchange(conn, &job, 1);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+	if (job.response.length < MIN_HEADER_SIZE)
+		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+	if (is_bit)
+		return s7_analysis_read_bit_into(job.response, value);
 
+	int got = 0;
+	ret = s7_analysis_read_byte_into(job.response, value, length, &got);
+	if (ret == S7_ERROR_CODE_SUCCESS && got < length)
+		ret = S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED;
 	return ret;
 }
 
+static s7_error_code_e s7_read_value(int fd, const char* address, int length, bool is_bit, byte* value)
+{
+	siemens_s7_address_data address_data;
+	if (!s7_analysis_address(address, length, &address_data))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+	return s7_read_range(s7_conn_from_fd(fd), address_data, is_bit, value);
+}
+
+// A range within one PDU goes through the allocation-free path, anything larger is split.
+static s7_error_code_e s7_read_into(s7_conn_t* conn, siemens_s7_address_data address_data, byte* buffer)
+{
+	if (address_data.length <= s7_max_read_chunk(conn) && S7_TPKT_MIN_SIZE + conn->pdu_size <= S7_MAX_RESPONSE_SIZE)
+		return s7_read_range(conn, address_data, false, buffer);
+	return s7_transfer_chunked(conn, address_data, buffer, false);
+}
+
 s7_error_code_e read_bit_value(int fd, const char* address, int length, byte_array_info* out_bytes)
 {
 	return s7_read_data(fd, address, length, out_bytes, true);
@@ -191,44 +278,137 @@ s7_error_code_e read_byte_value(int fd, const char* address, int length, byte_ar
 	return s7_read_data(fd, address, length, out_bytes, false);
 }
 
-static s7_error_code_e s7_write_data(int fd, const char* address, int length, byte_array_info in_bytes, bool is_bit, bool value)
+s7_error_code_e s7_read_bytes(int fd, const char* address, int length, byte* buffer)
 {
-	if (fd < 0 || address == NULL || length <= 0)
+	if (fd < 0 || address == NULL || length <= 0 || buffer == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
 	siemens_s7_address_data address_data;
 	if (!s7_analysis_address(address, length, &address_data))
 		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
 
-	s7_error_code_e ret = S7_ERROR_CODE_UNKOWN;
-	byte_array_info core_cmd = is_bit ? build_write_bit_command(address_data, value) : build_write_byte_command(address_data, in_bytes);
-	if (core_cmd.data == NULL)
-		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
+	return s7_read_into(s7_conn_from_fd(fd), address_data, buffer);
+}
 
-	if (!try_send_data_to_server(fd, &core_cmd, NULL)) {
-		RELEASE_DATA(core_cmd.data);
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-	RELEASE_DATA(core_cmd.data);
+static s7_error_code_e s7_multi_transfer(int fd, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write)
+{
+	if (fd < 0 || items == NULL || count <= 0 || results == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	s7_transfer transfer;
+	s7_error_code_e ret = s7_transfer_prepare(&transfer, conn, items, count, results, is_write);
 	if (ret != S7_ERROR_CODE_SUCCESS)
-	{
-		RELEASE_DATA(response.data);
 		return ret;
-	}
 
-	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+	if (transfer.batch_count > 0)
+		ret = s7_conn_exchange(conn, transfer.jobs, transfer.batch_count);
+	return s7_transfer_complete(&transfer, ret, results, count);
+}
+
+s7_error_code_e s7_read_multi(int fd, s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_multi_transfer(fd, items, count, results, false);
+}
+
+s7_error_code_e s7_write_multi(int fd, const s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_multi_transfer(fd, items, count, results, true);
+}
+
+// Connections opened by this library get an I/O thread on first use; other sockets complete on the calling thread.
+static s7_error_code_e s7_submit_async(int fd, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	s7_async_callback callback, void* user_data)
+{
+	if (fd < 0 || items == NULL || count <= 0 || callback == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	// Connections without an I/O owner share one event loop thread; only where there is no loop do they get a thread each.
+	s7_conn_t* conn = s7_conn_find(fd);
+	if (conn == NULL)
+		conn = s7_conn_from_fd(fd);
+	else if (conn->io == NULL && !s7_loop_adopt(conn) && !s7_conn_start_io(conn))
+		return S7_ERROR_CODE_FAILED;
+
+	return s7_conn_submit_async(conn, items, count, results, is_write, callback, user_data, NULL);
+}
+
+s7_error_code_e s7_read_async(int fd, const char* address, int length, byte* buffer, s7_async_callback callback, void* user_data)
+{
+	if (address == NULL || length <= 0 || buffer == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_multi_item item = { address, length, false, buffer };
+	return s7_submit_async(fd, &item, 1, NULL, false, callback, user_data);
+}
+
+s7_error_code_e s7_write_async(int fd, const char* address, int length, const byte* data, s7_async_callback callback, void* user_data)
+{
+	if (address == NULL || length <= 0 || data == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_multi_item item = { address, length, false, (byte*)data };
+	return s7_submit_async(fd, &item, 1, NULL, true, callback, user_data);
+}
+
+s7_error_code_e s7_read_multi_async(int fd, s7_multi_item* items, int count, s7_error_code_e* results, s7_async_callback callback, void* user_data)
+{
+	if (results == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	return s7_submit_async(fd, items, count, results, false, callback, user_data);
+}
+
+void s7_completion_handler(s7_error_code_e result, void* completion)
+{
+	s7_completion* record = (s7_completion*)completion;
+	record->result = result;
+	s7_atomic_store_long(&record->done, 1);
+}
+
+bool s7_completion_done(const s7_completion* completion)
+{
+	return completion != NULL && s7_atomic_load_long(&completion->done) != 0;
+}
+
+// Only the header is built; the data goes out from the caller's buffer in the same gather write
+// and the acknowledgement lands on the stack.
+static s7_error_code_e s7_write_range(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, const byte* data, int data_length)
+{
+	byte header[S7_WRITE_HEADER_SIZE];
+	byte ack[S7_MAX_RESPONSE_SIZE];
+	s7_pdu_job job = { 0 };
+	job.request.data = header;
+	job.request.length = sizeof(header);
+	job.response_buffer.data = ack;
+	job.response_buffer.length = sizeof(ack);
+	job.payload.data = (byte*)data;
+	job.payload.length = data != NULL ? data_length : 0;
+	if (S7_WRITE_HEADER_SIZE + job.payload.length > 0xFFFF)
+		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
+	build_write_header(header, address_data, is_bit, job.payload.length);
+
+	s7_error_code_e ret = s7_conn_exchange(conn, &job, 1);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+	if (job.response.length < MIN_HEADER_SIZE)
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
-	}
+	return s7_analysis_write(job.response);
+}
 
-	ret = s7_analysis_write(response);
-	RELEASE_DATA(response.data);
+static s7_error_code_e s7_write_data(int fd, const char* address, int length, byte_array_info in_bytes, bool is_bit, bool value)
+{
+	if (fd < 0 || address == NULL || length <= 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	return ret;
+	siemens_s7_address_data address_data;
+	if (!s7_analysis_address(address, length, &address_data))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+
+	byte bit_value = value ? (byte)0x01 : (byte)0x00;
+	if (is_bit)
+		return s7_write_range(s7_conn_from_fd(fd), address_data, true, &bit_value, 1);
+	return s7_write_range(s7_conn_from_fd(fd), address_data, false, in_bytes.data, in_bytes.length);
 }
 
 s7_error_code_e write_bit_value(int fd, const char* address, int length, bool value)
@@ -251,7 +431,8 @@ s7_error_code_e s7_remote_run(int fd)
 	const byte* core_cmd_temp = g_s7_hot_start;
 
 	int core_cmd_len = sizeof(g_s7_hot_start);
-	byte* core_cmd = (byte*)malloc(core_cmd_len);
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	byte* core_cmd = s7_frame_alloc(conn, core_cmd_len);
 	if (core_cmd == NULL)
 		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
 
@@ -261,28 +442,23 @@ s7_error_code_e s7_remote_run(int fd)
 	temp.data = core_cmd;
 	temp.length = core_cmd_len;
 
-	if (!try_send_data_to_server(fd, &temp, NULL)) {
-		RELEASE_DATA(temp.data);
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-	RELEASE_DATA(temp.data);
-
 	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	ret = s7_conn_roundtrip(conn, &temp, &response);
+	RELEASE_FRAME(temp.data);
+	int recv_size = response.length;
 	if (ret != S7_ERROR_CODE_SUCCESS)
 	{
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return ret;
 	}
 
 	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
 	ret = s7_analysis_write(response);
-	RELEASE_DATA(response.data);
+	RELEASE_FRAME(response.data);
 
 	return ret;
 }
@@ -296,7 +472,8 @@ s7_error_code_e s7_remote_stop(int fd)
 	const byte* core_cmd_temp = g_s7_stop;
 	int core_cmd_len = sizeof(g_s7_stop);
 
-	byte* core_cmd = (byte*)malloc(core_cmd_len);
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	byte* core_cmd = s7_frame_alloc(conn, core_cmd_len);
 	if (core_cmd == NULL)
 		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
 	memcpy(core_cmd, core_cmd_temp, core_cmd_len);
@@ -305,28 +482,23 @@ s7_error_code_e s7_remote_stop(int fd)
 	temp.data = core_cmd;
 	temp.length = core_cmd_len;
 
-	if (!try_send_data_to_server(fd, &temp, NULL)) {
-		RELEASE_DATA(temp.data);
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-	RELEASE_DATA(temp.data);
-
 	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	ret = s7_conn_roundtrip(conn, &temp, &response);
+	RELEASE_FRAME(temp.data);
+	int recv_size = response.length;
 	if (ret != S7_ERROR_CODE_SUCCESS)
 	{
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return ret;
 	}
 
 	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
 	ret = s7_analysis_write(response);
-	RELEASE_DATA(response.data);
+	RELEASE_FRAME(response.data);
 
 	return ret;
 }
@@ -340,7 +512,8 @@ s7_error_code_e s7_remote_reset(int fd)
 	byte core_cmd_temp[] = { 0x06, 0x10, 0x00, 0x00, 0x01, 0x00 };
 
 	int core_cmd_len = sizeof(core_cmd_temp);
-	byte* core_cmd = (byte*)malloc(core_cmd_len);
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	byte* core_cmd = s7_frame_alloc(conn, core_cmd_len);
 	if (core_cmd == NULL)
 		return S7_ERROR_CODE_BUILD_CORE_CMD_FAILED;
 	memcpy(core_cmd, core_cmd_temp, core_cmd_len);
@@ -349,28 +522,23 @@ s7_error_code_e s7_remote_reset(int fd)
 	temp.data = core_cmd;
 	temp.length = core_cmd_len;
 
-	if (!try_send_data_to_server(fd, &temp, NULL)) {
-		RELEASE_DATA(temp.data);
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-	RELEASE_DATA(temp.data);
-
 	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	ret = s7_conn_roundtrip(conn, &temp, &response);
+	RELEASE_FRAME(temp.data);
+	int recv_size = response.length;
 	if (ret != S7_ERROR_CODE_SUCCESS)
 	{
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return ret;
 	}
 
 	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
 	ret = s7_analysis_write(response);
-	RELEASE_DATA(response.data);
+	RELEASE_FRAME(response.data);
 
 	return ret;
 }
@@ -390,33 +558,29 @@ s7_error_code_e s7_read_plc_type(int fd, char** type)
 	temp.data = core_cmd;
 	temp.length = core_cmd_len;
 
-	if (!try_send_data_to_server(fd, &temp, NULL)) {
-		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
-	}
-
 	byte_array_info response = { 0 };
-	int recv_size = 0;
-	ret = s7_read_response(fd, &response, &recv_size);
+	ret = s7_conn_roundtrip(s7_conn_from_fd(fd), &temp, &response);
+	int recv_size = response.length;
 	if (ret != S7_ERROR_CODE_SUCCESS)
 	{
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return ret;
 	}
 
 	if (recv_size < MIN_HEADER_SIZE) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
 	if (recv_size < 91) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
 	}
 
 	out_bytes.length = 20;
 	out_bytes.data = (byte*)malloc(out_bytes.length + 1);
 	if (out_bytes.data == NULL) {
-		RELEASE_DATA(response.data);
+		RELEASE_FRAME(response.data);
 		return S7_ERROR_CODE_MALLOC_FAILED;
 	}
 	memset(out_bytes.data, 0, out_bytes.length + 1);
@@ -426,43 +590,11 @@ s7_error_code_e s7_read_plc_type(int fd, char** type)
 		*type = (char*)out_bytes.data;
 	}
 
-	RELEASE_DATA(response.data);
+	RELEASE_FRAME(response.data);
 
 	return ret;
 }
 
-bool initialization_on_connect(int fd)
-{
-	byte_array_info ret;
-	bool is_ok = false;
-
-	// First handshake.
-	byte_array_info temp = { 0 };
-	temp.data = g_plc_head1;
-	temp.length = sizeof(g_plc_head1);
-	is_ok = read_data_from_core_server(fd, temp, &ret);
-	if (!is_ok)
-		return false;
-	else
-		if (NULL != ret.data) free(ret.data);
-
-	// Second handshake.
-	temp.data = g_plc_head2;
-	temp.length = sizeof(g_plc_head2);
-	is_ok = read_data_from_core_server(fd, temp, &ret);
-	if (!is_ok)
-		return false;
-
-	// Update the negotiated PDU length for single receive operations.
-	g_pdu_length = ntohs(bytes2ushort(ret.data + ret.length - 2)) - 28;
-	if (g_pdu_length < 200) g_pdu_length = 200;
-
-	if (NULL != ret.data) free(ret.data);
-
-	// Return success.
-	return true;
-}
-
 //////////////////////////////////////////////////////////////////////////
 
 s7_error_code_e s7_read_bool(int fd, const char* address, bool* val)
@@ -470,14 +602,10 @@ s7_error_code_e s7_read_bool(int fd, const char* address, bool* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_bit_value(fd, address, 1, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length > 0)
-	{
-		*val = (bool)read_data.data[0];
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[1] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 1, true, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = (bool)data[0];
 	return ret;
 }
 
@@ -486,14 +614,10 @@ s7_error_code_e s7_read_byte(int fd, const char* address, byte* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 1, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length > 0)
-	{
-		*val = read_data.data[0];
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[1] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 1, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = data[0];
 	return ret;
 }
 
@@ -502,14 +626,10 @@ s7_error_code_e s7_read_short(int fd, const char* address, short* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 2, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length > 0)
-	{
-		*val = (short)ntohs(bytes2short(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[2] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 2, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = (short)ntohs(bytes2short(data));
 	return ret;
 }
 
@@ -518,14 +638,10 @@ s7_error_code_e s7_read_ushort(int fd, const char* address, ushort* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 2, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 2)
-	{
-		*val = ntohs(bytes2ushort(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[2] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 2, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = ntohs(bytes2ushort(data));
 	return ret;
 }
 
@@ -534,14 +650,10 @@ s7_error_code_e s7_read_int32(int fd, const char* address, int32* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 4, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 4)
-	{
-		*val = (int32)ntohl(bytes2int32(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[4] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 4, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = (int32)ntohl(bytes2int32(data));
 	return ret;
 }
 
@@ -550,14 +662,10 @@ s7_error_code_e s7_read_uint32(int fd, const char* address, uint32* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 4, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 2)
-	{
-		*val = ntohl(bytes2uint32(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[4] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 4, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = ntohl(bytes2uint32(data));
 	return ret;
 }
 
@@ -566,14 +674,10 @@ s7_error_code_e s7_read_int64(int fd, const char* address, int64* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 8, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 8)
-	{
-		*val = (int64)ntohll_(bytes2bigInt(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[8] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 8, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = (int64)ntohll_(bytes2bigInt(data));
 	return ret;
 }
 
@@ -582,14 +686,10 @@ s7_error_code_e s7_read_uint64(int fd, const char* address, uint64* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 8, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 8)
-	{
-		*val = ntohll_(bytes2ubigInt(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[8] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 8, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = ntohll_(bytes2ubigInt(data));
 	return ret;
 }
 
@@ -598,14 +698,10 @@ s7_error_code_e s7_read_float(int fd, const char* address, float* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 4, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 4)
-	{
-		*val = ntohf_(bytes2uint32(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[4] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 4, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = ntohf_(bytes2uint32(data));
 	return ret;
 }
 
@@ -614,14 +710,10 @@ s7_error_code_e s7_read_double(int fd, const char* address, double* val)
 	if (fd < 0 || address == NULL || strlen(address) == 0 || val == NULL)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	byte_array_info read_data = { 0 };
-	ret = read_byte_value(fd, address, 8, &read_data);
-	if (ret == S7_ERROR_CODE_SUCCESS && read_data.length >= 8)
-	{
-		*val = ntohd_(bytes2ubigInt(read_data.data));
-		RELEASE_DATA(read_data.data);
-	}
+	byte data[8] = { 0 };
+	s7_error_code_e ret = s7_read_value(fd, address, 8, false, data);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		*val = ntohd_(bytes2ubigInt(data));
 	return ret;
 }
 
@@ -639,7 +731,7 @@ s7_error_code_e s7_read_string(int fd, const char* address, int length, char** v
 		char* ret_str = (char*)malloc(read_len);
 		memset(ret_str, 0, read_len);
 		memcpy(ret_str, read_data.data, read_len);
-		RELEASE_DATA(read_data.data);
+		RELEASE_FRAME(read_data.data);
 		*val = ret_str;
 	}
 	return ret;
@@ -668,25 +760,17 @@ s7_error_code_e s7_write_byte(int fd, const char* address, byte val)
 	return write_byte_value(fd, address, 1, write_data);
 }
 
-s7_error_code_e s7_write_short(int fd, const char* address, short val)  
-{  
-   if (fd < 0 || address == NULL || strlen(address) == 0)  
-       return S7_ERROR_CODE_INVALID_PARAMETER;  
-
-   s7_error_code_e ret = S7_ERROR_CODE_FAILED;  
-   int write_len = 2;  
-   byte_array_info write_data = { 0 };  
-   write_data.data = (byte*)malloc(write_len);  
-   if (write_data.data == NULL)  
-       return S7_ERROR_CODE_MALLOC_FAILED;  
-
-   memset(write_data.data, 0, write_len);  
-   write_data.length = write_len;  
+s7_error_code_e s7_write_short(int fd, const char* address, short val)
+{
+	if (fd < 0 || address == NULL || strlen(address) == 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-   short2bytes(htons(val), write_data.data);  
-   ret = write_byte_value(fd, address, 2, write_data);  
-   RELEASE_DATA(write_data.data);  
-   return ret;  
+	byte data[2] = { 0 };
+	byte_array_info write_data = { 0 };
+	write_data.data = data;
+	write_data.length = 2;
+	short2bytes(htons(val), write_data.data);
+	return write_byte_value(fd, address, 2, write_data);
 }
 
 s7_error_code_e s7_write_ushort(int fd, const char* address, ushort val)
@@ -694,19 +778,12 @@ s7_error_code_e s7_write_ushort(int fd, const char* address, ushort val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 2;
+	byte data[2] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 2;
 	ushort2bytes(htons(val), write_data.data);
-	ret = write_byte_value(fd, address, 2, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 2, write_data);
 }
 
 s7_error_code_e s7_write_int32(int fd, const char* address, int32 val)
@@ -714,19 +791,12 @@ s7_error_code_e s7_write_int32(int fd, const char* address, int32 val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 4;
+	byte data[4] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 4;
 	int2bytes(htonl(val), write_data.data);
-	ret = write_byte_value(fd, address, 4, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 4, write_data);
 }
 
 s7_error_code_e s7_write_uint32(int fd, const char* address, uint32 val)
@@ -734,19 +804,12 @@ s7_error_code_e s7_write_uint32(int fd, const char* address, uint32 val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 4;
+	byte data[4] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 4;
 	uint2bytes(htonl(val), write_data.data);
-	ret = write_byte_value(fd, address, 4, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 4, write_data);
 }
 
 s7_error_code_e s7_write_int64(int fd, const char* address, int64 val)
@@ -754,19 +817,12 @@ s7_error_code_e s7_write_int64(int fd, const char* address, int64 val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 8;
+	byte data[8] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 8;
 	bigInt2bytes(htonll_(val), write_data.data);
-	ret = write_byte_value(fd, address, 8, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 8, write_data);
 }
 
 s7_error_code_e s7_write_uint64(int fd, const char* address, uint64 val)
@@ -774,19 +830,12 @@ s7_error_code_e s7_write_uint64(int fd, const char* address, uint64 val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 8;
+	byte data[8] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 8;
 	ubigInt2bytes(htonll_(val), write_data.data);
-	ret = write_byte_value(fd, address, 8, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 8, write_data);
 }
 
 s7_error_code_e s7_write_float(int fd, const char* address, float val)
@@ -794,19 +843,12 @@ s7_error_code_e s7_write_float(int fd, const char* address, float val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 4;
+	byte data[4] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 4;
 	uint2bytes(htonf_(val), write_data.data);
-	ret = write_byte_value(fd, address, 4, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 4, write_data);
 }
 
 s7_error_code_e s7_write_double(int fd, const char* address, double val)
@@ -814,19 +856,12 @@ s7_error_code_e s7_write_double(int fd, const char* address, double val)
 	if (fd < 0 || address == NULL || strlen(address) == 0)
 		return S7_ERROR_CODE_INVALID_PARAMETER;
 
-	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
-	int write_len = 8;
+	byte data[8] = { 0 };
 	byte_array_info write_data = { 0 };
-	write_data.data = (byte*)malloc(write_len);
-	if (write_data.data == NULL)
-		return S7_ERROR_CODE_MALLOC_FAILED;
-	memset(write_data.data, 0, write_len);
-	write_data.length = write_len;
-
+	write_data.data = data;
+	write_data.length = 8;
 	bigInt2bytes(htond_(val), write_data.data);
-	ret = write_byte_value(fd, address, 8, write_data);
-	RELEASE_DATA(write_data.data);
-	return ret;
+	return write_byte_value(fd, address, 8, write_data);
 }
 
 s7_error_code_e s7_write_string(int fd, const char* address, int length, const char* val)
@@ -849,92 +884,380 @@ s7_error_code_e s7_write_string(int fd, const char* address, int length, const c
 	return ret;
 }
 
+s7_error_code_e s7_write_bytes(int fd, const char* address, int length, const byte* data)
+{
+	if (fd < 0 || address == NULL || length <= 0 || data == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	siemens_s7_address_data address_data;
+	if (!s7_analysis_address(address, length, &address_data))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+
+	return s7_write_parsed(s7_conn_from_fd(fd), address_data, false, data);
+}
+
+s7_error_code_e s7_read_parsed(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, byte* buffer)
+{
+	if (is_bit)
+		return s7_read_range(conn, address_data, true, buffer);
+	return s7_read_into(conn, address_data, buffer);
+}
+
+// A range within one PDU goes out from the caller's buffer in a single frame.
+s7_error_code_e s7_write_parsed(s7_conn_t* conn, siemens_s7_address_data address_data, bool is_bit, const byte* data)
+{
+	if (is_bit)
+	{
+		byte bit_value = data[0] != 0 ? (byte)0x01 : (byte)0x00;
+		return s7_write_range(conn, address_data, true, &bit_value, 1);
+	}
+	if (address_data.length <= s7_max_write_chunk(conn))
+		return s7_write_range(conn, address_data, false, data, address_data.length);
+	return s7_transfer_chunked(conn, address_data, (byte*)data, true);
+}
+
+//////////////////////////////////////////////////////////////////////////
+static void s7_swap_values(void* dst, const void* src, int count, int width)
+{
+	if (width == 2)
+		swap16_array(dst, src, count);
+	else if (width == 4)
+		swap32_array(dst, src, count);
+	else
+		swap64_array(dst, src, count);
+}
+
+// The range lands in the caller's array and is converted to host order in place
+static s7_error_code_e s7_read_array(int fd, const char* address, void* values, int count, int width)
+{
+	if (values == NULL || count <= 0 || count > INT_MAX / width)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_error_code_e ret = s7_read_bytes(fd, address, count * width, (byte*)values);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		s7_swap_values(values, values, count, width);
+	return ret;
+}
+
+// Values are converted to PLC order once, on the stack when they fit one PDU and into one frame otherwise
+static s7_error_code_e s7_write_array(int fd, const char* address, const void* values, int count, int width)
+{
+	if (fd < 0 || address == NULL || values == NULL || count <= 0 || count > INT_MAX / width)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	int length = count * width;
+	byte stack_data[S7_MAX_PDU_SIZE];
+	byte* data = length <= (int)sizeof(stack_data) ? stack_data : s7_frame_alloc(s7_conn_from_fd(fd), length);
+	if (data == NULL)
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	s7_swap_values(data, values, count, width);
+	s7_error_code_e ret = s7_write_bytes(fd, address, length, data);
+	if (data != stack_data)
+		RELEASE_FRAME(data);
+	return ret;
+}
+
+s7_error_code_e s7_read_short_array(int fd, const char* address, short* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(short));
+}
+
+s7_error_code_e s7_read_ushort_array(int fd, const char* address, ushort* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(ushort));
+}
+
+s7_error_code_e s7_read_int32_array(int fd, const char* address, int32* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(int32));
+}
+
+s7_error_code_e s7_read_uint32_array(int fd, const char* address, uint32* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(uint32));
+}
+
+s7_error_code_e s7_read_int64_array(int fd, const char* address, int64* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(int64));
+}
+
+s7_error_code_e s7_read_uint64_array(int fd, const char* address, uint64* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(uint64));
+}
+
+s7_error_code_e s7_read_float_array(int fd, const char* address, float* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(float));
+}
+
+s7_error_code_e s7_read_double_array(int fd, const char* address, double* values, int count)
+{
+	return s7_read_array(fd, address, values, count, sizeof(double));
+}
+
+s7_error_code_e s7_write_short_array(int fd, const char* address, const short* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(short));
+}
+
+s7_error_code_e s7_write_ushort_array(int fd, const char* address, const ushort* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(ushort));
+}
+
+s7_error_code_e s7_write_int32_array(int fd, const char* address, const int32* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(int32));
+}
+
+s7_error_code_e s7_write_uint32_array(int fd, const char* address, const uint32* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(uint32));
+}
+
+s7_error_code_e s7_write_int64_array(int fd, const char* address, const int64* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(int64));
+}
+
+s7_error_code_e s7_write_uint64_array(int fd, const char* address, const uint64* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(uint64));
+}
+
+s7_error_code_e s7_write_float_array(int fd, const char* address, const float* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(float));
+}
+
+s7_error_code_e s7_write_double_array(int fd, const char* address, const double* values, int count)
+{
+	return s7_write_array(fd, address, values, count, sizeof(double));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Timers and counters are addressed by element, not by bit.
+static bool s7_is_bit_area(const siemens_s7_address_data* address_data)
+{
+	return address_data->data_code != 0x1C && address_data->data_code != 0x1D &&
+		address_data->data_code != 0x1E && address_data->data_code != 0x1F;
+}
+
+// The bytes covering every bit are read once and unpacked straight into the caller's array
+s7_error_code_e s7_read_bool_array(int fd, const char* address, bool_array_info* values)
+{
+	if (fd < 0 || address == NULL || values == NULL || values->data == NULL || values->length <= 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	siemens_s7_address_data address_data;
+	if (!s7_analysis_address(address, 1, &address_data))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+	if (!s7_is_bit_area(&address_data))
+		return S7_ERROR_CODE_ERROR_0006;
+
+	int first_bit = address_data.address_start % 8;
+	if (values->length > INT_MAX - 7 - first_bit)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+	address_data.address_start -= first_bit;
+	address_data.length = (first_bit + values->length + 7) / 8;
+
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	byte stack_data[S7_MAX_PDU_SIZE];
+	byte* packed = address_data.length <= (int)sizeof(stack_data) ? stack_data : s7_frame_alloc(conn, address_data.length);
+	if (packed == NULL)
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	s7_error_code_e ret = s7_read_into(conn, address_data, packed);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		unpack_bits(values->data, packed, first_bit, values->length);
+	if (packed != stack_data)
+		RELEASE_FRAME(packed);
+	return ret;
+}
+
+// Bits sharing a byte with bits outside the array go out as bit items, every whole byte in between
+// as part of a byte item, so no byte is ever read back and rewritten.
+s7_error_code_e s7_write_bool_array(int fd, const char* address, const bool_array_info* values)
+{
+	if (fd < 0 || address == NULL || values == NULL || values->data == NULL || values->length <= 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	siemens_s7_address_data address_data;
+	if (!s7_analysis_address(address, 1, &address_data))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+	if (!s7_is_bit_area(&address_data))
+		return S7_ERROR_CODE_ERROR_0006;
+	if (values->length > INT_MAX - address_data.address_start)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	int first_bit = address_data.address_start;
+	int end_bit = first_bit + values->length;
+	int head_end = (first_bit + 7) / 8 * 8;
+	int tail_start = end_bit / 8 * 8;
+	if (head_end > end_bit)
+		head_end = tail_start = end_bit;
+
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	int byte_count = (tail_start - head_end) / 8;
+	int max_chunk = s7_max_write_chunk(conn);
+	if (max_chunk <= 0)
+		return S7_ERROR_CODE_PDU_SIZE_EXCEEDED;
+
+	int chunk_count = (byte_count + max_chunk - 1) / max_chunk;
+	int item_count = (head_end - first_bit) + (end_bit - tail_start) + chunk_count;
+	s7_request_item* items = (s7_request_item*)calloc(item_count, sizeof(s7_request_item));
+	s7_error_code_e* results = (s7_error_code_e*)malloc(sizeof(s7_error_code_e) * item_count);
+	byte* packed = byte_count > 0 ? s7_frame_alloc(conn, byte_count) : NULL;
+	if (items == NULL || results == NULL || (byte_count > 0 && packed == NULL))
+	{
+		RELEASE_DATA(items);
+		RELEASE_DATA(results);
+		RELEASE_FRAME(packed);
+		return S7_ERROR_CODE_MALLOC_FAILED;
+	}
+
+	// bool is stored as one byte holding 0 or 1, which is exactly the data of a bit item.
+	int count = 0;
+	for (int bit = first_bit; bit < end_bit; bit++)
+	{
+		if (bit == head_end && byte_count > 0)
+			bit = tail_start;
+		if (bit >= end_bit)
+			break;
+
+		s7_request_item* item = &items[count++];
+		item->address = address_data;
+		item->address.address_start = bit;
+		item->address.length = 1;
+		item->is_bit = true;
+		item->data = (byte*)&values->data[bit - first_bit];
+	}
+
+	if (byte_count > 0)
+		pack_bits(packed, values->data + (head_end - first_bit), byte_count * 8);
+	for (int i = 0; i < chunk_count; i++)
+	{
+		int offset = i * max_chunk;
+		s7_request_item* item = &items[count++];
+		item->address = address_data;
+		item->address.address_start = head_end + offset * 8;
+		item->address.length = byte_count - offset < max_chunk ? byte_count - offset : max_chunk;
+		item->data = packed + offset;
+	}
+
+	s7_transfer transfer;
+	s7_error_code_e ret = s7_transfer_prepare_items(&transfer, conn, items, count, results, true);
+	if (ret == S7_ERROR_CODE_SUCCESS)
+	{
+		if (transfer.batch_count > 0)
+			ret = s7_conn_exchange(conn, transfer.jobs, transfer.batch_count);
+		ret = s7_transfer_complete(&transfer, ret, results, count);
+	}
+
+	RELEASE_DATA(items);
+	RELEASE_DATA(results);
+	RELEASE_FRAME(packed);
+	return ret;
+}
+
 byte get_plc_slot()
 {
-	return g_plc_slot;
+	s7_mutex_lock(&g_conn_template_lock);
+	byte value = s7_conn_get_slot(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
 
 void set_plc_slot(byte slot)
 {
-	g_plc_slot = slot;
-	if (current_plc != S200 && current_plc != S200Smart)
-		g_plc_head1[21] = (byte)((g_plc_rack * 0x20) + g_plc_slot);
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_set_slot(s7_conn_template(), slot);
+	s7_mutex_unlock(&g_conn_template_lock);
 }
 
 byte get_plc_rack()
 {
-	return g_plc_rack;
+	s7_mutex_lock(&g_conn_template_lock);
+	byte value = s7_conn_get_rack(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
 
 void set_plc_rack(byte rack)
 {
-	g_plc_rack = rack;
-	if (current_plc != S200 && current_plc != S200Smart)
-		g_plc_head1[21] = (byte)((g_plc_rack * 0x20) + g_plc_slot);
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_set_rack(s7_conn_template(), rack);
+	s7_mutex_unlock(&g_conn_template_lock);
 }
 
 byte get_plc_connection_type()
 {
-	return g_plc_head1[20];
+	s7_mutex_lock(&g_conn_template_lock);
+	byte value = s7_conn_get_connection_type(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
 
 void set_plc_connection_type(byte type)
 {
-	if (current_plc != S200 && current_plc != S200Smart)
-		g_plc_head1[20] = type;
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_set_connection_type(s7_conn_template(), type);
+	s7_mutex_unlock(&g_conn_template_lock);
 }
 
 int get_plc_local_TSAP()
 {
-	if (current_plc == S200 || current_plc == S200Smart)
-		return g_plc_head1[13] * 256 + g_plc_head1[14];
-	else
-		return g_plc_head1[16] * 256 + g_plc_head1[17];
+	s7_mutex_lock(&g_conn_template_lock);
+	int value = s7_conn_get_local_TSAP(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
 
 void set_plc_local_TSAP(int tasp)
 {
-	byte temp[4] = { 0 };
-	int2bytes(tasp, temp);
-
-	if (current_plc == S200 || current_plc == S200Smart)
-	{
-		g_plc_head1[13] = temp[1];
-		g_plc_head1[14] = temp[0];
-	}
-	else
-	{
-		g_plc_head1[16] = temp[1];
-		g_plc_head1[17] = temp[0];
-	}
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_set_local_TSAP(s7_conn_template(), tasp);
+	s7_mutex_unlock(&g_conn_template_lock);
 }
 
 int get_plc_dest_TSAP()
 {
-	if (current_plc == S200 || current_plc == S200Smart)
-		return g_plc_head1[17] * 256 + g_plc_head1[18];
-	else
-		return g_plc_head1[20] * 256 + g_plc_head1[21];
+	s7_mutex_lock(&g_conn_template_lock);
+	int value = s7_conn_get_dest_TSAP(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
 
 void set_plc_dest_TSAP(int tasp)
 {
-	byte temp[4] = { 0 };
-	int2bytes(tasp, temp);
-
-	if (current_plc == S200 || current_plc == S200Smart)
-	{
-		g_plc_head1[17] = temp[1];
-		g_plc_head1[18] = temp[0];
-	}
-	else
-	{
-		g_plc_head1[20] = temp[1];
-		g_plc_head1[21] = temp[0];
-	}
+	s7_mutex_lock(&g_conn_template_lock);
+	s7_conn_set_dest_TSAP(s7_conn_template(), tasp);
+	s7_mutex_unlock(&g_conn_template_lock);
 }
 
 int get_plc_PDU_length()
 {
-	return g_pdu_length;
+	s7_mutex_lock(&g_conn_template_lock);
+	int value = s7_max_read_chunk(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
+}
+
+int get_plc_PDU_size()
+{
+	s7_mutex_lock(&g_conn_template_lock);
+	int value = s7_conn_get_PDU_size(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
+}
+
+int get_plc_parallel_jobs()
+{
+	s7_mutex_lock(&g_conn_template_lock);
+	int value = s7_conn_get_parallel_jobs(s7_conn_template());
+	s7_mutex_unlock(&g_conn_template_lock);
+	return value;
 }
\ No newline at end of file
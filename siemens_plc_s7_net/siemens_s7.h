@@ -9,6 +9,30 @@
 #define __H_SIEMENS_S7_H__
 
 #include "typedef.h"
+#include "utill.h"
+
+typedef struct _tag_s7_multi_item {
+	const char* address;	// PLC address, e.g. "DB1.DBD70" or "MX100.1"
+	int		length;			// Number of bytes to access, ignored for bit items
+	bool	is_bit;			// Access a single bit instead of a byte range
+	byte*	data;			// Caller buffer, at least length bytes (1 byte for bit items)
+} s7_multi_item;
+
+// Setup Communication values requested on connect; zero keeps the PLC type default
+typedef struct _tag_s7_connect_options {
+	int		pdu_size;			// Requested PDU size in bytes, e.g. 960 for S7-1500
+	int		max_amq_calling;	// Requested parallel jobs, calling side
+	int		max_amq_called;		// Requested parallel jobs, called side
+} s7_connect_options;
+
+// Completion of an asynchronous call; runs on the thread of the connection's I/O owner and must not wait for other jobs
+typedef void (*s7_async_callback)(s7_error_code_e result, void* user_data);
+
+// Ready-made completion record: pass s7_completion_handler as callback and the record as user_data
+typedef struct _tag_s7_completion {
+	volatile long	done;		// Set once result is valid, read it through s7_completion_done()
+	s7_error_code_e	result;
+} s7_completion;
 
 /////////////////////////////////////////////////////////////
 
@@ -28,10 +52,13 @@ int get_plc_dest_TSAP();
 void set_plc_dest_TSAP(int tasp);
 
 int get_plc_PDU_length();
+int get_plc_PDU_size();
+int get_plc_parallel_jobs();
 
 /////////////////////////////////////////////////////////////
 
 bool s7_connect(char* ip_addr, int port, siemens_plc_types_e plc, int* fd);
+bool s7_connect_ex(char* ip_addr, int port, siemens_plc_types_e plc, const s7_connect_options* options, int* fd);
 bool s7_disconnect(int fd);
 
 //read
@@ -46,6 +73,19 @@ s7_error_code_e s7_read_uint64(int fd, const char* address, uint64* val);
 s7_error_code_e s7_read_float(int fd, const char* address, float* val);
 s7_error_code_e s7_read_double(int fd, const char* address, double* val);
 s7_error_code_e s7_read_string(int fd, const char* address, int length, char** val); //need free val
+s7_error_code_e s7_read_bytes(int fd, const char* address, int length, byte* buffer); //any length, split by PDU
+s7_error_code_e s7_read_multi(int fd, s7_multi_item* items, int count, s7_error_code_e* results); //results: one code per item
+
+//read arrays: count consecutive values from address, split by PDU and converted to host order in one pass
+s7_error_code_e s7_read_short_array(int fd, const char* address, short* values, int count);
+s7_error_code_e s7_read_ushort_array(int fd, const char* address, ushort* values, int count);
+s7_error_code_e s7_read_int32_array(int fd, const char* address, int32* values, int count);
+s7_error_code_e s7_read_uint32_array(int fd, const char* address, uint32* values, int count);
+s7_error_code_e s7_read_int64_array(int fd, const char* address, int64* values, int count);
+s7_error_code_e s7_read_uint64_array(int fd, const char* address, uint64* values, int count);
+s7_error_code_e s7_read_float_array(int fd, const char* address, float* values, int count);
+s7_error_code_e s7_read_double_array(int fd, const char* address, double* values, int count);
+s7_error_code_e s7_read_bool_array(int fd, const char* address, bool_array_info* values); //values->length bits from a bit address into values->data
 
 //write
 s7_error_code_e s7_write_bool(int fd, const char* address, bool val);
@@ -59,6 +99,31 @@ s7_error_code_e s7_write_uint64(int fd, const char* address, uint64 val);
 s7_error_code_e s7_write_float(int fd, const char* address, float val);
 s7_error_code_e s7_write_double(int fd, const char* address, double val);
 s7_error_code_e s7_write_string(int fd, const char* address, int length, const char* val);
+s7_error_code_e s7_write_bytes(int fd, const char* address, int length, const byte* data); //any length, split by PDU
+s7_error_code_e s7_write_multi(int fd, const s7_multi_item* items, int count, s7_error_code_e* results); //results: one code per item
+
+//write arrays: count consecutive values to address, split by PDU
+s7_error_code_e s7_write_short_array(int fd, const char* address, const short* values, int count);
+s7_error_code_e s7_write_ushort_array(int fd, const char* address, const ushort* values, int count);
+s7_error_code_e s7_write_int32_array(int fd, const char* address, const int32* values, int count);
+s7_error_code_e s7_write_uint32_array(int fd, const char* address, const uint32* values, int count);
+s7_error_code_e s7_write_int64_array(int fd, const char* address, const int64* values, int count);
+s7_error_code_e s7_write_uint64_array(int fd, const char* address, const uint64* values, int count);
+s7_error_code_e s7_write_float_array(int fd, const char* address, const float* values, int count);
+s7_error_code_e s7_write_double_array(int fd, const char* address, const double* values, int count);
+s7_error_code_e s7_write_bool_array(int fd, const char* address, const bool_array_info* values); //edge bits as bit items, whole bytes as byte items
+
+//async: queue the request and return at once; the callback reports the result.
+//Callbacks run on the connection's I/O owner: the thread calling s7_loop_run() for a loop-owned connection, the thread of
+//s7_conn_start_io()/s7_conn_start_managed_io(), and otherwise one async thread the library shares among all connections
+//(Linux; where there is no event loop the first call starts an I/O thread for the connection). On the shared thread blocking
+//calls on that connection return S7_ERROR_CODE_WOULD_BLOCK. Buffers and results must stay valid until completion.
+//An error returned here means nothing was queued and the callback will not run.
+s7_error_code_e s7_read_async(int fd, const char* address, int length, byte* buffer, s7_async_callback callback, void* user_data); //length up to one PDU
+s7_error_code_e s7_write_async(int fd, const char* address, int length, const byte* data, s7_async_callback callback, void* user_data); //length up to one PDU
+s7_error_code_e s7_read_multi_async(int fd, s7_multi_item* items, int count, s7_error_code_e* results, s7_async_callback callback, void* user_data);
+void s7_completion_handler(s7_error_code_e result, void* completion);
+bool s7_completion_done(const s7_completion* completion);
 
 //
 s7_error_code_e s7_remote_run(int fd);
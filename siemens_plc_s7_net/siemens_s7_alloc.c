@@ -0,0 +1,280 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_alloc.h"
+#include "siemens_helper.h"
+#include "siemens_s7_queue.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Every frame starts with the release hook of its allocator, so it can be released without knowing its connection
+typedef struct _tag_s7_frame_header {
+	void	(*release)(void* block, void* user_data);
+	void*	user_data;
+} s7_frame_header;
+
+struct _tag_s7_frame_pool {
+	s7_mutex	lock;
+	byte*		blocks;				// block_count blocks of block_stride bytes
+	int*		free_blocks;		// Stack of unused block indexes
+	int			free_count;
+	int			block_stride;		// Frame header plus block_size
+	bool		retired;			// Released by its connection while blocks were out, the last release frees it
+	s7_frame_pool_stats stats;
+};
+
+static void* s7_frame_pool_alloc(size_t size, void* user_data);
+
+static void* s7_heap_alloc(size_t size, void* user_data)
+{
+	(void)user_data;
+	return malloc(size);
+}
+
+static void s7_heap_release(void* block, void* user_data)
+{
+	(void)user_data;
+	free(block);
+}
+
+static s7_allocator g_s7_allocator = { s7_heap_alloc, s7_heap_release, NULL };
+
+void s7_set_allocator(const s7_allocator* allocator)
+{
+	if (allocator == NULL || allocator->alloc == NULL || allocator->release == NULL)
+	{
+		g_s7_allocator.alloc = s7_heap_alloc;
+		g_s7_allocator.release = s7_heap_release;
+		g_s7_allocator.user_data = NULL;
+		return;
+	}
+	g_s7_allocator = *allocator;
+}
+
+void s7_conn_set_allocator(s7_conn_t* conn, const s7_allocator* allocator)
+{
+	if (conn == NULL)
+		return;
+
+	s7_mutex_lock(&conn->allocator_lock);
+	if (allocator == NULL || allocator->alloc == NULL || allocator->release == NULL)
+		memset(&conn->allocator, 0, sizeof(conn->allocator));
+	else
+		conn->allocator = *allocator;
+	s7_mutex_unlock(&conn->allocator_lock);
+}
+
+// Whether block lies in the region of the pool rather than being one of its heap fallbacks
+static bool s7_frame_pool_owns(const s7_frame_pool_t* pool, const void* block)
+{
+	const byte* address = (const byte*)block;
+	return address >= pool->blocks && address < pool->blocks + (size_t)pool->block_stride * pool->stats.block_count;
+}
+
+byte* s7_frame_alloc(const s7_conn_t* conn, int size)
+{
+	if (size <= 0)
+		return NULL;
+
+	// The lock keeps the allocator from being swapped, and its pool from being freed, while a frame is taken.
+	s7_mutex* lock = conn != NULL ? (s7_mutex*)&conn->allocator_lock : NULL;
+	if (lock != NULL)
+		s7_mutex_lock(lock);
+	const s7_allocator* allocator = conn != NULL && conn->allocator.alloc != NULL ? &conn->allocator : &g_s7_allocator;
+	s7_frame_header* header = (s7_frame_header*)allocator->alloc(sizeof(s7_frame_header) + (size_t)size, allocator->user_data);
+	if (header != NULL)
+	{
+		// Heap fallbacks of a pool are released as plain heap memory and never touch the pool, which may be gone by then.
+		bool fallback = allocator->alloc == s7_frame_pool_alloc && !s7_frame_pool_owns((s7_frame_pool_t*)allocator->user_data, header);
+		header->release = fallback ? s7_heap_release : allocator->release;
+		header->user_data = fallback ? NULL : allocator->user_data;
+	}
+	if (lock != NULL)
+		s7_mutex_unlock(lock);
+	return header != NULL ? (byte*)(header + 1) : NULL;
+}
+
+void s7_frame_release(void* frame)
+{
+	if (frame == NULL)
+		return;
+
+	s7_frame_header* header = (s7_frame_header*)frame - 1;
+	header->release(header, header->user_data);
+}
+
+static void* s7_frame_pool_alloc(size_t size, void* user_data)
+{
+	s7_frame_pool_t* pool = (s7_frame_pool_t*)user_data;
+	void* block = NULL;
+	s7_mutex_lock(&pool->lock);
+	if (size <= (size_t)pool->block_stride && pool->free_count > 0)
+	{
+		block = pool->blocks + (size_t)pool->free_blocks[--pool->free_count] * pool->block_stride;
+		if (++pool->stats.in_use > pool->stats.high_water)
+			pool->stats.high_water = pool->stats.in_use;
+	}
+	else
+		pool->stats.fallbacks++;
+	s7_mutex_unlock(&pool->lock);
+	return block != NULL ? block : malloc(size);
+}
+
+static void s7_frame_pool_release(void* block, void* user_data)
+{
+	s7_frame_pool_t* pool = (s7_frame_pool_t*)user_data;
+	if (!s7_frame_pool_owns(pool, block))
+	{
+		free(block);
+		return;
+	}
+
+	s7_mutex_lock(&pool->lock);
+	pool->free_blocks[pool->free_count++] = (int)(((byte*)block - pool->blocks) / pool->block_stride);
+	pool->stats.in_use--;
+	bool last = pool->retired && pool->stats.in_use == 0;
+	s7_mutex_unlock(&pool->lock);
+	if (last)
+		s7_frame_pool_destroy(pool);
+}
+
+s7_frame_pool_t* s7_frame_pool_create(int block_size, int block_count)
+{
+	if (block_size <= 0 || block_count <= 0)
+		return NULL;
+
+	s7_frame_pool_t* pool = (s7_frame_pool_t*)calloc(1, sizeof(s7_frame_pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	// Strides stay pointer-aligned so every block can hold the frame header.
+	pool->block_stride = (int)((sizeof(s7_frame_header) + (size_t)block_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*));
+	pool->blocks = (byte*)malloc((size_t)pool->block_stride * block_count);
+	pool->free_blocks = (int*)malloc(sizeof(int) * block_count);
+	if (pool->blocks == NULL || pool->free_blocks == NULL)
+	{
+		RELEASE_DATA(pool->blocks);
+		RELEASE_DATA(pool->free_blocks);
+		free(pool);
+		return NULL;
+	}
+
+	for (int i = 0; i < block_count; i++)
+		pool->free_blocks[i] = block_count - 1 - i;
+	pool->free_count = block_count;
+	pool->stats.block_size = block_size;
+	pool->stats.block_count = block_count;
+	s7_mutex_init(&pool->lock);
+	return pool;
+}
+
+void s7_frame_pool_destroy(s7_frame_pool_t* pool)
+{
+	if (pool == NULL)
+		return;
+
+	s7_mutex_destroy(&pool->lock);
+	RELEASE_DATA(pool->blocks);
+	RELEASE_DATA(pool->free_blocks);
+	free(pool);
+}
+
+void s7_frame_pool_get_allocator(s7_frame_pool_t* pool, s7_allocator* allocator)
+{
+	if (pool == NULL || allocator == NULL)
+		return;
+
+	allocator->alloc = s7_frame_pool_alloc;
+	allocator->release = s7_frame_pool_release;
+	allocator->user_data = pool;
+}
+
+void s7_frame_pool_get_stats(s7_frame_pool_t* pool, s7_frame_pool_stats* stats)
+{
+	if (pool == NULL || stats == NULL)
+		return;
+
+	s7_mutex_lock(&pool->lock);
+	*stats = pool->stats;
+	s7_mutex_unlock(&pool->lock);
+}
+
+// Frames of the pool still out, i.e. frames whose release will touch it
+static int s7_frame_pool_in_use(s7_frame_pool_t* pool)
+{
+	s7_mutex_lock(&pool->lock);
+	int in_use = pool->stats.in_use;
+	s7_mutex_unlock(&pool->lock);
+	return in_use;
+}
+
+// Free the pool now, or let the release of its last frame out free it
+static void s7_frame_pool_retire(s7_frame_pool_t* pool)
+{
+	s7_mutex_lock(&pool->lock);
+	bool busy = pool->stats.in_use > 0;
+	pool->retired = busy;
+	s7_mutex_unlock(&pool->lock);
+	if (!busy)
+		s7_frame_pool_destroy(pool);
+}
+
+bool s7_conn_use_frame_pool(s7_conn_t* conn, int block_count)
+{
+	if (conn == NULL || block_count <= 0)
+		return false;
+
+	// Requests and responses both stay within the PDU plus the TPKT and COTP headers.
+	int pdu_size = conn->fd >= 0 ? conn->pdu_size : S7_MAX_PDU_SIZE;
+	s7_frame_pool_t* pool = s7_frame_pool_create(S7_TPKT_MIN_SIZE + pdu_size, block_count);
+	if (pool == NULL)
+		return false;
+
+	// Checked under the lock, so no frame can be taken from the old pool between the check and the swap.
+	s7_mutex_lock(&conn->allocator_lock);
+	s7_frame_pool_t* old_pool = conn->frame_pool;
+	if (old_pool != NULL && s7_frame_pool_in_use(old_pool) > 0)
+	{
+		s7_mutex_unlock(&conn->allocator_lock);
+		s7_frame_pool_destroy(pool);
+		return false;
+	}
+	conn->frame_pool = pool;
+	s7_frame_pool_get_allocator(pool, &conn->allocator);
+	s7_mutex_unlock(&conn->allocator_lock);
+
+	s7_frame_pool_destroy(old_pool);
+	return true;
+}
+
+bool s7_conn_get_frame_pool_stats(const s7_conn_t* conn, s7_frame_pool_stats* stats)
+{
+	if (conn == NULL || stats == NULL)
+		return false;
+
+	s7_mutex* lock = (s7_mutex*)&conn->allocator_lock;
+	s7_mutex_lock(lock);
+	bool has_pool = conn->frame_pool != NULL;
+	if (has_pool)
+		s7_frame_pool_get_stats(conn->frame_pool, stats);
+	s7_mutex_unlock(lock);
+	return has_pool;
+}
+
+void s7_conn_release_frame_pool(s7_conn_t* conn)
+{
+	s7_mutex_lock(&conn->allocator_lock);
+	s7_frame_pool_t* pool = conn->frame_pool;
+	if (pool != NULL && conn->allocator.user_data == pool)
+		memset(&conn->allocator, 0, sizeof(conn->allocator));
+	conn->frame_pool = NULL;
+	s7_mutex_unlock(&conn->allocator_lock);
+
+	// Frames still held by the caller or a queued job keep the pool alive until they are released.
+	if (pool != NULL)
+		s7_frame_pool_retire(pool);
+}
@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_ALLOC_H__
+#define __H_SIEMENS_S7_ALLOC_H__
+
+#include <stddef.h>
+#include "siemens_s7_conn.h"
+
+// Memory for request and response frames and the values decoded from them; alloc returns NULL when out of memory
+typedef struct _tag_s7_allocator {
+	void*	(*alloc)(size_t size, void* user_data);
+	void	(*release)(void* block, void* user_data);
+	void*	user_data;
+} s7_allocator;
+
+// Process default for connections without their own allocator; NULL restores malloc/free. Set it before any traffic.
+void s7_set_allocator(const s7_allocator* allocator);
+
+// Frames of this connection come from allocator (NULL: the process default); the allocator must outlive the connection.
+// Safe while the connection's I/O owner is allocating; alloc runs under the connection's allocator lock and must not call back into it.
+void s7_conn_set_allocator(s7_conn_t* conn, const s7_allocator* allocator);
+
+// Fixed-size blocks carved from one region allocated up front; larger requests or an exhausted pool fall back to the heap
+typedef struct _tag_s7_frame_pool s7_frame_pool_t;
+
+typedef struct _tag_s7_frame_pool_stats {
+	int		block_size;		// Largest frame a block holds
+	int		block_count;
+	int		in_use;			// Blocks handed out right now
+	int		high_water;		// Most blocks handed out at the same time
+	int		fallbacks;		// Frames served by the heap because they were too large or the pool was empty
+} s7_frame_pool_stats;
+
+s7_frame_pool_t* s7_frame_pool_create(int block_size, int block_count);
+void s7_frame_pool_destroy(s7_frame_pool_t* pool); //every frame taken from it must have been released
+void s7_frame_pool_get_allocator(s7_frame_pool_t* pool, s7_allocator* allocator);
+void s7_frame_pool_get_stats(s7_frame_pool_t* pool, s7_frame_pool_stats* stats);
+
+// Give the connection its own pool of block_count frames sized for the negotiated PDU (the largest PDU while disconnected).
+// Call it after connecting; it replaces an idle pool of the connection and fails while frames of the old one are in use.
+// Any thread may call it, also while the I/O owner runs jobs: the swap happens under the connection's allocator lock.
+// Heap fallbacks never refer to the pool, and a pool still lending frames when its connection is destroyed is freed
+// by the release of its last frame, so frames may outlive both the pool swap and the connection.
+bool s7_conn_use_frame_pool(s7_conn_t* conn, int block_count);
+bool s7_conn_get_frame_pool_stats(const s7_conn_t* conn, s7_frame_pool_stats* stats); //false without a pool
+
+#endif//__H_SIEMENS_S7_ALLOC_H__
@@ -0,0 +1,206 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_bit_batch.h"
+#include "siemens_helper.h"
+#include "siemens_s7_queue.h"
+#include "socket.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Pending bits of one byte
+typedef struct _tag_s7_bit_batch_byte {
+	siemens_s7_address_data address;	// Bit 0 of the byte
+	byte	mask;						// Bits with a pending write
+	byte	values;						// Their values
+} s7_bit_batch_byte;
+
+struct _tag_s7_bit_batch {
+	s7_mutex			lock;
+	s7_conn_t*			conn;
+	int					deadline_ms;
+	long long			first_pending_at;	// Monotonic ms of the oldest pending write
+	s7_bit_batch_byte*	bytes;				// Bytes in the order they were first touched
+	int					byte_count;
+	int					byte_capacity;
+	int					pending;			// Bits set in all masks
+};
+
+s7_bit_batch_t* s7_bit_batch_create(s7_conn_t* conn, int deadline_ms)
+{
+	if (conn == NULL || deadline_ms < 0)
+		return NULL;
+
+	s7_bit_batch_t* batch = (s7_bit_batch_t*)calloc(1, sizeof(s7_bit_batch_t));
+	if (batch == NULL)
+		return NULL;
+
+	batch->conn = conn;
+	batch->deadline_ms = deadline_ms;
+	s7_mutex_init(&batch->lock);
+	return batch;
+}
+
+void s7_bit_batch_destroy(s7_bit_batch_t* batch)
+{
+	if (batch == NULL)
+		return;
+
+	s7_mutex_destroy(&batch->lock);
+	RELEASE_DATA(batch->bytes);
+	free(batch);
+}
+
+static bool s7_bit_batch_same_byte(const siemens_s7_address_data* a, const siemens_s7_address_data* b)
+{
+	return a->data_code == b->data_code && a->db_block == b->db_block && a->address_start == b->address_start;
+}
+
+static s7_bit_batch_byte* s7_bit_batch_find(s7_bit_batch_t* batch, const siemens_s7_address_data* address)
+{
+	// The newest byte first: a cycle usually sets neighbouring bits one after another.
+	for (int i = batch->byte_count - 1; i >= 0; i--)
+	{
+		if (s7_bit_batch_same_byte(&batch->bytes[i].address, address))
+			return &batch->bytes[i];
+	}
+
+	if (batch->byte_count == batch->byte_capacity)
+	{
+		int capacity = batch->byte_capacity > 0 ? batch->byte_capacity * 2 : 16;
+		s7_bit_batch_byte* bytes = (s7_bit_batch_byte*)realloc(batch->bytes, sizeof(s7_bit_batch_byte) * capacity);
+		if (bytes == NULL)
+			return NULL;
+		batch->bytes = bytes;
+		batch->byte_capacity = capacity;
+	}
+
+	s7_bit_batch_byte* entry = &batch->bytes[batch->byte_count++];
+	memset(entry, 0, sizeof(s7_bit_batch_byte));
+	entry->address = *address;
+	return entry;
+}
+
+// Called with the lock held; pending writes are taken whatever the outcome
+static s7_error_code_e s7_bit_batch_flush(s7_bit_batch_t* batch)
+{
+	int count = batch->pending;
+	if (count == 0)
+		return S7_ERROR_CODE_SUCCESS;
+
+	s7_request_item* items = (s7_request_item*)calloc(count, sizeof(s7_request_item));
+	s7_error_code_e* results = (s7_error_code_e*)malloc(sizeof(s7_error_code_e) * count);
+	byte* values = (byte*)malloc(count);
+	s7_error_code_e ret = S7_ERROR_CODE_MALLOC_FAILED;
+	if (items != NULL && results != NULL && values != NULL)
+	{
+		int n = 0;
+		for (int i = 0; i < batch->byte_count; i++)
+		{
+			const s7_bit_batch_byte* entry = &batch->bytes[i];
+			for (int bit = 0; bit < 8; bit++)
+			{
+				if ((entry->mask & (1 << bit)) == 0)
+					continue;
+				values[n] = (byte)((entry->values >> bit) & 1);
+				items[n].address = entry->address;
+				items[n].address.address_start += bit;
+				items[n].is_bit = true;
+				items[n].data = &values[n];
+				n++;
+			}
+		}
+
+		s7_transfer transfer;
+		ret = s7_transfer_prepare_items(&transfer, batch->conn, items, n, results, true);
+		if (ret == S7_ERROR_CODE_SUCCESS)
+		{
+			if (transfer.batch_count > 0)
+				ret = s7_conn_exchange(batch->conn, transfer.jobs, transfer.batch_count);
+			ret = s7_transfer_complete(&transfer, ret, results, n);
+		}
+	}
+
+	RELEASE_DATA(items);
+	RELEASE_DATA(results);
+	RELEASE_DATA(values);
+	batch->byte_count = 0;
+	batch->pending = 0;
+	return ret;
+}
+
+static bool s7_bit_batch_due(const s7_bit_batch_t* batch)
+{
+	return batch->pending > 0 && batch->deadline_ms > 0 && socket_now_ms() - batch->first_pending_at >= batch->deadline_ms;
+}
+
+s7_error_code_e s7_bit_batch_set(s7_bit_batch_t* batch, const char* address, bool value)
+{
+	if (batch == NULL || address == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	siemens_s7_address_data bit_address;
+	if (!s7_analysis_address(address, 1, &bit_address))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+	if (bit_address.data_code == 0x1C || bit_address.data_code == 0x1D || bit_address.data_code == 0x1E || bit_address.data_code == 0x1F)
+		return S7_ERROR_CODE_ERROR_0006;
+
+	int bit = bit_address.address_start % 8;
+	bit_address.address_start -= bit;
+
+	s7_mutex_lock(&batch->lock);
+	s7_bit_batch_byte* entry = s7_bit_batch_find(batch, &bit_address);
+	if (entry == NULL)
+	{
+		s7_mutex_unlock(&batch->lock);
+		return S7_ERROR_CODE_MALLOC_FAILED;
+	}
+
+	if (batch->pending == 0)
+		batch->first_pending_at = socket_now_ms();
+	if ((entry->mask & (1 << bit)) == 0)
+		batch->pending++;
+	entry->mask |= (byte)(1 << bit);
+	entry->values = (byte)(value ? entry->values | (1 << bit) : entry->values & ~(1 << bit));
+
+	s7_error_code_e ret = s7_bit_batch_due(batch) ? s7_bit_batch_flush(batch) : S7_ERROR_CODE_SUCCESS;
+	s7_mutex_unlock(&batch->lock);
+	return ret;
+}
+
+s7_error_code_e s7_bit_batch_poll(s7_bit_batch_t* batch)
+{
+	if (batch == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_mutex_lock(&batch->lock);
+	s7_error_code_e ret = s7_bit_batch_due(batch) ? s7_bit_batch_flush(batch) : S7_ERROR_CODE_SUCCESS;
+	s7_mutex_unlock(&batch->lock);
+	return ret;
+}
+
+s7_error_code_e s7_bit_batch_commit(s7_bit_batch_t* batch)
+{
+	if (batch == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_mutex_lock(&batch->lock);
+	s7_error_code_e ret = s7_bit_batch_flush(batch);
+	s7_mutex_unlock(&batch->lock);
+	return ret;
+}
+
+int s7_bit_batch_get_pending(s7_bit_batch_t* batch)
+{
+	if (batch == NULL)
+		return 0;
+
+	s7_mutex_lock(&batch->lock);
+	int pending = batch->pending;
+	s7_mutex_unlock(&batch->lock);
+	return pending;
+}
@@ -0,0 +1,28 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_BIT_BATCH_H__
+#define __H_SIEMENS_S7_BIT_BATCH_H__
+
+#include "siemens_s7_conn.h"
+
+// Pending bit writes of one cycle, sent together as bit items of as few Write Var frames as the PDU allows.
+// Every bit is written on its own, so bits of the same byte the PLC changes in the meantime are never overwritten.
+typedef struct _tag_s7_bit_batch s7_bit_batch_t;
+
+// deadline_ms is the longest the first pending write may wait before the next set or poll flushes it; 0 waits for a commit
+s7_bit_batch_t* s7_bit_batch_create(s7_conn_t* conn, int deadline_ms);
+void s7_bit_batch_destroy(s7_bit_batch_t* batch); //pending writes are dropped
+
+// Queue a bit write ("M10.3", "DB1.DBX2.5"); a later value for the same bit replaces the earlier one.
+// Returns the flush result when the deadline has passed, S7_ERROR_CODE_SUCCESS otherwise.
+s7_error_code_e s7_bit_batch_set(s7_bit_batch_t* batch, const char* address, bool value);
+s7_error_code_e s7_bit_batch_poll(s7_bit_batch_t* batch); //flush if the deadline has passed
+s7_error_code_e s7_bit_batch_commit(s7_bit_batch_t* batch); //flush now; pending writes are cleared even on failure
+int s7_bit_batch_get_pending(s7_bit_batch_t* batch); //bits waiting to be written
+
+#endif//__H_SIEMENS_S7_BIT_BATCH_H__
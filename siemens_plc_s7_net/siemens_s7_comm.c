@@ -6,89 +6,96 @@
  */
 
 #include "siemens_s7_comm.h"
-#include <ctype.h>
-#include <stdlib.h>
-#include <string.h>
+#include <limits.h>
 
 /// <summary>
-/// Validate whether a text segment is a pure decimal number.
+/// Accumulate the decimal number at *text and advance past it.
 /// </summary>
-/// <param name="text">Input text segment.</param>
-/// <returns>True if all characters are decimal digits; otherwise false.</returns>
-static bool is_decimal_text(const char* text)
+/// <param name="text">Cursor into the address, moved behind the last digit on success.</param>
+/// <param name="max">Largest accepted value.</param>
+/// <param name="value">Parsed number.</param>
+/// <returns>True if at least one digit was read and the number does not exceed max; otherwise false.</returns>
+static bool s7_parse_decimal(const char** text, int max, int* value)
 {
-	// Address segments are numeric-only; reject mixed tokens early to avoid silent truncation.
-	if (text == NULL || text[0] == '\0')
+	const char* cursor = *text;
+	int result = 0;
+	if (*cursor < '0' || *cursor > '9')
 		return false;
 
-	for (int i = 0; text[i] != '\0'; ++i)
+	for (; *cursor >= '0' && *cursor <= '9'; cursor++)
 	{
-		if (!isdigit((unsigned char)text[i]))
+		// Reject instead of wrapping: a huge offset must not alias a small one.
+		int digit = *cursor - '0';
+		if (digit > max || result > (max - digit) / 10)
 			return false;
+		result = result * 10 + digit;
 	}
 
+	*text = cursor;
+	*value = result;
 	return true;
 }
 
-static bool calculate_address_started(const char* address, bool isCT, int* ret_count)
+// "byte" or "byte.bit" (bit 0-7) running to the end of the text, as a bit offset; timers and counters take a plain number
+static bool s7_parse_offset(const char* text, bool is_counter_timer, int* address_start)
 {
-	if (address == NULL || ret_count == NULL)
+	int index = 0;
+	if (!s7_parse_decimal(&text, is_counter_timer ? INT_MAX : INT_MAX / 8, &index))
 		return false;
 
-	int addr_len = strlen(address);
-	if (addr_len <= 0)
-		return false;
-
-	const char* dot = strchr(address, '.');
-	if (dot == NULL)
+	if (*text == '\0')
 	{
-		if (!is_decimal_text(address))
-			return false;
-
-		*ret_count = isCT ? str_to_int(address) : str_to_int(address) * 8;
+		*address_start = is_counter_timer ? index : index * 8;
+		return true;
 	}
-	else
-	{
-		// Bit-address form must be exactly "byte.bit" and bit must stay within 0-7.
-		if (isCT || dot == address || dot[1] == '\0' || strchr(dot + 1, '.') != NULL)
-			return false;
 
-		int byte_index_len = (int)(dot - address);
-		char* byte_index_text = (char*)malloc((size_t)byte_index_len + 1);
-		if (byte_index_text == NULL)
-		{
-			return false;
-		}
-
-		memcpy(byte_index_text, address, (size_t)byte_index_len);
-		byte_index_text[byte_index_len] = '\0';
+	int bit = 0;
+	if (is_counter_timer || *text != '.')
+		return false;
+	text++;
+	if (!s7_parse_decimal(&text, 7, &bit) || *text != '\0')
+		return false;
 
-		if (!is_decimal_text(byte_index_text) || !is_decimal_text(dot + 1))
-		{
-			free(byte_index_text);
-			return false;
-		}
+	*address_start = index * 8 + bit;
+	return true;
+}
 
-		int bit_index = str_to_int(dot + 1);
-		if (bit_index < 0 || bit_index > 7)
-		{
-			free(byte_index_text);
-			return false;
-		}
+// ASCII-only case folding; address letters must not depend on the C locale
+static char s7_upper(char c)
+{
+	return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
 
-		*ret_count = str_to_int(byte_index_text) * 8 + bit_index;
-		free(byte_index_text);
-	}
-	return true;
+static bool s7_is_width_letter(char c)
+{
+	c = s7_upper(c);
+	return c == 'X' || c == 'B' || c == 'W' || c == 'D';
 }
 
-bool s7_analysis_address(const char* address, int length, siemens_s7_address_data* address_data)
+// "DB1", "DB1.DBX0.1", "DB1.DBD70", "D1.2": the block number, then an optional DBX/DBB/DBW/DBD-prefixed offset
+static bool s7_parse_db(const char* text, siemens_s7_address_data* address_data)
 {
-	if (address == NULL || length <= 0 || address_data == NULL)
+	int block = 0;
+	if (s7_upper(*text) == 'B')
+		text++;
+	if (!s7_parse_decimal(&text, USHRT_MAX, &block))
 		return false;
 
-	int address_len = (int)strlen(address);
-	if (address_len <= 0)
+	address_data->db_block = (ushort)block;
+	if (*text == '\0')
+		return true;
+	if (*text != '.')
+		return false;
+
+	text++;
+	if (s7_upper(text[0]) == 'D' && s7_upper(text[1]) == 'B' && s7_is_width_letter(text[2]))
+		text += 3;
+	return s7_parse_offset(text, false, &address_data->address_start);
+}
+
+bool s7_analysis_address(const char* address, int length, siemens_s7_address_data* address_data)
+{
+	if (address == NULL || length <= 0 || address_data == NULL || address[0] == '\0')
 		return false;
 
 	address_data->length = length;
@@ -96,134 +103,48 @@ bool s7_analysis_address(const char* address, int length, siemens_s7_address_dat
 	address_data->db_block = 0;
 	address_data->address_start = 0;
 
-	char* normalized = (char*)malloc((size_t)address_len + 1);
-	if (normalized == NULL)
-		return false;
-
-	memcpy(normalized, address, (size_t)address_len + 1);
-	// Parse on a normalized uppercase copy so all edge-case validation uses one code path.
-	str_toupper(normalized);
-
-	bool matched = true;
-	int prefix_len = 0;
+	// One pass, no copy: the area letter picks the grammar, letters are matched case-insensitively in place.
+	const char* text = address + 1;
 	bool is_counter_timer = false;
-
-	if (strncmp(normalized, "AI", 2) == 0) {
-		address_data->data_code = 0x06;
-		prefix_len = 2;
-	}
-	else if (strncmp(normalized, "AQ", 2) == 0) {
-		address_data->data_code = 0x07;
-		prefix_len = 2;
-	}
-	else if (strncmp(normalized, "DB", 2) == 0) {
-		address_data->data_code = 0x84;
-		prefix_len = 2;
-	}
-	else if (strncmp(normalized, "I", 1) == 0) {
+	switch (s7_upper(address[0]))
+	{
+	case 'A':
+		if (s7_upper(*text) == 'I')
+			address_data->data_code = 0x06;
+		else if (s7_upper(*text) == 'Q')
+			address_data->data_code = 0x07;
+		else
+			return false;
+		text++;
+		break;
+	case 'I':
 		address_data->data_code = 0x81;
-		prefix_len = 1;
-	}
-	else if (strncmp(normalized, "Q", 1) == 0) {
+		break;
+	case 'Q':
 		address_data->data_code = 0x82;
-		prefix_len = 1;
-	}
-	else if (strncmp(normalized, "M", 1) == 0) {
+		break;
+	case 'M':
 		address_data->data_code = 0x83;
-		prefix_len = 1;
-	}
-	else if (strncmp(normalized, "D", 1) == 0) {
+		break;
+	case 'V':
 		address_data->data_code = 0x84;
-		prefix_len = 1;
-	}
-	else if (strncmp(normalized, "T", 1) == 0) {
+		break;
+	case 'D':
+		address_data->data_code = 0x84;
+		return s7_parse_db(text, address_data);
+	case 'T':
 		address_data->data_code = 0x1F;
-		prefix_len = 1;
 		is_counter_timer = true;
-	}
-	else if (strncmp(normalized, "C", 1) == 0) {
+		break;
+	case 'C':
 		address_data->data_code = 0x1E;
-		prefix_len = 1;
 		is_counter_timer = true;
-	}
-	else if (strncmp(normalized, "V", 1) == 0) {
-		address_data->data_code = 0x84;
-		prefix_len = 1;
-	}
-	else {
-		matched = false;
-	}
-
-	if (matched && address_data->data_code == 0x84 && (prefix_len == 1 || prefix_len == 2) && (normalized[0] == 'D'))
-	{
-		// DB addresses carry both block number and optional DBX/DBB/DBW/DBD suffix.
-		char* dot = strchr(normalized, '.');
-		char* data_part = NULL;
-		char saved = '\0';
-
-		if (dot != NULL) {
-			saved = *dot;
-			*dot = '\0';
-			data_part = dot + 1;
-		}
-
-		if (!is_decimal_text(normalized + prefix_len)) {
-			matched = false;
-		}
-		else {
-			address_data->db_block = str_to_int(normalized + prefix_len);
-		}
-
-		if (dot != NULL) {
-			*dot = saved;
-			if (matched) {
-				if (strncmp(data_part, "DBX", 3) == 0 ||
-					strncmp(data_part, "DBB", 3) == 0 ||
-					strncmp(data_part, "DBW", 3) == 0 ||
-					strncmp(data_part, "DBD", 3) == 0) {
-					data_part += 3;
-				}
-
-				if (!calculate_address_started(data_part, false, &address_data->address_start)) {
-					matched = false;
-				}
-			}
-		}
-	}
-	else if (matched)
-	{
-		if ((strncmp(normalized, "AIX", 3) == 0) ||
-			(strncmp(normalized, "AIB", 3) == 0) ||
-			(strncmp(normalized, "AIW", 3) == 0) ||
-			(strncmp(normalized, "AID", 3) == 0) ||
-			(strncmp(normalized, "AQX", 3) == 0) ||
-			(strncmp(normalized, "AQB", 3) == 0) ||
-			(strncmp(normalized, "AQW", 3) == 0) ||
-			(strncmp(normalized, "AQD", 3) == 0) ||
-			(strncmp(normalized, "IX", 2) == 0) ||
-			(strncmp(normalized, "IB", 2) == 0) ||
-			(strncmp(normalized, "IW", 2) == 0) ||
-			(strncmp(normalized, "ID", 2) == 0) ||
-			(strncmp(normalized, "QX", 2) == 0) ||
-			(strncmp(normalized, "QB", 2) == 0) ||
-			(strncmp(normalized, "QW", 2) == 0) ||
-			(strncmp(normalized, "QD", 2) == 0) ||
-			(strncmp(normalized, "MX", 2) == 0) ||
-			(strncmp(normalized, "MB", 2) == 0) ||
-			(strncmp(normalized, "MW", 2) == 0) ||
-			(strncmp(normalized, "MD", 2) == 0) ||
-			(strncmp(normalized, "VX", 2) == 0) ||
-			(strncmp(normalized, "VB", 2) == 0) ||
-			(strncmp(normalized, "VW", 2) == 0) ||
-			(strncmp(normalized, "VD", 2) == 0)) {
-			prefix_len++;
-		}
-
-		if (!calculate_address_started(normalized + prefix_len, is_counter_timer, &address_data->address_start)) {
-			matched = false;
-		}
+		break;
+	default:
+		return false;
 	}
 
-	free(normalized);
-	return matched;
-}
\ No newline at end of file
+	if (!is_counter_timer && s7_is_width_letter(*text))
+		text++;
+	return s7_parse_offset(text, is_counter_timer, &address_data->address_start);
+}
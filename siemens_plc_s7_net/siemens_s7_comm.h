@@ -8,11 +8,74 @@
 #ifndef __H_SIEMENS_S7_COMM_H__
 #define __H_SIEMENS_S7_COMM_H__
 #include "utill.h"
+#include "siemens_s7_alloc.h"
 
 #define MAX_RETRY_TIMES 3				// Maximum retry count
 #define MIN_HEADER_SIZE 21				// Defined by protocol specification
 #define BUFFER_SIZE 1024
 
+#define S7_DEFAULT_PDU_SIZE 240			// Smallest PDU every S7 CPU accepts
+#define S7_CONNECT_PDU_SIZE 480			// PDU size requested by default in Setup Communication
+#define S7_MAX_PDU_SIZE 960				// Largest PDU offered by S7 CPUs (S7-1500)
+#define S7_REQUEST_HEADER_SIZE 12		// S7 header(10) + function + item count
+#define S7_RESPONSE_HEADER_SIZE 14		// S7 ack header(12) + function + item count
+#define S7_ITEM_SPEC_SIZE 12			// ANY pointer item in a Read/Write Var request
+#define S7_ITEM_DATA_HEADER_SIZE 4		// Return code + transport size + length
+#define S7_RX_BUFFER_SIZE 4096			// Receive buffer per connection, four full-size responses
+#define S7_TPKT_MIN_SIZE 7				// TPKT header(4) + COTP data header(3)
+#define S7_MAX_RESPONSE_SIZE (S7_TPKT_MIN_SIZE + S7_MAX_PDU_SIZE)	// Largest frame a PLC answers within the biggest PDU
+#define S7_READ_REQUEST_SIZE 31			// Single-item Read Var request: header(19) + item(12)
+#define S7_WRITE_HEADER_SIZE 35			// Single-item Write Var request up to its data: header(19) + item(12) + data header(4)
+#define S7_SEND_GATHER_PARTS 64			// Buffers handed to one gather write of the pipelined exchange
+
+// Threads, locks and atomics of the library, implemented in siemens_s7_queue.c
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+typedef SRWLOCK s7_mutex;
+typedef CONDITION_VARIABLE s7_cond;
+typedef struct _tag_s7_thread { HANDLE handle; DWORD id; } s7_thread;
+#define S7_MUTEX_INITIALIZER SRWLOCK_INIT
+#define S7_THREAD_LOCAL __declspec(thread)
+#define s7_atomic_exchange_ptr(target, value) InterlockedExchangePointer((PVOID volatile*)(target), (value))
+#define s7_atomic_load_ptr(source) (*(void* volatile*)(source))
+#define s7_atomic_store_ptr(target, value) (*(void* volatile*)(target) = (value))
+#define s7_atomic_load_long(source) InterlockedCompareExchange((LONG volatile*)(source), 0, 0)
+#define s7_atomic_store_long(target, value) InterlockedExchange((LONG volatile*)(target), (value))
+#define s7_atomic_exchange_long(target, value) InterlockedExchange((LONG volatile*)(target), (value))
+#define s7_atomic_add_long(target, value) InterlockedExchangeAdd((LONG volatile*)(target), (value))
+#else
+#include <pthread.h>
+typedef pthread_mutex_t s7_mutex;
+typedef pthread_cond_t s7_cond;
+typedef struct _tag_s7_thread { pthread_t handle; } s7_thread;
+#define S7_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define S7_THREAD_LOCAL __thread
+#define s7_atomic_exchange_ptr(target, value) __atomic_exchange_n((target), (value), __ATOMIC_ACQ_REL)
+#define s7_atomic_load_ptr(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define s7_atomic_store_ptr(target, value) __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#define s7_atomic_load_long(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define s7_atomic_store_long(target, value) __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#define s7_atomic_exchange_long(target, value) __atomic_exchange_n((target), (value), __ATOMIC_ACQ_REL)
+#define s7_atomic_add_long(target, value) __atomic_fetch_add((target), (value), __ATOMIC_ACQ_REL)
+#endif
+
+void s7_mutex_init(s7_mutex* mutex);
+void s7_mutex_destroy(s7_mutex* mutex);
+void s7_mutex_lock(s7_mutex* mutex);
+void s7_mutex_unlock(s7_mutex* mutex);
+
+void s7_cond_init(s7_cond* cond);
+void s7_cond_destroy(s7_cond* cond);
+void s7_cond_wait(s7_cond* cond, s7_mutex* mutex);
+bool s7_cond_timedwait(s7_cond* cond, s7_mutex* mutex, int timeout_ms); //false on timeout
+void s7_cond_signal(s7_cond* cond);
+void s7_cond_broadcast(s7_cond* cond);
+
+bool s7_thread_start(s7_thread* thread, void (*entry)(void*), void* arg);
+void s7_thread_join(s7_thread* thread);
+void s7_thread_detach(s7_thread* thread); //the thread releases itself when it ends, nobody joins it
+
 typedef struct _tag_siemens_s7_address_data {
 	byte	data_code;			// Data type code
 	ushort	db_block;			// PLC DB block number
@@ -20,6 +83,48 @@ typedef struct _tag_siemens_s7_address_data {
 	int		length;				// Data length to read
 }siemens_s7_address_data;
 
+typedef struct _tag_s7_request_item {
+	siemens_s7_address_data	address;	// Parsed PLC address
+	bool	is_bit;						// Access a single bit instead of a byte range
+	byte*	data;						// Read destination or write source, address.length bytes
+}s7_request_item;
+
+// Bytes received on a connection but not handed out yet; TPKT frames are parsed in place
+typedef struct _tag_s7_rx_buffer {
+	int		start;						// First byte of the next frame
+	int		end;						// One past the last received byte
+	byte	data[S7_RX_BUFFER_SIZE];
+} s7_rx_buffer;
+
+struct _tag_s7_conn {
+	int		fd;							// Socket, -1 while disconnected
+	siemens_plc_types_e plc;			// PLC family the handshake frames were built for
+	char	ip_address[64];				// Address of the last connect
+	int		port;
+	byte	plc_rack;
+	byte	plc_slot;
+	byte	head1[22];					// COTP connection request
+	byte	head2[25];					// Setup Communication request, before connect options
+	byte	setup[25];					// Setup Communication request of the last connect, replayed on reconnect
+	int		pdu_size;					// Negotiated S7 PDU size in bytes
+	int		max_amq_calling;			// Negotiated parallel jobs, calling side
+	int		max_amq_called;				// Negotiated parallel jobs, called side
+	ushort	pdu_reference;				// Last PDU reference sent on this connection
+	bool	legacy_owned;				// Opened by s7_connect() and released by s7_disconnect()
+	struct _tag_s7_conn_io* io;			// I/O owner while the connection is shared, NULL otherwise
+	s7_rx_buffer rx;					// Used by whoever does the connection's blocking I/O
+	s7_mutex allocator_lock;			// Guards allocator and frame_pool against the I/O owner allocating frames
+	s7_allocator allocator;				// Frames of this connection, the process default while alloc is NULL
+	struct _tag_s7_frame_pool* frame_pool;	// Owned pool behind allocator, see s7_conn_use_frame_pool()
+};
+
 bool s7_analysis_address(const char* address, int length, siemens_s7_address_data* address_data);
 
+void s7_conn_init(s7_conn_t* conn, siemens_plc_types_e plc);
+s7_conn_t* s7_conn_create_from(const s7_conn_t* settings);
+s7_conn_t* s7_conn_find(int fd);
+s7_conn_t* s7_conn_from_fd(int fd);
+bool s7_conn_restore(s7_conn_t* conn);
+void s7_conn_release_frame_pool(s7_conn_t* conn);
+
 #endif//__H_SIEMENS_S7_COMM_H__
\ No newline at end of file
@@ -0,0 +1,691 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_conn.h"
+#include "siemens_s7_queue.h"
+#include "socket.h"
+#include <string.h>
+#include <stdlib.h>
+
+//private byte[] plcHead1 = "03 00 00 16 11 E0 00 00 00 02 00 C1 02 01 00 C2 02 01 02 C0 01 0A".ToHexBytes( );
+//private byte[] plcHead2 = "03 00 00 19 02 F0 80 32 01 00 00 02 00 00 08 00 00 F0 00 00 01 00 01 01 E0".ToHexBytes( );
+#define S7_CONNECT_TIMEOUT 5000	// Same as the blocking TCP connect and socket timeouts
+
+static const byte g_plc_head1[22] =
+{
+	0x03,0x00,0x00,0x16,0x11,0xE0,0x00,0x00,0x00,0x01,
+	0x00,0xC0,0x01,0x0A,0xC1,0x02,0x01,0x02,0xC2,0x02,
+	0x01,0x00
+};
+static const byte g_plc_head2[25] =
+{
+	0x03,0x00,0x00,0x19,0x02,0xF0,0x80,0x32,0x01,0x00,
+	0x00,0x04,0x00,0x00,0x08,0x00,0x00,0xF0,0x00,0x00,
+	0x01,0x00,0x01,0x01,0xE0
+};
+
+static const byte g_plc_head1_200smart[22] =
+{
+	0x03,0x00,0x00,0x16,0x11,0xE0,0x00,0x00,0x00,0x01,
+	0x00,0xC1,0x02,0x10,0x00,0xC2,0x02,0x03,0x00,0xC0,
+	0x01,0x0A
+};
+
+static const byte g_plc_head2_200smart[25] =
+{
+	0x03,0x00,0x00,0x19,0x02,0xF0,0x80,0x32,0x01,0x00,
+	0x00,0xCC,0xC1,0x00,0x08,0x00,0x00,0xF0,0x00,
+	0x00,0x01,0x00,0x01,0x03,0xC0
+};
+
+static const byte g_plc_head1_200[22] =
+{
+	0x03,0x00,0x00,0x16,0x11,0xE0,0x00,0x00,0x00,0x01,
+	0x00,0xC1,0x02,0x4D,0x57,0xC2,0x02,0x4D,0x57,0xC0,
+	0x01,0x09
+};
+
+static const byte g_plc_head2_200[25] =
+{
+	0x03,0x00,0x00,0x19,0x02,0xF0,0x80,0x32,0x01,0x00,
+	0x00,0x00,0x00,0x00,0x08,0x00,0x00,0xF0,0x00,0x00,
+	0x01,0x00,0x01,0x03,0xC0
+};
+
+static s7_conn_t** g_conn_registry = NULL;	// Connected contexts, looked up by socket
+static int g_conn_registry_count = 0;
+static int g_conn_registry_capacity = 0;
+static s7_mutex g_conn_registry_lock = S7_MUTEX_INITIALIZER;
+static S7_THREAD_LOCAL s7_conn_t g_unregistered_conn;	// Context for sockets not opened through this library
+static S7_THREAD_LOCAL bool g_unregistered_conn_ready = false;
+
+static bool s7_conn_is_s200(const s7_conn_t* conn)
+{
+	return conn->plc == S200 || conn->plc == S200Smart;
+}
+
+static void s7_conn_reset_negotiated(s7_conn_t* conn)
+{
+	conn->pdu_size = S7_DEFAULT_PDU_SIZE;
+	conn->max_amq_calling = 1;
+	conn->max_amq_called = 1;
+}
+
+void s7_conn_init(s7_conn_t* conn, siemens_plc_types_e plc)
+{
+	memset(conn, 0, sizeof(s7_conn_t));
+	s7_mutex_init(&conn->allocator_lock);
+	conn->fd = -1;
+	conn->plc = plc;
+	s7_conn_reset_negotiated(conn);
+
+	switch (plc)
+	{
+	case S200Smart:
+		memcpy(conn->head1, g_plc_head1_200smart, sizeof(conn->head1));
+		memcpy(conn->head2, g_plc_head2_200smart, sizeof(conn->head2));
+		return;
+
+	case S200:
+		memcpy(conn->head1, g_plc_head1_200, sizeof(conn->head1));
+		memcpy(conn->head2, g_plc_head2_200, sizeof(conn->head2));
+		return;
+
+	default:
+		memcpy(conn->head1, g_plc_head1, sizeof(conn->head1));
+		memcpy(conn->head2, g_plc_head2, sizeof(conn->head2));
+		break;
+	}
+
+	switch (plc)
+	{
+	case S1200:
+	case S1500:
+		conn->head1[21] = 0;
+		break;
+
+	case S300:
+		conn->head1[21] = 2;
+		break;
+
+	case S400:
+		conn->head1[21] = 3;
+		conn->head1[17] = 0x00;
+		break;
+
+	default:
+		conn->head1[18] = 0;
+		break;
+	}
+}
+
+s7_conn_t* s7_conn_create(siemens_plc_types_e plc)
+{
+	s7_conn_t* conn = (s7_conn_t*)malloc(sizeof(s7_conn_t));
+	if (conn != NULL)
+		s7_conn_init(conn, plc);
+	return conn;
+}
+
+// New disconnected context carrying the handshake settings of another one
+s7_conn_t* s7_conn_create_from(const s7_conn_t* settings)
+{
+	s7_conn_t* conn = s7_conn_create(settings->plc);
+	if (conn == NULL)
+		return NULL;
+
+	conn->plc_rack = settings->plc_rack;
+	conn->plc_slot = settings->plc_slot;
+	memcpy(conn->head1, settings->head1, sizeof(conn->head1));
+	memcpy(conn->head2, settings->head2, sizeof(conn->head2));
+	// A pool belongs to the connection that made it; other allocators are shared.
+	if (settings->frame_pool == NULL)
+		conn->allocator = settings->allocator;
+	return conn;
+}
+
+void s7_conn_destroy(s7_conn_t* conn)
+{
+	if (conn == NULL)
+		return;
+
+	s7_conn_disconnect(conn);
+	// Destroyed from a callback on its own I/O thread, which still runs the batch that called it.
+	if (s7_conn_io_defer_destroy(conn))
+		return;
+	s7_conn_release_frame_pool(conn);
+	s7_mutex_destroy(&conn->allocator_lock);
+	free(conn);
+}
+
+static bool s7_conn_register(s7_conn_t* conn)
+{
+	bool is_ok = true;
+	s7_mutex_lock(&g_conn_registry_lock);
+	if (g_conn_registry_count == g_conn_registry_capacity)
+	{
+		int capacity = g_conn_registry_capacity > 0 ? g_conn_registry_capacity * 2 : 16;
+		s7_conn_t** registry = (s7_conn_t**)realloc(g_conn_registry, sizeof(s7_conn_t*) * capacity);
+		if (registry != NULL)
+		{
+			g_conn_registry = registry;
+			g_conn_registry_capacity = capacity;
+		}
+		else
+			is_ok = false;
+	}
+	if (is_ok)
+		g_conn_registry[g_conn_registry_count++] = conn;
+	s7_mutex_unlock(&g_conn_registry_lock);
+	return is_ok;
+}
+
+static void s7_conn_unregister(s7_conn_t* conn)
+{
+	s7_mutex_lock(&g_conn_registry_lock);
+	for (int i = 0; i < g_conn_registry_count; i++)
+	{
+		if (g_conn_registry[i] == conn)
+		{
+			g_conn_registry[i] = g_conn_registry[--g_conn_registry_count];
+			break;
+		}
+	}
+	s7_mutex_unlock(&g_conn_registry_lock);
+}
+
+s7_conn_t* s7_conn_find(int fd)
+{
+	s7_conn_t* conn = NULL;
+	s7_mutex_lock(&g_conn_registry_lock);
+	for (int i = 0; fd >= 0 && i < g_conn_registry_count && conn == NULL; i++)
+	{
+		if (g_conn_registry[i]->fd == fd)
+			conn = g_conn_registry[i];
+	}
+	s7_mutex_unlock(&g_conn_registry_lock);
+	return conn;
+}
+
+// Sockets opened elsewhere get the smallest PDU and a single job, which every S7 CPU accepts.
+s7_conn_t* s7_conn_from_fd(int fd)
+{
+	s7_conn_t* conn = s7_conn_find(fd);
+	if (conn != NULL)
+		return conn;
+
+	if (!g_unregistered_conn_ready)
+	{
+		s7_mutex_init(&g_unregistered_conn.allocator_lock);
+		g_unregistered_conn_ready = true;
+	}
+	if (g_unregistered_conn.fd != fd)
+		s7_rx_reset(&g_unregistered_conn.rx);
+	g_unregistered_conn.fd = fd;
+	s7_conn_reset_negotiated(&g_unregistered_conn);
+	return &g_unregistered_conn;
+}
+
+// Setup Communication request parameters: AmQ calling, AmQ called, PDU size; zero fields keep the default
+static void s7_conn_apply_options(byte* setup, const s7_connect_options* options)
+{
+	if (options == NULL)
+		return;
+
+	if (options->max_amq_calling > 0)
+	{
+		int value = options->max_amq_calling > 0xFFFF ? 0xFFFF : options->max_amq_calling;
+		setup[19] = (byte)(value / 256);
+		setup[20] = (byte)(value % 256);
+	}
+	if (options->max_amq_called > 0)
+	{
+		int value = options->max_amq_called > 0xFFFF ? 0xFFFF : options->max_amq_called;
+		setup[21] = (byte)(value / 256);
+		setup[22] = (byte)(value % 256);
+	}
+	if (options->pdu_size > 0)
+	{
+		int value = options->pdu_size;
+		if (value < S7_DEFAULT_PDU_SIZE) value = S7_DEFAULT_PDU_SIZE;
+		if (value > S7_MAX_PDU_SIZE) value = S7_MAX_PDU_SIZE;
+		setup[23] = (byte)(value / 256);
+		setup[24] = (byte)(value % 256);
+	}
+}
+
+// Setup Communication ack parameters: F0 00, AmQ calling, AmQ called, PDU size.
+static bool s7_conn_accept_setup(s7_conn_t* conn, const byte* setup, const byte* ack, int ack_length)
+{
+	if (ack_length < 27 || ack[8] != 0x03 || ack[17] != 0x00 || ack[18] != 0x00 || ack[19] != 0xF0)
+		return false;
+
+	// The PLC may only lower the requested values; never trust it to raise them.
+	int max_amq_calling = ack[21] * 256 + ack[22];
+	int max_amq_called = ack[23] * 256 + ack[24];
+	int pdu_size = ack[25] * 256 + ack[26];
+
+	int requested_calling = setup[19] * 256 + setup[20];
+	int requested_called = setup[21] * 256 + setup[22];
+	int requested_pdu = setup[23] * 256 + setup[24];
+	if (max_amq_calling < 1 || max_amq_called < 1 || s7_read_chunk_size(pdu_size) <= 0)
+		return false;
+
+	conn->max_amq_calling = max_amq_calling < requested_calling ? max_amq_calling : requested_calling;
+	conn->max_amq_called = max_amq_called < requested_called ? max_amq_called : requested_called;
+	conn->pdu_size = pdu_size < requested_pdu ? pdu_size : requested_pdu;
+	return true;
+}
+
+// Send one handshake frame and receive its answer as a view into the receive buffer
+static bool s7_conn_handshake_step(s7_conn_t* conn, int fd, byte* request, int length, byte_array_info* response)
+{
+	return socket_send_data(fd, request, length) == length &&
+		s7_rx_next_frame(fd, &conn->rx, response) == S7_ERROR_CODE_SUCCESS && response->length >= MIN_HEADER_SIZE;
+}
+
+static bool s7_conn_handshake(s7_conn_t* conn, int fd, byte* setup, int setup_length)
+{
+	byte_array_info ret = { 0 };
+
+	// Whatever the previous socket left in the buffer has nothing to do with this one.
+	s7_rx_reset(&conn->rx);
+
+	// First handshake.
+	if (!s7_conn_handshake_step(conn, fd, conn->head1, sizeof(conn->head1), &ret))
+		return false;
+
+	// Second handshake.
+	if (!s7_conn_handshake_step(conn, fd, setup, setup_length, &ret))
+		return false;
+
+	return s7_conn_accept_setup(conn, setup, ret.data, ret.length);
+}
+
+// Remember where the connection goes and build its Setup Communication request
+static void s7_conn_prepare(s7_conn_t* conn, const char* ip_addr, int port, const s7_connect_options* options, byte* setup)
+{
+	strncpy(conn->ip_address, ip_addr, sizeof(conn->ip_address) - 1);
+	conn->ip_address[sizeof(conn->ip_address) - 1] = '\0';
+	conn->port = port;
+
+	// Options only shape this handshake; a later connect without them requests the defaults again.
+	memcpy(setup, conn->head2, sizeof(conn->head2));
+	s7_conn_apply_options(setup, options);
+	memcpy(conn->setup, setup, sizeof(conn->setup));
+}
+
+// The handshake succeeded: the socket becomes the connection's, or is closed when it cannot be registered
+static bool s7_conn_attach(s7_conn_t* conn, int fd)
+{
+	s7_rx_reset(&conn->rx);
+	conn->fd = fd;
+	if (!s7_conn_register(conn))
+	{
+		conn->fd = -1;
+		s7_conn_reset_negotiated(conn);
+		socket_close_tcp_socket(fd);
+		return false;
+	}
+	return true;
+}
+
+bool s7_conn_connect(s7_conn_t* conn, const char* ip_addr, int port, const s7_connect_options* options)
+{
+	if (conn == NULL || ip_addr == NULL)
+		return false;
+
+	s7_conn_disconnect(conn);
+	byte setup[sizeof(conn->head2)];
+	s7_conn_prepare(conn, ip_addr, port, options, setup);
+
+	int fd = socket_open_tcp_client_socket(conn->ip_address, (short)port);
+	if (fd < 0)
+		return false;
+
+	if (!s7_conn_handshake(conn, fd, setup, sizeof(setup)))
+	{
+		s7_conn_reset_negotiated(conn);
+		socket_close_tcp_socket(fd);
+		return false;
+	}
+	return s7_conn_attach(conn, fd);
+}
+
+bool s7_conn_disconnect(s7_conn_t* conn)
+{
+	if (conn == NULL)
+		return false;
+
+	s7_conn_stop_io(conn);
+	if (conn->fd >= 0)
+	{
+		s7_conn_unregister(conn);
+		socket_close_tcp_socket(conn->fd);
+		conn->fd = -1;
+	}
+	s7_conn_reset_negotiated(conn);
+	s7_rx_reset(&conn->rx);
+	return true;
+}
+
+// Replay the stored handshake on a fresh socket that takes over the descriptor of the dropped one.
+// Runs on the I/O owner while the connection is offline, so nobody else touches the socket.
+bool s7_conn_restore(s7_conn_t* conn)
+{
+	int fd = socket_open_tcp_client_socket(conn->ip_address, (short)conn->port);
+	if (fd < 0)
+		return false;
+
+	if (!s7_conn_handshake(conn, fd, conn->setup, sizeof(conn->setup)))
+	{
+		socket_close_tcp_socket(fd);
+		return false;
+	}
+
+	int replaced = socket_replace_tcp_socket(conn->fd, fd);
+	if (replaced < 0)
+		return false;
+	if (replaced != conn->fd)
+	{
+		s7_mutex_lock(&g_conn_registry_lock);
+		conn->fd = replaced;
+		s7_mutex_unlock(&g_conn_registry_lock);
+	}
+	return true;
+}
+
+typedef enum _tag_s7_connect_stage {
+	S7_CONNECT_TCP = 0,			// TCP connect in progress
+	S7_CONNECT_COTP,			// COTP connection request out, waiting for the confirm
+	S7_CONNECT_SETUP			// Setup Communication out, waiting for the ack
+} s7_connect_stage;
+
+// One target of s7_connect_many(), advanced whenever its socket is ready
+typedef struct _tag_s7_connect_state {
+	int				fd;
+	s7_connect_stage stage;
+	long long		deadline;
+	byte			setup[25];
+	const byte*		tx;				// Request of the current stage
+	int				tx_length;
+	int				tx_done;
+	byte			header[4];
+	byte*			frame;			// Response of the current stage, allocated once its TPKT header is in
+	int				frame_length;
+	int				have;
+} s7_connect_state;
+
+static void s7_connect_begin(s7_connect_state* state, s7_connect_stage stage, const byte* request, int length)
+{
+	state->stage = stage;
+	state->tx = request;
+	state->tx_length = length;
+	state->tx_done = 0;
+	state->have = 0;
+	RELEASE_DATA(state->frame);
+	state->frame_length = 0;
+}
+
+// Move a target as far as its socket allows; S7_ERROR_CODE_WOULD_BLOCK while it has to wait
+static s7_error_code_e s7_connect_step(s7_conn_t* conn, s7_connect_state* state, int ready)
+{
+	if (state->stage == S7_CONNECT_TCP)
+	{
+		if (!(ready & SOCKET_WAIT_WRITE))
+			return S7_ERROR_CODE_WOULD_BLOCK;
+		if (socket_finish_connect(state->fd, 0) != 0)
+			return S7_ERROR_CODE_FAILED;
+		s7_connect_begin(state, S7_CONNECT_COTP, conn->head1, sizeof(conn->head1));
+	}
+
+	for (;;)
+	{
+		while (state->tx_done < state->tx_length)
+		{
+			int sent = socket_send_nonblocking(state->fd, state->tx + state->tx_done, state->tx_length - state->tx_done);
+			if (sent < 0)
+				return S7_ERROR_CODE_SOCKET_SEND_FAILED;
+			if (sent == 0)
+				return S7_ERROR_CODE_WOULD_BLOCK;
+			state->tx_done += sent;
+		}
+
+		if (state->frame == NULL)
+		{
+			int got = socket_recv_nonblocking(state->fd, state->header + state->have, 4 - state->have);
+			if (got <= 0)
+				return got < 0 ? S7_ERROR_CODE_FAILED : S7_ERROR_CODE_WOULD_BLOCK;
+			state->have += got;
+			if (state->have < 4)
+				continue;
+
+			// Same lower bound as the blocking handshake
+			state->frame_length = ((int)state->header[2] << 8) | (int)state->header[3];
+			if (state->frame_length < MIN_HEADER_SIZE)
+				return S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+			state->frame = (byte*)malloc(state->frame_length);
+			if (state->frame == NULL)
+				return S7_ERROR_CODE_MALLOC_FAILED;
+			memcpy(state->frame, state->header, 4);
+		}
+
+		if (state->have < state->frame_length)
+		{
+			int got = socket_recv_nonblocking(state->fd, state->frame + state->have, state->frame_length - state->have);
+			if (got <= 0)
+				return got < 0 ? S7_ERROR_CODE_FAILED : S7_ERROR_CODE_WOULD_BLOCK;
+			state->have += got;
+			continue;
+		}
+
+		if (state->stage == S7_CONNECT_COTP)
+		{
+			s7_connect_begin(state, S7_CONNECT_SETUP, state->setup, sizeof(state->setup));
+			continue;
+		}
+		return s7_conn_accept_setup(conn, state->setup, state->frame, state->frame_length) ? S7_ERROR_CODE_SUCCESS : S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+	}
+}
+
+// A finished target: the socket turns blocking like one from s7_conn_connect() and joins the registry
+static s7_error_code_e s7_connect_finish(s7_conn_t* conn, s7_connect_state* state, s7_error_code_e ret)
+{
+	RELEASE_DATA(state->frame);
+	if (ret == S7_ERROR_CODE_SUCCESS && socket_finish_connect(state->fd, S7_CONNECT_TIMEOUT) != 0)
+		ret = S7_ERROR_CODE_FAILED;
+	if (ret == S7_ERROR_CODE_SUCCESS)
+		return s7_conn_attach(conn, state->fd) ? S7_ERROR_CODE_SUCCESS : S7_ERROR_CODE_MALLOC_FAILED;
+
+	s7_conn_reset_negotiated(conn);
+	socket_close_tcp_socket(state->fd);
+	return ret;
+}
+
+int s7_connect_many(const s7_connect_target* targets, int count, s7_error_code_e* results)
+{
+	if (targets == NULL || results == NULL || count <= 0)
+		return 0;
+
+	s7_connect_state* states = (s7_connect_state*)calloc(count, sizeof(s7_connect_state));
+	int* slots = (int*)malloc(sizeof(int) * 4 * count);	// fds, events, ready, target index
+	if (states == NULL || slots == NULL)
+	{
+		RELEASE_DATA(states);
+		RELEASE_DATA(slots);
+		for (int i = 0; i < count; i++)
+			results[i] = S7_ERROR_CODE_MALLOC_FAILED;
+		return 0;
+	}
+	int* fds = slots;
+	int* events = slots + count;
+	int* ready = slots + 2 * count;
+	int* index = slots + 3 * count;
+
+	// Start every TCP connect before waiting for any of them.
+	int active = 0;
+	long long now = socket_now_ms();
+	for (int i = 0; i < count; i++)
+	{
+		s7_conn_t* conn = targets[i].conn;
+		results[i] = S7_ERROR_CODE_INVALID_PARAMETER;
+		if (conn == NULL || targets[i].ip_addr == NULL)
+			continue;
+
+		s7_conn_disconnect(conn);
+		s7_conn_prepare(conn, targets[i].ip_addr, targets[i].port, targets[i].options, states[i].setup);
+		states[i].fd = socket_open_tcp_client_socket_async(conn->ip_address, (short)targets[i].port);
+		results[i] = S7_ERROR_CODE_FAILED;
+		if (states[i].fd < 0)
+			continue;
+
+		states[i].deadline = now + (targets[i].timeout_ms > 0 ? targets[i].timeout_ms : S7_CONNECT_TIMEOUT);
+		results[i] = S7_ERROR_CODE_WOULD_BLOCK;
+		active++;
+	}
+
+	int connected = 0;
+	while (active > 0)
+	{
+		int n = 0;
+		long long next_deadline = 0;
+		for (int i = 0; i < count; i++)
+		{
+			if (results[i] != S7_ERROR_CODE_WOULD_BLOCK)
+				continue;
+			fds[n] = states[i].fd;
+			events[n] = states[i].stage == S7_CONNECT_TCP || states[i].tx_done < states[i].tx_length ? SOCKET_WAIT_WRITE : SOCKET_WAIT_READ;
+			index[n++] = i;
+			if (next_deadline == 0 || states[i].deadline < next_deadline)
+				next_deadline = states[i].deadline;
+		}
+
+		now = socket_now_ms();
+		bool is_ok = socket_wait_many(fds, events, ready, n, next_deadline > now ? (int)(next_deadline - now) : 0) >= 0;
+		now = socket_now_ms();
+		for (int k = 0; k < n; k++)
+		{
+			int i = index[k];
+			s7_error_code_e ret = !is_ok ? S7_ERROR_CODE_FAILED : S7_ERROR_CODE_WOULD_BLOCK;
+			if (is_ok && ready[k] != 0)
+				ret = s7_connect_step(targets[i].conn, &states[i], ready[k]);
+			if (ret == S7_ERROR_CODE_WOULD_BLOCK && now >= states[i].deadline)
+				ret = S7_ERROR_CODE_TIMEOUT;
+			if (ret == S7_ERROR_CODE_WOULD_BLOCK)
+				continue;
+
+			results[i] = s7_connect_finish(targets[i].conn, &states[i], ret);
+			connected += results[i] == S7_ERROR_CODE_SUCCESS;
+			active--;
+		}
+	}
+
+	free(slots);
+	free(states);
+	return connected;
+}
+
+int s7_conn_get_fd(const s7_conn_t* conn)
+{
+	return conn != NULL ? conn->fd : -1;
+}
+
+byte s7_conn_get_slot(const s7_conn_t* conn)
+{
+	return conn->plc_slot;
+}
+
+void s7_conn_set_slot(s7_conn_t* conn, byte slot)
+{
+	conn->plc_slot = slot;
+	if (!s7_conn_is_s200(conn))
+		conn->head1[21] = (byte)((conn->plc_rack * 0x20) + conn->plc_slot);
+}
+
+byte s7_conn_get_rack(const s7_conn_t* conn)
+{
+	return conn->plc_rack;
+}
+
+void s7_conn_set_rack(s7_conn_t* conn, byte rack)
+{
+	conn->plc_rack = rack;
+	if (!s7_conn_is_s200(conn))
+		conn->head1[21] = (byte)((conn->plc_rack * 0x20) + conn->plc_slot);
+}
+
+byte s7_conn_get_connection_type(const s7_conn_t* conn)
+{
+	return conn->head1[20];
+}
+
+void s7_conn_set_connection_type(s7_conn_t* conn, byte type)
+{
+	if (!s7_conn_is_s200(conn))
+		conn->head1[20] = type;
+}
+
+int s7_conn_get_local_TSAP(const s7_conn_t* conn)
+{
+	if (s7_conn_is_s200(conn))
+		return conn->head1[13] * 256 + conn->head1[14];
+	else
+		return conn->head1[16] * 256 + conn->head1[17];
+}
+
+void s7_conn_set_local_TSAP(s7_conn_t* conn, int tsap)
+{
+	byte temp[4] = { 0 };
+	int2bytes(tsap, temp);
+
+	if (s7_conn_is_s200(conn))
+	{
+		conn->head1[13] = temp[1];
+		conn->head1[14] = temp[0];
+	}
+	else
+	{
+		conn->head1[16] = temp[1];
+		conn->head1[17] = temp[0];
+	}
+}
+
+int s7_conn_get_dest_TSAP(const s7_conn_t* conn)
+{
+	if (s7_conn_is_s200(conn))
+		return conn->head1[17] * 256 + conn->head1[18];
+	else
+		return conn->head1[20] * 256 + conn->head1[21];
+}
+
+void s7_conn_set_dest_TSAP(s7_conn_t* conn, int tsap)
+{
+	byte temp[4] = { 0 };
+	int2bytes(tsap, temp);
+
+	if (s7_conn_is_s200(conn))
+	{
+		conn->head1[17] = temp[1];
+		conn->head1[18] = temp[0];
+	}
+	else
+	{
+		conn->head1[20] = temp[1];
+		conn->head1[21] = temp[0];
+	}
+}
+
+int s7_conn_get_PDU_size(const s7_conn_t* conn)
+{
+	return conn->pdu_size;
+}
+
+// Number of requests that may be outstanding at once, as negotiated during Setup Communication
+int s7_conn_get_parallel_jobs(const s7_conn_t* conn)
+{
+	return conn->max_amq_calling < conn->max_amq_called ? conn->max_amq_calling : conn->max_amq_called;
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_CONN_H__
+#define __H_SIEMENS_S7_CONN_H__
+
+#include "siemens_s7.h"
+
+// Connection context: handshake frames, rack/slot/TSAP and negotiated PDU of one PLC.
+// Pass s7_conn_get_fd() to the fd-based read/write functions.
+typedef struct _tag_s7_conn s7_conn_t;
+
+s7_conn_t* s7_conn_create(siemens_plc_types_e plc);
+void s7_conn_destroy(s7_conn_t* conn); //disconnects first when connected
+
+bool s7_conn_connect(s7_conn_t* conn, const char* ip_addr, int port, const s7_connect_options* options); //options may be NULL
+bool s7_conn_disconnect(s7_conn_t* conn);
+int s7_conn_get_fd(const s7_conn_t* conn); //-1 while disconnected
+
+typedef struct _tag_s7_connect_target {
+	s7_conn_t*	conn;						// Rack/slot/TSAP come from here; connected on success
+	const char*	ip_addr;
+	int			port;
+	const s7_connect_options* options;		// May be NULL
+	int			timeout_ms;					// TCP connect plus both handshakes, <=0 uses 5000
+} s7_connect_target;
+
+// Connect many PLCs at once: every TCP connect and both handshake stages run concurrently on the calling thread.
+// results[i] is S7_ERROR_CODE_SUCCESS or why target i failed (S7_ERROR_CODE_TIMEOUT when out of time); returns how many connected
+int s7_connect_many(const s7_connect_target* targets, int count, s7_error_code_e* results);
+
+byte s7_conn_get_slot(const s7_conn_t* conn);
+void s7_conn_set_slot(s7_conn_t* conn, byte slot);
+
+byte s7_conn_get_rack(const s7_conn_t* conn);
+void s7_conn_set_rack(s7_conn_t* conn, byte rack);
+
+byte s7_conn_get_connection_type(const s7_conn_t* conn);
+void s7_conn_set_connection_type(s7_conn_t* conn, byte type);
+
+int s7_conn_get_local_TSAP(const s7_conn_t* conn);
+void s7_conn_set_local_TSAP(s7_conn_t* conn, int tsap);
+
+int s7_conn_get_dest_TSAP(const s7_conn_t* conn);
+void s7_conn_set_dest_TSAP(s7_conn_t* conn, int tsap);
+
+int s7_conn_get_PDU_size(const s7_conn_t* conn);
+int s7_conn_get_parallel_jobs(const s7_conn_t* conn);
+
+#endif//__H_SIEMENS_S7_CONN_H__
@@ -0,0 +1,644 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_queue.h"
+#include "socket.h"
+#include <string.h>
+#include <stdlib.h>
+
+// I/O owner running on this thread; its own calls go straight to the socket instead of through the queue
+static S7_THREAD_LOCAL struct _tag_s7_conn_io* g_current_io = NULL;
+static s7_mutex g_io_start_lock = S7_MUTEX_INITIALIZER;	// Async calls may start an owner from several threads at once
+
+static bool s7_conn_is_shared(const s7_conn_t* conn)
+{
+	return conn->io != NULL && conn->io != g_current_io;
+}
+
+// Waiting on the event loop thread for a job of a connection that same loop drives would never return
+static bool s7_conn_would_block(const s7_conn_t* conn)
+{
+	return conn->io != NULL && conn->io->loop_conn != NULL && s7_loop_is_current(conn->io->loop_conn);
+}
+
+void s7_job_complete(s7_job_t* job, s7_error_code_e result)
+{
+	struct _tag_s7_conn_io* io = job->conn->io;
+	job->result = result;
+	if (job->member != NULL)
+		s7_pool_job_done(job->member, result);
+	if (job->callback != NULL)
+	{
+		job->callback(result, job->user_data);
+		free(job);
+		return;
+	}
+	if (io == NULL)
+	{
+		job->done = 1;
+		return;
+	}
+
+	s7_mutex_lock(&io->lock);
+	job->done = 1;
+	s7_cond_broadcast(&io->completion);
+	s7_mutex_unlock(&io->lock);
+}
+
+static s7_error_code_e s7_frame_roundtrip(s7_conn_t* conn, byte_array_info* request, byte_array_info* response)
+{
+	if (!try_send_data_to_server(conn->fd, request, NULL))
+		return S7_ERROR_CODE_SOCKET_SEND_FAILED;
+
+	byte_array_info view = { 0 };
+	s7_error_code_e ret = s7_read_response(conn, &view);
+	return ret == S7_ERROR_CODE_SUCCESS ? s7_copy_frame(conn, &view, response) : ret;
+}
+
+// Results that leave the byte stream in an unknown state; item errors reported by the PLC do not count
+bool s7_is_transport_error(s7_error_code_e result)
+{
+	switch (result)
+	{
+	case S7_ERROR_CODE_FAILED:
+	case S7_ERROR_CODE_SOCKET_SEND_FAILED:
+	case S7_ERROR_CODE_RESPONSE_HEADER_FAILED:
+	case S7_ERROR_CODE_TIMEOUT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// A managed owner drops the session once the batch that broke it is done
+static void s7_job_check_transport(s7_conn_t* conn, s7_error_code_e result)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	if (io != NULL && io->managed && s7_is_transport_error(result))
+		io->broken = true;
+}
+
+void s7_job_finish_exchange(s7_job_t* job)
+{
+	s7_error_code_e result = S7_ERROR_CODE_SUCCESS;
+	for (int i = 0; i < job->pdu_count && result == S7_ERROR_CODE_SUCCESS; i++)
+		result = job->pdu_jobs[i].result;
+	s7_job_check_transport(job->conn, result);
+
+	if (job->kind == S7_JOB_TRANSFER)
+		result = s7_transfer_complete(&job->transfer, result, job->results, job->item_count);
+	s7_job_complete(job, result);
+}
+
+// Complete a job that never ran; transfer jobs still release their prepared frames
+void s7_job_cancel(s7_job_t* job, s7_error_code_e result)
+{
+	if (job->kind == S7_JOB_FRAME)
+	{
+		s7_job_complete(job, result);
+		return;
+	}
+
+	for (int i = 0; i < job->pdu_count; i++)
+		job->pdu_jobs[i].result = result;
+	s7_job_finish_exchange(job);
+}
+
+// Scratch for merged frames owned by the I/O thread; it only grows, so steady polling stops allocating
+static s7_pdu_job* s7_job_merge_buffer(struct _tag_s7_conn_io* io, int frame_count)
+{
+	if (frame_count > io->merged_capacity)
+	{
+		s7_pdu_job* temp = (s7_pdu_job*)realloc(io->merged, sizeof(s7_pdu_job) * frame_count);
+		if (temp == NULL)
+			return NULL;
+		io->merged = temp;
+		io->merged_capacity = frame_count;
+	}
+	return io->merged;
+}
+
+// Merge the frames of consecutive exchange jobs into one pipelined run
+static void s7_job_run_exchanges(s7_conn_t* conn, s7_job_t** jobs, int count, int frame_count)
+{
+	if (frame_count == 0)
+	{
+		for (int i = 0; i < count; i++)
+			s7_job_finish_exchange(jobs[i]);
+		return;
+	}
+
+	// A job may be released as soon as it completes, so never look at one after finishing it.
+	bool is_merged = count > 1;
+	s7_pdu_job* merged = is_merged ? s7_job_merge_buffer(conn->io, frame_count) : jobs[0]->pdu_jobs;
+	if (merged == NULL)
+	{
+		for (int i = 0; i < count; i++)
+			s7_job_cancel(jobs[i], S7_ERROR_CODE_MALLOC_FAILED);
+		return;
+	}
+
+	int offset = 0;
+	for (int i = 0; is_merged && i < count; i++)
+	{
+		memcpy(merged + offset, jobs[i]->pdu_jobs, sizeof(s7_pdu_job) * jobs[i]->pdu_count);
+		offset += jobs[i]->pdu_count;
+	}
+
+	s7_exchange_pipelined(conn, merged, frame_count);
+
+	offset = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (is_merged)
+			memcpy(jobs[i]->pdu_jobs, merged + offset, sizeof(s7_pdu_job) * jobs[i]->pdu_count);
+		offset += jobs[i]->pdu_count;
+		s7_job_finish_exchange(jobs[i]);
+	}
+
+}
+
+// Run jobs in submission order; frame jobs go out alone, everything between them is pipelined together
+void s7_job_run_batch(s7_conn_t* conn, s7_job_t** jobs, int count)
+{
+	int i = 0;
+	while (i < count)
+	{
+		// The rest of a batch that broke a managed session would only wait for socket timeouts.
+		if (conn->io != NULL && conn->io->broken)
+		{
+			s7_job_cancel(jobs[i++], S7_ERROR_CODE_CONNECTION_CLOSED);
+			continue;
+		}
+
+		if (jobs[i]->kind == S7_JOB_FRAME)
+		{
+			s7_error_code_e ret = s7_frame_roundtrip(conn, &jobs[i]->request, &jobs[i]->response);
+			s7_job_check_transport(conn, ret);
+			s7_job_complete(jobs[i], ret);
+			i++;
+			continue;
+		}
+
+		int end = i, frame_count = 0;
+		while (end < count && jobs[end]->kind != S7_JOB_FRAME)
+			frame_count += jobs[end++]->pdu_count;
+		s7_job_run_exchanges(conn, jobs + i, end - i, frame_count);
+		i = end;
+	}
+}
+
+// Delay before the next restore attempt: doubled per failed attempt, then jittered into [delay/2, delay]
+// so clients that lost their PLCs at the same moment do not all come back at the same moment
+static int s7_io_backoff(struct _tag_s7_conn_io* io)
+{
+	int delay = io->reconnect.initial_delay_ms;
+	for (int i = 0; i < io->attempts && delay < io->reconnect.max_delay_ms; i++)
+		delay = delay > io->reconnect.max_delay_ms / 2 ? io->reconnect.max_delay_ms : delay * 2;
+	if (delay > io->reconnect.max_delay_ms)
+		delay = io->reconnect.max_delay_ms;
+
+	io->jitter = io->jitter * 1103515245u + 12345u;
+	return delay / 2 + (int)((io->jitter >> 8) % (unsigned int)(delay / 2 + 1));
+}
+
+// Shut the socket down but keep its descriptor, so the fd handed out to the application stays reserved
+static void s7_io_drop_session(s7_conn_t* conn)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	io->broken = false;
+	io->attempts = 0;
+	s7_atomic_store_long(&io->offline, 1);
+	socket_shutdown_tcp_socket(conn->fd);
+	io->retry_at = socket_now_ms() + s7_io_backoff(io);
+	if (io->reconnect.callback != NULL)
+		io->reconnect.callback(conn, false, io->reconnect.user_data);
+}
+
+static void s7_io_restore_session(s7_conn_t* conn)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	if (!s7_conn_restore(conn))
+	{
+		io->attempts++;
+		io->retry_at = socket_now_ms() + s7_io_backoff(io);
+		return;
+	}
+
+	s7_atomic_add_long(&io->reconnects, 1);
+	s7_atomic_store_long(&io->offline, 0);
+	if (io->reconnect.callback != NULL)
+		io->reconnect.callback(conn, true, io->reconnect.user_data);
+}
+
+static void s7_io_main(void* arg)
+{
+	s7_conn_t* conn = (s7_conn_t*)arg;
+	struct _tag_s7_conn_io* io = conn->io;
+	s7_job_t** batch = NULL;
+	int capacity = 0;
+	unsigned int seen = 0;
+	bool stopping = false;
+
+	g_current_io = io;
+	while (!stopping)
+	{
+		s7_mutex_lock(&io->lock);
+		while (io->signals == seen && !io->stopping)
+		{
+			if (s7_atomic_load_long(&io->offline) == 0)
+			{
+				s7_cond_wait(&io->wakeup, &io->lock);
+				continue;
+			}
+
+			long long wait_ms = io->retry_at - socket_now_ms();
+			if (wait_ms <= 0)
+				break;
+			s7_cond_timedwait(&io->wakeup, &io->lock, (int)wait_ms);
+		}
+		seen = io->signals;
+		stopping = io->stopping;
+		s7_mutex_unlock(&io->lock);
+
+		int count = 0;
+		s7_queue_node* node = NULL;
+		while ((node = s7_mpsc_pop(&io->queue)) != NULL)
+		{
+			if (count == capacity)
+			{
+				int grown = capacity > 0 ? capacity * 2 : 32;
+				s7_job_t** temp = (s7_job_t**)realloc(batch, sizeof(s7_job_t*) * grown);
+				if (temp == NULL)
+				{
+					s7_job_cancel((s7_job_t*)node, S7_ERROR_CODE_MALLOC_FAILED);
+					continue;
+				}
+				batch = temp;
+				capacity = grown;
+			}
+			batch[count++] = (s7_job_t*)node;
+		}
+
+		if (stopping || s7_atomic_load_long(&io->offline) != 0)
+		{
+			for (int i = 0; i < count; i++)
+				s7_job_cancel(batch[i], S7_ERROR_CODE_CONNECTION_CLOSED);
+		}
+		else if (count > 0)
+		{
+			s7_job_run_batch(conn, batch, count);
+			if (io->broken && !io->owner_stopped)
+				s7_io_drop_session(conn);
+		}
+
+		if (!stopping && !io->owner_stopped && s7_atomic_load_long(&io->offline) != 0 && socket_now_ms() >= io->retry_at)
+			s7_io_restore_session(conn);
+	}
+
+	g_current_io = NULL;
+	RELEASE_DATA(batch);
+	if (io->owner_destroys)
+	{
+		// The connection is gone for everybody else, so nobody is left to join this thread.
+		s7_thread_detach(&io->thread);
+		s7_conn_io_release(conn);
+		s7_conn_destroy(conn);
+	}
+}
+
+static void s7_job_submit(s7_conn_t* conn, s7_job_t* job)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	if (io == NULL)
+	{
+		s7_job_run_batch(conn, &job, 1);
+		return;
+	}
+
+	// A managed session being restored answers at once instead of after a socket timeout.
+	if (s7_atomic_load_long(&io->offline) != 0)
+	{
+		s7_job_cancel(job, S7_ERROR_CODE_CONNECTION_CLOSED);
+		return;
+	}
+
+	s7_mpsc_push(&io->queue, &job->node);
+	if (io->loop_conn != NULL)
+	{
+		s7_loop_notify(io->loop_conn);
+		return;
+	}
+
+	s7_mutex_lock(&io->lock);
+	io->signals++;
+	s7_cond_signal(&io->wakeup);
+	s7_mutex_unlock(&io->lock);
+}
+
+struct _tag_s7_conn_io* s7_conn_io_create(void)
+{
+	struct _tag_s7_conn_io* io = (struct _tag_s7_conn_io*)calloc(1, sizeof(struct _tag_s7_conn_io));
+	if (io == NULL)
+		return NULL;
+
+	s7_mpsc_init(&io->queue);
+	s7_mutex_init(&io->lock);
+	s7_cond_init(&io->wakeup);
+	s7_cond_init(&io->completion);
+	return io;
+}
+
+// The owner is gone: complete whatever is still queued, let blocked submitters return, then free
+void s7_conn_io_release(s7_conn_t* conn)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	s7_queue_node* node = NULL;
+	while ((node = s7_mpsc_pop(&io->queue)) != NULL)
+		s7_job_cancel((s7_job_t*)node, S7_ERROR_CODE_CONNECTION_CLOSED);
+
+	// Waiters woken by the last completions still need the lock to return.
+	s7_mutex_lock(&io->lock);
+	io->stopping = true;
+	while (io->waiters > 0)
+		s7_cond_wait(&io->completion, &io->lock);
+	s7_mutex_unlock(&io->lock);
+
+	conn->io = NULL;
+	s7_cond_destroy(&io->completion);
+	s7_cond_destroy(&io->wakeup);
+	s7_mutex_destroy(&io->lock);
+	RELEASE_DATA(io->merged);
+	free(io);
+}
+
+bool s7_conn_io_defer_destroy(s7_conn_t* conn)
+{
+	struct _tag_s7_conn_io* io = conn->io;
+	if (io == NULL || io != g_current_io || io->loop_conn != NULL)
+		return false;
+
+	io->owner_destroys = true;
+	return true;
+}
+
+static bool s7_conn_start_thread(s7_conn_t* conn, const s7_reconnect_options* reconnect, bool managed)
+{
+	if (conn == NULL || conn->fd < 0)
+		return false;
+
+	s7_mutex_lock(&g_io_start_lock);
+	bool is_ok = conn->io != NULL && (!managed || conn->io->managed);
+	struct _tag_s7_conn_io* io = conn->io != NULL ? NULL : s7_conn_io_create();
+	if (io != NULL)
+	{
+		io->managed = managed;
+		if (reconnect != NULL)
+			io->reconnect = *reconnect;
+		if (io->reconnect.initial_delay_ms <= 0)
+			io->reconnect.initial_delay_ms = 100;
+		if (io->reconnect.max_delay_ms <= 0)
+			io->reconnect.max_delay_ms = 30000;
+		if (io->reconnect.max_delay_ms < io->reconnect.initial_delay_ms)
+			io->reconnect.max_delay_ms = io->reconnect.initial_delay_ms;
+		io->jitter = (unsigned int)socket_now_ms() ^ (unsigned int)(size_t)conn;
+
+		conn->io = io;
+		is_ok = s7_thread_start(&io->thread, s7_io_main, conn);
+		if (!is_ok)
+			s7_conn_io_release(conn);
+	}
+	s7_mutex_unlock(&g_io_start_lock);
+	return is_ok;
+}
+
+bool s7_conn_start_io(s7_conn_t* conn)
+{
+	return s7_conn_start_thread(conn, NULL, false);
+}
+
+bool s7_conn_start_managed_io(s7_conn_t* conn, const s7_reconnect_options* options)
+{
+	return s7_conn_start_thread(conn, options, true);
+}
+
+bool s7_conn_is_online(s7_conn_t* conn)
+{
+	if (conn == NULL || conn->fd < 0)
+		return false;
+	return conn->io == NULL || s7_atomic_load_long(&conn->io->offline) == 0;
+}
+
+int s7_conn_get_reconnect_count(s7_conn_t* conn)
+{
+	if (conn == NULL || conn->io == NULL)
+		return 0;
+	return (int)s7_atomic_load_long(&conn->io->reconnects);
+}
+
+// Must not race with submissions from other threads; every queued job completes before it returns,
+// except on the I/O thread itself, which stops once the running batch is done
+void s7_conn_stop_io(s7_conn_t* conn)
+{
+	if (conn == NULL || conn->io == NULL)
+		return;
+
+	struct _tag_s7_conn_io* io = conn->io;
+	if (io->loop_conn != NULL)
+	{
+		s7_loop_detach(io->loop_conn);
+		return;
+	}
+
+	// A thread cannot join itself; the next stop from another thread joins and releases it.
+	if (io == g_current_io)
+	{
+		io->owner_stopped = true;
+		s7_mutex_lock(&io->lock);
+		io->stopping = true;
+		s7_mutex_unlock(&io->lock);
+		return;
+	}
+
+	s7_mutex_lock(&io->lock);
+	io->stopping = true;
+	s7_cond_signal(&io->wakeup);
+	s7_mutex_unlock(&io->lock);
+	s7_thread_join(&io->thread);
+	s7_conn_io_release(conn);
+}
+
+static void s7_job_wait_done(s7_job_t* job)
+{
+	struct _tag_s7_conn_io* io = job->conn->io;
+	if (io == NULL)
+		return;
+
+	s7_mutex_lock(&io->lock);
+	io->waiters++;
+	while (!job->done)
+		s7_cond_wait(&io->completion, &io->lock);
+	io->waiters--;
+	if (io->stopping && io->waiters == 0)
+		s7_cond_broadcast(&io->completion);
+	s7_mutex_unlock(&io->lock);
+}
+
+s7_error_code_e s7_conn_exchange(s7_conn_t* conn, s7_pdu_job* jobs, int count)
+{
+	if (conn == NULL || !s7_conn_is_shared(conn))
+		return s7_exchange_pipelined(conn, jobs, count);
+	if (s7_conn_would_block(conn))
+		return S7_ERROR_CODE_WOULD_BLOCK;
+
+	s7_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.conn = conn;
+	job.kind = S7_JOB_EXCHANGE;
+	job.pdu_jobs = jobs;
+	job.pdu_count = count;
+	s7_job_submit(conn, &job);
+	s7_job_wait_done(&job);
+	return job.result;
+}
+
+s7_error_code_e s7_conn_roundtrip(s7_conn_t* conn, byte_array_info* request, byte_array_info* response)
+{
+	if (conn == NULL || conn->fd < 0 || request == NULL || response == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	if (!s7_conn_is_shared(conn))
+		return s7_frame_roundtrip(conn, request, response);
+	if (s7_conn_would_block(conn))
+		return S7_ERROR_CODE_WOULD_BLOCK;
+
+	s7_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.conn = conn;
+	job.kind = S7_JOB_FRAME;
+	job.request = *request;
+	s7_job_submit(conn, &job);
+	s7_job_wait_done(&job);
+	*response = job.response;
+	return job.result;
+}
+
+// Heap transfer job with its frames built, not yet submitted; a failed preparation is left in job->result
+static s7_job_t* s7_job_create_transfer(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write)
+{
+	s7_job_t* job = (s7_job_t*)calloc(1, sizeof(s7_job_t));
+	if (job == NULL)
+		return NULL;
+
+	job->conn = conn;
+	job->kind = S7_JOB_TRANSFER;
+	job->heap = true;
+	job->results = results != NULL ? results : &job->item_result;
+	job->item_count = count;
+	job->result = s7_transfer_prepare(&job->transfer, conn, items, count, job->results, is_write);
+	job->pdu_jobs = job->transfer.jobs;
+	job->pdu_count = job->transfer.batch_count;
+	return job;
+}
+
+// Queue the job and start counting it against its pool member
+static void s7_job_submit_counted(s7_conn_t* conn, s7_job_t* job, struct _tag_s7_pool_member* member)
+{
+	job->member = member;
+	if (member != NULL)
+		s7_pool_job_started(member);
+	s7_job_submit(conn, job);
+}
+
+s7_job_t* s7_conn_submit_transfer(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	struct _tag_s7_pool_member* member)
+{
+	if (conn == NULL || conn->fd < 0 || items == NULL || count <= 0 || results == NULL)
+		return NULL;
+
+	s7_job_t* job = s7_job_create_transfer(conn, items, count, results, is_write);
+	if (job == NULL)
+		return NULL;
+
+	if (job->result != S7_ERROR_CODE_SUCCESS)
+		job->done = 1;
+	else
+		s7_job_submit_counted(conn, job, member);
+	return job;
+}
+
+s7_error_code_e s7_conn_submit_async(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	s7_async_callback callback, void* user_data, struct _tag_s7_pool_member* member)
+{
+	if (conn == NULL || conn->fd < 0 || items == NULL || count <= 0 || (results == NULL && count != 1) || callback == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	s7_job_t* job = s7_job_create_transfer(conn, items, count, results, is_write);
+	if (job == NULL)
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	// Nothing has been queued yet, so a batch without a single valid item is reported to the caller directly.
+	s7_error_code_e ret = job->result;
+	if (ret == S7_ERROR_CODE_SUCCESS && job->pdu_count == 0)
+		ret = s7_transfer_complete(&job->transfer, ret, job->results, count);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+	{
+		free(job);
+		return ret;
+	}
+
+	job->callback = callback;
+	job->user_data = user_data;
+	s7_job_submit_counted(conn, job, member);
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+s7_job_t* s7_conn_submit_read(s7_conn_t* conn, s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_conn_submit_transfer(conn, items, count, results, false, NULL);
+}
+
+s7_job_t* s7_conn_submit_write(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_conn_submit_transfer(conn, items, count, results, true, NULL);
+}
+
+bool s7_job_poll(s7_job_t* job)
+{
+	if (job == NULL)
+		return true;
+
+	struct _tag_s7_conn_io* io = job->conn->io;
+	if (io == NULL)
+		return job->done != 0;
+
+	s7_mutex_lock(&io->lock);
+	bool done = job->done != 0;
+	s7_mutex_unlock(&io->lock);
+	return done;
+}
+
+s7_error_code_e s7_job_wait(s7_job_t* job)
+{
+	if (job == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+	if (!s7_job_poll(job) && s7_conn_would_block(job->conn))
+		return S7_ERROR_CODE_WOULD_BLOCK;
+
+	s7_job_wait_done(job);
+	return job->result;
+}
+
+void s7_job_release(s7_job_t* job)
+{
+	if (job == NULL)
+		return;
+
+	s7_job_wait_done(job);
+	if (job->heap)
+		free(job);
+}
@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_JOB_H__
+#define __H_SIEMENS_S7_JOB_H__
+
+#include "siemens_s7_conn.h"
+
+// Read or write submitted to a connection, completed by its I/O owner
+typedef struct _tag_s7_job s7_job_t;
+
+// Start a thread that owns the socket; afterwards any thread may submit jobs or call the fd-based API on the connection
+bool s7_conn_start_io(s7_conn_t* conn);
+void s7_conn_stop_io(s7_conn_t* conn); //queued jobs complete with S7_ERROR_CODE_CONNECTION_CLOSED
+// From one of the connection's callbacks the I/O thread exits after its batch and the next stop, disconnect or destroy
+// from another thread joins it; s7_conn_destroy() from a callback leaves the free to the exiting thread.
+
+typedef void (*s7_reconnect_callback)(s7_conn_t* conn, bool is_online, void* user_data);
+
+typedef struct _tag_s7_reconnect_options {
+	int		initial_delay_ms;		// First restore attempt after a drop, <=0 uses 100
+	int		max_delay_ms;			// The delay doubles per failed attempt up to this, <=0 uses 30000
+	s7_reconnect_callback callback;	// May be NULL; runs on the I/O thread when the session drops and once it is back
+	void*	user_data;
+} s7_reconnect_options;
+
+// Like s7_conn_start_io(), and the thread also restores the session after a transport error: queued and new jobs fail
+// at once with S7_ERROR_CODE_CONNECTION_CLOSED while it reconnects with jittered exponential backoff and replays the
+// stored handshake. The fd stays the same on POSIX, so fd-based calls and read plans keep working afterwards.
+// The callback may call the fd API to re-arm reads; it goes straight to the new socket.
+bool s7_conn_start_managed_io(s7_conn_t* conn, const s7_reconnect_options* options); //options may be NULL
+bool s7_conn_is_online(s7_conn_t* conn); //false while a managed connection is restoring its session
+int s7_conn_get_reconnect_count(s7_conn_t* conn);
+
+// The items, their buffers and results must stay valid until the job completes.
+// Without an I/O owner the job runs on the calling thread before the submit returns.
+s7_job_t* s7_conn_submit_read(s7_conn_t* conn, s7_multi_item* items, int count, s7_error_code_e* results);
+s7_job_t* s7_conn_submit_write(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results);
+
+bool s7_job_poll(s7_job_t* job); //true once the job completed
+s7_error_code_e s7_job_wait(s7_job_t* job); //blocks until completion, returns the transport error or the first failing item
+void s7_job_release(s7_job_t* job); //waits for completion first
+
+#endif//__H_SIEMENS_S7_JOB_H__
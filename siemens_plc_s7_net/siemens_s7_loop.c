@@ -0,0 +1,1263 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_loop.h"
+#include "siemens_s7_queue.h"
+#include "siemens_s7_uring.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+
+#define S7_LOOP_DEFAULT_TIMEOUT	5000
+#define S7_LOOP_TICK_MS			10		// Timer wheel resolution
+#define S7_LOOP_WHEEL_SLOTS		512		// One lap covers 5.12 s, later deadlines simply wait for another lap
+#define S7_LOOP_MAX_EVENTS		64
+#define S7_LOOP_MAX_CONNECTIONS	512		// Default io_uring buffer slots
+#define S7_LOOP_SLOT_SIZE		2048	// Registered tx and rx buffer per connection, above the largest TPKT frame
+
+// io_uring user_data: connection pointer with the operation in the low bits
+#define S7_LOOP_OP_RECV			1
+#define S7_LOOP_OP_SEND			2
+#define S7_LOOP_OP_CANCEL		3
+#define S7_LOOP_OP_MASK			3
+
+typedef struct _tag_s7_timer {
+	struct _tag_s7_timer* prev;
+	struct _tag_s7_timer* next;		// NULL while not armed
+	long long deadline;				// Monotonic milliseconds
+} s7_timer;
+
+typedef struct _tag_s7_loop_frame {
+	s7_job_t*	job;
+	int			index;				// Frame of job->pdu_jobs, -1 for a frame job
+	ushort		pdu_reference;
+} s7_loop_frame;
+
+struct _tag_s7_loop_conn {
+	s7_queue_node	ready_node;		// Link in the loop's ready queue, must stay first
+	s7_loop_t*		loop;
+	s7_conn_t*		conn;
+	struct _tag_s7_loop_conn* prev;	// Connections of the loop
+	struct _tag_s7_loop_conn* next;
+	volatile long	queued;			// Already waiting in the ready queue
+
+	s7_job_t*		pending_head;	// Taken off the job queue with frames left to send, linked through node.next
+	s7_job_t*		pending_tail;
+	int				next_frame;		// Next frame of pending_head
+	s7_loop_frame*	inflight;
+	int				inflight_count;
+	int				window;			// Negotiated parallel jobs
+	bool			exclusive;		// A frame job is in flight and must be answered before anything else goes out
+
+	const byte*		tx_data;		// Frame being written
+	int				tx_length;
+	const byte*		tx_payload;		// Data sent behind tx_data from the caller's memory
+	int				tx_payload_length;
+	int				tx_offset;		// Bytes of tx_data and then tx_payload already written
+	bool			writable;
+
+	s7_timer		timer;			// Armed while requests are in flight
+	bool			broken;			// Socket failed; jobs complete with an error until the connection is removed
+
+	int				slot;			// io_uring: registered buffer slot
+	byte*			tx_slot;		// io_uring: frames are packed here and written in one operation
+	byte*			rx_slot;
+	int				tx_used;
+	int				tx_done;
+	bool			send_busy;		// io_uring: write in flight
+	bool			recv_busy;		// io_uring: read in flight
+	bool			detached;		// Connection gone, freed once the loop and its io_uring operations are done with it
+};
+
+struct _tag_s7_loop {
+	s7_loop_backend_e backend;
+	int				epoll_fd;
+	int				wake_fd;		// eventfd written by submitters on other threads
+	s7_mpsc_queue	ready;			// Connections with newly queued jobs
+	volatile long	wake_pending;
+	int				request_timeout;
+	s7_timer		wheel[S7_LOOP_WHEEL_SLOTS];
+	long long		wheel_tick;		// Last processed tick
+	int				armed;
+	struct _tag_s7_loop_conn* conns;
+	int				conn_count;
+
+#ifdef S7_HAVE_IO_URING
+	s7_uring		ring;
+#endif
+	byte*			buffers;		// io_uring: two slots per connection, registered as fixed buffer 0
+	bool			fixed_buffers;	// Registration may fail under a low RLIMIT_MEMLOCK; plain reads/writes are used then
+	int*			free_slots;
+	int				free_count;
+	uint64_t		wake_value;		// io_uring: target of the eventfd read
+	bool			wake_busy;
+	struct _tag_s7_loop_conn* zombies;	// Detached connections still referenced by the running pass or io_uring operations
+};
+
+static S7_THREAD_LOCAL s7_loop_t* g_running_loop = NULL;
+
+// Removal or adoption the shared async loop performs on its own thread for a caller waiting on g_shared_done
+typedef struct _tag_s7_shared_request {
+	s7_conn_t*		conn;			// Connection to adopt
+	struct _tag_s7_loop_conn* detach;	// Or connection to remove
+	bool			ok;
+	bool			done;
+	struct _tag_s7_shared_request* next;
+} s7_shared_request;
+
+// Owner of the async calls on connections nobody else drives, started by the first of them
+static s7_mutex g_shared_lock = S7_MUTEX_INITIALIZER;
+static s7_cond g_shared_done;
+static s7_loop_t* g_shared_loop = NULL;
+static s7_thread g_shared_thread;
+static s7_shared_request* g_shared_requests = NULL;
+
+static long long s7_loop_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void s7_timer_cancel(s7_loop_t* loop, s7_timer* timer)
+{
+	if (timer->next == NULL)
+		return;
+
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->prev = timer->next = NULL;
+	loop->armed--;
+}
+
+static void s7_timer_arm(s7_loop_t* loop, s7_timer* timer, long long deadline)
+{
+	s7_timer_cancel(loop, timer);
+	long long tick = deadline / S7_LOOP_TICK_MS;
+	if (tick < loop->wheel_tick)
+		tick = loop->wheel_tick;
+
+	s7_timer* slot = &loop->wheel[tick % S7_LOOP_WHEEL_SLOTS];
+	timer->deadline = deadline;
+	timer->next = slot;
+	timer->prev = slot->prev;
+	slot->prev->next = timer;
+	slot->prev = timer;
+	loop->armed++;
+}
+
+static void s7_loop_set_blocking(int fd, bool blocking)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags >= 0)
+		fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
+// response is a view into the receive buffer, kept by copying before the job completes
+static void s7_loop_frame_done(s7_loop_frame frame, s7_error_code_e result, byte_array_info response)
+{
+	s7_job_t* job = frame.job;
+	if (frame.index < 0)
+	{
+		if (response.data != NULL && result == S7_ERROR_CODE_SUCCESS)
+			result = s7_copy_frame(job->conn, &response, &job->response);
+		s7_job_complete(job, result);
+		return;
+	}
+
+	s7_pdu_job* pdu = &job->pdu_jobs[frame.index];
+	if (response.data != NULL && result == S7_ERROR_CODE_SUCCESS)
+		result = s7_store_response(job->conn, pdu, &response);
+	pdu->result = result;
+	if (--job->frames_left == 0)
+		s7_job_finish_exchange(job);
+}
+
+static void s7_loop_fail_inflight(struct _tag_s7_loop_conn* lc, s7_error_code_e result)
+{
+	byte_array_info none = { 0 };
+	// Completions may queue new jobs, but nothing is sent until this connection is flushed again.
+	while (lc->inflight_count > 0)
+		s7_loop_frame_done(lc->inflight[--lc->inflight_count], result, none);
+	lc->exclusive = false;
+	lc->tx_data = NULL;
+	s7_timer_cancel(lc->loop, &lc->timer);
+}
+
+static void s7_loop_fail_pending(struct _tag_s7_loop_conn* lc, s7_error_code_e result)
+{
+	while (lc->pending_head != NULL)
+	{
+		s7_job_t* job = lc->pending_head;
+		lc->pending_head = (s7_job_t*)job->node.next;
+		if (job->kind == S7_JOB_FRAME)
+		{
+			s7_job_complete(job, result);
+			continue;
+		}
+
+		for (int i = lc->next_frame; i < job->pdu_count; i++)
+			job->pdu_jobs[i].result = result;
+		job->frames_left -= job->pdu_count - lc->next_frame;
+		lc->next_frame = 0;
+		if (job->frames_left == 0)
+			s7_job_finish_exchange(job);
+	}
+	lc->pending_tail = NULL;
+}
+
+static void s7_loop_take_jobs(struct _tag_s7_loop_conn* lc);
+
+// The byte stream can no longer be trusted: fail everything and stop watching the socket
+static void s7_loop_break(struct _tag_s7_loop_conn* lc, s7_error_code_e result)
+{
+	if (lc->broken)
+		return;
+
+	lc->broken = true;
+	if (lc->loop->backend == S7_LOOP_BACKEND_EPOLL)
+		epoll_ctl(lc->loop->epoll_fd, EPOLL_CTL_DEL, lc->conn->fd, NULL);
+	s7_rx_reset(&lc->conn->rx);
+	s7_loop_fail_inflight(lc, result);
+	s7_loop_fail_pending(lc, result);
+	s7_loop_take_jobs(lc);
+}
+
+static void s7_loop_take_jobs(struct _tag_s7_loop_conn* lc)
+{
+	// Cleared first: a job pushed while draining either shows up below or queues the connection again.
+	s7_atomic_store_long(&lc->queued, 0);
+
+	// A completion below may remove this very connection; its queue is gone then.
+	s7_queue_node* node = NULL;
+	while (lc->conn != NULL && (node = s7_mpsc_pop(&lc->conn->io->queue)) != NULL)
+	{
+		s7_job_t* job = (s7_job_t*)node;
+		if (lc->broken)
+		{
+			s7_job_cancel(job, S7_ERROR_CODE_CONNECTION_CLOSED);
+			continue;
+		}
+
+		if (job->kind == S7_JOB_FRAME)
+		{
+			if (job->request.data == NULL || job->request.length < MIN_HEADER_SIZE - 2)
+			{
+				s7_job_complete(job, S7_ERROR_CODE_INVALID_PARAMETER);
+				continue;
+			}
+			job->frames_left = 1;
+		}
+		else
+		{
+			bool is_valid = true;
+			for (int i = 0; i < job->pdu_count; i++)
+			{
+				job->pdu_jobs[i].response.data = NULL;
+				job->pdu_jobs[i].response.length = 0;
+				job->pdu_jobs[i].result = S7_ERROR_CODE_UNKOWN;
+				if (job->pdu_jobs[i].request.data == NULL || job->pdu_jobs[i].request.length < MIN_HEADER_SIZE - 2 ||
+					(job->pdu_jobs[i].payload.length > 0 && job->pdu_jobs[i].payload.data == NULL))
+					is_valid = false;
+			}
+			if (!is_valid || job->pdu_count == 0)
+			{
+				s7_job_cancel(job, is_valid ? S7_ERROR_CODE_SUCCESS : S7_ERROR_CODE_INVALID_PARAMETER);
+				continue;
+			}
+			job->frames_left = job->pdu_count;
+		}
+
+		job->node.next = NULL;
+		if (lc->pending_tail != NULL)
+			lc->pending_tail->node.next = &job->node;
+		else
+			lc->pending_head = job;
+		lc->pending_tail = job;
+	}
+}
+
+// Put the next frame in flight and make it the one being written; false when the window or a frame job blocks
+static bool s7_loop_next_frame(struct _tag_s7_loop_conn* lc)
+{
+	s7_job_t* job = lc->pending_head;
+	if (job == NULL || lc->exclusive || lc->inflight_count >= lc->window)
+		return false;
+
+	s7_loop_frame* frame = &lc->inflight[lc->inflight_count];
+	frame->job = job;
+	if (job->kind == S7_JOB_FRAME)
+	{
+		// Sent alone with its reference untouched, so whatever comes back next is its answer.
+		if (lc->inflight_count > 0)
+			return false;
+		frame->index = -1;
+		frame->pdu_reference = 0;
+		lc->exclusive = true;
+		lc->tx_data = job->request.data;
+		lc->tx_length = job->request.length;
+		lc->tx_payload = NULL;
+		lc->tx_payload_length = 0;
+	}
+	else
+	{
+		s7_pdu_job* pdu = &job->pdu_jobs[lc->next_frame];
+		pdu->pdu_reference = s7_next_pdu_reference(lc->conn);
+		pdu->request.data[11] = (byte)(pdu->pdu_reference / 256);
+		pdu->request.data[12] = (byte)(pdu->pdu_reference % 256);
+		frame->index = lc->next_frame++;
+		frame->pdu_reference = pdu->pdu_reference;
+		lc->tx_data = pdu->request.data;
+		lc->tx_length = pdu->request.length;
+		lc->tx_payload = pdu->payload.data;
+		lc->tx_payload_length = pdu->payload.length;
+	}
+	lc->tx_offset = 0;
+
+	if (job->kind == S7_JOB_FRAME || lc->next_frame == job->pdu_count)
+	{
+		lc->pending_head = (s7_job_t*)job->node.next;
+		if (lc->pending_head == NULL)
+			lc->pending_tail = NULL;
+		lc->next_frame = 0;
+	}
+
+	if (lc->inflight_count++ == 0)
+		s7_timer_arm(lc->loop, &lc->timer, s7_loop_now() + lc->loop->request_timeout);
+	return true;
+}
+
+// Write what is left of the current frame, header and payload in one call
+static ssize_t s7_loop_send_frame(struct _tag_s7_loop_conn* lc)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	if (lc->tx_offset < lc->tx_length)
+	{
+		iov[msg.msg_iovlen].iov_base = (void*)(lc->tx_data + lc->tx_offset);
+		iov[msg.msg_iovlen++].iov_len = (size_t)(lc->tx_length - lc->tx_offset);
+	}
+	int payload_offset = lc->tx_offset > lc->tx_length ? lc->tx_offset - lc->tx_length : 0;
+	if (lc->tx_payload_length > payload_offset)
+	{
+		iov[msg.msg_iovlen].iov_base = (void*)(lc->tx_payload + payload_offset);
+		iov[msg.msg_iovlen++].iov_len = (size_t)(lc->tx_payload_length - payload_offset);
+	}
+	return sendmsg(lc->conn->fd, &msg, MSG_NOSIGNAL);
+}
+
+static void s7_loop_send_epoll(struct _tag_s7_loop_conn* lc)
+{
+	while (!lc->broken && lc->writable)
+	{
+		if (lc->tx_data == NULL && !s7_loop_next_frame(lc))
+			break;
+
+		ssize_t sent = s7_loop_send_frame(lc);
+		if (sent > 0)
+		{
+			lc->tx_offset += (int)sent;
+			if (lc->tx_offset == lc->tx_length + lc->tx_payload_length)
+				lc->tx_data = NULL;
+		}
+		else if (sent < 0 && errno == EINTR)
+			continue;
+		else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			lc->writable = false;
+		else
+			s7_loop_break(lc, S7_ERROR_CODE_SOCKET_SEND_FAILED);
+	}
+}
+
+static void s7_loop_dispatch(struct _tag_s7_loop_conn* lc, byte_array_info response)
+{
+	int owner = -1;
+	if (lc->exclusive)
+		owner = 0;
+	else
+	{
+		ushort reference = (ushort)(response.data[11] * 256 + response.data[12]);
+		for (int i = 0; i < lc->inflight_count && owner < 0; i++)
+		{
+			if (lc->inflight[i].index >= 0 && lc->inflight[i].pdu_reference == reference)
+				owner = i;
+		}
+	}
+
+	// Late answers to requests that already timed out carry an unknown reference; drop them.
+	if (owner < 0 || lc->inflight_count == 0)
+		return;
+
+	s7_loop_frame frame = lc->inflight[owner];
+	lc->inflight[owner] = lc->inflight[--lc->inflight_count];
+	lc->exclusive = false;
+	if (lc->inflight_count > 0)
+		s7_timer_arm(lc->loop, &lc->timer, s7_loop_now() + lc->loop->request_timeout);
+	else
+		s7_timer_cancel(lc->loop, &lc->timer);
+	s7_loop_frame_done(frame, S7_ERROR_CODE_SUCCESS, response);
+}
+
+// Dispatch every complete frame in the connection's receive buffer, in place; false once the connection broke
+static bool s7_loop_rx_frames(struct _tag_s7_loop_conn* lc)
+{
+	byte_array_info response = { 0 };
+	s7_error_code_e ret = S7_ERROR_CODE_SUCCESS;
+	// A callback run by the dispatch may remove the connection, and its buffer with it.
+	while (!lc->broken && (ret = s7_rx_take_frame(&lc->conn->rx, &response)) == S7_ERROR_CODE_SUCCESS)
+	{
+		const byte* temp = response.data;
+		if (response.length < MIN_HEADER_SIZE || temp[4] != 0x02 || temp[5] != 0xF0 || temp[6] != 0x80 || temp[7] != 0x32)
+		{
+			s7_loop_break(lc, S7_ERROR_CODE_RESPONSE_HEADER_FAILED);
+			return false;
+		}
+		s7_loop_dispatch(lc, response);
+	}
+	if (ret == S7_ERROR_CODE_RESPONSE_HEADER_FAILED)
+		s7_loop_break(lc, ret);
+	return !lc->broken;
+}
+
+// Each recv takes whatever the socket holds into the receive buffer, up to the free space the last parse left
+static void s7_loop_receive(struct _tag_s7_loop_conn* lc)
+{
+	while (s7_loop_rx_frames(lc))
+	{
+		s7_rx_buffer* rx = &lc->conn->rx;
+		ssize_t got = recv(lc->conn->fd, rx->data + rx->end, S7_RX_BUFFER_SIZE - rx->end, 0);
+		if (got == 0)
+		{
+			s7_loop_break(lc, S7_ERROR_CODE_CONNECTION_CLOSED);
+			return;
+		}
+		if (got < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				s7_loop_break(lc, S7_ERROR_CODE_FAILED);
+			return;
+		}
+		rx->end += (int)got;
+	}
+}
+
+#ifdef S7_HAVE_IO_URING
+// Move bytes that arrived in the connection's buffer slot into its receive buffer, dispatching as frames complete
+static void s7_loop_consume(struct _tag_s7_loop_conn* lc, const byte* data, int length)
+{
+	while (length > 0 && s7_loop_rx_frames(lc))
+	{
+		s7_rx_buffer* rx = &lc->conn->rx;
+		int take = S7_RX_BUFFER_SIZE - rx->end < length ? S7_RX_BUFFER_SIZE - rx->end : length;
+		memcpy(rx->data + rx->end, data, take);
+		rx->end += take;
+		data += take;
+		length -= take;
+	}
+	if (!lc->broken)
+		s7_loop_rx_frames(lc);
+}
+
+static void s7_loop_queue_recv(struct _tag_s7_loop_conn* lc)
+{
+	s7_loop_t* loop = lc->loop;
+	struct io_uring_sqe* sqe = s7_uring_get_sqe(&loop->ring);
+	if (sqe == NULL)
+	{
+		s7_loop_break(lc, S7_ERROR_CODE_FAILED);
+		return;
+	}
+	sqe->opcode = loop->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = lc->conn->fd;
+	sqe->addr = (unsigned long long)(uintptr_t)lc->rx_slot;
+	sqe->len = S7_LOOP_SLOT_SIZE;
+	sqe->user_data = (unsigned long long)(uintptr_t)lc | S7_LOOP_OP_RECV;
+	lc->recv_busy = true;
+}
+
+static void s7_loop_queue_send(struct _tag_s7_loop_conn* lc)
+{
+	s7_loop_t* loop = lc->loop;
+	struct io_uring_sqe* sqe = s7_uring_get_sqe(&loop->ring);
+	if (sqe == NULL)
+	{
+		s7_loop_break(lc, S7_ERROR_CODE_SOCKET_SEND_FAILED);
+		return;
+	}
+	sqe->opcode = loop->fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = lc->conn->fd;
+	sqe->addr = (unsigned long long)(uintptr_t)(lc->tx_slot + lc->tx_done);
+	sqe->len = lc->tx_used - lc->tx_done;
+	sqe->user_data = (unsigned long long)(uintptr_t)lc | S7_LOOP_OP_SEND;
+	lc->send_busy = true;
+}
+
+// Pack as many ready frames as fit into the slot; the copy lets a timed-out job go while its bytes are still queued
+static void s7_loop_send_uring(struct _tag_s7_loop_conn* lc)
+{
+	int used = 0;
+	while (!lc->broken && !lc->send_busy)
+	{
+		if (lc->tx_data == NULL && !s7_loop_next_frame(lc))
+			break;
+		int length = lc->tx_length + lc->tx_payload_length;
+		if (length > S7_LOOP_SLOT_SIZE)
+		{
+			s7_loop_break(lc, S7_ERROR_CODE_PDU_SIZE_EXCEEDED);
+			return;
+		}
+		if (used + length > S7_LOOP_SLOT_SIZE)
+			break;
+
+		memcpy(lc->tx_slot + used, lc->tx_data, lc->tx_length);
+		if (lc->tx_payload_length > 0)
+			memcpy(lc->tx_slot + used + lc->tx_length, lc->tx_payload, lc->tx_payload_length);
+		used += length;
+		lc->tx_data = NULL;
+	}
+
+	if (used > 0 && !lc->broken)
+	{
+		lc->tx_used = used;
+		lc->tx_done = 0;
+		s7_loop_queue_send(lc);
+	}
+}
+#endif
+
+static void s7_loop_send(struct _tag_s7_loop_conn* lc)
+{
+#ifdef S7_HAVE_IO_URING
+	if (lc->loop->backend == S7_LOOP_BACKEND_IO_URING)
+	{
+		s7_loop_send_uring(lc);
+		return;
+	}
+#endif
+	s7_loop_send_epoll(lc);
+}
+
+static void s7_loop_timeout(struct _tag_s7_loop_conn* lc)
+{
+	// A half-written frame cannot be abandoned without corrupting the stream.
+	if (lc->tx_data != NULL && lc->tx_offset > 0)
+	{
+		s7_loop_break(lc, S7_ERROR_CODE_TIMEOUT);
+		return;
+	}
+
+	s7_loop_fail_inflight(lc, S7_ERROR_CODE_TIMEOUT);
+	s7_loop_send(lc);
+}
+
+static void s7_loop_expire(s7_loop_t* loop)
+{
+	long long now = s7_loop_now();
+	long long now_tick = now / S7_LOOP_TICK_MS;
+	// The current tick is walked again next time: its timers may not be due yet.
+	long long tick = loop->wheel_tick;
+	if (tick < now_tick - S7_LOOP_WHEEL_SLOTS + 1)
+		tick = now_tick - S7_LOOP_WHEEL_SLOTS + 1;
+
+	// Collect first: firing a timer may arm others in the slots being walked.
+	s7_timer expired;
+	expired.prev = expired.next = &expired;
+	for (; tick <= now_tick && loop->armed > 0; tick++)
+	{
+		s7_timer* slot = &loop->wheel[tick % S7_LOOP_WHEEL_SLOTS];
+		s7_timer* timer = slot->next;
+		while (timer != slot)
+		{
+			s7_timer* next = timer->next;
+			if (timer->deadline <= now)
+			{
+				timer->prev->next = timer->next;
+				timer->next->prev = timer->prev;
+				timer->next = &expired;
+				timer->prev = expired.prev;
+				expired.prev->next = timer;
+				expired.prev = timer;
+			}
+			timer = next;
+		}
+	}
+	loop->wheel_tick = now_tick;
+
+	while (expired.next != &expired)
+	{
+		s7_timer* timer = expired.next;
+		s7_timer_cancel(loop, timer);
+		s7_loop_timeout((struct _tag_s7_loop_conn*)((char*)timer - offsetof(struct _tag_s7_loop_conn, timer)));
+	}
+}
+
+static void s7_loop_wake(s7_loop_t* loop)
+{
+	if (s7_atomic_exchange_long(&loop->wake_pending, 1) == 0)
+	{
+		uint64_t one = 1;
+		(void)!write(loop->wake_fd, &one, sizeof(one));
+	}
+}
+
+void s7_loop_notify(struct _tag_s7_loop_conn* lc)
+{
+	if (s7_atomic_exchange_long(&lc->queued, 1) != 0)
+		return;
+
+	s7_mpsc_push(&lc->loop->ready, &lc->ready_node);
+	s7_loop_wake(lc->loop);
+}
+
+bool s7_loop_is_current(const struct _tag_s7_loop_conn* lc)
+{
+	return g_running_loop != NULL && g_running_loop == lc->loop;
+}
+
+static void s7_loop_free_conn(struct _tag_s7_loop_conn* lc)
+{
+	s7_loop_t* loop = lc->loop;
+	if (lc->slot >= 0)
+		loop->free_slots[loop->free_count++] = lc->slot;
+	free(lc->inflight);
+	free(lc);
+}
+
+static void s7_loop_bury(struct _tag_s7_loop_conn* lc)
+{
+	if (lc->prev != NULL)
+		lc->prev->next = lc->next;
+	else
+		lc->loop->zombies = lc->next;
+	if (lc->next != NULL)
+		lc->next->prev = lc->prev;
+	s7_loop_free_conn(lc);
+}
+
+// Free the connections detached during the pass that just ended, unless io_uring still holds their buffers
+static void s7_loop_reap(s7_loop_t* loop)
+{
+	struct _tag_s7_loop_conn* lc = loop->zombies;
+	while (lc != NULL)
+	{
+		struct _tag_s7_loop_conn* next = lc->next;
+		if (!lc->recv_busy && !lc->send_busy)
+			s7_loop_bury(lc);
+		lc = next;
+	}
+}
+
+#ifdef S7_HAVE_IO_URING
+static void s7_loop_complete(s7_loop_t* loop, unsigned long long user_data, int res)
+{
+	struct _tag_s7_loop_conn* lc = (struct _tag_s7_loop_conn*)(uintptr_t)(user_data & ~(unsigned long long)S7_LOOP_OP_MASK);
+	int op = (int)(user_data & S7_LOOP_OP_MASK);
+	if (lc == NULL)
+	{
+		loop->wake_busy = false;
+		return;
+	}
+	if (op == S7_LOOP_OP_CANCEL)
+		return;
+
+	if (op == S7_LOOP_OP_RECV)
+		lc->recv_busy = false;
+	else
+		lc->send_busy = false;
+	if (lc->detached)
+	{
+		if (!lc->recv_busy && !lc->send_busy)
+			s7_loop_bury(lc);
+		return;
+	}
+	if (lc->broken)
+		return;
+
+	if (op == S7_LOOP_OP_RECV)
+	{
+		if (res > 0)
+			s7_loop_consume(lc, lc->rx_slot, res);
+		else if (res == 0)
+			s7_loop_break(lc, S7_ERROR_CODE_CONNECTION_CLOSED);
+		else if (res != -EINTR && res != -EAGAIN)
+			s7_loop_break(lc, S7_ERROR_CODE_FAILED);
+		if (!lc->broken)
+			s7_loop_queue_recv(lc);
+	}
+	else if (res <= 0)
+	{
+		if (res != -EINTR && res != -EAGAIN)
+		{
+			s7_loop_break(lc, S7_ERROR_CODE_SOCKET_SEND_FAILED);
+			return;
+		}
+		s7_loop_queue_send(lc);
+		return;
+	}
+	else
+	{
+		lc->tx_done += res;
+		if (lc->tx_done < lc->tx_used)
+		{
+			s7_loop_queue_send(lc);
+			return;
+		}
+	}
+	s7_loop_send(lc);
+}
+
+// One io_uring_enter submits everything staged since the last call and waits for completions
+static int s7_loop_wait_uring(s7_loop_t* loop, int wait_ms)
+{
+	if (!loop->wake_busy)
+	{
+		struct io_uring_sqe* sqe = s7_uring_get_sqe(&loop->ring);
+		if (sqe != NULL)
+		{
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = loop->wake_fd;
+			sqe->addr = (unsigned long long)(uintptr_t)&loop->wake_value;
+			sqe->len = sizeof(loop->wake_value);
+			loop->wake_busy = true;
+		}
+	}
+
+	if (s7_uring_enter(&loop->ring, wait_ms) < 0 && errno != EBUSY)
+		return -1;
+
+	int count = 0;
+	struct io_uring_cqe* cqe = NULL;
+	while ((cqe = s7_uring_peek(&loop->ring)) != NULL)
+	{
+		unsigned long long user_data = cqe->user_data;
+		int res = cqe->res;
+		s7_uring_advance(&loop->ring);
+		s7_loop_complete(loop, user_data, res);
+		count++;
+	}
+	return count;
+}
+
+static bool s7_loop_init_uring(s7_loop_t* loop, int max_connections)
+{
+	unsigned entries = 8;
+	while (entries < (unsigned)max_connections * 2 + 8 && entries < 4096)
+		entries <<= 1;
+	if (!s7_uring_init(&loop->ring, entries))
+		return false;
+
+	size_t length = (size_t)max_connections * 2 * S7_LOOP_SLOT_SIZE;
+	loop->free_slots = (int*)malloc(max_connections * sizeof(int));
+	loop->wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (loop->free_slots == NULL || loop->wake_fd < 0 || posix_memalign((void**)&loop->buffers, 4096, length) != 0)
+	{
+		loop->buffers = NULL;
+		RELEASE_DATA(loop->free_slots);
+		if (loop->wake_fd >= 0) close(loop->wake_fd);
+		s7_uring_exit(&loop->ring);
+		return false;
+	}
+
+	for (int i = max_connections - 1; i >= 0; i--)
+		loop->free_slots[loop->free_count++] = i;
+	loop->fixed_buffers = s7_uring_register_buffer(&loop->ring, loop->buffers, length);
+	return true;
+}
+#endif
+
+static bool s7_loop_init_epoll(s7_loop_t* loop)
+{
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (loop->epoll_fd < 0 || loop->wake_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) != 0)
+	{
+		if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+		if (loop->wake_fd >= 0) close(loop->wake_fd);
+		return false;
+	}
+	return true;
+}
+
+s7_loop_t* s7_loop_create(int request_timeout_ms)
+{
+	s7_loop_options options = { 0 };
+	options.request_timeout_ms = request_timeout_ms;
+	options.backend = S7_LOOP_BACKEND_EPOLL;
+	return s7_loop_create_ex(&options);
+}
+
+s7_loop_t* s7_loop_create_ex(const s7_loop_options* options)
+{
+	if (options == NULL)
+		return NULL;
+
+	s7_loop_t* loop = (s7_loop_t*)calloc(1, sizeof(s7_loop_t));
+	if (loop == NULL)
+		return NULL;
+
+	loop->request_timeout = options->request_timeout_ms > 0 ? options->request_timeout_ms : S7_LOOP_DEFAULT_TIMEOUT;
+	loop->wheel_tick = s7_loop_now() / S7_LOOP_TICK_MS;
+	for (int i = 0; i < S7_LOOP_WHEEL_SLOTS; i++)
+		loop->wheel[i].prev = loop->wheel[i].next = &loop->wheel[i];
+	s7_mpsc_init(&loop->ready);
+	loop->epoll_fd = -1;
+
+#ifdef S7_HAVE_IO_URING
+	int max_connections = options->max_connections > 0 ? options->max_connections : S7_LOOP_MAX_CONNECTIONS;
+	if (options->backend == S7_LOOP_BACKEND_IO_URING && s7_loop_init_uring(loop, max_connections))
+	{
+		loop->backend = S7_LOOP_BACKEND_IO_URING;
+		return loop;
+	}
+#endif
+
+	loop->backend = S7_LOOP_BACKEND_EPOLL;
+	if (!s7_loop_init_epoll(loop))
+	{
+		free(loop);
+		return NULL;
+	}
+	return loop;
+}
+
+s7_loop_backend_e s7_loop_get_backend(const s7_loop_t* loop)
+{
+	return loop != NULL ? loop->backend : S7_LOOP_BACKEND_EPOLL;
+}
+
+static void s7_loop_detach_now(struct _tag_s7_loop_conn* lc);
+
+void s7_loop_destroy(s7_loop_t* loop)
+{
+	if (loop == NULL)
+		return;
+
+	while (loop->conns != NULL)
+		s7_loop_detach_now(loop->conns);
+#ifdef S7_HAVE_IO_URING
+	if (loop->backend == S7_LOOP_BACKEND_IO_URING)
+	{
+		// Tearing the ring down cancels and waits for whatever the zombies still have queued.
+		s7_uring_exit(&loop->ring);
+		while (loop->zombies != NULL)
+			s7_loop_bury(loop->zombies);
+		free(loop->buffers);
+		free(loop->free_slots);
+	}
+#endif
+	while (loop->zombies != NULL)
+		s7_loop_bury(loop->zombies);
+	close(loop->wake_fd);
+	if (loop->epoll_fd >= 0)
+		close(loop->epoll_fd);
+	free(loop);
+}
+
+bool s7_loop_add(s7_loop_t* loop, s7_conn_t* conn)
+{
+	if (loop == NULL || conn == NULL || conn->fd < 0 || conn->io != NULL)
+		return false;
+	if (loop->backend == S7_LOOP_BACKEND_IO_URING && loop->free_count == 0)
+		return false;
+
+	struct _tag_s7_loop_conn* lc = (struct _tag_s7_loop_conn*)calloc(1, sizeof(struct _tag_s7_loop_conn));
+	if (lc == NULL)
+		return false;
+
+	lc->loop = loop;
+	lc->conn = conn;
+	lc->slot = -1;
+	lc->window = s7_conn_get_parallel_jobs(conn) > 0 ? s7_conn_get_parallel_jobs(conn) : 1;
+	lc->inflight = (s7_loop_frame*)calloc(lc->window, sizeof(s7_loop_frame));
+	struct _tag_s7_conn_io* io = lc->inflight != NULL ? s7_conn_io_create() : NULL;
+	if (io == NULL)
+	{
+		RELEASE_DATA(lc->inflight);
+		free(lc);
+		return false;
+	}
+
+#ifdef S7_HAVE_IO_URING
+	if (loop->backend == S7_LOOP_BACKEND_IO_URING)
+	{
+		// Sockets stay blocking: io_uring parks the read instead of failing it with EAGAIN.
+		lc->slot = loop->free_slots[--loop->free_count];
+		lc->tx_slot = loop->buffers + (size_t)lc->slot * 2 * S7_LOOP_SLOT_SIZE;
+		lc->rx_slot = lc->tx_slot + S7_LOOP_SLOT_SIZE;
+		s7_loop_queue_recv(lc);
+		if (!lc->recv_busy)
+		{
+			conn->io = io;
+			s7_conn_io_release(conn);
+			s7_loop_free_conn(lc);
+			return false;
+		}
+	}
+	else
+#endif
+	{
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.ptr = lc;
+		s7_loop_set_blocking(conn->fd, false);
+		if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event) != 0)
+		{
+			s7_loop_set_blocking(conn->fd, true);
+			conn->io = io;
+			s7_conn_io_release(conn);
+			free(lc->inflight);
+			free(lc);
+			return false;
+		}
+	}
+
+	lc->writable = true;
+	lc->next = loop->conns;
+	if (loop->conns != NULL)
+		loop->conns->prev = lc;
+	loop->conns = lc;
+	loop->conn_count++;
+	io->loop_conn = lc;
+	conn->io = io;
+	return true;
+}
+
+static void s7_loop_detach_now(struct _tag_s7_loop_conn* lc)
+{
+	s7_loop_t* loop = lc->loop;
+	s7_conn_t* conn = lc->conn;
+	s7_loop_break(lc, S7_ERROR_CODE_CONNECTION_CLOSED);
+	s7_timer_cancel(loop, &lc->timer);
+
+	// Nobody submits to this connection any more; keep every other connection's ready entry.
+	s7_queue_node* keep = NULL;
+	s7_queue_node* node = NULL;
+	while ((node = s7_mpsc_pop(&loop->ready)) != NULL)
+	{
+		if (node == &lc->ready_node)
+			continue;
+		node->next = keep;
+		keep = node;
+	}
+	while (keep != NULL)
+	{
+		node = keep;
+		keep = keep->next;
+		s7_mpsc_push(&loop->ready, node);
+	}
+
+	if (lc->prev != NULL)
+		lc->prev->next = lc->next;
+	else
+		loop->conns = lc->next;
+	if (lc->next != NULL)
+		lc->next->prev = lc->prev;
+	loop->conn_count--;
+
+#ifdef S7_HAVE_IO_URING
+	if (loop->backend == S7_LOOP_BACKEND_IO_URING)
+	{
+		// The parked read must be gone before the caller closes the socket.
+		struct io_uring_sqe* sqe = lc->recv_busy ? s7_uring_get_sqe(&loop->ring) : NULL;
+		if (sqe != NULL)
+		{
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = (unsigned long long)(uintptr_t)lc | S7_LOOP_OP_RECV;
+			sqe->user_data = (unsigned long long)(uintptr_t)lc | S7_LOOP_OP_CANCEL;
+			s7_uring_enter(&loop->ring, 0);
+		}
+	}
+#endif
+
+	if (loop->backend == S7_LOOP_BACKEND_EPOLL && conn->fd >= 0)
+		s7_loop_set_blocking(conn->fd, true);
+	s7_conn_io_release(conn);
+	lc->conn = NULL;
+
+	// Removed from a callback: the pass that ran it still holds lc in its events, ready queue or call stack.
+	if (g_running_loop == loop || lc->recv_busy || lc->send_busy)
+	{
+		lc->detached = true;
+		lc->prev = NULL;
+		lc->next = loop->zombies;
+		if (loop->zombies != NULL)
+			loop->zombies->prev = lc;
+		loop->zombies = lc;
+	}
+	else
+		s7_loop_free_conn(lc);
+}
+
+void s7_loop_remove(s7_loop_t* loop, s7_conn_t* conn)
+{
+	if (loop == NULL || conn == NULL || conn->io == NULL || conn->io->loop_conn == NULL || conn->io->loop_conn->loop != loop)
+		return;
+
+	s7_loop_detach_now(conn->io->loop_conn);
+}
+
+static int s7_loop_wait_epoll(s7_loop_t* loop, int wait_ms)
+{
+	struct epoll_event events[S7_LOOP_MAX_EVENTS];
+	int count = epoll_wait(loop->epoll_fd, events, S7_LOOP_MAX_EVENTS, wait_ms);
+	if (count < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < count; i++)
+	{
+		struct _tag_s7_loop_conn* lc = (struct _tag_s7_loop_conn*)events[i].data.ptr;
+		if (lc == NULL)
+		{
+			uint64_t value = 0;
+			(void)!read(loop->wake_fd, &value, sizeof(value));
+			continue;
+		}
+		// Removed by a callback of an earlier event; still allocated until the pass is over.
+		if (lc->detached)
+			continue;
+
+		if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			s7_loop_receive(lc);
+		if (events[i].events & EPOLLOUT)
+			lc->writable = true;
+		s7_loop_send(lc);
+	}
+	return count;
+}
+
+int s7_loop_run(s7_loop_t* loop, int timeout_ms)
+{
+	if (loop == NULL)
+		return -1;
+
+	// Timers are checked once per tick while anything is in flight.
+	int wait_ms = timeout_ms;
+	if (loop->armed > 0 && (wait_ms < 0 || wait_ms > S7_LOOP_TICK_MS))
+		wait_ms = S7_LOOP_TICK_MS;
+
+	s7_loop_t* outer = g_running_loop;
+	g_running_loop = loop;
+	int count = 0;
+#ifdef S7_HAVE_IO_URING
+	if (loop->backend == S7_LOOP_BACKEND_IO_URING)
+		count = s7_loop_wait_uring(loop, wait_ms);
+	else
+#endif
+		count = s7_loop_wait_epoll(loop, wait_ms);
+	if (count < 0)
+	{
+		g_running_loop = outer;
+		if (outer != loop)
+			s7_loop_reap(loop);
+		return -1;
+	}
+
+	s7_atomic_store_long(&loop->wake_pending, 0);
+	s7_queue_node* node = NULL;
+	while ((node = s7_mpsc_pop(&loop->ready)) != NULL)
+	{
+		struct _tag_s7_loop_conn* lc = (struct _tag_s7_loop_conn*)node;
+		if (lc->detached)
+			continue;
+		s7_loop_take_jobs(lc);
+		s7_loop_send(lc);
+	}
+
+	s7_loop_expire(loop);
+	g_running_loop = outer;
+	if (outer != loop)
+		s7_loop_reap(loop);
+	return count;
+}
+
+int s7_loop_get_connection_count(const s7_loop_t* loop)
+{
+	return loop != NULL ? loop->conn_count : 0;
+}
+
+// Adds and removals are queued to the shared loop's thread, the only one that may change its connections.
+static void s7_shared_loop_main(void* arg)
+{
+	s7_loop_t* loop = (s7_loop_t*)arg;
+	for (;;)
+	{
+		s7_mutex_lock(&g_shared_lock);
+		s7_shared_request* request = g_shared_requests;
+		g_shared_requests = NULL;
+		s7_mutex_unlock(&g_shared_lock);
+
+		while (request != NULL)
+		{
+			// The request lives on its caller's stack and is gone once done is seen.
+			s7_shared_request* next = request->next;
+			bool ok = true;
+			if (request->detach != NULL)
+				s7_loop_detach_now(request->detach);
+			else
+				ok = s7_loop_add(loop, request->conn) || request->conn->io != NULL;
+
+			s7_mutex_lock(&g_shared_lock);
+			request->ok = ok;
+			request->done = true;
+			s7_cond_broadcast(&g_shared_done);
+			s7_mutex_unlock(&g_shared_lock);
+			request = next;
+		}
+		s7_loop_run(loop, -1);
+	}
+}
+
+static bool s7_shared_loop_call(s7_loop_t* loop, s7_shared_request* request)
+{
+	s7_mutex_lock(&g_shared_lock);
+	request->next = g_shared_requests;
+	g_shared_requests = request;
+	s7_mutex_unlock(&g_shared_lock);
+	s7_loop_wake(loop);
+
+	s7_mutex_lock(&g_shared_lock);
+	while (!request->done)
+		s7_cond_wait(&g_shared_done, &g_shared_lock);
+	s7_mutex_unlock(&g_shared_lock);
+	return request->ok;
+}
+
+bool s7_loop_adopt(s7_conn_t* conn)
+{
+	s7_mutex_lock(&g_shared_lock);
+	if (g_shared_loop == NULL)
+	{
+		s7_loop_t* loop = s7_loop_create(S7_LOOP_DEFAULT_TIMEOUT);
+		if (loop != NULL && s7_thread_start(&g_shared_thread, s7_shared_loop_main, loop))
+		{
+			s7_cond_init(&g_shared_done);
+			g_shared_loop = loop;
+		}
+		else
+			s7_loop_destroy(loop);
+	}
+	s7_loop_t* loop = g_shared_loop;
+	s7_mutex_unlock(&g_shared_lock);
+	if (loop == NULL)
+		return false;
+
+	// A callback of the shared loop may start async calls on another connection itself.
+	if (g_running_loop == loop)
+		return s7_loop_add(loop, conn) || conn->io != NULL;
+
+	s7_shared_request request = { conn, NULL, false, false, NULL };
+	return s7_shared_loop_call(loop, &request);
+}
+
+void s7_loop_detach(struct _tag_s7_loop_conn* lc)
+{
+	s7_mutex_lock(&g_shared_lock);
+	bool shared = lc->loop == g_shared_loop;
+	s7_mutex_unlock(&g_shared_lock);
+	if (!shared || g_running_loop == lc->loop)
+	{
+		s7_loop_detach_now(lc);
+		return;
+	}
+
+	s7_shared_request request = { NULL, lc, false, false, NULL };
+	s7_shared_loop_call(lc->loop, &request);
+}
+
+#else
+
+s7_loop_t* s7_loop_create(int request_timeout_ms)
+{
+	(void)request_timeout_ms;
+	return NULL;
+}
+
+s7_loop_t* s7_loop_create_ex(const s7_loop_options* options)
+{
+	(void)options;
+	return NULL;
+}
+
+s7_loop_backend_e s7_loop_get_backend(const s7_loop_t* loop)
+{
+	(void)loop;
+	return S7_LOOP_BACKEND_EPOLL;
+}
+
+void s7_loop_destroy(s7_loop_t* loop)
+{
+	(void)loop;
+}
+
+bool s7_loop_add(s7_loop_t* loop, s7_conn_t* conn)
+{
+	(void)loop;
+	(void)conn;
+	return false;
+}
+
+void s7_loop_remove(s7_loop_t* loop, s7_conn_t* conn)
+{
+	(void)loop;
+	(void)conn;
+}
+
+int s7_loop_run(s7_loop_t* loop, int timeout_ms)
+{
+	(void)loop;
+	(void)timeout_ms;
+	return -1;
+}
+
+int s7_loop_get_connection_count(const s7_loop_t* loop)
+{
+	(void)loop;
+	return 0;
+}
+
+void s7_loop_notify(struct _tag_s7_loop_conn* loop_conn)
+{
+	(void)loop_conn;
+}
+
+bool s7_loop_is_current(const struct _tag_s7_loop_conn* loop_conn)
+{
+	(void)loop_conn;
+	return false;
+}
+
+void s7_loop_detach(struct _tag_s7_loop_conn* loop_conn)
+{
+	(void)loop_conn;
+}
+
+bool s7_loop_adopt(s7_conn_t* conn)
+{
+	(void)conn;
+	return false;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_LOOP_H__
+#define __H_SIEMENS_S7_LOOP_H__
+
+#include "siemens_s7_conn.h"
+
+// Event loop driving many connections from the thread that runs it (Linux only; create fails elsewhere)
+typedef struct _tag_s7_loop s7_loop_t;
+
+typedef enum _tag_s7_loop_backend {
+	S7_LOOP_BACKEND_EPOLL = 0,		// Readiness events, one send/recv call per socket operation
+	S7_LOOP_BACKEND_IO_URING		// Every send and receive of one iteration in a single io_uring_enter, on registered buffers
+} s7_loop_backend_e;
+
+typedef struct _tag_s7_loop_options {
+	int		request_timeout_ms;		// <=0 uses 5000 ms, the blocking socket timeout
+	s7_loop_backend_e backend;		// io_uring falls back to epoll when the kernel lacks it (needs 5.11)
+	int		max_connections;		// io_uring: connections with a registered buffer slot, <=0 uses 512
+} s7_loop_options;
+
+s7_loop_t* s7_loop_create(int request_timeout_ms); //epoll backend
+s7_loop_t* s7_loop_create_ex(const s7_loop_options* options);
+s7_loop_backend_e s7_loop_get_backend(const s7_loop_t* loop);
+void s7_loop_destroy(s7_loop_t* loop); //removes the remaining connections
+
+// The loop becomes the connection's I/O owner: jobs, async calls and the fd API from other threads go through it.
+// Call add/remove on the loop thread, from its callbacks too, or while the loop is not running; s7_conn_disconnect() removes as well.
+bool s7_loop_add(s7_loop_t* loop, s7_conn_t* conn);
+void s7_loop_remove(s7_loop_t* loop, s7_conn_t* conn); //pending jobs complete with S7_ERROR_CODE_CONNECTION_CLOSED
+
+// Wait up to timeout_ms for socket events, submissions or timer expiry, then dispatch them; -1 on error
+int s7_loop_run(s7_loop_t* loop, int timeout_ms);
+int s7_loop_get_connection_count(const s7_loop_t* loop);
+
+#endif//__H_SIEMENS_S7_LOOP_H__
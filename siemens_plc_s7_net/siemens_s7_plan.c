@@ -0,0 +1,424 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_plan.h"
+#include "siemens_helper.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct _tag_s7_plan_tag {
+	byte*	data;				// Caller buffer the value is scattered into
+	int		range;				// Index of the covering range
+	int		offset;				// Byte offset of the value inside the plan buffer
+	int		length;				// Number of bytes to copy
+	int		bit;				// Bit index for bit tags read through a byte range, -1 otherwise
+	s7_error_code_e status;		// Parse status, reported on every execution
+} s7_plan_tag;
+
+typedef struct _tag_s7_plan_range {
+	siemens_s7_address_data address;	// Area, DB block, start and byte length of the range
+	bool	is_bit;						// Single bit item of an area that is never coalesced
+	int		offset;						// Offset of the range inside the plan buffer
+	s7_error_code_e result;				// Worst item result of the last execution
+} s7_plan_range;
+
+typedef struct _tag_s7_plan_segment {
+	s7_request_item item;		// PDU-sized slice of a range
+	int		range;				// Index of the owning range
+	int		response_size;		// Bytes the slice occupies in a Read Var response
+} s7_plan_segment;
+
+typedef struct _tag_s7_plan_request {
+	byte_array_info command;	// Prebuilt Read Var frame
+	s7_request_item* items;		// Items decoded from the response
+	int*	ranges;				// Owning range of every item
+	int		count;				// Number of items
+	int		response_used;		// Response bytes already claimed while packing
+} s7_plan_request;
+
+struct _tag_s7_read_plan {
+	s7_plan_tag*		tags;
+	int					tag_count;
+	s7_plan_range*		ranges;
+	int					range_count;
+	s7_plan_request*	requests;
+	int					request_count;
+	s7_error_code_e*	item_results;	// Scratch for the per-item codes of one response
+	s7_pdu_job*			jobs;			// One pipelined job per request
+	byte*				buffer;			// Backing store of every range
+	int					buffer_length;
+	int					pdu_size;		// PDU size the requests were packed for
+};
+
+typedef struct _tag_s7_plan_entry {
+	int		tag;
+	siemens_s7_address_data address;
+	bool	is_bit;
+	bool	coalesce;
+	int		start;			// First byte covered, in bytes
+	int		end;			// One past the last byte covered
+} s7_plan_entry;
+
+// Only byte-addressed areas can be merged; word areas, timers and counters keep one range per tag.
+static bool s7_plan_can_coalesce(byte data_code)
+{
+	return data_code == 0x81 || data_code == 0x82 || data_code == 0x83 || data_code == 0x84;
+}
+
+static int s7_plan_entry_compare(const void* left, const void* right)
+{
+	const s7_plan_entry* a = (const s7_plan_entry*)left;
+	const s7_plan_entry* b = (const s7_plan_entry*)right;
+	if (a->coalesce != b->coalesce)
+		return a->coalesce ? -1 : 1;
+	if (a->address.data_code != b->address.data_code)
+		return a->address.data_code - b->address.data_code;
+	if (a->address.db_block != b->address.db_block)
+		return a->address.db_block - b->address.db_block;
+	if (a->start != b->start)
+		return a->start - b->start;
+	return a->tag - b->tag;
+}
+
+static int s7_plan_segment_compare(const void* left, const void* right)
+{
+	const s7_plan_segment* a = (const s7_plan_segment*)left;
+	const s7_plan_segment* b = (const s7_plan_segment*)right;
+	if (a->response_size != b->response_size)
+		return b->response_size - a->response_size;
+	return a->range - b->range;
+}
+
+static void s7_plan_release_requests(s7_read_plan* plan)
+{
+	for (int i = 0; i < plan->request_count; i++)
+	{
+		RELEASE_FRAME(plan->requests[i].command.data);
+		RELEASE_DATA(plan->requests[i].items);
+		RELEASE_DATA(plan->requests[i].ranges);
+	}
+	RELEASE_DATA(plan->requests);
+	RELEASE_DATA(plan->item_results);
+	RELEASE_DATA(plan->jobs);
+	plan->request_count = 0;
+}
+
+void s7_read_plan_destroy(s7_read_plan* plan)
+{
+	if (plan == NULL)
+		return;
+
+	s7_plan_release_requests(plan);
+	RELEASE_DATA(plan->tags);
+	RELEASE_DATA(plan->ranges);
+	RELEASE_DATA(plan->buffer);
+	free(plan);
+}
+
+// Merge sorted entries into ranges and record where every tag lands inside the plan buffer
+static bool s7_plan_build_ranges(s7_read_plan* plan, s7_plan_entry* entries, int entry_count, int max_gap)
+{
+	plan->ranges = (s7_plan_range*)calloc(entry_count > 0 ? entry_count : 1, sizeof(s7_plan_range));
+	if (plan->ranges == NULL)
+		return false;
+
+	s7_plan_range* current = NULL;
+	int current_start = 0, current_end = 0;
+	for (int i = 0; i < entry_count; i++)
+	{
+		s7_plan_entry* entry = &entries[i];
+		bool extend = current != NULL && entry->coalesce && s7_plan_can_coalesce(current->address.data_code) &&
+			current->address.data_code == entry->address.data_code &&
+			current->address.db_block == entry->address.db_block &&
+			entry->start <= current_end + max_gap;
+
+		if (!extend)
+		{
+			current = &plan->ranges[plan->range_count++];
+			current->address = entry->address;
+			current->is_bit = entry->is_bit && !entry->coalesce;
+			current_start = entry->start;
+			current_end = entry->end;
+			if (entry->coalesce)
+				current->address.address_start = entry->start * 8;
+		}
+		else if (entry->end > current_end)
+		{
+			current_end = entry->end;
+		}
+
+		if (entry->coalesce)
+			current->address.length = current_end - current_start;
+
+		s7_plan_tag* tag = &plan->tags[entry->tag];
+		tag->range = plan->range_count - 1;
+		tag->offset = entry->start - current_start;
+		tag->length = entry->is_bit ? 1 : entry->address.length;
+		tag->bit = (entry->is_bit && entry->coalesce) ? entry->address.address_start % 8 : -1;
+	}
+
+	for (int i = 0; i < plan->range_count; i++)
+	{
+		plan->ranges[i].offset = plan->buffer_length;
+		plan->buffer_length += plan->ranges[i].is_bit ? 1 : plan->ranges[i].address.length;
+	}
+
+	for (int i = 0; i < plan->tag_count; i++)
+	{
+		if (plan->tags[i].status == S7_ERROR_CODE_SUCCESS)
+			plan->tags[i].offset += plan->ranges[plan->tags[i].range].offset;
+	}
+
+	plan->buffer = (byte*)calloc(plan->buffer_length > 0 ? plan->buffer_length : 1, 1);
+	return plan->buffer != NULL;
+}
+
+// Slice ranges into PDU-sized segments and first-fit them, largest first, into Read Var requests
+static bool s7_plan_pack_requests(s7_read_plan* plan)
+{
+	int pdu_size = plan->pdu_size;
+	int chunk = s7_read_chunk_size(pdu_size);
+	int max_items = (pdu_size - S7_REQUEST_HEADER_SIZE) / S7_ITEM_SPEC_SIZE;
+	int response_budget = pdu_size - S7_RESPONSE_HEADER_SIZE;
+	if (chunk <= 0 || max_items <= 0)
+		return false;
+
+	int segment_count = 0;
+	for (int i = 0; i < plan->range_count; i++)
+		segment_count += plan->ranges[i].is_bit ? 1 : (plan->ranges[i].address.length + chunk - 1) / chunk;
+
+	s7_plan_segment* segments = (s7_plan_segment*)calloc(segment_count > 0 ? segment_count : 1, sizeof(s7_plan_segment));
+	plan->requests = (s7_plan_request*)calloc(segment_count > 0 ? segment_count : 1, sizeof(s7_plan_request));
+	plan->item_results = (s7_error_code_e*)calloc(max_items, sizeof(s7_error_code_e));
+	if (segments == NULL || plan->requests == NULL || plan->item_results == NULL)
+	{
+		RELEASE_DATA(segments);
+		return false;
+	}
+
+	int index = 0;
+	for (int i = 0; i < plan->range_count; i++)
+	{
+		s7_plan_range* range = &plan->ranges[i];
+		int length = range->is_bit ? 1 : range->address.length;
+		for (int offset = 0; offset < length; offset += chunk)
+		{
+			s7_plan_segment* segment = &segments[index++];
+			segment->range = i;
+			segment->item.is_bit = range->is_bit;
+			segment->item.address = range->address;
+			segment->item.data = plan->buffer + range->offset + offset;
+			if (!range->is_bit)
+			{
+				segment->item.address.length = length - offset < chunk ? length - offset : chunk;
+				if (range->address.data_code == 0x1E || range->address.data_code == 0x1F)
+					segment->item.address.address_start += offset / 2;
+				else
+					segment->item.address.address_start += offset * 8;
+			}
+			segment->response_size = s7_read_item_response_size(&segment->item);
+		}
+	}
+
+	qsort(segments, segment_count, sizeof(s7_plan_segment), s7_plan_segment_compare);
+
+	bool is_ok = true;
+	for (int i = 0; i < segment_count && is_ok; i++)
+	{
+		s7_plan_request* target = NULL;
+		for (int j = 0; j < plan->request_count; j++)
+		{
+			s7_plan_request* request = &plan->requests[j];
+			if (request->count < max_items && request->response_used + segments[i].response_size <= response_budget)
+			{
+				target = request;
+				break;
+			}
+		}
+
+		if (target == NULL)
+		{
+			target = &plan->requests[plan->request_count++];
+			target->items = (s7_request_item*)malloc(sizeof(s7_request_item) * max_items);
+			target->ranges = (int*)malloc(sizeof(int) * max_items);
+			if (target->items == NULL || target->ranges == NULL)
+			{
+				is_ok = false;
+				break;
+			}
+		}
+
+		target->items[target->count] = segments[i].item;
+		target->ranges[target->count] = segments[i].range;
+		target->count++;
+		target->response_used += segments[i].response_size;
+	}
+
+	for (int i = 0; i < plan->request_count && is_ok; i++)
+	{
+		plan->requests[i].command = build_read_multi_command(NULL, plan->requests[i].items, plan->requests[i].count);
+		is_ok = plan->requests[i].command.data != NULL;
+	}
+
+	if (is_ok)
+	{
+		plan->jobs = (s7_pdu_job*)calloc(plan->request_count > 0 ? plan->request_count : 1, sizeof(s7_pdu_job));
+		is_ok = plan->jobs != NULL;
+	}
+
+	RELEASE_DATA(segments);
+	return is_ok;
+}
+
+// Pack the ranges again for a smaller PDU; on failure the plan keeps no requests and tries again next time
+static bool s7_plan_repack(s7_read_plan* plan, int pdu_size)
+{
+	int packed_for = plan->pdu_size;
+	s7_plan_release_requests(plan);
+	plan->pdu_size = pdu_size;
+	if (s7_plan_pack_requests(plan))
+		return true;
+
+	s7_plan_release_requests(plan);
+	plan->pdu_size = packed_for;
+	return false;
+}
+
+s7_read_plan* s7_read_plan_create(const s7_multi_item* tags, int count, int max_gap)
+{
+	if (tags == NULL || count <= 0 || max_gap < 0)
+		return NULL;
+
+	s7_read_plan* plan = (s7_read_plan*)calloc(1, sizeof(s7_read_plan));
+	s7_plan_entry* entries = (s7_plan_entry*)calloc(count, sizeof(s7_plan_entry));
+	if (plan == NULL || entries == NULL)
+	{
+		RELEASE_DATA(plan);
+		RELEASE_DATA(entries);
+		return NULL;
+	}
+
+	plan->tag_count = count;
+	plan->pdu_size = get_plc_PDU_size();
+	plan->tags = (s7_plan_tag*)calloc(count, sizeof(s7_plan_tag));
+	if (plan->tags == NULL)
+	{
+		RELEASE_DATA(entries);
+		s7_read_plan_destroy(plan);
+		return NULL;
+	}
+
+	int entry_count = 0;
+	for (int i = 0; i < count; i++)
+	{
+		s7_plan_tag* tag = &plan->tags[i];
+		tag->data = tags[i].data;
+		tag->status = S7_ERROR_CODE_SUCCESS;
+		if (tags[i].address == NULL || tags[i].data == NULL || (!tags[i].is_bit && tags[i].length <= 0))
+		{
+			tag->status = S7_ERROR_CODE_INVALID_PARAMETER;
+			continue;
+		}
+
+		s7_plan_entry* entry = &entries[entry_count];
+		if (!s7_analysis_address(tags[i].address, tags[i].is_bit ? 1 : tags[i].length, &entry->address))
+		{
+			tag->status = S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+			continue;
+		}
+
+		entry->tag = i;
+		entry->is_bit = tags[i].is_bit;
+		entry->coalesce = s7_plan_can_coalesce(entry->address.data_code);
+		entry->start = entry->coalesce ? entry->address.address_start / 8 : 0;
+		entry->end = entry->start + (entry->is_bit ? 1 : entry->address.length);
+		entry_count++;
+	}
+
+	qsort(entries, entry_count, sizeof(s7_plan_entry), s7_plan_entry_compare);
+
+	bool is_ok = s7_plan_build_ranges(plan, entries, entry_count, max_gap) && s7_plan_pack_requests(plan);
+	RELEASE_DATA(entries);
+	if (!is_ok)
+	{
+		s7_read_plan_destroy(plan);
+		return NULL;
+	}
+	return plan;
+}
+
+int s7_read_plan_request_count(const s7_read_plan* plan)
+{
+	return plan != NULL ? plan->request_count : 0;
+}
+
+s7_error_code_e s7_read_plan_execute(int fd, s7_read_plan* plan, s7_error_code_e* results)
+{
+	if (fd < 0 || plan == NULL || results == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	for (int i = 0; i < plan->range_count; i++)
+		plan->ranges[i].result = S7_ERROR_CODE_SUCCESS;
+
+	// Requests are packed for the PDU this connection negotiated: a bigger one would be rejected by the PLC,
+	// a smaller one (the template's default before any connect) would send more requests than needed.
+	s7_conn_t* conn = s7_conn_from_fd(fd);
+	s7_error_code_e ret = S7_ERROR_CODE_SUCCESS;
+	if (plan->range_count > 0 && conn->pdu_size != plan->pdu_size && !s7_plan_repack(plan, conn->pdu_size))
+	{
+		ret = S7_ERROR_CODE_MALLOC_FAILED;
+		for (int i = 0; i < plan->range_count; i++)
+			plan->ranges[i].result = ret;
+	}
+	else if (plan->request_count > 0)
+	{
+		for (int i = 0; i < plan->request_count; i++)
+			plan->jobs[i].request = plan->requests[i].command;
+		ret = s7_conn_exchange(conn, plan->jobs, plan->request_count);
+	}
+
+	for (int i = 0; i < plan->request_count; i++)
+	{
+		s7_plan_request* request = &plan->requests[i];
+		s7_pdu_job* job = &plan->jobs[i];
+		for (int j = 0; j < request->count; j++)
+			plan->item_results[j] = job->result != S7_ERROR_CODE_SUCCESS ? job->result : S7_ERROR_CODE_RESPONSE_HEADER_FAILED;
+
+		if (job->result == S7_ERROR_CODE_SUCCESS)
+		{
+			s7_analysis_read_multi(job->response, request->items, request->count, plan->item_results);
+			RELEASE_FRAME(job->response.data);
+		}
+
+		for (int j = 0; j < request->count; j++)
+		{
+			s7_plan_range* range = &plan->ranges[request->ranges[j]];
+			if (range->result == S7_ERROR_CODE_SUCCESS)
+				range->result = plan->item_results[j];
+		}
+	}
+
+	s7_error_code_e first_failure = S7_ERROR_CODE_SUCCESS;
+	for (int i = 0; i < plan->tag_count; i++)
+	{
+		s7_plan_tag* tag = &plan->tags[i];
+		results[i] = tag->status != S7_ERROR_CODE_SUCCESS ? tag->status : plan->ranges[tag->range].result;
+		if (results[i] == S7_ERROR_CODE_SUCCESS)
+		{
+			if (tag->bit >= 0)
+				tag->data[0] = (byte)((plan->buffer[tag->offset] >> tag->bit) & 0x01);
+			else
+				memcpy(tag->data, plan->buffer + tag->offset, tag->length);
+		}
+		else if (first_failure == S7_ERROR_CODE_SUCCESS)
+		{
+			first_failure = results[i];
+		}
+	}
+
+	return ret != S7_ERROR_CODE_SUCCESS ? ret : first_failure;
+}
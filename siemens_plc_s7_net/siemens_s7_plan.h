@@ -0,0 +1,24 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_PLAN_H__
+#define __H_SIEMENS_S7_PLAN_H__
+
+#include "siemens_s7.h"
+
+// Reusable read plan: tags coalesced into contiguous ranges and packed into PDU-sized requests
+typedef struct _tag_s7_read_plan s7_read_plan;
+
+// Build a plan for the given tags; the tag data buffers must stay valid for the plan lifetime.
+// max_gap is the largest number of unused bytes bridged when merging neighbouring tags.
+// Requests are packed for get_plc_PDU_size() at creation and packed again when executed on a connection with another PDU size.
+s7_read_plan* s7_read_plan_create(const s7_multi_item* tags, int count, int max_gap);
+s7_error_code_e s7_read_plan_execute(int fd, s7_read_plan* plan, s7_error_code_e* results); //results: one code per tag
+int s7_read_plan_request_count(const s7_read_plan* plan);
+void s7_read_plan_destroy(s7_read_plan* plan);
+
+#endif//__H_SIEMENS_S7_PLAN_H__
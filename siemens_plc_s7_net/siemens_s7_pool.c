@@ -0,0 +1,283 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_pool.h"
+#include "siemens_s7_queue.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef enum _tag_s7_pool_state {
+	S7_POOL_MEMBER_DOWN = 0,
+	S7_POOL_MEMBER_UP,
+	S7_POOL_MEMBER_RECONNECTING		// Owned by a reconnect pass, never picked
+} s7_pool_state;
+
+struct _tag_s7_pool_member {
+	s7_conn_t*		conn;
+	volatile long	outstanding;	// Jobs submitted and not yet completed
+	volatile long	failed;			// A completion broke the transport; skipped until reconnected
+	s7_pool_state	state;			// Guarded by the pool lock
+	int				submitting;		// Submitters between picking this member and queueing, guarded by the pool lock
+};
+
+struct _tag_s7_pool {
+	s7_mutex		lock;			// Guards member state; never held while connecting or preparing frames
+	s7_cond			idle;			// A member being taken down waits here for its submitters
+	s7_mutex		reconnect_lock;	// One reconnect pass at a time, also guards the address
+	struct _tag_s7_pool_member* members;
+	int				size;
+	unsigned int	next;			// Rotates the search start so ties spread over the members
+	char			ip_address[64];
+	int				port;
+	s7_connect_options options;
+	bool			has_options;
+};
+
+// A member disconnected under a job has to be reopened as well
+static bool s7_pool_is_transport_error(s7_error_code_e result)
+{
+	return s7_is_transport_error(result) || result == S7_ERROR_CODE_CONNECTION_CLOSED;
+}
+
+void s7_pool_job_started(struct _tag_s7_pool_member* member)
+{
+	s7_atomic_add_long(&member->outstanding, 1);
+}
+
+void s7_pool_job_done(struct _tag_s7_pool_member* member, s7_error_code_e result)
+{
+	if (s7_pool_is_transport_error(result))
+		s7_atomic_store_long(&member->failed, 1);
+	s7_atomic_add_long(&member->outstanding, -1);
+}
+
+s7_pool_t* s7_pool_create(const s7_conn_t* settings, int size)
+{
+	if (settings == NULL || size <= 0)
+		return NULL;
+
+	s7_pool_t* pool = (s7_pool_t*)calloc(1, sizeof(s7_pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	s7_mutex_init(&pool->lock);
+	s7_mutex_init(&pool->reconnect_lock);
+	s7_cond_init(&pool->idle);
+	pool->members = (struct _tag_s7_pool_member*)calloc(size, sizeof(struct _tag_s7_pool_member));
+	for (int i = 0; pool->members != NULL && i < size; i++)
+	{
+		pool->members[i].conn = s7_conn_create_from(settings);
+		if (pool->members[i].conn == NULL)
+			break;
+		pool->size++;
+	}
+	if (pool->size < size)
+	{
+		s7_pool_destroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void s7_pool_destroy(s7_pool_t* pool)
+{
+	if (pool == NULL)
+		return;
+
+	for (int i = 0; i < pool->size; i++)
+		s7_conn_destroy(pool->members[i].conn);
+	RELEASE_DATA(pool->members);
+	s7_cond_destroy(&pool->idle);
+	s7_mutex_destroy(&pool->reconnect_lock);
+	s7_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+// Take the member out of rotation and wait until nobody is about to queue on it
+static void s7_pool_take_member(s7_pool_t* pool, struct _tag_s7_pool_member* member)
+{
+	member->state = S7_POOL_MEMBER_RECONNECTING;
+	while (member->submitting > 0)
+		s7_cond_wait(&pool->idle, &pool->lock);
+}
+
+static bool s7_pool_open_member(s7_pool_t* pool, struct _tag_s7_pool_member* member)
+{
+	// Whatever is still queued completes with S7_ERROR_CODE_CONNECTION_CLOSED first.
+	s7_conn_disconnect(member->conn);
+	s7_atomic_store_long(&member->failed, 0);
+	if (!s7_conn_connect(member->conn, pool->ip_address, pool->port, pool->has_options ? &pool->options : NULL))
+		return false;
+	return s7_conn_start_io(member->conn);
+}
+
+static int s7_pool_reconnect(s7_pool_t* pool, bool all)
+{
+	for (int i = 0; i < pool->size; i++)
+	{
+		struct _tag_s7_pool_member* member = &pool->members[i];
+		s7_mutex_lock(&pool->lock);
+		bool needed = all || member->state == S7_POOL_MEMBER_DOWN || s7_atomic_load_long(&member->failed) != 0;
+		if (needed)
+			s7_pool_take_member(pool, member);
+		s7_mutex_unlock(&pool->lock);
+		if (!needed)
+			continue;
+
+		bool is_up = s7_pool_open_member(pool, member);
+		s7_mutex_lock(&pool->lock);
+		member->state = is_up ? S7_POOL_MEMBER_UP : S7_POOL_MEMBER_DOWN;
+		s7_mutex_unlock(&pool->lock);
+	}
+	return s7_pool_get_connected_count(pool);
+}
+
+int s7_pool_connect(s7_pool_t* pool, const char* ip_addr, int port, const s7_connect_options* options)
+{
+	if (pool == NULL || ip_addr == NULL)
+		return 0;
+
+	s7_mutex_lock(&pool->reconnect_lock);
+	strncpy(pool->ip_address, ip_addr, sizeof(pool->ip_address) - 1);
+	pool->ip_address[sizeof(pool->ip_address) - 1] = '\0';
+	pool->port = port;
+	pool->has_options = options != NULL;
+	if (options != NULL)
+		pool->options = *options;
+	int count = s7_pool_reconnect(pool, true);
+	s7_mutex_unlock(&pool->reconnect_lock);
+	return count;
+}
+
+int s7_pool_maintain(s7_pool_t* pool)
+{
+	if (pool == NULL)
+		return 0;
+
+	s7_mutex_lock(&pool->reconnect_lock);
+	int count = pool->ip_address[0] != '\0' ? s7_pool_reconnect(pool, false) : 0;
+	s7_mutex_unlock(&pool->reconnect_lock);
+	return count;
+}
+
+int s7_pool_get_size(const s7_pool_t* pool)
+{
+	return pool != NULL ? pool->size : 0;
+}
+
+int s7_pool_get_connected_count(s7_pool_t* pool)
+{
+	if (pool == NULL)
+		return 0;
+
+	int count = 0;
+	s7_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->size; i++)
+	{
+		if (pool->members[i].state == S7_POOL_MEMBER_UP && s7_atomic_load_long(&pool->members[i].failed) == 0)
+			count++;
+	}
+	s7_mutex_unlock(&pool->lock);
+	return count;
+}
+
+int s7_pool_get_outstanding(s7_pool_t* pool)
+{
+	if (pool == NULL)
+		return 0;
+
+	long count = 0;
+	for (int i = 0; i < pool->size; i++)
+		count += s7_atomic_load_long(&pool->members[i].outstanding);
+	return (int)count;
+}
+
+// Least outstanding requests wins; the caller queues on it and then calls s7_pool_put_member()
+static struct _tag_s7_pool_member* s7_pool_get_member(s7_pool_t* pool)
+{
+	struct _tag_s7_pool_member* best = NULL;
+	long best_outstanding = 0;
+
+	s7_mutex_lock(&pool->lock);
+	int start = (int)(pool->next++ % (unsigned int)pool->size);
+	for (int i = 0; i < pool->size; i++)
+	{
+		struct _tag_s7_pool_member* member = &pool->members[(start + i) % pool->size];
+		if (member->state != S7_POOL_MEMBER_UP || s7_atomic_load_long(&member->failed) != 0)
+			continue;
+
+		long outstanding = s7_atomic_load_long(&member->outstanding);
+		if (best == NULL || outstanding < best_outstanding)
+		{
+			best = member;
+			best_outstanding = outstanding;
+		}
+	}
+	if (best != NULL)
+		best->submitting++;
+	s7_mutex_unlock(&pool->lock);
+	return best;
+}
+
+static void s7_pool_put_member(s7_pool_t* pool, struct _tag_s7_pool_member* member)
+{
+	s7_mutex_lock(&pool->lock);
+	if (--member->submitting == 0 && member->state == S7_POOL_MEMBER_RECONNECTING)
+		s7_cond_broadcast(&pool->idle);
+	s7_mutex_unlock(&pool->lock);
+}
+
+static s7_job_t* s7_pool_submit_transfer(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write)
+{
+	if (pool == NULL)
+		return NULL;
+
+	struct _tag_s7_pool_member* member = s7_pool_get_member(pool);
+	if (member == NULL)
+		return NULL;
+
+	s7_job_t* job = s7_conn_submit_transfer(member->conn, items, count, results, is_write, member);
+	s7_pool_put_member(pool, member);
+	return job;
+}
+
+static s7_error_code_e s7_pool_submit_async(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	s7_async_callback callback, void* user_data)
+{
+	if (pool == NULL || results == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	struct _tag_s7_pool_member* member = s7_pool_get_member(pool);
+	if (member == NULL)
+		return S7_ERROR_CODE_CONNECTION_CLOSED;
+
+	s7_error_code_e ret = s7_conn_submit_async(member->conn, items, count, results, is_write, callback, user_data, member);
+	s7_pool_put_member(pool, member);
+	return ret;
+}
+
+s7_job_t* s7_pool_submit_read(s7_pool_t* pool, s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_pool_submit_transfer(pool, items, count, results, false);
+}
+
+s7_job_t* s7_pool_submit_write(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results)
+{
+	return s7_pool_submit_transfer(pool, items, count, results, true);
+}
+
+s7_error_code_e s7_pool_read_multi_async(s7_pool_t* pool, s7_multi_item* items, int count, s7_error_code_e* results,
+	s7_async_callback callback, void* user_data)
+{
+	return s7_pool_submit_async(pool, items, count, results, false, callback, user_data);
+}
+
+s7_error_code_e s7_pool_write_multi_async(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results,
+	s7_async_callback callback, void* user_data)
+{
+	return s7_pool_submit_async(pool, items, count, results, true, callback, user_data);
+}
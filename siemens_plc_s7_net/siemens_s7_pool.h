@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_POOL_H__
+#define __H_SIEMENS_S7_POOL_H__
+
+#include "siemens_s7_job.h"
+
+// Several connections to one PLC; each job goes to the member with the fewest outstanding requests
+typedef struct _tag_s7_pool s7_pool_t;
+
+s7_pool_t* s7_pool_create(const s7_conn_t* settings, int size); //members copy the rack/slot/TSAP of settings
+void s7_pool_destroy(s7_pool_t* pool); //outstanding jobs complete with S7_ERROR_CODE_CONNECTION_CLOSED
+
+// Opens every member with its own handshake and I/O thread; returns how many are up
+int s7_pool_connect(s7_pool_t* pool, const char* ip_addr, int port, const s7_connect_options* options); //options may be NULL
+
+// Reconnects members that are down or failed on the transport, one at a time; jobs keep flowing to the others.
+// Call it from a housekeeping thread or timer, never from a completion callback; returns how many members are up afterwards.
+int s7_pool_maintain(s7_pool_t* pool);
+
+int s7_pool_get_size(const s7_pool_t* pool);
+int s7_pool_get_connected_count(s7_pool_t* pool);
+int s7_pool_get_outstanding(s7_pool_t* pool); //jobs submitted and not yet completed, over all members
+
+// Same contract as s7_conn_submit_read/write; NULL when no member is up
+s7_job_t* s7_pool_submit_read(s7_pool_t* pool, s7_multi_item* items, int count, s7_error_code_e* results);
+s7_job_t* s7_pool_submit_write(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results);
+
+// Same contract as s7_read_multi_async/s7_write_multi_async; S7_ERROR_CODE_CONNECTION_CLOSED when no member is up
+s7_error_code_e s7_pool_read_multi_async(s7_pool_t* pool, s7_multi_item* items, int count, s7_error_code_e* results,
+	s7_async_callback callback, void* user_data);
+s7_error_code_e s7_pool_write_multi_async(s7_pool_t* pool, const s7_multi_item* items, int count, s7_error_code_e* results,
+	s7_async_callback callback, void* user_data);
+
+#endif//__H_SIEMENS_S7_POOL_H__
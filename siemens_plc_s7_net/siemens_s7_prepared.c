@@ -0,0 +1,132 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_prepared.h"
+#include "siemens_helper.h"
+#include <string.h>
+#include <stdlib.h>
+
+struct _tag_s7_prepared {
+	s7_conn_t*		conn;
+	s7_request_item	item;							// Parsed address; data is set per execution
+	bool			is_write;
+	int				length;							// Data bytes per execution, 1 for bits
+	byte			frame[S7_WRITE_HEADER_SIZE];	// Read Var request, or Write Var request up to its data
+	int				frame_length;
+};
+
+static s7_prepared_t* s7_prepare(s7_conn_t* conn, const char* address, int length, bool is_bit, bool is_write)
+{
+	if (conn == NULL || address == NULL || (!is_bit && length <= 0))
+		return NULL;
+
+	s7_prepared_t* prepared = (s7_prepared_t*)calloc(1, sizeof(s7_prepared_t));
+	if (prepared == NULL)
+		return NULL;
+
+	prepared->length = is_bit ? 1 : length;
+	if (!s7_analysis_address(address, prepared->length, &prepared->item.address) ||
+		(is_write && S7_WRITE_HEADER_SIZE + prepared->length > 0xFFFF))
+	{
+		free(prepared);
+		return NULL;
+	}
+
+	prepared->conn = conn;
+	prepared->item.is_bit = is_bit;
+	prepared->is_write = is_write;
+	if (is_write)
+	{
+		build_write_header(prepared->frame, prepared->item.address, is_bit, prepared->length);
+		prepared->frame_length = S7_WRITE_HEADER_SIZE;
+	}
+	else
+	{
+		build_read_request(prepared->frame, prepared->item.address, is_bit);
+		prepared->frame_length = S7_READ_REQUEST_SIZE;
+	}
+	return prepared;
+}
+
+s7_prepared_t* s7_prepare_read(s7_conn_t* conn, const char* address, int length, bool is_bit)
+{
+	return s7_prepare(conn, address, length, is_bit, false);
+}
+
+s7_prepared_t* s7_prepare_write(s7_conn_t* conn, const char* address, int length, bool is_bit)
+{
+	return s7_prepare(conn, address, length, is_bit, true);
+}
+
+void s7_prepared_destroy(s7_prepared_t* prepared)
+{
+	free(prepared);
+}
+
+int s7_prepared_get_length(const s7_prepared_t* prepared)
+{
+	return prepared != NULL ? prepared->length : 0;
+}
+
+// The PDU may have shrunk since the handle was prepared, e.g. after a managed reconnect
+static bool s7_prepared_fits(const s7_prepared_t* prepared)
+{
+	int pdu_size = prepared->conn->pdu_size;
+	if (prepared->is_write)
+		return S7_ITEM_SPEC_SIZE + s7_write_item_request_size(&prepared->item) <= pdu_size - S7_REQUEST_HEADER_SIZE;
+	return s7_read_item_response_size(&prepared->item) <= pdu_size - S7_RESPONSE_HEADER_SIZE;
+}
+
+// Run the frame from a stack copy so concurrent executions never share the PDU reference bytes;
+// the response lands in the caller's stack buffer, so an execution never touches the heap
+static s7_error_code_e s7_prepared_exchange(s7_prepared_t* prepared, const byte* data, byte* response, s7_pdu_job* job)
+{
+	byte request[S7_WRITE_HEADER_SIZE];
+	memcpy(request, prepared->frame, prepared->frame_length);
+	job->request.data = request;
+	job->request.length = prepared->frame_length;
+	job->payload.data = (byte*)data;
+	job->payload.length = data != NULL ? prepared->length : 0;
+	job->response_buffer.data = response;
+	job->response_buffer.length = S7_MAX_RESPONSE_SIZE;
+	return s7_conn_exchange(prepared->conn, job, 1);
+}
+
+s7_error_code_e s7_prepared_read(s7_prepared_t* prepared, byte* buffer)
+{
+	if (prepared == NULL || prepared->is_write || buffer == NULL || prepared->conn->fd < 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+	if (!s7_prepared_fits(prepared))
+		return S7_ERROR_CODE_PDU_SIZE_EXCEEDED;
+
+	byte response[S7_MAX_RESPONSE_SIZE];
+	s7_pdu_job job = { 0 };
+	s7_error_code_e ret = s7_prepared_exchange(prepared, NULL, response, &job);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	s7_request_item item = prepared->item;
+	s7_error_code_e result = S7_ERROR_CODE_FAILED;
+	item.data = buffer;
+	ret = s7_analysis_read_multi(job.response, &item, 1, &result);
+	return ret == S7_ERROR_CODE_SUCCESS ? result : ret;
+}
+
+s7_error_code_e s7_prepared_write(s7_prepared_t* prepared, const byte* data)
+{
+	if (prepared == NULL || !prepared->is_write || data == NULL || prepared->conn->fd < 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+	if (!s7_prepared_fits(prepared))
+		return S7_ERROR_CODE_PDU_SIZE_EXCEEDED;
+
+	byte response[S7_MAX_RESPONSE_SIZE];
+	s7_pdu_job job = { 0 };
+	s7_error_code_e ret = s7_prepared_exchange(prepared, data, response, &job);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+	return job.response.length < MIN_HEADER_SIZE ? S7_ERROR_CODE_RESPONSE_HEADER_FAILED : s7_analysis_write(job.response);
+}
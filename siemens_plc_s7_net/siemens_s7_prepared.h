@@ -0,0 +1,27 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_PREPARED_H__
+#define __H_SIEMENS_S7_PREPARED_H__
+
+#include "siemens_s7_conn.h"
+
+// Single-item access with its address parsed and its frame built once; executing it only stamps the PDU reference and sends
+typedef struct _tag_s7_prepared s7_prepared_t;
+
+// length is the number of bytes to access, ignored for bit items; the handle stays bound to conn and survives reconnects
+s7_prepared_t* s7_prepare_read(s7_conn_t* conn, const char* address, int length, bool is_bit);
+s7_prepared_t* s7_prepare_write(s7_conn_t* conn, const char* address, int length, bool is_bit);
+void s7_prepared_destroy(s7_prepared_t* prepared);
+
+// buffer receives the raw big-endian bytes (one byte 0/1 for bits); data is sent straight from the caller's memory.
+// Handles may be executed from several threads at once; S7_ERROR_CODE_PDU_SIZE_EXCEEDED when the connection's PDU is too small.
+s7_error_code_e s7_prepared_read(s7_prepared_t* prepared, byte* buffer);
+s7_error_code_e s7_prepared_write(s7_prepared_t* prepared, const byte* data);
+int s7_prepared_get_length(const s7_prepared_t* prepared); //bytes read or written per execution
+
+#endif//__H_SIEMENS_S7_PREPARED_H__
@@ -0,0 +1,212 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_queue.h"
+#include <stdlib.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+void s7_mutex_init(s7_mutex* mutex)
+{
+#ifdef _WIN32
+	InitializeSRWLock(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void s7_mutex_destroy(s7_mutex* mutex)
+{
+#ifndef _WIN32
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void s7_mutex_lock(s7_mutex* mutex)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void s7_mutex_unlock(s7_mutex* mutex)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+void s7_cond_init(s7_cond* cond)
+{
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+void s7_cond_destroy(s7_cond* cond)
+{
+#ifndef _WIN32
+	pthread_cond_destroy(cond);
+#endif
+}
+
+void s7_cond_wait(s7_cond* cond, s7_mutex* mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+
+bool s7_cond_timedwait(s7_cond* cond, s7_mutex* mutex, int timeout_ms)
+{
+#ifdef _WIN32
+	return SleepConditionVariableSRW(cond, mutex, (DWORD)timeout_ms, 0) != 0;
+#else
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	return pthread_cond_timedwait(cond, mutex, &deadline) == 0;
+#endif
+}
+
+void s7_cond_signal(s7_cond* cond)
+{
+#ifdef _WIN32
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+void s7_cond_broadcast(s7_cond* cond)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+typedef struct _tag_s7_thread_start {
+	void (*entry)(void*);
+	void* arg;
+} s7_thread_start_info;
+
+#ifdef _WIN32
+static DWORD WINAPI s7_thread_main(LPVOID param)
+#else
+static void* s7_thread_main(void* param)
+#endif
+{
+	s7_thread_start_info info = *(s7_thread_start_info*)param;
+	free(param);
+	info.entry(info.arg);
+	return 0;
+}
+
+bool s7_thread_start(s7_thread* thread, void (*entry)(void*), void* arg)
+{
+	s7_thread_start_info* info = (s7_thread_start_info*)malloc(sizeof(s7_thread_start_info));
+	if (info == NULL)
+		return false;
+
+	info->entry = entry;
+	info->arg = arg;
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, s7_thread_main, info, 0, &thread->id);
+	if (thread->handle == NULL)
+#else
+	if (pthread_create(&thread->handle, NULL, s7_thread_main, info) != 0)
+#endif
+	{
+		free(info);
+		return false;
+	}
+	return true;
+}
+
+void s7_thread_join(s7_thread* thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+}
+
+void s7_thread_detach(s7_thread* thread)
+{
+#ifdef _WIN32
+	CloseHandle(thread->handle);
+#else
+	pthread_detach(thread->handle);
+#endif
+}
+
+void s7_mpsc_init(s7_mpsc_queue* queue)
+{
+	queue->stub.next = NULL;
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+}
+
+void s7_mpsc_push(s7_mpsc_queue* queue, s7_queue_node* node)
+{
+	node->next = NULL;
+	s7_queue_node* prev = (s7_queue_node*)s7_atomic_exchange_ptr(&queue->head, node);
+	// Until this store lands the consumer sees the list end at prev and simply retries later.
+	s7_atomic_store_ptr(&prev->next, node);
+}
+
+s7_queue_node* s7_mpsc_pop(s7_mpsc_queue* queue)
+{
+	s7_queue_node* tail = queue->tail;
+	s7_queue_node* next = (s7_queue_node*)s7_atomic_load_ptr(&tail->next);
+	if (tail == &queue->stub)
+	{
+		if (next == NULL)
+			return NULL;
+		queue->tail = next;
+		tail = next;
+		next = (s7_queue_node*)s7_atomic_load_ptr(&tail->next);
+	}
+
+	if (next != NULL)
+	{
+		queue->tail = next;
+		return tail;
+	}
+
+	// tail is the last linked node: park the stub behind it so tail can be handed out.
+	if (tail != (s7_queue_node*)s7_atomic_load_ptr(&queue->head))
+		return NULL;
+
+	s7_mpsc_push(queue, &queue->stub);
+	next = (s7_queue_node*)s7_atomic_load_ptr(&tail->next);
+	if (next != NULL)
+	{
+		queue->tail = next;
+		return tail;
+	}
+	return NULL;
+}
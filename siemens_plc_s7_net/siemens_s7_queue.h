@@ -0,0 +1,105 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_QUEUE_H__
+#define __H_SIEMENS_S7_QUEUE_H__
+
+#include "siemens_helper.h"
+#include "siemens_s7_job.h"
+
+// Intrusive multi-producer single-consumer queue: push is wait-free from any thread, pop belongs to one consumer
+typedef struct _tag_s7_queue_node {
+	struct _tag_s7_queue_node* next;
+} s7_queue_node;
+
+typedef struct _tag_s7_mpsc_queue {
+	s7_queue_node*	head;		// Last pushed node, swapped by producers
+	s7_queue_node*	tail;		// Next node to pop, consumer only
+	s7_queue_node	stub;		// Keeps the list non-empty so producers never touch tail
+} s7_mpsc_queue;
+
+void s7_mpsc_init(s7_mpsc_queue* queue);
+void s7_mpsc_push(s7_mpsc_queue* queue, s7_queue_node* node);
+s7_queue_node* s7_mpsc_pop(s7_mpsc_queue* queue); //NULL when empty or a push is still linking its node
+
+typedef enum _tag_s7_job_kind {
+	S7_JOB_EXCHANGE = 0,	// Caller-owned PDU jobs, pipelined together with neighbouring exchanges
+	S7_JOB_TRANSFER,		// Batch read/write prepared at submission and decoded by the I/O owner
+	S7_JOB_FRAME			// Prebuilt frame sent on its own with its PDU reference untouched
+} s7_job_kind;
+
+struct _tag_s7_job {
+	s7_queue_node	node;			// Queue link, must stay first
+	s7_conn_t*		conn;
+	s7_job_kind		kind;
+	s7_pdu_job*		pdu_jobs;		// Frames of an exchange or transfer job
+	int				pdu_count;
+	s7_transfer		transfer;		// Batch owned by a transfer job
+	s7_error_code_e* results;		// Caller result array of a transfer job
+	int				item_count;
+	byte_array_info	request;		// Frame job request
+	byte_array_info	response;		// Frame job response, released by the submitter
+	s7_error_code_e	result;
+	int				done;			// Set by the I/O owner under the connection lock
+	bool			heap;			// Allocated by a submit function and freed by s7_job_release()
+	s7_error_code_e	item_result;	// Result slot of a single-item async call
+	int				frames_left;	// Event loop: frames not yet answered or failed
+	s7_async_callback callback;		// Replaces waiting: the job is freed once the callback returns
+	void*			user_data;
+	struct _tag_s7_pool_member* member;	// Pool member the job was balanced onto, told before the submitter
+};
+
+// I/O owner state of a shared connection
+struct _tag_s7_conn_io {
+	s7_mpsc_queue	queue;
+	s7_mutex		lock;			// Only used to sleep and wake, never held while submitting or doing I/O
+	s7_cond			wakeup;			// Owner waits here for new work
+	s7_cond			completion;		// Submitters wait here for their job
+	unsigned int	signals;		// Bumped after every push, guarded by lock
+	int				waiters;		// Submitters blocked on completion, guarded by lock
+	bool			stopping;
+	s7_thread		thread;
+	struct _tag_s7_loop_conn* loop_conn;	// Set instead of thread while an event loop owns the connection
+	bool			managed;		// Started by s7_conn_start_managed_io(), the thread restores dropped sessions
+	s7_reconnect_options reconnect;
+	bool			broken;			// The last batch hit a transport error, owner only
+	volatile long	offline;		// Session dropped: submissions fail at once until it is restored
+	volatile long	reconnects;		// Sessions restored so far
+	int				attempts;		// Failed restores since the drop, owner only
+	long long		retry_at;		// Next restore attempt, monotonic ms, owner only
+	unsigned int	jitter;			// Backoff jitter state, owner only
+	s7_pdu_job*		merged;			// Frames of merged exchange jobs, reused across batches, owner only
+	int				merged_capacity;
+	bool			owner_stopped;	// Stopped from one of its own callbacks: the thread winds down after the batch, owner only
+	bool			owner_destroys;	// Destroyed from one of its own callbacks: the thread frees the connection on exit, owner only
+};
+
+struct _tag_s7_conn_io* s7_conn_io_create(void);
+void s7_conn_io_release(s7_conn_t* conn);
+bool s7_conn_io_defer_destroy(s7_conn_t* conn); //true when called on the connection's I/O thread, which then frees it on exit
+
+void s7_job_complete(s7_job_t* job, s7_error_code_e result);
+void s7_job_finish_exchange(s7_job_t* job); //completes an exchange or transfer job from its frame results
+void s7_job_cancel(s7_job_t* job, s7_error_code_e result);
+bool s7_is_transport_error(s7_error_code_e result); //the byte stream is in an unknown state afterwards
+s7_job_t* s7_conn_submit_transfer(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	struct _tag_s7_pool_member* member);
+s7_error_code_e s7_conn_submit_async(s7_conn_t* conn, const s7_multi_item* items, int count, s7_error_code_e* results, bool is_write,
+	s7_async_callback callback, void* user_data, struct _tag_s7_pool_member* member); //results may be NULL for a single item
+
+// Event loop side of a loop-owned connection, see siemens_s7_loop.c
+void s7_loop_notify(struct _tag_s7_loop_conn* loop_conn); //any thread, after pushing a job
+bool s7_loop_is_current(const struct _tag_s7_loop_conn* loop_conn);
+void s7_loop_detach(struct _tag_s7_loop_conn* loop_conn); //any thread; the shared loop detaches on its own thread
+bool s7_loop_adopt(s7_conn_t* conn); //hand a connection without I/O owner to the shared async loop, false where there is none
+void s7_job_run_batch(s7_conn_t* conn, s7_job_t** jobs, int count);
+
+// Pool side of a balanced job, see siemens_s7_pool.c
+void s7_pool_job_started(struct _tag_s7_pool_member* member);
+void s7_pool_job_done(struct _tag_s7_pool_member* member, s7_error_code_e result);
+
+#endif//__H_SIEMENS_S7_QUEUE_H__
@@ -0,0 +1,527 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#include "siemens_s7_tags.h"
+#include "siemens_helper.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define S7_TAG_MIN_SLOTS 64			// Smallest hash table, kept at most half full
+#define S7_TAG_MAX_FIELDS 4			// name, address, data type, scan group; further columns are ignored
+
+typedef struct _tag_s7_tag_entry {
+	siemens_s7_address_data	address;	// Parsed once; length is the size of the data type
+	uint32	hash;
+	int		name;						// Offsets into the text arena, which moves as it grows
+	int		address_text;
+	int		group;
+	s7_tag_type_e type;
+} s7_tag_entry;
+
+struct _tag_s7_tag_db {
+	s7_tag_entry* tags;
+	int		tag_count;
+	int		tag_capacity;
+	char*	text;						// Every name, address and group, NUL-terminated back to back
+	int		text_length;
+	int		text_capacity;
+	int*	slots;						// Tag id + 1 per slot, 0 when empty; open addressing with linear probing
+	int		slot_count;					// Power of two
+};
+
+typedef struct _tag_s7_tag_field {
+	const char* start;
+	int		length;
+	bool	quoted;						// "" inside stands for one quote
+} s7_tag_field;
+
+typedef struct _tag_s7_tag_type_name {
+	const char*		name;
+	s7_tag_type_e	type;
+} s7_tag_type_name;
+
+static const int s7_tag_type_size[] = { 1, 1, 2, 2, 4, 4, 4, 8, 8, 8 };
+
+static const s7_tag_type_name s7_tag_type_names[] = {
+	{ "Bool", S7_TAG_TYPE_BOOL },
+	{ "Byte", S7_TAG_TYPE_BYTE }, { "USInt", S7_TAG_TYPE_BYTE }, { "SInt", S7_TAG_TYPE_BYTE }, { "Char", S7_TAG_TYPE_BYTE },
+	{ "Word", S7_TAG_TYPE_WORD }, { "UInt", S7_TAG_TYPE_WORD }, { "Date", S7_TAG_TYPE_WORD }, { "S5Time", S7_TAG_TYPE_WORD },
+	{ "Int", S7_TAG_TYPE_INT },
+	{ "DWord", S7_TAG_TYPE_DWORD }, { "UDInt", S7_TAG_TYPE_DWORD }, { "Time_Of_Day", S7_TAG_TYPE_DWORD }, { "TOD", S7_TAG_TYPE_DWORD },
+	{ "DInt", S7_TAG_TYPE_DINT }, { "Time", S7_TAG_TYPE_DINT },
+	{ "Real", S7_TAG_TYPE_REAL },
+	{ "LWord", S7_TAG_TYPE_LWORD }, { "ULInt", S7_TAG_TYPE_LWORD },
+	{ "LInt", S7_TAG_TYPE_LINT }, { "LTime", S7_TAG_TYPE_LINT },
+	{ "LReal", S7_TAG_TYPE_LREAL },
+};
+
+// FNV-1a
+static uint32 s7_tag_hash(const char* name)
+{
+	uint32 hash = 2166136261u;
+	for (; *name != '\0'; name++)
+		hash = (hash ^ (byte)*name) * 16777619u;
+	return hash;
+}
+
+static char s7_tag_lower(char c)
+{
+	return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool s7_tag_field_is(const s7_tag_field* field, const char* word)
+{
+	int i = 0;
+	for (; i < field->length && word[i] != '\0'; i++)
+	{
+		if (s7_tag_lower(field->start[i]) != s7_tag_lower(word[i]))
+			return false;
+	}
+	return i == field->length && word[i] == '\0';
+}
+
+s7_tag_db_t* s7_tag_db_create(void)
+{
+	return (s7_tag_db_t*)calloc(1, sizeof(s7_tag_db_t));
+}
+
+void s7_tag_db_destroy(s7_tag_db_t* db)
+{
+	if (db == NULL)
+		return;
+
+	RELEASE_DATA(db->tags);
+	RELEASE_DATA(db->text);
+	RELEASE_DATA(db->slots);
+	free(db);
+}
+
+static int s7_tag_slot(const s7_tag_db_t* db, const char* name, uint32 hash)
+{
+	int mask = db->slot_count - 1;
+	int slot = (int)(hash & (uint32)mask);
+	for (; db->slots[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const s7_tag_entry* tag = &db->tags[db->slots[slot] - 1];
+		if (tag->hash == hash && strcmp(db->text + tag->name, name) == 0)
+			break;
+	}
+	return slot;
+}
+
+static bool s7_tag_rehash(s7_tag_db_t* db, int slot_count)
+{
+	int* slots = (int*)calloc(slot_count, sizeof(int));
+	if (slots == NULL)
+		return false;
+
+	RELEASE_DATA(db->slots);
+	db->slots = slots;
+	db->slot_count = slot_count;
+	for (int i = 0; i < db->tag_count; i++)
+		db->slots[s7_tag_slot(db, db->text + db->tags[i].name, db->tags[i].hash)] = i + 1;
+	return true;
+}
+
+// Grow every table up front so a whole load runs without reallocating
+static bool s7_tag_reserve(s7_tag_db_t* db, int tags, int text)
+{
+	if (tags > INT_MAX / 4 - db->tag_count || text > INT_MAX / 2 - db->text_length)
+		return false;
+
+	// Grow at least geometrically so tags added one by one stay amortized O(1)
+	int tag_count = db->tag_count + tags;
+	if (tag_count > db->tag_capacity)
+	{
+		int capacity = tag_count > db->tag_capacity * 2 ? tag_count : db->tag_capacity * 2;
+		s7_tag_entry* entries = (s7_tag_entry*)realloc(db->tags, sizeof(s7_tag_entry) * capacity);
+		if (entries == NULL)
+			return false;
+		db->tags = entries;
+		db->tag_capacity = capacity;
+	}
+
+	int text_length = db->text_length + text;
+	if (text_length > db->text_capacity)
+	{
+		int capacity = text_length > db->text_capacity * 2 ? text_length : db->text_capacity * 2;
+		char* arena = (char*)realloc(db->text, capacity);
+		if (arena == NULL)
+			return false;
+		db->text = arena;
+		db->text_capacity = capacity;
+	}
+
+	int slot_count = db->slot_count > 0 ? db->slot_count : S7_TAG_MIN_SLOTS;
+	while (slot_count < tag_count * 2)
+		slot_count *= 2;
+	return slot_count == db->slot_count || s7_tag_rehash(db, slot_count);
+}
+
+// Drop everything added after a failed load or add
+static void s7_tag_rollback(s7_tag_db_t* db, int tag_count, int text_length)
+{
+	db->tag_count = tag_count;
+	db->text_length = text_length;
+	memset(db->slots, 0, sizeof(int) * db->slot_count);
+	for (int i = 0; i < db->tag_count; i++)
+		db->slots[s7_tag_slot(db, db->text + db->tags[i].name, db->tags[i].hash)] = i + 1;
+}
+
+// Space was reserved by the caller
+static int s7_tag_append(s7_tag_db_t* db, const s7_tag_field* field)
+{
+	int offset = db->text_length;
+	char* out = db->text + offset;
+	for (int i = 0; i < field->length; i++)
+	{
+		*out++ = field->start[i];
+		if (field->quoted && field->start[i] == '"')
+			i++;
+	}
+	*out++ = '\0';
+	db->text_length = (int)(out - db->text);
+	return offset;
+}
+
+static s7_error_code_e s7_tag_insert(s7_tag_db_t* db, int name, int address_text, int group, s7_tag_type_e type)
+{
+	s7_tag_entry* tag = &db->tags[db->tag_count];
+	const char* address = db->text + address_text;
+	if (db->text[name] == '\0' || *address == '\0')
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	int size = s7_tag_type_size[type];
+	if (!s7_analysis_address(address, size, &tag->address))
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+
+	// Timers and counters are addressed by element; everywhere else only Bool may sit on a bit
+	bool is_counter_timer = tag->address.data_code == 0x1E || tag->address.data_code == 0x1F;
+	if (type == S7_TAG_TYPE_BOOL && (is_counter_timer || tag->address.data_code == 0x1C || tag->address.data_code == 0x1D))
+		return S7_ERROR_CODE_ERROR_0006;
+	if (type != S7_TAG_TYPE_BOOL && !is_counter_timer && tag->address.address_start % 8 != 0)
+		return S7_ERROR_CODE_PARSE_ADDRESS_FAILED;
+
+	tag->hash = s7_tag_hash(db->text + name);
+	int slot = s7_tag_slot(db, db->text + name, tag->hash);
+	if (db->slots[slot] != 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	tag->name = name;
+	tag->address_text = address_text;
+	tag->group = group;
+	tag->type = type;
+	db->slots[slot] = ++db->tag_count;
+	return S7_ERROR_CODE_SUCCESS;
+}
+
+static const char* s7_tag_skip_percent(const char* address)
+{
+	return address != NULL && *address == '%' ? address + 1 : address;
+}
+
+s7_error_code_e s7_tag_db_add(s7_tag_db_t* db, const char* name, const char* address, s7_tag_type_e type, const char* group)
+{
+	if (db == NULL || name == NULL || address == NULL || (int)type < S7_TAG_TYPE_BOOL || (int)type > S7_TAG_TYPE_LREAL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	address = s7_tag_skip_percent(address);
+	s7_tag_field fields[3] = {
+		{ name, (int)strlen(name), false },
+		{ address, (int)strlen(address), false },
+		{ group != NULL ? group : "", group != NULL ? (int)strlen(group) : 0, false },
+	};
+	if (fields[0].length > INT_MAX / 4 || fields[1].length > INT_MAX / 4 || fields[2].length > INT_MAX / 4 ||
+		!s7_tag_reserve(db, 1, fields[0].length + fields[1].length + fields[2].length + 3))
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	int tag_count = db->tag_count;
+	int text_length = db->text_length;
+	int name_text = s7_tag_append(db, &fields[0]);
+	int address_text = s7_tag_append(db, &fields[1]);
+	s7_error_code_e ret = s7_tag_insert(db, name_text, address_text, s7_tag_append(db, &fields[2]), type);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		s7_tag_rollback(db, tag_count, text_length);
+	return ret;
+}
+
+// Split one line into at most max fields; surrounding blanks are dropped, quotes removed and "" kept escaped
+static int s7_tag_split(const char* line, const char* end, char separator, s7_tag_field* fields, int max)
+{
+	int count = 0;
+	const char* cursor = line;
+	for (;;)
+	{
+		s7_tag_field field = { cursor, 0, false };
+		while (cursor < end && *cursor == ' ')
+			cursor++;
+		if (cursor < end && *cursor == '"')
+		{
+			field.start = ++cursor;
+			field.quoted = true;
+			while (cursor < end && !(*cursor == '"' && (cursor + 1 == end || cursor[1] != '"')))
+				cursor += *cursor == '"' ? 2 : 1;
+			field.length = (int)(cursor - field.start);
+			while (cursor < end && *cursor != separator)
+				cursor++;
+		}
+		else
+		{
+			field.start = cursor;
+			while (cursor < end && *cursor != separator)
+				cursor++;
+			const char* last = cursor;
+			while (last > field.start && (last[-1] == ' ' || (separator != '\t' && last[-1] == '\t')))
+				last--;
+			field.length = (int)(last - field.start);
+		}
+
+		if (count < max)
+			fields[count] = field;
+		count++;
+		if (cursor >= end)
+			return count < max ? count : max;
+		cursor++;
+	}
+}
+
+static bool s7_tag_parse_type(const s7_tag_field* field, s7_tag_type_e* type)
+{
+	for (int i = 0; i < (int)(sizeof(s7_tag_type_names) / sizeof(s7_tag_type_names[0])); i++)
+	{
+		if (s7_tag_field_is(field, s7_tag_type_names[i].name))
+		{
+			*type = s7_tag_type_names[i].type;
+			return true;
+		}
+	}
+	return false;
+}
+
+static char s7_tag_detect_separator(const char* line, const char* end)
+{
+	char separator = ',';
+	for (; line < end; line++)
+	{
+		if (*line == '\t')
+			return '\t';
+		if (*line == ';')
+			separator = ';';
+	}
+	return separator;
+}
+
+s7_error_code_e s7_tag_db_load_text(s7_tag_db_t* db, const char* text, int length, int* error_line)
+{
+	if (error_line != NULL)
+		*error_line = 0;
+	if (db == NULL || text == NULL || length < 0)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	// Every tag needs a line, and its strings take at most the line plus three terminators.
+	const char* end = text + length;
+	int lines = 1;
+	for (const char* p = (const char*)memchr(text, '\n', length); p != NULL; p = (const char*)memchr(p + 1, '\n', end - p - 1))
+		lines++;
+	if (lines > INT_MAX / 4 || length > INT_MAX / 2 - lines * 3 || !s7_tag_reserve(db, lines, length + lines * 3))
+		return S7_ERROR_CODE_MALLOC_FAILED;
+
+	// UTF-8 byte order mark written by Excel and TIA
+	if (length >= 3 && (byte)text[0] == 0xEF && (byte)text[1] == 0xBB && (byte)text[2] == 0xBF)
+		text += 3;
+
+	int tag_count = db->tag_count;
+	int text_length = db->text_length;
+	char separator = 0;
+	int line_number = 0;
+	s7_error_code_e ret = S7_ERROR_CODE_SUCCESS;
+	for (const char* line = text; line < end && ret == S7_ERROR_CODE_SUCCESS; )
+	{
+		const char* newline = (const char*)memchr(line, '\n', end - line);
+		const char* line_end = newline != NULL ? newline : end;
+		const char* next = newline != NULL ? newline + 1 : end;
+		if (line_end > line && line_end[-1] == '\r')
+			line_end--;
+		line_number++;
+
+		const char* first = line;
+		while (first < line_end && (*first == ' ' || *first == '\t'))
+			first++;
+		if (first == line_end || *first == '#')
+		{
+			line = next;
+			continue;
+		}
+
+		s7_tag_field fields[S7_TAG_MAX_FIELDS];
+		bool is_first = separator == 0;
+		if (is_first)
+			separator = s7_tag_detect_separator(line, line_end);
+		int count = s7_tag_split(line, line_end, separator, fields, S7_TAG_MAX_FIELDS);
+		if (is_first && s7_tag_field_is(&fields[0], "name"))
+		{
+			line = next;
+			continue;
+		}
+
+		s7_tag_type_e type = S7_TAG_TYPE_BOOL;
+		if (count < 3)
+			ret = S7_ERROR_CODE_INVALID_PARAMETER;
+		else if (!s7_tag_parse_type(&fields[2], &type))
+			ret = S7_ERROR_CODE_ERROR_0006;
+		else
+		{
+			s7_tag_field group = { "", 0, false };
+			if (fields[1].length > 0 && fields[1].start[0] == '%')
+			{
+				fields[1].start++;
+				fields[1].length--;
+			}
+			int name_text = s7_tag_append(db, &fields[0]);
+			int address_text = s7_tag_append(db, &fields[1]);
+			ret = s7_tag_insert(db, name_text, address_text, s7_tag_append(db, count > 3 ? &fields[3] : &group), type);
+		}
+		line = next;
+	}
+
+	if (ret != S7_ERROR_CODE_SUCCESS)
+	{
+		s7_tag_rollback(db, tag_count, text_length);
+		if (error_line != NULL)
+			*error_line = line_number;
+	}
+	return ret;
+}
+
+s7_error_code_e s7_tag_db_load_file(s7_tag_db_t* db, const char* path, int* error_line)
+{
+	if (error_line != NULL)
+		*error_line = 0;
+	if (db == NULL || path == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return S7_ERROR_CODE_FAILED;
+
+	s7_error_code_e ret = S7_ERROR_CODE_FAILED;
+	long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+	char* text = size >= 0 && size < INT_MAX ? (char*)malloc(size > 0 ? (size_t)size : 1) : NULL;
+	if (size >= INT_MAX)
+		ret = S7_ERROR_CODE_INVALID_PARAMETER;
+	else if (size >= 0 && text == NULL)
+		ret = S7_ERROR_CODE_MALLOC_FAILED;
+	else if (text != NULL && fseek(file, 0, SEEK_SET) == 0 && fread(text, 1, (size_t)size, file) == (size_t)size)
+		ret = s7_tag_db_load_text(db, text, (int)size, error_line);
+
+	fclose(file);
+	RELEASE_DATA(text);
+	return ret;
+}
+
+int s7_tag_db_find(const s7_tag_db_t* db, const char* name)
+{
+	if (db == NULL || name == NULL || db->tag_count == 0)
+		return -1;
+
+	return db->slots[s7_tag_slot(db, name, s7_tag_hash(name))] - 1;
+}
+
+int s7_tag_db_get_count(const s7_tag_db_t* db)
+{
+	return db != NULL ? db->tag_count : 0;
+}
+
+bool s7_tag_db_get_info(const s7_tag_db_t* db, int tag_id, s7_tag_info* info)
+{
+	if (db == NULL || tag_id < 0 || tag_id >= db->tag_count || info == NULL)
+		return false;
+
+	const s7_tag_entry* tag = &db->tags[tag_id];
+	info->name = db->text + tag->name;
+	info->address = db->text + tag->address_text;
+	info->group = db->text + tag->group;
+	info->type = tag->type;
+	info->size = s7_tag_type_size[tag->type];
+	return true;
+}
+
+int s7_tag_db_get_group(const s7_tag_db_t* db, const char* group, int* tag_ids, int capacity)
+{
+	if (db == NULL || group == NULL)
+		return 0;
+
+	int count = 0;
+	for (int i = 0; i < db->tag_count; i++)
+	{
+		if (strcmp(db->text + db->tags[i].group, group) != 0)
+			continue;
+		if (tag_ids != NULL && count < capacity)
+			tag_ids[count] = i;
+		count++;
+	}
+	return count;
+}
+
+s7_error_code_e s7_tag_read(int fd, const s7_tag_db_t* db, int tag_id, void* value)
+{
+	if (fd < 0 || db == NULL || tag_id < 0 || tag_id >= db->tag_count || value == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	const s7_tag_entry* tag = &db->tags[tag_id];
+	byte data[8] = { 0 };
+	s7_error_code_e ret = s7_read_parsed(s7_conn_from_fd(fd), tag->address, tag->type == S7_TAG_TYPE_BOOL, data);
+	if (ret != S7_ERROR_CODE_SUCCESS)
+		return ret;
+
+	switch (s7_tag_type_size[tag->type])
+	{
+	case 1:
+		if (tag->type == S7_TAG_TYPE_BOOL)
+			*(bool*)value = data[0] != 0;
+		else
+			*(byte*)value = data[0];
+		break;
+	case 2:
+		swap16_array(value, data, 1);
+		break;
+	case 4:
+		swap32_array(value, data, 1);
+		break;
+	default:
+		swap64_array(value, data, 1);
+		break;
+	}
+	return ret;
+}
+
+s7_error_code_e s7_tag_write(int fd, const s7_tag_db_t* db, int tag_id, const void* value)
+{
+	if (fd < 0 || db == NULL || tag_id < 0 || tag_id >= db->tag_count || value == NULL)
+		return S7_ERROR_CODE_INVALID_PARAMETER;
+
+	const s7_tag_entry* tag = &db->tags[tag_id];
+	byte data[8] = { 0 };
+	switch (s7_tag_type_size[tag->type])
+	{
+	case 1:
+		data[0] = tag->type == S7_TAG_TYPE_BOOL ? (byte)(*(const bool*)value ? 1 : 0) : *(const byte*)value;
+		break;
+	case 2:
+		swap16_array(data, value, 1);
+		break;
+	case 4:
+		swap32_array(data, value, 1);
+		break;
+	default:
+		swap64_array(data, value, 1);
+		break;
+	}
+	return s7_write_parsed(s7_conn_from_fd(fd), tag->address, tag->type == S7_TAG_TYPE_BOOL, data);
+}
@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_TAGS_H__
+#define __H_SIEMENS_S7_TAGS_H__
+
+#include "siemens_s7.h"
+
+// Data type of a tag and the C type s7_tag_read()/s7_tag_write() exchange for it
+typedef enum _tag_s7_tag_type {
+	S7_TAG_TYPE_BOOL = 0,	// bool; Bool
+	S7_TAG_TYPE_BYTE,		// byte; Byte, USInt, SInt, Char
+	S7_TAG_TYPE_WORD,		// ushort; Word, UInt, Date, S5Time
+	S7_TAG_TYPE_INT,		// short; Int
+	S7_TAG_TYPE_DWORD,		// uint32; DWord, UDInt, Time_Of_Day
+	S7_TAG_TYPE_DINT,		// int32; DInt, Time
+	S7_TAG_TYPE_REAL,		// float; Real
+	S7_TAG_TYPE_LWORD,		// uint64; LWord, ULInt
+	S7_TAG_TYPE_LINT,		// int64; LInt, LTime
+	S7_TAG_TYPE_LREAL,		// double; LReal
+} s7_tag_type_e;
+
+typedef struct _tag_s7_tag_info {
+	const char*		name;
+	const char*		address;	// As loaded, without a leading '%'
+	const char*		group;		// Scan group, "" when none was given
+	s7_tag_type_e	type;
+	int				size;		// Bytes on the PLC, 1 for Bool
+} s7_tag_info;
+
+// Symbolic tags with their addresses parsed once at load time; ids are assigned 0, 1, 2... in load order.
+// Loading is not thread-safe, lookups and tag reads/writes on a loaded database are.
+typedef struct _tag_s7_tag_db s7_tag_db_t;
+
+s7_tag_db_t* s7_tag_db_create(void);
+void s7_tag_db_destroy(s7_tag_db_t* db);
+
+// Append the tags of a CSV/TSV export, one per line: name, address, data type[, scan group[, ignored columns]].
+// The separator is a tab, ';' or ',', whichever the first line uses; fields may be double-quoted, lines starting
+// with '#' are skipped, and so is a first line whose first field is "Name". Addresses may carry TIA's '%' prefix.
+// On failure nothing of the text is kept and error_line (may be NULL) receives the 1-based line at fault:
+// S7_ERROR_CODE_PARSE_ADDRESS_FAILED for a bad address, S7_ERROR_CODE_ERROR_0006 for an unknown data type,
+// S7_ERROR_CODE_INVALID_PARAMETER for a missing field or a duplicate name.
+s7_error_code_e s7_tag_db_load_text(s7_tag_db_t* db, const char* text, int length, int* error_line);
+s7_error_code_e s7_tag_db_load_file(s7_tag_db_t* db, const char* path, int* error_line);
+s7_error_code_e s7_tag_db_add(s7_tag_db_t* db, const char* name, const char* address, s7_tag_type_e type, const char* group); //group may be NULL
+
+int s7_tag_db_find(const s7_tag_db_t* db, const char* name); //tag id, -1 when unknown
+int s7_tag_db_get_count(const s7_tag_db_t* db);
+bool s7_tag_db_get_info(const s7_tag_db_t* db, int tag_id, s7_tag_info* info); //strings valid until the next load or add
+int s7_tag_db_get_group(const s7_tag_db_t* db, const char* group, int* tag_ids, int capacity); //members found, the first capacity ids stored
+
+// value points to the C type of the tag's data type (see s7_tag_type_e); no address is parsed on the way
+s7_error_code_e s7_tag_read(int fd, const s7_tag_db_t* db, int tag_id, void* value);
+s7_error_code_e s7_tag_write(int fd, const s7_tag_db_t* db, int tag_id, const void* value);
+
+#endif//__H_SIEMENS_S7_TAGS_H__
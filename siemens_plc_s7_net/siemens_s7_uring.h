@@ -0,0 +1,55 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+#ifndef __H_SIEMENS_S7_URING_H__
+#define __H_SIEMENS_S7_URING_H__
+
+#include "typedef.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define S7_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef S7_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+// Minimal io_uring over the raw syscalls, so no liburing is needed
+typedef struct _tag_s7_uring {
+	int			fd;
+	void*		sq_ring;
+	size_t		sq_ring_size;
+	void*		cq_ring;			// Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+	size_t		cq_ring_size;
+	struct io_uring_sqe* sqes;
+	size_t		sqes_size;
+	unsigned*	sq_head;
+	unsigned*	sq_tail;
+	unsigned*	sq_array;
+	unsigned	sq_mask;
+	unsigned	sq_entries;
+	unsigned	sq_local_tail;		// Filled but not yet published entries end here
+	unsigned*	cq_head;
+	unsigned*	cq_tail;
+	unsigned	cq_mask;
+	struct io_uring_cqe* cqes;
+} s7_uring;
+
+bool s7_uring_init(s7_uring* ring, unsigned entries); //false when io_uring or IORING_FEAT_EXT_ARG is unavailable
+void s7_uring_exit(s7_uring* ring);
+bool s7_uring_register_buffer(s7_uring* ring, void* base, size_t length); //becomes fixed buffer index 0
+
+struct io_uring_sqe* s7_uring_get_sqe(s7_uring* ring); //zeroed entry, submits the staged ones first when the ring is full
+int s7_uring_enter(s7_uring* ring, int wait_ms); //submit staged entries, wait up to wait_ms (<0 forever) for one completion
+
+struct io_uring_cqe* s7_uring_peek(s7_uring* ring); //NULL when no completion is ready
+void s7_uring_advance(s7_uring* ring);
+#endif
+
+#endif//__H_SIEMENS_S7_URING_H__
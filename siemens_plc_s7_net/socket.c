@@ -8,6 +8,7 @@
 #include "socket.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -17,8 +18,11 @@
 #else
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #endif
@@ -50,6 +54,27 @@ static int socket_set_nonblocking(int fd, int nonblocking) {
 #endif
 }
 
+static int socket_would_block_error(void) {
+#ifdef _WIN32
+	int err = WSAGetLastError();
+	return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS;
+#endif
+}
+
+static void socket_set_timeouts(int sockFd, int timeout_ms) {
+#ifdef _WIN32
+	int timeout = timeout_ms > 0 ? timeout_ms : 5000;
+	setsockopt(sockFd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt(sockFd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+	struct timeval timeout = { (timeout_ms > 0 ? timeout_ms : 5000) / 1000, ((timeout_ms > 0 ? timeout_ms : 5000) % 1000) * 1000 };
+	setsockopt(sockFd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt(sockFd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#endif
+}
+
 static int socket_connect_with_timeout_impl(int sockFd, struct sockaddr_in* serverAddr, int timeout_ms) {
 	if (timeout_ms <= 0) {
 		timeout_ms = 5000;
@@ -123,7 +148,7 @@ int socket_send_data(int fd, void* buf, int nbytes) {
 				return -1;
 		}
 		else {
-				// Currently this function performs only one receive loop by design.
+			nleft -= nwritten;
 			ptr += nwritten;
 		}
 	}
@@ -131,6 +156,69 @@ int socket_send_data(int fd, void* buf, int nbytes) {
 	return (nbytes - nleft);
 }
 
+#define SOCKET_GATHER_MAX 64
+
+int socket_send_gather(int fd, const socket_buffer* buffers, int count) {
+	int total = 0;
+	int index = 0;
+	int offset = 0;		// Bytes of buffers[index] already sent
+
+	if (fd < 0 || buffers == NULL || count < 0) return -1;
+
+	while (index < count) {
+		if (offset >= buffers[index].length) {
+			index++;
+			offset = 0;
+			continue;
+		}
+
+		int parts = 0;
+#ifdef _WIN32
+		WSABUF iov[SOCKET_GATHER_MAX];
+		for (int i = index; i < count && parts < SOCKET_GATHER_MAX; i++) {
+			int skip = i == index ? offset : 0;
+			iov[parts].buf = (char*)buffers[i].data + skip;
+			iov[parts].len = (ULONG)(buffers[i].length - skip);
+			parts++;
+		}
+		DWORD sent = 0;
+		int nwritten = WSASend(fd, iov, parts, &sent, 0, NULL, NULL) == 0 ? (int)sent : -1;
+#else
+		struct iovec iov[SOCKET_GATHER_MAX];
+		struct msghdr msg;
+		for (int i = index; i < count && parts < SOCKET_GATHER_MAX; i++) {
+			int skip = i == index ? offset : 0;
+			iov[parts].iov_base = (char*)buffers[i].data + skip;
+			iov[parts].iov_len = (size_t)(buffers[i].length - skip);
+			parts++;
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = parts;
+		int nwritten = (int)sendmsg(fd, &msg, 0);
+#endif
+		if (nwritten <= 0) {
+			if (socket_is_interrupted_error())
+				continue;
+			return -1;
+		}
+
+		// Step over whatever went out; a short write resumes inside the buffer it stopped in.
+		total += nwritten;
+		while (nwritten > 0) {
+			int left = buffers[index].length - offset;
+			if (nwritten < left) {
+				offset += nwritten;
+				break;
+			}
+			nwritten -= left;
+			index++;
+			offset = 0;
+		}
+	}
+	return total;
+}
+
 int socket_recv_data(int fd, void* buf, int nbytes) {
 	int   nleft, nread;
 	char* ptr = (char*)buf;
@@ -211,17 +299,115 @@ int socket_open_tcp_client_socket_with_timeout(char* destIp, short destPort, int
 		return -1;
 	}
 
+	socket_set_timeouts(sockFd, timeout_ms);
+	return sockFd;
+}
+
+int socket_open_tcp_client_socket_async(char* destIp, short destPort) {
+	struct sockaddr_in serverAddr = { 0 };
+	int sockFd = (int)socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sockFd < 0) {
+		return -1;
+	}
+
+	serverAddr.sin_family = AF_INET;
+	serverAddr.sin_addr.s_addr = inet_addr(destIp);
+	serverAddr.sin_port = (uint16_t)htons((uint16_t)destPort);
+	if (socket_set_nonblocking(sockFd, 1) != 0 ||
+		(connect(sockFd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) != 0 && !socket_would_block_error())) {
+		socket_close_tcp_socket(sockFd);
+		return -1;
+	}
+	return sockFd;
+}
+
+int socket_finish_connect(int sockFd, int timeout_ms) {
+	int so_error = 0;
 #ifdef _WIN32
-	int timeout = timeout_ms > 0 ? timeout_ms : 5000;
-	ret = setsockopt(sockFd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
-	ret = setsockopt(sockFd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	int opt_len = sizeof(so_error);
 #else
-	struct timeval timeout = { (timeout_ms > 0 ? timeout_ms : 5000) / 1000, ((timeout_ms > 0 ? timeout_ms : 5000) % 1000) * 1000 };
-	ret = setsockopt(sockFd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
-	ret = setsockopt(sockFd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	socklen_t opt_len = sizeof(so_error);
 #endif
+	if (getsockopt(sockFd, SOL_SOCKET, SO_ERROR, (char*)&so_error, &opt_len) != 0 || so_error != 0) {
+		return -1;
+	}
+	if (timeout_ms > 0) {
+		if (socket_set_nonblocking(sockFd, 0) != 0) {
+			return -1;
+		}
+		socket_set_timeouts(sockFd, timeout_ms);
+	}
+	return 0;
+}
 
-	return sockFd;
+int socket_send_nonblocking(int fd, const void* buf, int nbytes) {
+	for (;;) {
+		int sent = send(fd, (const char*)buf, nbytes, 0);
+		if (sent >= 0) {
+			return sent;
+		}
+		if (!socket_is_interrupted_error()) {
+			return socket_would_block_error() ? 0 : -1;
+		}
+	}
+}
+
+int socket_recv_nonblocking(int fd, void* buf, int nbytes) {
+	for (;;) {
+		int got = recv(fd, (char*)buf, nbytes, 0);
+		if (got > 0) {
+			return got;
+		}
+		if (got == 0) {
+			return -1;
+		}
+		if (!socket_is_interrupted_error()) {
+			return socket_would_block_error() ? 0 : -1;
+		}
+	}
+}
+
+int socket_wait_many(const int* fds, const int* events, int* ready, int count, int timeout_ms) {
+#ifdef _WIN32
+	WSAPOLLFD* polls = (WSAPOLLFD*)malloc(sizeof(WSAPOLLFD) * count);
+#else
+	struct pollfd* polls = (struct pollfd*)malloc(sizeof(struct pollfd) * count);
+#endif
+	if (polls == NULL) {
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		polls[i].fd = fds[i];
+		polls[i].events = (short)(((events[i] & SOCKET_WAIT_READ) ? POLLIN : 0) | ((events[i] & SOCKET_WAIT_WRITE) ? POLLOUT : 0));
+		polls[i].revents = 0;
+	}
+#ifdef _WIN32
+	int ret = WSAPoll(polls, (ULONG)count, timeout_ms);
+#else
+	int ret = poll(polls, (nfds_t)count, timeout_ms);
+	if (ret < 0 && errno == EINTR) {
+		ret = 0;
+	}
+#endif
+	for (int i = 0; i < count; i++) {
+		// Errors and hang-ups wake both directions so the caller's next call reports them.
+		int revents = polls[i].revents;
+		ready[i] = ((revents & (POLLIN | POLLERR | POLLHUP)) ? SOCKET_WAIT_READ : 0) |
+			((revents & (POLLOUT | POLLERR | POLLHUP)) ? SOCKET_WAIT_WRITE : 0);
+	}
+	free(polls);
+	return ret;
+}
+
+long long socket_now_ms(void) {
+#ifdef _WIN32
+	return (long long)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
 }
 
 int socket_open_tcp_client_socket(char* destIp, short destPort) {
@@ -239,6 +425,29 @@ void socket_close_tcp_socket(int sockFd) {
 	}
 }
 
+void socket_shutdown_tcp_socket(int sockFd) {
+	if (sockFd >= 0)
+	{
+#ifdef _WIN32
+		shutdown(sockFd, SD_BOTH);
+#else
+		shutdown(sockFd, SHUT_RDWR);
+#endif
+	}
+}
+
+int socket_replace_tcp_socket(int sockFd, int newFd) {
+#ifdef _WIN32
+	// Winsock has no dup2; the caller gets the new handle.
+	closesocket(sockFd);
+	return newFd;
+#else
+	int ret = dup2(newFd, sockFd);
+	close(newFd);
+	return ret;
+#endif
+}
+
 static void tinet_ntoa(char* ipstr, unsigned int ip) {
 	sprintf(ipstr, "%d.%d.%d.%d", ip & 0xFF, (ip >> 8) & 0xFF, (ip >> 16) & 0xFF, ip >> 24);
 }
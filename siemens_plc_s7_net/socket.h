@@ -11,10 +11,30 @@
 #include "utill.h"
 
 int socket_send_data(int fd, void* ptr, int nbytes);
+
+typedef struct _tag_socket_buffer {
+	const void*	data;
+	int			length;
+} socket_buffer;
+
+int socket_send_gather(int fd, const socket_buffer* buffers, int count); //all buffers back to back, one call per 64 buffers when the socket keeps up; bytes sent or -1
 int socket_recv_data(int fd, void* ptr, int nbytes);
 int socket_recv_data_one_loop(int fd, void* ptr, int nbytes);
 int socket_open_tcp_client_socket(char* ip, short port);
 int socket_open_tcp_client_socket_with_timeout(char* ip, short port, int timeout_ms);
 void socket_close_tcp_socket(int sockFd);
+void socket_shutdown_tcp_socket(int sockFd); //both directions; the descriptor stays allocated until closed
+int socket_replace_tcp_socket(int sockFd, int newFd); //newFd takes over sockFd's number where the OS allows; returns the live descriptor, -1 on error
+
+// Non-blocking sockets for connecting many PLCs at once
+#define SOCKET_WAIT_READ	1
+#define SOCKET_WAIT_WRITE	2
+
+int socket_open_tcp_client_socket_async(char* ip, short port); //non-blocking, connect in progress; wait for SOCKET_WAIT_WRITE
+int socket_finish_connect(int sockFd, int timeout_ms); //0 once connected; timeout_ms > 0 makes it blocking with that send/recv timeout
+int socket_send_nonblocking(int fd, const void* ptr, int nbytes); //0 would block, -1 on error
+int socket_recv_nonblocking(int fd, void* ptr, int nbytes); //0 would block, -1 on error or close
+int socket_wait_many(const int* fds, const int* events, int* ready, int count, int timeout_ms);
+long long socket_now_ms(void); //monotonic clock
 
 #endif //__SOCKET_H_
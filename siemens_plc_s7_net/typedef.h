@@ -45,6 +45,10 @@ typedef enum _tag_s7_error_code {
 	S7_ERROR_CODE_BUILD_CORE_CMD_FAILED,			// Failed to build core command
 	S7_ERROR_CODE_SOCKET_SEND_FAILED,				// Failed to send command
 	S7_ERROR_CODE_RESPONSE_HEADER_FAILED,			// Incomplete response header
+	S7_ERROR_CODE_PDU_SIZE_EXCEEDED,				// Item does not fit into the negotiated PDU
+	S7_ERROR_CODE_CONNECTION_CLOSED,				// Job dropped because its connection was stopped or closed
+	S7_ERROR_CODE_TIMEOUT,							// No response within the event loop request timeout
+	S7_ERROR_CODE_WOULD_BLOCK,						// Blocking call on the event loop thread for one of its own connections
 	S7_ERROR_CODE_UNKOWN = 99,						// Unknown error
 } s7_error_code_e;
 
@@ -16,12 +16,26 @@
 #include <unistd.h>
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define UTILL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define UTILL_TARGET(isa)
+#else
+#define UTILL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
 #define _WS2_32_WINSOCK_SWAP_LONG(l)                \
             ( ( ((l) >> 24) & 0x000000FFL ) |       \
               ( ((l) >>  8) & 0x0000FF00L ) |       \
               ( ((l) <<  8) & 0x00FF0000L ) |       \
               ( ((l) << 24) & 0xFF000000L ) )
 
+#define _WS2_32_WINSOCK_SWAP_SHORT(s)               \
+            ( (ushort)( (((s) >> 8) & 0x00FF) | (((s) << 8) & 0xFF00) ) )
+
 #define _WS2_32_WINSOCK_SWAP_LONGLONG(l)            \
             ( ( ((l) >> 56) & 0x00000000000000FFLL ) |       \
               ( ((l) >> 40) & 0x000000000000FF00LL ) |       \
@@ -245,6 +259,298 @@ uint64 ntohll_(uint64 Value)
 	return Retval;
 }
 
+enum {
+	UTILL_ISA_SCALAR,
+	UTILL_ISA_SSE2,
+	UTILL_ISA_SSSE3,
+	UTILL_ISA_AVX2,
+};
+
+static int utill_isa(void)
+{
+#if defined(UTILL_X86) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+		return UTILL_ISA_AVX2;
+	if (__builtin_cpu_supports("ssse3"))
+		return UTILL_ISA_SSSE3;
+	if (__builtin_cpu_supports("sse2"))
+		return UTILL_ISA_SSE2;
+	return UTILL_ISA_SCALAR;
+#elif defined(UTILL_X86) && defined(_MSC_VER)
+	static volatile long isa = -1;
+	if (isa < 0)
+	{
+		int info[4];
+		int level = UTILL_ISA_SCALAR;
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		if (info[3] & (1 << 26))
+			level = UTILL_ISA_SSE2;
+		if (info[2] & (1 << 9))
+			level = UTILL_ISA_SSSE3;
+		// AVX2 also needs the OS to save the YMM registers.
+		if (max_leaf >= 7 && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuid(info, 7);
+			if (info[1] & (1 << 5))
+				level = UTILL_ISA_AVX2;
+		}
+		isa = level;
+	}
+	return (int)isa;
+#else
+	return UTILL_ISA_SCALAR;
+#endif
+}
+
+static void swap16_scalar(byte* dst, const byte* src, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		ushort value;
+		memcpy(&value, src + i * 2, sizeof(value));
+		value = _WS2_32_WINSOCK_SWAP_SHORT(value);
+		memcpy(dst + i * 2, &value, sizeof(value));
+	}
+}
+
+static void swap32_scalar(byte* dst, const byte* src, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		uint32 value;
+		memcpy(&value, src + i * 4, sizeof(value));
+		value = _WS2_32_WINSOCK_SWAP_LONG(value);
+		memcpy(dst + i * 4, &value, sizeof(value));
+	}
+}
+
+static void swap64_scalar(byte* dst, const byte* src, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		uint64 value;
+		memcpy(&value, src + i * 8, sizeof(value));
+		value = _WS2_32_WINSOCK_SWAP_LONGLONG(value);
+		memcpy(dst + i * 8, &value, sizeof(value));
+	}
+}
+
+#ifdef UTILL_X86
+// The vector kernels convert whole 16 or 32 byte blocks and return how many bytes they did; the caller finishes the tail.
+UTILL_TARGET("sse2")
+static int swap_sse2(byte* dst, const byte* src, int bytes, int width)
+{
+	int done = 0;
+	for (; done + 16 <= bytes; done += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + done));
+		if (width == 8)
+			v = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+		if (width >= 4)
+			v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i*)(dst + done), v);
+	}
+	return done;
+}
+
+UTILL_TARGET("ssse3")
+static __m128i swap_mask_ssse3(int width)
+{
+	if (width == 2)
+		return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	if (width == 4)
+		return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	return _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+}
+
+UTILL_TARGET("ssse3")
+static int swap_ssse3(byte* dst, const byte* src, int bytes, int width)
+{
+	const __m128i mask = swap_mask_ssse3(width);
+	int done = 0;
+	for (; done + 16 <= bytes; done += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + done));
+		_mm_storeu_si128((__m128i*)(dst + done), _mm_shuffle_epi8(v, mask));
+	}
+	return done;
+}
+
+UTILL_TARGET("avx2")
+static int swap_avx2(byte* dst, const byte* src, int bytes, int width)
+{
+	// vpshufb shuffles within each 128-bit lane, which never splits an element.
+	const __m256i mask = _mm256_broadcastsi128_si256(swap_mask_ssse3(width));
+	int done = 0;
+	for (; done + 32 <= bytes; done += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + done));
+		_mm256_storeu_si256((__m256i*)(dst + done), _mm256_shuffle_epi8(v, mask));
+	}
+	return done + swap_ssse3(dst + done, src + done, bytes - done, width);
+}
+#endif
+
+static void swap_array(void* dst, const void* src, int count, int width)
+{
+	if (dst == NULL || src == NULL || count <= 0)
+		return;
+
+	byte* out = (byte*)dst;
+	const byte* in = (const byte*)src;
+	int done = 0;
+#ifdef UTILL_X86
+	switch (utill_isa())
+	{
+	case UTILL_ISA_AVX2:
+		done = swap_avx2(out, in, count * width, width);
+		break;
+	case UTILL_ISA_SSSE3:
+		done = swap_ssse3(out, in, count * width, width);
+		break;
+	case UTILL_ISA_SSE2:
+		done = swap_sse2(out, in, count * width, width);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	int left = count - done / width;
+	if (width == 2)
+		swap16_scalar(out + done, in + done, left);
+	else if (width == 4)
+		swap32_scalar(out + done, in + done, left);
+	else
+		swap64_scalar(out + done, in + done, left);
+}
+
+void swap16_array(void* dst, const void* src, int count)
+{
+	swap_array(dst, src, count, 2);
+}
+
+void swap32_array(void* dst, const void* src, int count)
+{
+	swap_array(dst, src, count, 4);
+}
+
+void swap64_array(void* dst, const void* src, int count)
+{
+	swap_array(dst, src, count, 8);
+}
+
+const char* swap_array_isa(void)
+{
+	static const char* const names[] = { "scalar", "sse2", "ssse3", "avx2" };
+	return names[utill_isa()];
+}
+
+// Each byte is spread over eight lanes that keep only their own bit, turned into 0 or 1 per lane.
+static void unpack_bits_scalar(bool* values, const byte* packed, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		uint64 lanes = (packed[i] * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+		lanes = (((lanes + 0x7F7F7F7F7F7F7F7FULL) | lanes) >> 7) & 0x0101010101010101ULL;
+		memcpy(values + i * 8, &lanes, sizeof(lanes));
+	}
+}
+
+#ifdef UTILL_X86
+UTILL_TARGET("ssse3")
+static int unpack_bits_ssse3(bool* values, const byte* packed, int bytes)
+{
+	const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+	const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m128i one = _mm_set1_epi8(1);
+	int done = 0;
+	for (; done + 2 <= bytes; done += 2)
+	{
+		ushort pair;
+		memcpy(&pair, packed + done, sizeof(pair));
+		__m128i v = _mm_and_si128(_mm_shuffle_epi8(_mm_cvtsi32_si128(pair), spread), bits);
+		_mm_storeu_si128((__m128i*)(values + done * 8), _mm_and_si128(_mm_cmpeq_epi8(v, bits), one));
+	}
+	return done;
+}
+
+UTILL_TARGET("avx2")
+static int unpack_bits_avx2(bool* values, const byte* packed, int bytes)
+{
+	// Every 128-bit lane holds all four source bytes, so the lane-local shuffle can reach each of them.
+	const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+		1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m256i one = _mm256_set1_epi8(1);
+	int done = 0;
+	for (; done + 4 <= bytes; done += 4)
+	{
+		uint32 quad;
+		memcpy(&quad, packed + done, sizeof(quad));
+		__m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32((int)quad), spread), bits);
+		_mm256_storeu_si256((__m256i*)(values + done * 8), _mm256_and_si256(_mm256_cmpeq_epi8(v, bits), one));
+	}
+	return done + unpack_bits_ssse3(values + done * 8, packed + done, bytes - done);
+}
+#endif
+
+void unpack_bits(bool* values, const byte* packed, int first_bit, int count)
+{
+	if (values == NULL || packed == NULL || first_bit < 0 || count <= 0)
+		return;
+
+	packed += first_bit / 8;
+	int bit = first_bit % 8;
+	int done = 0;
+	for (; bit != 0 && bit < 8 && done < count; bit++)
+		values[done++] = ((packed[0] >> bit) & 1) != 0;
+	if (bit == 8)
+		packed++;
+
+	int bytes = (count - done) / 8;
+	int unpacked = 0;
+#ifdef UTILL_X86
+	int isa = utill_isa();
+	if (isa == UTILL_ISA_AVX2)
+		unpacked = unpack_bits_avx2(values + done, packed, bytes);
+	else if (isa == UTILL_ISA_SSSE3)
+		unpacked = unpack_bits_ssse3(values + done, packed, bytes);
+#endif
+	unpack_bits_scalar(values + done + unpacked * 8, packed + unpacked, bytes - unpacked);
+	done += bytes * 8;
+	packed += bytes;
+
+	for (bit = 0; done < count; bit++)
+		values[done++] = ((packed[0] >> bit) & 1) != 0;
+}
+
+void pack_bits(byte* packed, const bool* values, int count)
+{
+	if (packed == NULL || values == NULL || count <= 0)
+		return;
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		// Gather bit 0 of every lane into the top byte.
+		uint64 lanes;
+		memcpy(&lanes, values + i, sizeof(lanes));
+		packed[i / 8] = (byte)(((lanes & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56);
+	}
+	if (i < count)
+	{
+		byte last = 0;
+		for (int bit = 0; i + bit < count; bit++)
+			last |= (byte)((values[i + bit] ? 1 : 0) << bit);
+		packed[i / 8] = last;
+	}
+}
+
 #ifndef _WIN32
 /*
 =============
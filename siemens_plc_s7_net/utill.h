@@ -58,6 +58,16 @@ double ntohd_(uint64 value);
 uint64 htonll_(uint64 Value);
 uint64 ntohll_(uint64 Value);
 
+// Big-endian <-> host order for count 16/32/64-bit elements, vectorized where the CPU allows; dst may equal src
+void swap16_array(void* dst, const void* src, int count);
+void swap32_array(void* dst, const void* src, int count);
+void swap64_array(void* dst, const void* src, int count);
+const char* swap_array_isa(void); //kernel picked for this CPU: "avx2", "ssse3", "sse2" or "scalar"
+
+// Bits are numbered from the least significant bit of the first byte, the S7 bit order
+void unpack_bits(bool* values, const byte* packed, int first_bit, int count);
+void pack_bits(byte* packed, const bool* values, int count); //(count + 7) / 8 bytes, unused high bits cleared
+
 #ifndef _WIN32
 char* itoa(unsigned long long  value, char str[], int radix);
 #endif // !_WIN32
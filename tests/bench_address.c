@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+// Address parse throughput for the forms typed calls see: make -C tests bench CFLAGS=-O2 && tests/bench_address
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../siemens_plc_s7_net/siemens_s7_comm.h"
+
+#define BENCH_ROUNDS 2000000
+
+static const char* bench_addresses[] = {
+	"M100", "MX10.3", "MW20", "I0.0", "QB4", "AIW64", "T37", "C5",
+	"DB1", "DB1.70", "DB1.DBX0.1", "DB10.DBD200", "db3.dbw14", "V100",
+};
+
+static double now_seconds(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	int count = (int)(sizeof(bench_addresses) / sizeof(bench_addresses[0]));
+	volatile int sink = 0;
+	siemens_s7_address_data data;
+
+	double total = 0;
+	for (int i = 0; i < count; i++) {
+		double start = now_seconds();
+		for (int round = 0; round < BENCH_ROUNDS; round++) {
+			if (s7_analysis_address(bench_addresses[i], 4, &data))
+				sink += data.address_start;
+		}
+		double seconds = now_seconds() - start;
+		total += seconds;
+		printf("%-14s %8.2f ns/address\n", bench_addresses[i], seconds * 1e9 / BENCH_ROUNDS);
+	}
+
+	printf("%-14s %8.2f M addresses/s\n", "mix", (double)count * BENCH_ROUNDS / total / 1e6);
+	(void)sink;
+	return 0;
+}
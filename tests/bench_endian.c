@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+// Bulk endian kernels against the per-value helpers: make -C tests bench CFLAGS=-O2 && tests/bench_endian
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "../siemens_plc_s7_net/utill.h"
+
+#define BENCH_VALUES 4096		// A large array read: several PDUs worth of REAL/DINT/LREAL
+#define BENCH_ROUNDS 20000
+
+static double now_seconds(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report(const char* name, double seconds, int width) {
+	double bytes = (double)BENCH_VALUES * width * BENCH_ROUNDS;
+	printf("%-28s %8.3f ms  %8.2f GB/s\n", name, seconds * 1e3, bytes / seconds / 1e9);
+}
+
+int main(void) {
+	byte* wire = (byte*)malloc(BENCH_VALUES * 8);
+	float* reals = (float*)malloc(BENCH_VALUES * sizeof(float));
+	uint32* dints = (uint32*)malloc(BENCH_VALUES * sizeof(uint32));
+	double* lreals = (double*)malloc(BENCH_VALUES * sizeof(double));
+	ushort* words = (ushort*)malloc(BENCH_VALUES * sizeof(ushort));
+	if (wire == NULL || reals == NULL || dints == NULL || lreals == NULL || words == NULL)
+		return 1;
+
+	for (int i = 0; i < BENCH_VALUES * 8; i++)
+		wire[i] = (byte)(i * 31 + 7);
+
+	printf("kernel: %s, %d values x %d rounds\n", swap_array_isa(), BENCH_VALUES, BENCH_ROUNDS);
+	volatile double sink = 0;
+
+	double start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < BENCH_VALUES; i++)
+			reals[i] = ntohf_(bytes2uint32(wire + i * 4));
+		sink += reals[round % BENCH_VALUES];
+	}
+	report("REAL  bytes2uint32+ntohf_", now_seconds() - start, 4);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		swap32_array(reals, wire, BENCH_VALUES);
+		sink += reals[round % BENCH_VALUES];
+	}
+	report("REAL  swap32_array", now_seconds() - start, 4);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < BENCH_VALUES; i++)
+			dints[i] = ntohl(bytes2uint32(wire + i * 4));
+		sink += dints[round % BENCH_VALUES];
+	}
+	report("DINT  bytes2uint32+ntohl", now_seconds() - start, 4);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		swap32_array(dints, wire, BENCH_VALUES);
+		sink += dints[round % BENCH_VALUES];
+	}
+	report("DINT  swap32_array", now_seconds() - start, 4);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < BENCH_VALUES; i++)
+			lreals[i] = ntohd_(bytes2ubigInt(wire + i * 8));
+		sink += lreals[round % BENCH_VALUES];
+	}
+	report("LREAL bytes2ubigInt+ntohd_", now_seconds() - start, 8);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		swap64_array(lreals, wire, BENCH_VALUES);
+		sink += lreals[round % BENCH_VALUES];
+	}
+	report("LREAL swap64_array", now_seconds() - start, 8);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < BENCH_VALUES; i++)
+			words[i] = ntohs(bytes2ushort(wire + i * 2));
+		sink += words[round % BENCH_VALUES];
+	}
+	report("INT   bytes2ushort+ntohs", now_seconds() - start, 2);
+
+	start = now_seconds();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		swap16_array(words, wire, BENCH_VALUES);
+		sink += words[round % BENCH_VALUES];
+	}
+	report("INT   swap16_array", now_seconds() - start, 2);
+
+	(void)sink;
+	free(wire);
+	free(reals);
+	free(dints);
+	free(lreals);
+	free(words);
+	return 0;
+}
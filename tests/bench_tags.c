@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2022-2026 wqliceman
+ * GitHub: iceman
+ * Email: wqliceman@gmail.com
+ */
+
+// Tag database startup and name lookup for a plant-sized export: make -C tests bench CFLAGS=-O2 && tests/bench_tags
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../siemens_plc_s7_net/siemens_s7_tags.h"
+
+#define BENCH_TAGS 50000
+#define BENCH_LOOKUPS 2000000
+#define BENCH_LINE_SIZE 64
+
+static double now_seconds(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	static const char* types[] = { "Real", "Bool", "Int", "DInt" };
+	char* text = (char*)malloc((size_t)BENCH_TAGS * BENCH_LINE_SIZE);
+	char (*names)[32] = malloc(sizeof(*names) * BENCH_TAGS);
+	if (text == NULL || names == NULL)
+		return 1;
+
+	int length = snprintf(text, BENCH_LINE_SIZE, "Name,Address,Data Type,Scan Group\n");
+	for (int i = 0; i < BENCH_TAGS; i++) {
+		int type = i % 4;
+		snprintf(names[i], sizeof(names[i]), "Area%d_Station%d_Tag%d", i % 13, i % 97, i);
+		if (type == 1)
+			length += snprintf(text + length, BENCH_LINE_SIZE, "%s,%%M%d.%d,Bool,g%d\n", names[i], i / 8 % 4096, i % 8, i % 16);
+		else
+			length += snprintf(text + length, BENCH_LINE_SIZE, "%s,%%DB%d.DBD%d,%s,g%d\n", names[i], 1 + i / 1000, (i % 1000) * 4, types[type], i % 16);
+	}
+
+	double start = now_seconds();
+	s7_tag_db_t* db = s7_tag_db_create();
+	int error_line = 0;
+	if (db == NULL || s7_tag_db_load_text(db, text, length, &error_line) != S7_ERROR_CODE_SUCCESS) {
+		printf("load failed at line %d\n", error_line);
+		return 1;
+	}
+	double load = now_seconds() - start;
+	printf("load   %d tags (%d KB)   %8.3f ms\n", s7_tag_db_get_count(db), length / 1024, load * 1e3);
+
+	volatile int sink = 0;
+	start = now_seconds();
+	for (int i = 0; i < BENCH_LOOKUPS; i++)
+		sink += s7_tag_db_find(db, names[(int)((unsigned)i * 7919u % BENCH_TAGS)]);
+	double lookup = now_seconds() - start;
+	printf("lookup %d names           %8.2f ns/name\n", BENCH_LOOKUPS, lookup * 1e9 / BENCH_LOOKUPS);
+
+	(void)sink;
+	s7_tag_db_destroy(db);
+	free(names);
+	free(text);
+	return 0;
+}
@@ -13,14 +13,53 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
 #endif
 
 #include "../siemens_plc_s7_net/siemens_s7_comm.h"
+#include "../siemens_plc_s7_net/siemens_helper.h"
 #include "../siemens_plc_s7_net/siemens_s7.h"
+#include "../siemens_plc_s7_net/siemens_s7_alloc.h"
+#include "../siemens_plc_s7_net/siemens_s7_bit_batch.h"
+#include "../siemens_plc_s7_net/siemens_s7_conn.h"
+#include "../siemens_plc_s7_net/siemens_s7_job.h"
+#include "../siemens_plc_s7_net/siemens_s7_loop.h"
+#include "../siemens_plc_s7_net/siemens_s7_plan.h"
+#include "../siemens_plc_s7_net/siemens_s7_pool.h"
+#include "../siemens_plc_s7_net/siemens_s7_prepared.h"
+#include "../siemens_plc_s7_net/siemens_s7_tags.h"
+#include "../siemens_plc_s7_net/socket.h"
 
 static int g_failed = 0;
 
+// Count heap allocations made by the current thread; glibc builds without sanitizers only
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define S7_TEST_COUNT_ALLOCS 1
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+static __thread int g_alloc_count = 0;
+
+void* malloc(size_t size) {
+	g_alloc_count++;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	g_alloc_count++;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+	g_alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
 #define EXPECT_TRUE(name, cond) \
 	do { \
 		if (!(cond)) { \
@@ -81,6 +120,22 @@ static void build_success_write_response(unsigned char response[22]) {
 	response[21] = 0xFF;
 }
 
+// Acknowledge a single-item Write Var request carrying 01 02 .. 08, answering with its PDU reference
+static int build_write_u64_ack(const unsigned char* request, int request_len, unsigned char response[22]) {
+	if (request_len != 43 || request[17] != 0x05) {
+		return 0;
+	}
+	for (int i = 0; i < 8; i++) {
+		if (request[35 + i] != i + 1) {
+			return 0;
+		}
+	}
+	build_success_write_response(response);
+	response[11] = request[11];
+	response[12] = request[12];
+	return 22;
+}
+
 static int drain_tpkt_request(int fd) {
 	unsigned char header[4] = { 0 };
 	if (read_exact(fd, header, 4) != 4) {
@@ -106,6 +161,183 @@ static int drain_tpkt_request(int fd) {
 	return ok;
 }
 
+static int read_tpkt_frame(int fd, unsigned char* buffer, int capacity) {
+	if (read_exact(fd, buffer, 4) != 4) {
+		return -1;
+	}
+
+	int packet_length = ((int)buffer[2] << 8) | (int)buffer[3];
+	if (packet_length < 4 || packet_length > capacity) {
+		return -1;
+	}
+
+	if (packet_length > 4 && read_exact(fd, buffer + 4, packet_length - 4) != packet_length - 4) {
+		return -1;
+	}
+	return packet_length;
+}
+
+// Answer a Read Var request like a PLC would: byte items echo their byte offset, bit items return 1,
+// items addressing DB9 fail with return code 0x0A and byte items addressing DB8 come back half as long.
+static int build_read_var_response(const unsigned char* request, int request_len, unsigned char* response) {
+	if (request_len < 19 || request[17] != 0x04) {
+		return 0;
+	}
+
+	int count = request[18];
+	int pos = 21;
+	memset(response, 0, 21);
+	for (int i = 0; i < count; i++) {
+		const unsigned char* item = request + 19 + 12 * i;
+		int db = item[6] * 256 + item[7];
+		int start = (item[9] << 16) | (item[10] << 8) | item[11];
+		int length = item[3] == 0x01 ? 1 : item[4] * 256 + item[5];
+		if (db == 8 && item[3] != 0x01) {
+			length /= 2;
+		}
+
+		if (db == 9) {
+			response[pos++] = 0x0A;
+			response[pos++] = 0x00;
+			response[pos++] = 0x00;
+			response[pos++] = 0x00;
+			continue;
+		}
+
+		response[pos++] = 0xFF;
+		response[pos++] = item[3] == 0x01 ? 0x03 : 0x04;
+		response[pos++] = (unsigned char)((item[3] == 0x01 ? 1 : length * 8) >> 8);
+		response[pos++] = (unsigned char)(item[3] == 0x01 ? 1 : length * 8);
+		for (int j = 0; j < length; j++) {
+			response[pos++] = item[3] == 0x01 ? 0x01 : (unsigned char)((start >> 3) + j);
+		}
+		if ((length % 2) == 1 && i != count - 1) {
+			response[pos++] = 0x00;
+		}
+	}
+
+	response[0] = 0x03;
+	response[2] = (unsigned char)(pos >> 8);
+	response[3] = (unsigned char)pos;
+	response[4] = 0x02;
+	response[5] = 0xF0;
+	response[6] = 0x80;
+	response[7] = 0x32;
+	response[8] = 0x03;
+	response[11] = request[11];
+	response[12] = request[12];
+	response[14] = 0x02;
+	response[15] = (unsigned char)((pos - 21) >> 8);
+	response[16] = (unsigned char)(pos - 21);
+	response[19] = 0x04;
+	response[20] = (unsigned char)count;
+	return pos;
+}
+
+static int serve_read_var_request(int fd) {
+	unsigned char request[1024];
+	unsigned char response[4096];
+	int request_len = read_tpkt_frame(fd, request, (int)sizeof(request));
+	int response_len = build_read_var_response(request, request_len, response);
+	return response_len > 0 && write_exact(fd, response, response_len) == response_len;
+}
+
+// Accept the COTP connection request and Setup Communication, negotiating the given parallel jobs and PDU size.
+// The connection request (22 bytes) and Setup Communication request (25 bytes) are copied out when not NULL.
+static int serve_handshake(int fd, int amq, int pdu_size, unsigned char* connect_request, unsigned char* setup_request) {
+	unsigned char request[256];
+	unsigned char connect_confirm[22] = {
+		0x03, 0x00, 0x00, 0x16, 0x11, 0xD0, 0x00, 0x01, 0x00, 0x01,
+		0x00, 0xC0, 0x01, 0x0A, 0xC1, 0x02, 0x01, 0x00, 0xC2, 0x02, 0x01, 0x02
+	};
+	unsigned char setup_ack[27] = {
+		0x03, 0x00, 0x00, 0x1B, 0x02, 0xF0, 0x80, 0x32, 0x03, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0xF0,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+
+	if (read_tpkt_frame(fd, request, (int)sizeof(request)) < 22 || request[5] != 0xE0 ||
+		write_exact(fd, connect_confirm, 22) != 22) {
+		return 0;
+	}
+	if (connect_request != NULL) {
+		memcpy(connect_request, request, 22);
+	}
+
+	if (read_tpkt_frame(fd, request, (int)sizeof(request)) < 25 || request[17] != 0xF0) {
+		return 0;
+	}
+	if (setup_request != NULL) {
+		memcpy(setup_request, request, 25);
+	}
+	setup_ack[11] = request[11];
+	setup_ack[12] = request[12];
+	setup_ack[22] = (unsigned char)amq;
+	setup_ack[24] = (unsigned char)amq;
+	setup_ack[25] = (unsigned char)(pdu_size >> 8);
+	setup_ack[26] = (unsigned char)pdu_size;
+	return write_exact(fd, setup_ack, 27) == 27;
+}
+
+static int open_loopback_listener(int* port) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+		getsockname(fd, (struct sockaddr*)&addr, &addr_len) != 0) {
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+// Check a Write Var request against the expected data section and acknowledge every item,
+// failing items that address DB9 with return code 0x0A.
+static int serve_write_var_request(int fd, const unsigned char* expected_data, int expected_len) {
+	unsigned char request[1024];
+	unsigned char response[512];
+	int request_len = read_tpkt_frame(fd, request, (int)sizeof(request));
+	if (request_len < 19 || request[17] != 0x05) {
+		return 0;
+	}
+
+	int count = request[18];
+	int param_len = request[13] * 256 + request[14];
+	int data_len = request[15] * 256 + request[16];
+	if (param_len != 2 + 12 * count || data_len != expected_len || 17 + param_len + data_len != request_len ||
+		memcmp(request + 17 + param_len, expected_data, expected_len) != 0) {
+		return 0;
+	}
+
+	memset(response, 0, 21 + count);
+	for (int i = 0; i < count; i++) {
+		const unsigned char* item = request + 19 + 12 * i;
+		response[21 + i] = (item[6] * 256 + item[7]) == 9 ? 0x0A : 0xFF;
+	}
+	response[0] = 0x03;
+	response[3] = (unsigned char)(21 + count);
+	response[4] = 0x02;
+	response[5] = 0xF0;
+	response[6] = 0x80;
+	response[7] = 0x32;
+	response[8] = 0x03;
+	response[11] = request[11];
+	response[12] = request[12];
+	response[14] = 0x02;
+	response[16] = (unsigned char)count;
+	response[19] = 0x05;
+	response[20] = (unsigned char)count;
+	return write_exact(fd, response, 21 + count) == 21 + count;
+}
+
 static int verify_command_roundtrip(s7_error_code_e (*command_fn)(int), const unsigned char* expected, int expected_len) {
 	int fds[2] = { -1, -1 };
 	if (create_socket_pair(fds) != 0) {
@@ -157,6 +389,84 @@ static void test_address_parser(void) {
 	EXPECT_TRUE("address: invalid fraction range", !s7_analysis_address("MX0.8", 1, &data));
 	EXPECT_TRUE("address: invalid fraction token", !s7_analysis_address("MX0.A", 1, &data));
 	EXPECT_TRUE("address: invalid empty string", !s7_analysis_address("", 0, &data));
+	EXPECT_TRUE("address: DB bit decoded", s7_analysis_address("db12.dbx3.5", 1, &data) &&
+		data.data_code == 0x84 && data.db_block == 12 && data.address_start == 29);
+	EXPECT_TRUE("address: analog word decoded", s7_analysis_address("AIW64", 2, &data) && data.data_code == 0x06 && data.address_start == 512);
+	EXPECT_TRUE("address: timer number not scaled", s7_analysis_address("T37", 2, &data) && data.data_code == 0x1F && data.address_start == 37);
+	EXPECT_TRUE("address: timer bit rejected", !s7_analysis_address("T1.2", 2, &data));
+	EXPECT_TRUE("address: trailing text rejected", !s7_analysis_address("MW10X", 2, &data) && !s7_analysis_address("DB1.DBX0.1.2", 1, &data));
+	EXPECT_TRUE("address: block overflow rejected", !s7_analysis_address("DB65536.0", 1, &data) && s7_analysis_address("DB65535.0", 1, &data));
+	EXPECT_TRUE("address: offset overflow rejected", !s7_analysis_address("MB268435456", 1, &data) && !s7_analysis_address("MX0.4294967299", 1, &data));
+}
+
+static void test_bulk_endian(void) {
+	byte source[8 * 70 + 1];
+	byte output[8 * 70 + 1];
+	int all_match = 1;
+	for (int i = 0; i < (int)sizeof(source); i++) {
+		source[i] = (byte)(i * 7 + 1);
+	}
+
+	// Every count up to a few vector blocks, from an odd offset, against the scalar helpers.
+	for (int count = 0; count <= 70; count++) {
+		const byte* in = source + 1;
+		swap16_array(output, in, count);
+		for (int i = 0; i < count; i++) {
+			all_match = all_match && bytes2ushort(output + i * 2) == (ushort)(in[i * 2] << 8 | in[i * 2 + 1]);
+		}
+		swap32_array(output + 1, in, count);
+		for (int i = 0; i < count; i++) {
+			all_match = all_match && bytes2uint32(output + 1 + i * 4) ==
+				((uint32)in[i * 4] << 24 | (uint32)in[i * 4 + 1] << 16 | (uint32)in[i * 4 + 2] << 8 | in[i * 4 + 3]);
+		}
+		swap64_array(output, in, count);
+		for (int i = 0; i < count; i++) {
+			all_match = all_match && bytes2ubigInt(output + i * 8) == ntohll_(bytes2ubigInt((byte*)in + i * 8));
+		}
+	}
+	EXPECT_TRUE("endian: bulk kernels match the scalar helpers", all_match);
+
+	float values[37];
+	memcpy(output, source, sizeof(float) * 37);
+	swap32_array(output, output, 37);
+	swap32_array(values, source, 37);
+	all_match = memcmp(values, output, sizeof(values)) == 0;
+	for (int i = 0; i < 37; i++) {
+		all_match = all_match && values[i] == ntohf_(bytes2uint32(source + i * 4));
+	}
+	EXPECT_TRUE("endian: in-place and typed conversion agree", all_match);
+	EXPECT_TRUE("endian: kernel reported", swap_array_isa() != NULL);
+}
+
+static void test_bit_packing(void) {
+	byte packed[16];
+	bool values[128];
+	bool naive[128];
+	int all_match = 1;
+	for (int i = 0; i < (int)sizeof(packed); i++) {
+		packed[i] = (byte)(i * 37 + 11);
+	}
+
+	// Every start bit within two bytes and every length across the vector widths.
+	for (int first = 0; first < 16; first++) {
+		for (int count = 1; count <= 112; count++) {
+			memset(values, 0xEE, sizeof(values));
+			unpack_bits(values, packed, first, count);
+			for (int i = 0; i < count; i++) {
+				naive[i] = ((packed[(first + i) / 8] >> ((first + i) % 8)) & 1) != 0;
+			}
+			all_match = all_match && memcmp(values, naive, count) == 0 && ((byte*)values)[count] == 0xEE;
+		}
+	}
+	EXPECT_TRUE("bits: unpack matches bit-by-bit extraction", all_match);
+
+	byte repacked[16];
+	unpack_bits(values, packed, 0, 128);
+	pack_bits(repacked, values, 128);
+	all_match = memcmp(repacked, packed, sizeof(packed)) == 0;
+	pack_bits(repacked, values, 13);
+	all_match = all_match && repacked[0] == packed[0] && repacked[1] == (packed[1] & 0x1F);
+	EXPECT_TRUE("bits: pack restores the bytes", all_match);
 }
 
 static void test_short_packet_guard(void) {
@@ -233,6 +543,89 @@ static void test_malformed_header_guard(void) {
 #endif
 }
 
+#ifndef _WIN32
+// TPKT frame of the given length whose payload counts up from seed
+static void fill_tpkt_frame(unsigned char* frame, int length, int seed) {
+	frame[0] = 0x03;
+	frame[1] = 0x00;
+	frame[2] = (unsigned char)(length >> 8);
+	frame[3] = (unsigned char)length;
+	for (int i = 4; i < length; i++) {
+		frame[i] = (unsigned char)(seed + i);
+	}
+}
+
+static int check_tpkt_frame(const byte_array_info* frame, int length, int seed) {
+	if (frame->length != length) {
+		return 0;
+	}
+	for (int i = 4; i < length; i++) {
+		if (frame->data[i] != (byte)(seed + i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+#endif
+
+static void test_receive_buffer(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("rx: receive buffer tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("rx: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		static s7_rx_buffer rx;
+		static unsigned char stream[6000];
+		byte_array_info frame = { 0 };
+		s7_rx_reset(&rx);
+
+		// Three frames in one segment come out of a single recv.
+		fill_tpkt_frame(stream, 27, 1);
+		fill_tpkt_frame(stream + 27, 300, 2);
+		fill_tpkt_frame(stream + 327, 22, 3);
+		write_exact(fds[1], stream, 349);
+		int ok = s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 27, 1);
+		EXPECT_TRUE("rx: whole segment taken in one receive", ok && rx.end == 349);
+		ok = s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 300, 2);
+		ok = ok && s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 22, 3);
+		EXPECT_TRUE("rx: frames parsed in place", ok && frame.data == rx.data + 327);
+
+		// Four 1000-byte frames and the head of a fifth: the fifth no longer fits behind them and moves to the front.
+		for (int i = 0; i < 5; i++) {
+			fill_tpkt_frame(stream + i * 1000, 1000, 10 + i);
+		}
+		write_exact(fds[1], stream, 4050);
+		ok = 1;
+		for (int i = 0; i < 4; i++) {
+			ok = ok && s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 1000, 10 + i);
+		}
+		write_exact(fds[1], stream + 4050, 950);
+		ok = ok && s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 1000, 14);
+		EXPECT_TRUE("rx: partial frame compacted and completed", ok && frame.data == rx.data);
+
+		// Without a socket: a frame still missing bytes waits, the ones already there come out in place.
+		s7_rx_reset(&rx);
+		fill_tpkt_frame(rx.data, 27, 4);
+		fill_tpkt_frame(rx.data + 27, 300, 5);
+		rx.end = 27 + 100;
+		ok = s7_rx_take_frame(&rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 27, 4) && frame.data == rx.data;
+		ok = ok && s7_rx_take_frame(&rx, &frame) == S7_ERROR_CODE_WOULD_BLOCK && rx.start == 27;
+		rx.end = 327;
+		ok = ok && s7_rx_take_frame(&rx, &frame) == S7_ERROR_CODE_SUCCESS && check_tpkt_frame(&frame, 300, 5);
+		EXPECT_TRUE("rx: frames taken from the buffer alone", ok && s7_rx_take_frame(&rx, &frame) == S7_ERROR_CODE_WOULD_BLOCK && rx.end == 0);
+
+		stream[0] = 0x04;
+		write_exact(fds[1], stream, 1000);
+		EXPECT_TRUE("rx: bad TPKT header rejected", s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_RESPONSE_HEADER_FAILED &&
+			rx.start == rx.end);
+		close(fds[1]);
+		EXPECT_TRUE("rx: closed peer reported", s7_rx_next_frame(fds[0], &rx, &frame) == S7_ERROR_CODE_FAILED);
+		close(fds[0]);
+	}
+#endif
+}
+
 static void test_remote_run_stop_packet_path(void) {
 #ifdef _WIN32
 	EXPECT_TRUE("remote_run/stop: protocol packet tests skipped on Windows", true);
@@ -255,13 +648,1956 @@ static void test_remote_run_stop_packet_path(void) {
 #endif
 }
 
+static void test_read_multi_packet_path(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("read_multi: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("read_multi: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			// Mixed items fit one request; 25 byte items need two requests at the default 240-byte PDU.
+			int ok = 1;
+			for (int i = 0; i < 6 && ok; i++) {
+				ok = serve_read_var_request(fds[1]);
+			}
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		byte word[2] = { 0 };
+		byte bit = 0;
+		byte missing[2] = { 0 };
+		s7_multi_item items[3] = {
+			{ "MW10", 2, false, word },
+			{ "MX0.3", 1, true, &bit },
+			{ "DB9.DBW0", 2, false, missing },
+		};
+		s7_error_code_e results[25];
+		s7_error_code_e ret = s7_read_multi(fds[0], items, 3, results);
+		EXPECT_TRUE("read_multi: first failing item reported", ret == S7_ERROR_CODE_ERROR_000A);
+		EXPECT_TRUE("read_multi: word item decoded", results[0] == S7_ERROR_CODE_SUCCESS && word[0] == 10 && word[1] == 11);
+		EXPECT_TRUE("read_multi: bit item decoded after fill byte", results[1] == S7_ERROR_CODE_SUCCESS && bit == 1);
+		EXPECT_TRUE("read_multi: per-item return code 0x0A", results[2] == S7_ERROR_CODE_ERROR_000A);
+
+		char addresses[25][16];
+		byte values[25] = { 0 };
+		s7_multi_item many[25];
+		for (int i = 0; i < 25; i++) {
+			snprintf(addresses[i], sizeof(addresses[i]), "MB%d", i + 100);
+			many[i].address = addresses[i];
+			many[i].length = 1;
+			many[i].is_bit = false;
+			many[i].data = &values[i];
+		}
+		ret = s7_read_multi(fds[0], many, 25, results);
+		int all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 25; i++) {
+			all_match = all_match && results[i] == S7_ERROR_CODE_SUCCESS && values[i] == i + 100;
+		}
+		EXPECT_TRUE("read_multi: items split across PDUs and scattered back", all_match);
+
+		// The PLC answers the DB8 item with 2 of 4 bytes: reported, and the buffer is left alone.
+		byte full[2] = { 0 };
+		byte truncated[4] = { 0xEE, 0xEE, 0xEE, 0xEE };
+		s7_multi_item short_items[2] = {
+			{ "MW20", 2, false, full },
+			{ "DB8.DBD0", 4, false, truncated },
+		};
+		ret = s7_read_multi(fds[0], short_items, 2, results);
+		EXPECT_TRUE("read_multi: short item fails the length check", ret == S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED &&
+			results[0] == S7_ERROR_CODE_SUCCESS && full[0] == 20 && results[1] == S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED &&
+			truncated[0] == 0xEE && truncated[3] == 0xEE);
+		byte large[300];
+		EXPECT_TRUE("read_multi: short chunk fails a split read", s7_read_bytes(fds[0], "DB8.0", (int)sizeof(large), large) ==
+			S7_ERROR_CODE_DATA_LENGTH_CHECK_FAILED);
+		close(fds[0]);
+		EXPECT_TRUE("read_multi: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_write_multi_packet_path(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("write_multi: protocol packet tests skipped on Windows", true);
+#else
+	// Bit and odd byte items are followed by a fill byte, the last item is not.
+	const unsigned char expected_data[] = {
+		0x00, 0x03, 0x00, 0x01, 0x01, 0x00,
+		0x00, 0x04, 0x00, 0x08, 0x12, 0x00,
+		0x00, 0x04, 0x00, 0x10, 0x34, 0x56,
+		0x00, 0x04, 0x00, 0x20, 0x01, 0x02, 0x03, 0x04
+	};
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("write_multi: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			int ok = serve_write_var_request(fds[1], expected_data, (int)sizeof(expected_data));
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		byte bit = 1;
+		byte single = 0x12;
+		byte word[2] = { 0x34, 0x56 };
+		byte dword[4] = { 0x01, 0x02, 0x03, 0x04 };
+		s7_multi_item items[4] = {
+			{ "MX0.3", 1, true, &bit },
+			{ "MB5", 1, false, &single },
+			{ "DB1.DBW2", 2, false, word },
+			{ "DB9.DBD0", 4, false, dword },
+		};
+		s7_error_code_e results[4];
+		s7_error_code_e ret = s7_write_multi(fds[0], items, 4, results);
+		close(fds[0]);
+		EXPECT_TRUE("write_multi: first failing item reported", ret == S7_ERROR_CODE_ERROR_000A);
+		EXPECT_TRUE("write_multi: per-item results decoded", results[0] == S7_ERROR_CODE_SUCCESS && results[1] == S7_ERROR_CODE_SUCCESS &&
+			results[2] == S7_ERROR_CODE_SUCCESS && results[3] == S7_ERROR_CODE_ERROR_000A);
+		EXPECT_TRUE("write_multi: packed payload verified by peer", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_large_read_split(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("large_read: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("large_read: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int ok = 1;
+			close(fds[0]);
+			// 1000 bytes need five 222-byte chunks and 300 bytes need two at the default 240-byte PDU.
+			for (int i = 0; i < 7 && ok; i++) {
+				ok = serve_read_var_request(fds[1]);
+			}
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		byte buffer[1000];
+		memset(buffer, 0xEE, sizeof(buffer));
+		s7_error_code_e ret = s7_read_bytes(fds[0], "DB10.0", (int)sizeof(buffer), buffer);
+		int all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < (int)sizeof(buffer); i++) {
+			all_match = all_match && buffer[i] == (byte)i;
+		}
+		EXPECT_TRUE("large_read: chunks reassembled in caller buffer", all_match);
+
+		char* text = NULL;
+		ret = s7_read_string(fds[0], "DB10.100", 300, &text);
+		EXPECT_TRUE("large_read: typed read above PDU size split", ret == S7_ERROR_CODE_SUCCESS && text != NULL &&
+			(byte)text[0] == 100 && (byte)text[299] == (byte)(399));
+		free(text);
+		close(fds[0]);
+		EXPECT_TRUE("large_read: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+// Serve Read Var and Write Var requests against a byte image of one data block until the client hangs up.
+static int serve_image_requests(int fd, byte* image, int image_size) {
+	unsigned char request[1024];
+	unsigned char response[1024];
+	int request_len = 0;
+	while ((request_len = read_tpkt_frame(fd, request, (int)sizeof(request))) > 0) {
+		int is_write = request[17] == 0x05;
+		int count = request[18];
+		int param_len = request[13] * 256 + request[14];
+		int pos = 21;
+		const unsigned char* data = request + 17 + param_len;
+		if (request_len < 19 || (request[17] != 0x04 && !is_write)) {
+			return 0;
+		}
+		for (int i = 0; i < count; i++) {
+			const unsigned char* item = request + 19 + 12 * i;
+			int start = ((item[9] << 16) | (item[10] << 8) | item[11]) >> 3;
+			int length = item[4] * 256 + item[5];
+			if (start + length > image_size) {
+				return 0;
+			}
+			if (is_write && item[3] == 0x01) {
+				int bit = item[11] & 7;
+				image[start] = (byte)(data[4] ? image[start] | (1 << bit) : image[start] & ~(1 << bit));
+				data += 6;
+				response[pos++] = 0xFF;
+				continue;
+			}
+			if (is_write) {
+				memcpy(image + start, data + 4, length);
+				data += 4 + length + (length % 2);
+				response[pos++] = 0xFF;
+				continue;
+			}
+			if (item[3] == 0x01) {
+				response[pos++] = 0xFF;
+				response[pos++] = 0x03;
+				response[pos++] = 0x00;
+				response[pos++] = 0x01;
+				response[pos++] = (unsigned char)((image[start] >> (item[11] & 7)) & 1);
+				continue;
+			}
+			response[pos++] = 0xFF;
+			response[pos++] = 0x04;
+			response[pos++] = (unsigned char)((length * 8) >> 8);
+			response[pos++] = (unsigned char)(length * 8);
+			memcpy(response + pos, image + start, length);
+			pos += length;
+		}
+		memset(response, 0, 21);
+		response[0] = 0x03;
+		response[2] = (unsigned char)(pos >> 8);
+		response[3] = (unsigned char)pos;
+		response[4] = 0x02;
+		response[5] = 0xF0;
+		response[6] = 0x80;
+		response[7] = 0x32;
+		response[8] = 0x03;
+		response[11] = request[11];
+		response[12] = request[12];
+		response[14] = 0x02;
+		response[15] = is_write ? 0 : (unsigned char)((pos - 21) >> 8);
+		response[16] = is_write ? (unsigned char)count : (unsigned char)(pos - 21);
+		response[19] = request[17];
+		response[20] = (unsigned char)count;
+		if (write_exact(fd, response, pos) != pos) {
+			return 0;
+		}
+	}
+	return 1;
+}
+#endif
+
+static void test_typed_arrays(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("arrays: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("arrays: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			byte image[1024];
+			close(fds[0]);
+			for (int i = 0; i < (int)sizeof(image); i++) {
+				image[i] = (byte)i;
+			}
+			int ok = serve_image_requests(fds[1], image, (int)sizeof(image));
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		// 400 bytes take two Read Var frames and 480 bytes three Write Var frames at the default 240-byte PDU.
+		float reals[100];
+		byte wire[480];
+		s7_error_code_e ret = s7_read_float_array(fds[0], "DB1.0", reals, 100);
+		int all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 100; i++) {
+			for (int j = 0; j < 4; j++) {
+				wire[j] = (byte)(i * 4 + j);
+			}
+			all_match = all_match && reals[i] == ntohf_(bytes2uint32(wire));
+		}
+		EXPECT_TRUE("arrays: REAL array read across PDUs", all_match);
+
+		double lreals[60];
+		double readback[60];
+		for (int i = 0; i < 60; i++) {
+			lreals[i] = i * 1.5 - 20.25;
+		}
+		ret = s7_write_double_array(fds[0], "DB1.0", lreals, 60);
+		EXPECT_TRUE("arrays: LREAL array written across PDUs", ret == S7_ERROR_CODE_SUCCESS);
+		all_match = s7_read_bytes(fds[0], "DB1.0", (int)sizeof(wire), wire) == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 60; i++) {
+			all_match = all_match && ntohd_(bytes2ubigInt(wire + i * 8)) == lreals[i];
+		}
+		EXPECT_TRUE("arrays: written values big-endian on the wire", all_match);
+		all_match = s7_read_double_array(fds[0], "DB1.0", readback, 60) == S7_ERROR_CODE_SUCCESS &&
+			memcmp(readback, lreals, sizeof(lreals)) == 0;
+		EXPECT_TRUE("arrays: LREAL array read back", all_match);
+
+		short words[5] = { -1, 2, -300, 4000, -32768 };
+		short words_back[5] = { 0 };
+		int32 dints[3] = { 0 };
+		all_match = s7_write_short_array(fds[0], "DB1.600", words, 5) == S7_ERROR_CODE_SUCCESS &&
+			s7_read_short_array(fds[0], "DB1.600", words_back, 5) == S7_ERROR_CODE_SUCCESS && memcmp(words, words_back, sizeof(words)) == 0;
+		EXPECT_TRUE("arrays: INT array round trip in one frame", all_match);
+		EXPECT_TRUE("arrays: DINT array decoded", s7_read_int32_array(fds[0], "DB1.800", dints, 3) == S7_ERROR_CODE_SUCCESS &&
+			dints[0] == 0x20212223 && dints[2] == 0x28292A2B);
+		EXPECT_TRUE("arrays: empty array rejected", s7_read_float_array(fds[0], "DB1.0", reals, 0) == S7_ERROR_CODE_INVALID_PARAMETER &&
+			s7_write_int64_array(fds[0], "DB1.0", NULL, 2) == S7_ERROR_CODE_INVALID_PARAMETER);
+		close(fds[0]);
+		EXPECT_TRUE("arrays: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_bit_arrays(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("bit_arrays: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("bit_arrays: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			byte image[1024];
+			close(fds[0]);
+			for (int i = 0; i < (int)sizeof(image); i++) {
+				image[i] = (byte)(i * 7);
+			}
+			int ok = serve_image_requests(fds[1], image, (int)sizeof(image));
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		bool alarms[3000];
+		bool_array_info bits = { alarms, 300 };
+		s7_error_code_e ret = s7_read_bool_array(fds[0], "M1.3", &bits);
+		int all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 300; i++) {
+			int bit = 11 + i;
+			all_match = all_match && alarms[i] == (((byte)(bit / 8 * 7) >> (bit % 8)) & 1);
+		}
+		EXPECT_TRUE("bit_arrays: bits unpacked from one byte range", all_match);
+
+		// 375 bytes of bits need two Read Var frames at the default 240-byte PDU.
+		bits.length = 3000;
+		ret = s7_read_bool_array(fds[0], "DB1.DBX0.0", &bits);
+		all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 3000; i++) {
+			all_match = all_match && alarms[i] == (((byte)(i / 8 * 7) >> (i % 8)) & 1);
+		}
+		EXPECT_TRUE("bit_arrays: large bit range split by PDU", all_match);
+
+		// DBX10.5 .. DBX14.2: three leading and three trailing bits around three whole bytes.
+		bool commands[30];
+		for (int i = 0; i < 30; i++) {
+			commands[i] = (i % 3) == 0;
+		}
+		bool_array_info update = { commands, 30 };
+		EXPECT_TRUE("bit_arrays: bits written", s7_write_bool_array(fds[0], "DB1.DBX10.5", &update) == S7_ERROR_CODE_SUCCESS);
+		byte after[6];
+		all_match = s7_read_bytes(fds[0], "DB1.9", 6, after) == S7_ERROR_CODE_SUCCESS;
+		for (int bit = 72; bit < 120; bit++) {
+			int expected = bit >= 85 && bit < 115 ? commands[bit - 85] : ((byte)(bit / 8 * 7) >> (bit % 8)) & 1;
+			all_match = all_match && ((after[bit / 8 - 9] >> (bit % 8)) & 1) == expected;
+		}
+		EXPECT_TRUE("bit_arrays: only the addressed bits changed", all_match);
+
+		bool_array_info timers = { alarms, 4 };
+		EXPECT_TRUE("bit_arrays: timer area rejected", s7_read_bool_array(fds[0], "T1", &timers) == S7_ERROR_CODE_ERROR_0006);
+		close(fds[0]);
+		EXPECT_TRUE("bit_arrays: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_bit_batch(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("bit_batch: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("bit_batch: socketpair created", create_socket_pair(fds) == 0);
+	if (fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			byte image[1024];
+			close(fds[0]);
+			memset(image, 0x5A, sizeof(image));
+			int ok = serve_image_requests(fds[1], image, (int)sizeof(image));
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		s7_conn_t* conn = s7_conn_from_fd(fds[0]);
+		s7_bit_batch_t* batch = s7_bit_batch_create(conn, 0);
+		EXPECT_TRUE("bit_batch: created", batch != NULL && s7_bit_batch_create(NULL, 0) == NULL);
+		s7_error_code_e ret = s7_bit_batch_set(batch, "DB1.DBX4.0", true);
+		ret = ret == S7_ERROR_CODE_SUCCESS ? s7_bit_batch_set(batch, "DB1.DBX4.1", false) : ret;
+		ret = ret == S7_ERROR_CODE_SUCCESS ? s7_bit_batch_set(batch, "DB1.DBX4.7", true) : ret;
+		ret = ret == S7_ERROR_CODE_SUCCESS ? s7_bit_batch_set(batch, "DB1.DBX6.0", true) : ret;
+		ret = ret == S7_ERROR_CODE_SUCCESS ? s7_bit_batch_set(batch, "DB1.DBX4.0", false) : ret;
+		EXPECT_TRUE("bit_batch: repeated bit kept once", ret == S7_ERROR_CODE_SUCCESS && s7_bit_batch_get_pending(batch) == 4);
+		EXPECT_TRUE("bit_batch: nothing sent before the commit", s7_bit_batch_poll(batch) == S7_ERROR_CODE_SUCCESS &&
+			s7_bit_batch_get_pending(batch) == 4);
+
+		// The PLC changes other bits of the byte in the meantime; bit items leave them alone.
+		byte plc_side = 0x0C;
+		byte after[3] = { 0 };
+		EXPECT_TRUE("bit_batch: byte changed underneath", s7_write_bytes(fds[0], "DB1.4", 1, &plc_side) == S7_ERROR_CODE_SUCCESS);
+		EXPECT_TRUE("bit_batch: committed", s7_bit_batch_commit(batch) == S7_ERROR_CODE_SUCCESS && s7_bit_batch_get_pending(batch) == 0);
+		EXPECT_TRUE("bit_batch: only the addressed bits changed", s7_read_bytes(fds[0], "DB1.4", 3, after) == S7_ERROR_CODE_SUCCESS &&
+			after[0] == 0x8C && after[1] == 0x5A && after[2] == 0x5B);
+		EXPECT_TRUE("bit_batch: empty commit", s7_bit_batch_commit(batch) == S7_ERROR_CODE_SUCCESS);
+		EXPECT_TRUE("bit_batch: word areas rejected", s7_bit_batch_set(batch, "T1", true) == S7_ERROR_CODE_ERROR_0006 &&
+			s7_bit_batch_set(batch, "XYZ1", true) == S7_ERROR_CODE_PARSE_ADDRESS_FAILED && s7_bit_batch_get_pending(batch) == 0);
+		s7_bit_batch_destroy(batch);
+
+		s7_bit_batch_t* timed = s7_bit_batch_create(conn, 20);
+		ret = timed != NULL ? s7_bit_batch_set(timed, "M8.2", true) : S7_ERROR_CODE_MALLOC_FAILED;
+		EXPECT_TRUE("bit_batch: held until the deadline", ret == S7_ERROR_CODE_SUCCESS && s7_bit_batch_get_pending(timed) == 1);
+		usleep(30000);
+		EXPECT_TRUE("bit_batch: flushed by poll after the deadline", s7_bit_batch_poll(timed) == S7_ERROR_CODE_SUCCESS &&
+			s7_bit_batch_get_pending(timed) == 0 && s7_read_bytes(fds[0], "MB8", 1, after) == S7_ERROR_CODE_SUCCESS && after[0] == 0x5E);
+		s7_bit_batch_destroy(timed);
+		close(fds[0]);
+		EXPECT_TRUE("bit_batch: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_tag_database(void) {
+	const char* export_csv =
+		"\xEF\xBB\xBFName,Address,Data Type,Scan Group,Comment\r\n"
+		"# exported from the line 3 tag table\r\n"
+		"Motor_Speed,%DB1.DBD0,Real,fast,rpm\r\n"
+		"\"Valve \"\"A\"\", open\",%M10.3,Bool,fast\r\n"
+		"Counter,DB1.DBW8,Int,slow\r\n"
+		"\r\n"
+		"Total,db1.dbd12,DInt\r\n";
+	s7_tag_db_t* db = s7_tag_db_create();
+	int error_line = -1;
+	s7_tag_info info;
+	EXPECT_TRUE("tags: export loaded", db != NULL && s7_tag_db_load_text(db, export_csv, (int)strlen(export_csv), &error_line) == S7_ERROR_CODE_SUCCESS &&
+		error_line == 0 && s7_tag_db_get_count(db) == 4);
+	EXPECT_TRUE("tags: names hashed", s7_tag_db_find(db, "Motor_Speed") == 0 && s7_tag_db_find(db, "Valve \"A\", open") == 1 &&
+		s7_tag_db_find(db, "Total") == 3 && s7_tag_db_find(db, "total") == -1 && s7_tag_db_find(db, "Missing") == -1);
+	EXPECT_TRUE("tags: info kept", s7_tag_db_get_info(db, 1, &info) && strcmp(info.address, "M10.3") == 0 &&
+		strcmp(info.group, "fast") == 0 && info.type == S7_TAG_TYPE_BOOL && info.size == 1 &&
+		s7_tag_db_get_info(db, 3, &info) && info.group[0] == '\0' && info.size == 4 && !s7_tag_db_get_info(db, 4, &info));
+	int ids[4] = { -1, -1, -1, -1 };
+	EXPECT_TRUE("tags: scan group members", s7_tag_db_get_group(db, "fast", ids, 1) == 2 && ids[0] == 0 && ids[1] == -1 &&
+		s7_tag_db_get_group(db, "slow", ids, 4) == 1 && ids[0] == 2);
+
+	const char* bad_type = "Level\tDB2.DBD0\tReal\nMode\tDB2.DBW4\tString\n";
+	const char* duplicate = "Level;DB2.DBD0;Real\nMotor_Speed;DB2.DBD4;Real\n";
+	const char* bit_word = "Flags,M0.1,Word\n";
+	EXPECT_TRUE("tags: unknown type reported with its line", s7_tag_db_load_text(db, bad_type, (int)strlen(bad_type), &error_line) == S7_ERROR_CODE_ERROR_0006 &&
+		error_line == 2 && s7_tag_db_get_count(db) == 4 && s7_tag_db_find(db, "Level") == -1);
+	EXPECT_TRUE("tags: duplicate name rejected", s7_tag_db_load_text(db, duplicate, (int)strlen(duplicate), &error_line) == S7_ERROR_CODE_INVALID_PARAMETER &&
+		error_line == 2 && s7_tag_db_get_count(db) == 4);
+	EXPECT_TRUE("tags: bit address needs Bool", s7_tag_db_load_text(db, bit_word, (int)strlen(bit_word), &error_line) == S7_ERROR_CODE_PARSE_ADDRESS_FAILED &&
+		s7_tag_db_add(db, "Timer", "T1", S7_TAG_TYPE_BOOL, NULL) == S7_ERROR_CODE_ERROR_0006);
+	const char* path = "test_tags.tsv";
+	FILE* file = fopen(path, "wb");
+	if (file != NULL) {
+		fputs("Name\tAddress\tData Type\nPressure\tDB3.DBD0\tLReal\n", file);
+		fclose(file);
+	}
+	s7_tag_db_t* from_file = s7_tag_db_create();
+	EXPECT_TRUE("tags: export file loaded", from_file != NULL && s7_tag_db_load_file(from_file, path, NULL) == S7_ERROR_CODE_SUCCESS &&
+		s7_tag_db_find(from_file, "Pressure") == 0 && s7_tag_db_get_info(from_file, 0, &info) && info.size == 8 &&
+		s7_tag_db_load_file(from_file, "missing_tags.csv", NULL) == S7_ERROR_CODE_FAILED);
+	s7_tag_db_destroy(from_file);
+	remove(path);
+	EXPECT_TRUE("tags: added by hand", s7_tag_db_add(db, "Level", "%DB2.DBD0", S7_TAG_TYPE_REAL, "slow") == S7_ERROR_CODE_SUCCESS &&
+		s7_tag_db_find(db, "Level") == 4 && s7_tag_db_find(db, "Motor_Speed") == 0);
+
+	// A large export: every name found again under its own id.
+	int big_count = 50000;
+	char* big = (char*)malloc((size_t)big_count * 48);
+	s7_tag_db_t* large = s7_tag_db_create();
+	int big_length = 0;
+	for (int i = 0; big != NULL && i < big_count; i++) {
+		big_length += snprintf(big + big_length, 48, "Line%d_Tag%d\tDB%d.DBD%d\tReal\tg%d\n", i % 7, i, 1 + i / 1000, (i % 1000) * 4, i % 10);
+	}
+	int all_match = big != NULL && large != NULL && s7_tag_db_load_text(large, big, big_length, NULL) == S7_ERROR_CODE_SUCCESS &&
+		s7_tag_db_get_count(large) == big_count;
+	for (int i = 0; all_match && i < big_count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "Line%d_Tag%d", i % 7, i);
+		all_match = s7_tag_db_find(large, name) == i;
+	}
+	EXPECT_TRUE("tags: 50k tags loaded and found", all_match && s7_tag_db_get_group(large, "g3", NULL, 0) == big_count / 10);
+	s7_tag_db_destroy(large);
+	free(big);
+
+#ifdef _WIN32
+	EXPECT_TRUE("tags: protocol packet tests skipped on Windows", true);
+#else
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("tags: socketpair created", create_socket_pair(fds) == 0);
+	if (db != NULL && fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			byte image[1024];
+			close(fds[0]);
+			memset(image, 0, sizeof(image));
+			int ok = serve_image_requests(fds[1], image, (int)sizeof(image));
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		float speed = 1480.5f, speed_back = 0;
+		short counter = -1234, counter_back = 0;
+		bool open = true, open_back = false;
+		byte wire[4] = { 0 };
+		EXPECT_TRUE("tags: values written by id", s7_tag_write(fds[0], db, 0, &speed) == S7_ERROR_CODE_SUCCESS &&
+			s7_tag_write(fds[0], db, 2, &counter) == S7_ERROR_CODE_SUCCESS && s7_tag_write(fds[0], db, 1, &open) == S7_ERROR_CODE_SUCCESS);
+		EXPECT_TRUE("tags: big-endian on the wire", s7_read_bytes(fds[0], "DB1.0", 4, wire) == S7_ERROR_CODE_SUCCESS &&
+			ntohf_(bytes2uint32(wire)) == speed);
+		EXPECT_TRUE("tags: values read by id", s7_tag_read(fds[0], db, 0, &speed_back) == S7_ERROR_CODE_SUCCESS && speed_back == speed &&
+			s7_tag_read(fds[0], db, 2, &counter_back) == S7_ERROR_CODE_SUCCESS && counter_back == counter &&
+			s7_tag_read(fds[0], db, 1, &open_back) == S7_ERROR_CODE_SUCCESS && open_back);
+		EXPECT_TRUE("tags: unknown id rejected", s7_tag_read(fds[0], db, 99, &speed_back) == S7_ERROR_CODE_INVALID_PARAMETER &&
+			s7_tag_write(fds[0], db, -1, &speed) == S7_ERROR_CODE_INVALID_PARAMETER);
+		close(fds[0]);
+		EXPECT_TRUE("tags: peer completed", wait_child_success(pid));
+	}
+#endif
+	s7_tag_db_destroy(db);
+}
+
+static void test_read_plan(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("read_plan: protocol packet tests skipped on Windows", true);
+#else
+	byte mb0 = 0xEE, mb1 = 0xEE, mw4[2] = { 0 }, mx3 = 0xEE, mx2 = 0xEE, dbd0[4] = { 0 }, dbw10[2] = { 0 }, missing = 0;
+	s7_multi_item tags[8] = {
+		{ "DB1.DBW10", 2, false, dbw10 },
+		{ "MB1", 1, false, &mb1 },
+		{ "MW4", 2, false, mw4 },
+		{ "MX3.0", 1, true, &mx3 },
+		{ "DB9.DBB0", 1, false, &missing },
+		{ "MB0", 1, false, &mb0 },
+		{ "DB1.DBD0", 4, false, dbd0 },
+		{ "MX2.1", 1, true, &mx2 },
+	};
+	// M0..M5 collapse into one range, DB1 stays split because the 6-byte gap exceeds max_gap.
+	s7_read_plan* plan = s7_read_plan_create(tags, 8, 4);
+	EXPECT_TRUE("read_plan: created", plan != NULL);
+	EXPECT_TRUE("read_plan: ranges packed into one request", s7_read_plan_request_count(plan) == 1);
+
+	char addresses[60][16];
+	byte values[60] = { 0 };
+	s7_multi_item spread[60];
+	for (int i = 0; i < 60; i++) {
+		snprintf(addresses[i], sizeof(addresses[i]), "MB%d", i * 10);
+		spread[i].address = addresses[i];
+		spread[i].length = 1;
+		spread[i].is_bit = false;
+		spread[i].data = &values[i];
+	}
+	s7_read_plan* wide = s7_read_plan_create(spread, 60, 0);
+	EXPECT_TRUE("read_plan: item limit splits requests", wide != NULL && s7_read_plan_request_count(wide) == 4);
+
+	int fds[2] = { -1, -1 };
+	EXPECT_TRUE("read_plan: socketpair created", create_socket_pair(fds) == 0);
+	if (plan != NULL && wide != NULL && fds[0] >= 0 && fds[1] >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int ok = 1;
+			close(fds[0]);
+			for (int i = 0; i < 6 && ok; i++) {
+				ok = serve_read_var_request(fds[1]);
+			}
+			close(fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(fds[1]);
+		s7_error_code_e results[60];
+		int all_match = 1;
+		for (int round = 0; round < 2; round++) {
+			s7_error_code_e ret = s7_read_plan_execute(fds[0], plan, results);
+			all_match = all_match && ret == S7_ERROR_CODE_ERROR_000A && results[4] == S7_ERROR_CODE_ERROR_000A &&
+				results[0] == S7_ERROR_CODE_SUCCESS && dbw10[0] == 10 && dbw10[1] == 11 &&
+				mb0 == 0 && mb1 == 1 && mw4[0] == 4 && mw4[1] == 5 && mx3 == 1 && mx2 == 1 &&
+				dbd0[0] == 0 && dbd0[3] == 3;
+			mb0 = mb1 = mx3 = mx2 = 0xEE;
+		}
+		EXPECT_TRUE("read_plan: values scattered on repeated execution", all_match);
+
+		s7_error_code_e ret = s7_read_plan_execute(fds[0], wide, results);
+		all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 60; i++) {
+			all_match = all_match && results[i] == S7_ERROR_CODE_SUCCESS && values[i] == (byte)(i * 10);
+		}
+		EXPECT_TRUE("read_plan: wide plan scattered", all_match);
+		close(fds[0]);
+		EXPECT_TRUE("read_plan: peer completed", wait_child_success(pid));
+	}
+	s7_read_plan_destroy(plan);
+	s7_read_plan_destroy(wide);
+#endif
+}
+
+#ifndef _WIN32
+typedef int (*fake_plc_handler)(int peer);
+
+// Fake PLC in a child process: accepts one client on a loopback port, completes COTP and Setup Communication
+// with the given PDU size, then lets handler serve the session. Returns the child's pid, -1 when it could not start.
+static pid_t run_fake_plc(int pdu_size, fake_plc_handler handler, int* port) {
+	int listener = open_loopback_listener(port);
+	if (listener < 0) {
+		return -1;
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		int peer = accept(listener, NULL, NULL);
+		int ok = peer >= 0 && serve_handshake(peer, 1, pdu_size, NULL, NULL) && handler(peer);
+		close(peer);
+		close(listener);
+		_exit(ok ? 0 : 1);
+	}
+	close(listener);
+	return pid;
+}
+
+// Answers reads from the DB image of build_read_var_response() and acknowledges writes until the client hangs up
+static int serve_until_eof(int peer) {
+	unsigned char request[1024];
+	unsigned char response[4096];
+	int request_len = 0;
+	int ok = 1;
+	while (ok && (request_len = read_tpkt_frame(peer, request, (int)sizeof(request))) > 0) {
+		int response_len = 0;
+		if (request[17] == 0x05) {
+			build_success_write_response(response);
+			response[11] = request[11];
+			response[12] = request[12];
+			response_len = 22;
+		}
+		else {
+			response_len = build_read_var_response(request, request_len, response);
+		}
+		ok = response_len > 0 && write_exact(peer, response, response_len) == response_len;
+	}
+	return ok;
+}
+
+static int serve_prepared_session(int peer) {
+	unsigned char first[64];
+	unsigned char request[64];
+	unsigned char response[256];
+	const unsigned char expected[8] = { 0x00, 0x04, 0x00, 0x20, 0x11, 0x22, 0x33, 0x44 };
+	// Both executions of one handle send the same frame apart from the PDU reference.
+	int first_len = read_tpkt_frame(peer, first, (int)sizeof(first));
+	int ok = first_len == 31 && write_exact(peer, response, build_read_var_response(first, first_len, response)) > 0;
+	int request_len = ok ? read_tpkt_frame(peer, request, (int)sizeof(request)) : -1;
+	ok = ok && request_len == 31 && memcmp(request, first, 11) == 0 && memcmp(request + 13, first + 13, 18) == 0 &&
+		memcmp(request + 11, first + 11, 2) != 0;
+	ok = ok && write_exact(peer, response, build_read_var_response(request, request_len, response)) > 0;
+	ok = ok && serve_read_var_request(peer);
+	ok = ok && serve_write_var_request(peer, expected, 8);
+	ok = ok && serve_read_var_request(peer);
+	unsigned char probe;
+	(void)read(peer, &probe, 1);
+	return ok;
+}
+#endif
+
+// Handshake tests run last: a real connect changes the negotiated PDU size and parallel jobs for the process.
+static void test_prepared_handles(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("prepared: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	pid_t pid = run_fake_plc(240, serve_prepared_session, &port);
+	EXPECT_TRUE("prepared: fake PLC started", pid > 0);
+	if (pid > 0) {
+		s7_conn_t* conn = s7_conn_create(S1200);
+		bool connected = conn != NULL && s7_conn_connect(conn, "127.0.0.1", port, NULL);
+		EXPECT_TRUE("prepared: connected", connected);
+		if (connected) {
+			EXPECT_TRUE("prepared: bad address rejected", s7_prepare_read(conn, "XYZ1", 4, false) == NULL);
+			s7_prepared_t* dword = s7_prepare_read(conn, "DB1.70", 4, false);
+			s7_prepared_t* bit = s7_prepare_read(conn, "M0.1", 1, true);
+			s7_prepared_t* write = s7_prepare_write(conn, "DB1.0", 4, false);
+			s7_prepared_t* failing = s7_prepare_read(conn, "DB9.0", 2, false);
+			s7_prepared_t* large = s7_prepare_read(conn, "DB1.0", 400, false);
+			EXPECT_TRUE("prepared: handles created", dword != NULL && bit != NULL && write != NULL && failing != NULL && large != NULL);
+			if (dword != NULL && bit != NULL && write != NULL && failing != NULL && large != NULL) {
+				byte value[4] = { 0 };
+				byte second[4] = { 0 };
+				byte flag = 0;
+				const byte data[4] = { 0x11, 0x22, 0x33, 0x44 };
+				byte buffer[400];
+				EXPECT_TRUE("prepared: read decodes value", s7_prepared_read(dword, value) == S7_ERROR_CODE_SUCCESS &&
+					value[0] == 70 && value[3] == 73);
+				EXPECT_TRUE("prepared: handle reused", s7_prepared_read(dword, second) == S7_ERROR_CODE_SUCCESS &&
+					memcmp(value, second, 4) == 0);
+				EXPECT_TRUE("prepared: bit read", s7_prepared_read(bit, &flag) == S7_ERROR_CODE_SUCCESS && flag == 1);
+				EXPECT_TRUE("prepared: write sends caller data", s7_prepared_write(write, data) == S7_ERROR_CODE_SUCCESS);
+				EXPECT_TRUE("prepared: direction checked", s7_prepared_write(dword, data) == S7_ERROR_CODE_INVALID_PARAMETER &&
+					s7_prepared_read(write, value) == S7_ERROR_CODE_INVALID_PARAMETER);
+				EXPECT_TRUE("prepared: item error reported", s7_prepared_read(failing, value) == S7_ERROR_CODE_ERROR_000A);
+				EXPECT_TRUE("prepared: oversized read refused before sending",
+					s7_prepared_read(large, buffer) == S7_ERROR_CODE_PDU_SIZE_EXCEEDED && s7_prepared_get_length(large) == 400);
+			}
+			s7_prepared_destroy(dword);
+			s7_prepared_destroy(bit);
+			s7_prepared_destroy(write);
+			s7_prepared_destroy(failing);
+			s7_prepared_destroy(large);
+		}
+		s7_conn_destroy(conn);
+		EXPECT_TRUE("prepared: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static int poll_round(int fd, s7_prepared_t* prepared) {
+	int32 value = 0;
+	bool flag = false;
+	byte range[16];
+	byte raw[4];
+	int ok = s7_read_int32(fd, "DB1.70", &value) == S7_ERROR_CODE_SUCCESS && value == 0x46474849;
+	ok = ok && s7_read_bool(fd, "M0.1", &flag) == S7_ERROR_CODE_SUCCESS && flag;
+	ok = ok && s7_write_int32(fd, "DB1.DBD0", 0x01020304) == S7_ERROR_CODE_SUCCESS;
+	ok = ok && s7_read_bytes(fd, "DB1.10", (int)sizeof(range), range) == S7_ERROR_CODE_SUCCESS && range[0] == 10 && range[15] == 25;
+	ok = ok && s7_prepared_read(prepared, raw) == S7_ERROR_CODE_SUCCESS && raw[0] == 70;
+	bool alarms[16];
+	bool_array_info bits = { alarms, 16 };
+	ok = ok && s7_read_bool_array(fd, "M2.0", &bits) == S7_ERROR_CODE_SUCCESS && alarms[1] && !alarms[0] && alarms[8] && alarms[9];
+	return ok;
+}
+
+// A plan packed before any connect uses the template's default PDU; executing it packs it for the connection's own.
+static void test_read_plan_negotiated_pdu(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("plan-pdu: protocol packet tests skipped on Windows", true);
+#else
+	char addresses[60][16];
+	byte values[60] = { 0 };
+	s7_multi_item spread[60];
+	for (int i = 0; i < 60; i++) {
+		snprintf(addresses[i], sizeof(addresses[i]), "MB%d", i * 10);
+		spread[i].address = addresses[i];
+		spread[i].length = 1;
+		spread[i].is_bit = false;
+		spread[i].data = &values[i];
+	}
+	int port = 0;
+	pid_t pid = run_fake_plc(960, serve_until_eof, &port);
+	s7_read_plan* plan = s7_read_plan_create(spread, 60, 0);
+	s7_connect_options options = { 960, 1, 1 };
+	s7_conn_t* conn = s7_conn_create(S1500);
+	int connected = pid > 0 && plan != NULL && conn != NULL && s7_conn_connect(conn, "127.0.0.1", port, &options);
+	EXPECT_TRUE("plan-pdu: connected with a bigger PDU", connected && s7_conn_get_PDU_size(conn) == 960 &&
+		get_plc_PDU_size() < 960 && s7_read_plan_request_count(plan) > 1);
+	if (connected) {
+		s7_error_code_e results[60];
+		s7_error_code_e ret = s7_read_plan_execute(s7_conn_get_fd(conn), plan, results);
+		int all_match = ret == S7_ERROR_CODE_SUCCESS;
+		for (int i = 0; i < 60; i++) {
+			all_match = all_match && results[i] == S7_ERROR_CODE_SUCCESS && values[i] == (byte)(i * 10);
+		}
+		EXPECT_TRUE("plan-pdu: packed again into one request", all_match && s7_read_plan_request_count(plan) == 1);
+	}
+	s7_conn_destroy(conn);
+	s7_read_plan_destroy(plan);
+	EXPECT_TRUE("plan-pdu: peer completed", pid <= 0 || wait_child_success(pid));
+#endif
+}
+
+static void test_zero_allocation_path(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("zero-alloc: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	pid_t pid = run_fake_plc(480, serve_until_eof, &port);
+	EXPECT_TRUE("zero-alloc: fake PLC started", pid > 0);
+	if (pid > 0) {
+		s7_conn_t* conn = s7_conn_create(S1200);
+		bool connected = conn != NULL && s7_conn_connect(conn, "127.0.0.1", port, NULL);
+		EXPECT_TRUE("zero-alloc: connected", connected);
+		if (connected) {
+			int fd = s7_conn_get_fd(conn);
+			s7_prepared_t* prepared = s7_prepare_read(conn, "DB1.70", 4, false);
+			EXPECT_TRUE("zero-alloc: warm-up round", prepared != NULL && poll_round(fd, prepared));
+#ifdef S7_TEST_COUNT_ALLOCS
+			g_alloc_count = 0;
+			int ok = prepared != NULL && poll_round(fd, prepared);
+			int allocations = g_alloc_count;
+			EXPECT_TRUE("zero-alloc: typed reads, writes, ranges, bits and handles stay off the heap", ok && allocations == 0);
+#endif
+			s7_prepared_destroy(prepared);
+		}
+		s7_conn_destroy(conn);
+		EXPECT_TRUE("zero-alloc: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	int allocs;
+	int releases;
+} counting_allocator_state;
+
+static void* counting_alloc(size_t size, void* user_data) {
+	((counting_allocator_state*)user_data)->allocs++;
+	return malloc(size);
+}
+
+static void counting_release(void* block, void* user_data) {
+	((counting_allocator_state*)user_data)->releases++;
+	free(block);
+}
+
+static int frame_round(int fd) {
+	char* text = NULL;
+	byte a[4] = { 0 };
+	byte b[2] = { 0 };
+	s7_multi_item items[2] = { { "DB1.70", 4, false, a }, { "DB1.10", 2, false, b } };
+	s7_error_code_e results[2];
+	int ok = s7_read_string(fd, "DB1.10", 8, &text) == S7_ERROR_CODE_SUCCESS && text != NULL && text[0] == 10 && text[7] == 17;
+	free(text);
+	ok = ok && s7_read_multi(fd, items, 2, results) == S7_ERROR_CODE_SUCCESS && a[0] == 70 && b[1] == 11;
+	return ok;
+}
+#endif
+
+static void test_frame_allocators(void) {
+	// Frames may outlive the pool that lent them: fallbacks across a swap, pool blocks across the connection.
+	s7_conn_t* owner = s7_conn_create(S1200);
+	EXPECT_TRUE("frame-alloc: pool on a disconnected context", owner != NULL && s7_conn_use_frame_pool(owner, 1));
+	if (owner != NULL) {
+		byte* pooled = s7_frame_alloc(owner, 16);
+		byte* spilled = s7_frame_alloc(owner, 16);
+		EXPECT_TRUE("frame-alloc: busy pool kept", pooled != NULL && spilled != NULL && !s7_conn_use_frame_pool(owner, 2));
+		s7_frame_release(pooled);
+		EXPECT_TRUE("frame-alloc: released pool replaced", s7_conn_use_frame_pool(owner, 2));
+		s7_frame_release(spilled);
+		pooled = s7_frame_alloc(owner, 16);
+		s7_conn_destroy(owner);
+		s7_frame_release(pooled);
+	}
+
+#ifdef _WIN32
+	EXPECT_TRUE("frame-alloc: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	pid_t pid = run_fake_plc(480, serve_until_eof, &port);
+	EXPECT_TRUE("frame-alloc: fake PLC started", pid > 0);
+	if (pid > 0) {
+		s7_conn_t* conn = s7_conn_create(S1200);
+		bool connected = conn != NULL && s7_conn_connect(conn, "127.0.0.1", port, NULL);
+		EXPECT_TRUE("frame-alloc: connected", connected);
+		if (connected) {
+			int fd = s7_conn_get_fd(conn);
+			s7_frame_pool_stats stats;
+			counting_allocator_state counts = { 0, 0 };
+			s7_allocator counting = { counting_alloc, counting_release, &counts };
+			s7_conn_set_allocator(conn, &counting);
+			EXPECT_TRUE("frame-alloc: embedder allocator serves every frame", frame_round(fd) &&
+				counts.allocs > 0 && counts.allocs == counts.releases);
+			EXPECT_TRUE("frame-alloc: no pool stats without a pool", !s7_conn_get_frame_pool_stats(conn, &stats));
+
+			// One block cannot hold a request and its response at once, so the response spills to the heap.
+			EXPECT_TRUE("frame-alloc: pool attached", s7_conn_use_frame_pool(conn, 1));
+			EXPECT_TRUE("frame-alloc: exhausted pool falls back", frame_round(fd) && s7_conn_get_frame_pool_stats(conn, &stats) &&
+				stats.block_size == S7_TPKT_MIN_SIZE + 480 && stats.high_water == 1 && stats.fallbacks > 0 && stats.in_use == 0);
+
+			int allocs = counts.allocs;
+			EXPECT_TRUE("frame-alloc: idle pool replaced", s7_conn_use_frame_pool(conn, 4));
+			EXPECT_TRUE("frame-alloc: frames served by the pool", frame_round(fd) && s7_conn_get_frame_pool_stats(conn, &stats) &&
+				stats.block_count == 4 && stats.high_water == 2 && stats.fallbacks == 0 && stats.in_use == 0 && counts.allocs == allocs);
+		}
+		s7_conn_destroy(conn);
+		EXPECT_TRUE("frame-alloc: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_connect_options(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("connect_options: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("connect_options: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			unsigned char setup_request[25];
+			unsigned char expected[6] = { 0x00, 0x02, 0x00, 0x04, 0x03, 0xC0 };
+			int ok = 1;
+			for (int i = 0; i < 2 && ok; i++) {
+				// The PLC answers the requested 960 bytes and 2/4 jobs with 720 bytes and 8 jobs.
+				int peer = accept(listener, NULL, NULL);
+				ok = peer >= 0 && serve_handshake(peer, 8, 720, NULL, setup_request) &&
+					memcmp(setup_request + 19, expected, sizeof(expected)) == 0;
+				unsigned char probe;
+				(void)read(peer, &probe, 1);
+				close(peer);
+				expected[1] = 0x01;
+				expected[3] = 0x01;
+				expected[4] = 0x01;
+				expected[5] = 0xE0;
+			}
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 960, 2, 4 };
+		int fd = -1;
+		bool connected = s7_connect_ex("127.0.0.1", port, S1500, &options, &fd);
+		EXPECT_TRUE("connect_options: connected with options", connected);
+		EXPECT_TRUE("connect_options: negotiated values parsed from ack",
+			get_plc_PDU_size() == 720 && get_plc_parallel_jobs() == 2 && get_plc_PDU_length() == 702);
+		if (connected) {
+			s7_disconnect(fd);
+		}
+
+		connected = s7_connect("127.0.0.1", port, S1500, &fd);
+		EXPECT_TRUE("connect_options: plain connect requests defaults again", connected);
+		EXPECT_TRUE("connect_options: defaults cap negotiated values", get_plc_PDU_size() == 480 && get_plc_parallel_jobs() == 1);
+		if (connected) {
+			s7_disconnect(fd);
+		}
+		EXPECT_TRUE("connect_options: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_independent_connections(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("connections: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("connections: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			unsigned char request_1500[22];
+			unsigned char request_smart[22];
+			int peer_1500 = accept(listener, NULL, NULL);
+			int ok = peer_1500 >= 0 && serve_handshake(peer_1500, 4, 960, request_1500, NULL);
+			int peer_smart = accept(listener, NULL, NULL);
+			ok = ok && peer_smart >= 0 && serve_handshake(peer_smart, 1, 240, request_smart, NULL);
+			// Rack 0 slot 1 on the S7-1500, the fixed Smart TSAPs on the other connection.
+			ok = ok && request_1500[11] == 0xC0 && request_1500[21] == 0x01;
+			ok = ok && request_smart[11] == 0xC1 && request_smart[13] == 0x10 && request_smart[17] == 0x03;
+			unsigned char probe;
+			(void)read(peer_1500, &probe, 1);
+			(void)read(peer_smart, &probe, 1);
+			close(peer_1500);
+			close(peer_smart);
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 960, 4, 4 };
+		s7_conn_t* s1500 = s7_conn_create(S1500);
+		s7_conn_t* smart = s7_conn_create(S200Smart);
+		EXPECT_TRUE("connections: contexts created", s1500 != NULL && smart != NULL);
+		if (s1500 != NULL && smart != NULL) {
+			s7_conn_set_slot(s1500, 1);
+			bool connected = s7_conn_connect(s1500, "127.0.0.1", port, &options) &&
+				s7_conn_connect(smart, "127.0.0.1", port, NULL);
+			EXPECT_TRUE("connections: both connected", connected);
+			EXPECT_TRUE("connections: negotiated values kept per connection",
+				s7_conn_get_PDU_size(s1500) == 960 && s7_conn_get_parallel_jobs(s1500) == 4 &&
+				s7_conn_get_PDU_size(smart) == 240 && s7_conn_get_parallel_jobs(smart) == 1);
+			EXPECT_TRUE("connections: distinct sockets", s7_conn_get_fd(s1500) >= 0 && s7_conn_get_fd(s1500) != s7_conn_get_fd(smart));
+
+			// Disconnecting through the fd shim keeps the caller's context alive.
+			s7_disconnect(s7_conn_get_fd(smart));
+			EXPECT_TRUE("connections: fd shim disconnects context", s7_conn_get_fd(smart) == -1 && s7_conn_get_PDU_size(smart) == 240);
+		}
+		s7_conn_destroy(s1500);
+		s7_conn_destroy(smart);
+		EXPECT_TRUE("connections: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+static void test_pipelined_large_read(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("pipeline: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("pipeline: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			unsigned char requests[3][256];
+			int lengths[3];
+			unsigned char response[1024];
+			int ok = 0;
+			int peer = accept(listener, NULL, NULL);
+			// Collect all three chunk requests before answering, then answer them in reverse order.
+			if (peer >= 0 && serve_handshake(peer, 3, 480, NULL, NULL)) {
+				ok = 1;
+				for (int i = 0; i < 3 && ok; i++) {
+					lengths[i] = read_tpkt_frame(peer, requests[i], (int)sizeof(requests[i]));
+					ok = lengths[i] > 0;
+				}
+				for (int i = 2; i >= 0 && ok; i--) {
+					int response_len = build_read_var_response(requests[i], lengths[i], response);
+					ok = response_len > 0 && write_exact(peer, response, response_len) == response_len;
+				}
+				ok = ok && requests[0][11] * 256 + requests[0][12] != requests[1][11] * 256 + requests[1][12];
+				// The write payload is sent from the caller's buffer behind the prebuilt header.
+				lengths[0] = ok ? read_tpkt_frame(peer, requests[0], (int)sizeof(requests[0])) : 0;
+				ok = build_write_u64_ack(requests[0], lengths[0], response) && write_exact(peer, response, 22) == 22;
+			}
+			close(peer);
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 480, 3, 3 };
+		int fd = -1;
+		bool connected = s7_connect_ex("127.0.0.1", port, S1200, &options, &fd);
+		EXPECT_TRUE("pipeline: connected through fake PLC", connected);
+		EXPECT_TRUE("pipeline: negotiated PDU and parallel jobs", get_plc_PDU_size() == 480 && get_plc_parallel_jobs() == 3);
+		if (connected) {
+			byte buffer[1000];
+			memset(buffer, 0xEE, sizeof(buffer));
+			s7_error_code_e ret = s7_read_bytes(fd, "DB10.0", (int)sizeof(buffer), buffer);
+			int all_match = ret == S7_ERROR_CODE_SUCCESS;
+			for (int i = 0; i < (int)sizeof(buffer); i++) {
+				all_match = all_match && buffer[i] == (byte)i;
+			}
+			EXPECT_TRUE("pipeline: out-of-order responses matched by PDU reference", all_match);
+			EXPECT_TRUE("pipeline: gathered write acknowledged", s7_write_uint64(fd, "DB10.0", 0x0102030405060708ULL) == S7_ERROR_CODE_SUCCESS);
+			s7_disconnect(fd);
+		}
+		EXPECT_TRUE("pipeline: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	s7_conn_t* conn;
+	int index;
+	int ok;
+} shared_reader;
+
+static int check_counting_bytes(const byte* buffer, int length, int first) {
+	for (int i = 0; i < length; i++) {
+		if (buffer[i] != (byte)(first + i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Each thread reads its own DB10 range through the fd API, the plan-free multi read and a submitted job.
+static void* shared_reader_main(void* arg) {
+	shared_reader* reader = (shared_reader*)arg;
+	int fd = s7_conn_get_fd(reader->conn);
+	int first = reader->index * 20;
+	char address[32];
+	snprintf(address, sizeof(address), "DB10.%d", first);
+	reader->ok = 1;
+	for (int round = 0; round < 25 && reader->ok; round++) {
+		byte single[4] = { 0 };
+		byte multi[6] = { 0 };
+		byte queued[8] = { 0 };
+		s7_error_code_e results[1];
+		s7_multi_item multi_item = { address, (int)sizeof(multi), false, multi };
+		s7_multi_item queued_item = { address, (int)sizeof(queued), false, queued };
+
+		reader->ok = s7_read_bytes(fd, address, (int)sizeof(single), single) == S7_ERROR_CODE_SUCCESS &&
+			check_counting_bytes(single, (int)sizeof(single), first);
+		reader->ok = reader->ok && s7_read_multi(fd, &multi_item, 1, results) == S7_ERROR_CODE_SUCCESS &&
+			check_counting_bytes(multi, (int)sizeof(multi), first);
+
+		s7_job_t* job = s7_conn_submit_read(reader->conn, &queued_item, 1, results);
+		reader->ok = reader->ok && job != NULL && s7_job_wait(job) == S7_ERROR_CODE_SUCCESS &&
+			s7_job_poll(job) && check_counting_bytes(queued, (int)sizeof(queued), first);
+		s7_job_release(job);
+	}
+	return NULL;
+}
+#endif
+
+static void test_shared_connection(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("shared: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("shared: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int peer = accept(listener, NULL, NULL);
+			int ok = peer >= 0 && serve_handshake(peer, 4, 480, NULL, NULL);
+			// Answer in arrival order until the client disconnects.
+			while (ok && serve_read_var_request(peer)) {
+			}
+			close(peer);
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 480, 4, 4 };
+		s7_conn_t* conn = s7_conn_create(S1200);
+		bool connected = conn != NULL && s7_conn_connect(conn, "127.0.0.1", port, &options);
+		EXPECT_TRUE("shared: connected through fake PLC", connected);
+		if (connected) {
+			EXPECT_TRUE("shared: I/O owner started", s7_conn_start_io(conn));
+
+			pthread_t threads[4];
+			shared_reader readers[4];
+			for (int i = 0; i < 4; i++) {
+				readers[i].conn = conn;
+				readers[i].index = i;
+				readers[i].ok = 0;
+				pthread_create(&threads[i], NULL, shared_reader_main, &readers[i]);
+			}
+			int all_ok = 1;
+			for (int i = 0; i < 4; i++) {
+				pthread_join(threads[i], NULL);
+				all_ok = all_ok && readers[i].ok;
+			}
+			EXPECT_TRUE("shared: concurrent threads each get their own data", all_ok);
+
+			// Without an I/O owner a submitted job runs on the caller before submit returns.
+			s7_conn_stop_io(conn);
+			byte inline_data[2] = { 0 };
+			s7_error_code_e results[1];
+			s7_multi_item item = { "DB10.100", (int)sizeof(inline_data), false, inline_data };
+			s7_job_t* job = s7_conn_submit_read(conn, &item, 1, results);
+			EXPECT_TRUE("shared: job runs inline after stop", job != NULL && s7_job_poll(job) &&
+				s7_job_wait(job) == S7_ERROR_CODE_SUCCESS && inline_data[0] == 100 && inline_data[1] == 101);
+			s7_job_release(job);
+		}
+		s7_conn_destroy(conn);
+		EXPECT_TRUE("shared: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	pthread_t caller;
+	int calls;
+	int off_caller_thread;
+	s7_error_code_e result;
+} async_probe;
+
+static void async_probe_callback(s7_error_code_e result, void* user_data) {
+	async_probe* probe = (async_probe*)user_data;
+	probe->result = result;
+	probe->off_caller_thread = !pthread_equal(probe->caller, pthread_self());
+	__atomic_add_fetch(&probe->calls, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+static void test_async_callbacks(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("async: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("async: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			const unsigned char expected_write[] = { 0x00, 0x04, 0x00, 0x10, 0x11, 0x22 };
+			int peer = accept(listener, NULL, NULL);
+			int ok = peer >= 0 && serve_handshake(peer, 3, 480, NULL, NULL);
+			// Two reads and a write, answered in submission order.
+			ok = ok && serve_read_var_request(peer) && serve_read_var_request(peer);
+			ok = ok && serve_write_var_request(peer, expected_write, (int)sizeof(expected_write));
+			unsigned char probe;
+			(void)read(peer, &probe, 1);
+			close(peer);
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 480, 3, 3 };
+		int fd = -1;
+		bool connected = s7_connect_ex("127.0.0.1", port, S1200, &options, &fd);
+		EXPECT_TRUE("async: connected through fake PLC", connected);
+		if (connected) {
+			byte single[6] = { 0 };
+			byte first[2] = { 0 };
+			byte second[3] = { 0 };
+			const byte payload[2] = { 0x11, 0x22 };
+			s7_multi_item items[2] = {
+				{ "DB10.30", (int)sizeof(first), false, first },
+				{ "DB10.40", (int)sizeof(second), false, second },
+			};
+			s7_error_code_e results[2] = { S7_ERROR_CODE_UNKOWN, S7_ERROR_CODE_UNKOWN };
+			s7_completion read_done = { 0 };
+			s7_completion multi_done = { 0 };
+			async_probe write_probe = { pthread_self(), 0, 0, S7_ERROR_CODE_UNKOWN };
+
+			s7_error_code_e queued = s7_read_async(fd, "DB10.4", (int)sizeof(single), single, s7_completion_handler, &read_done);
+			queued = queued == S7_ERROR_CODE_SUCCESS ? s7_read_multi_async(fd, items, 2, results, s7_completion_handler, &multi_done) : queued;
+			queued = queued == S7_ERROR_CODE_SUCCESS ? s7_write_async(fd, "DB10.0", (int)sizeof(payload), payload, async_probe_callback, &write_probe) : queued;
+			EXPECT_TRUE("async: requests queued without blocking", queued == S7_ERROR_CODE_SUCCESS);
+
+			async_probe rejected = { pthread_self(), 0, 0, S7_ERROR_CODE_UNKOWN };
+			EXPECT_TRUE("async: bad address rejected before queueing",
+				s7_read_async(fd, "QQ1", 2, single, async_probe_callback, &rejected) == S7_ERROR_CODE_PARSE_ADDRESS_FAILED);
+
+			for (int i = 0; i < 500 && (!s7_completion_done(&read_done) || !s7_completion_done(&multi_done) ||
+				__atomic_load_n(&write_probe.calls, __ATOMIC_ACQUIRE) == 0); i++) {
+				usleep(10000);
+			}
+			EXPECT_TRUE("async: read completion record filled", s7_completion_done(&read_done) &&
+				read_done.result == S7_ERROR_CODE_SUCCESS && single[0] == 4 && single[5] == 9);
+			EXPECT_TRUE("async: multi read results filled", s7_completion_done(&multi_done) &&
+				multi_done.result == S7_ERROR_CODE_SUCCESS && results[0] == S7_ERROR_CODE_SUCCESS &&
+				results[1] == S7_ERROR_CODE_SUCCESS && first[1] == 31 && second[2] == 42);
+			EXPECT_TRUE("async: write callback ran once on the I/O thread", write_probe.calls == 1 &&
+				write_probe.off_caller_thread && write_probe.result == S7_ERROR_CODE_SUCCESS);
+			EXPECT_TRUE("async: rejected request never calls back", rejected.calls == 0);
+			s7_disconnect(fd);
+		}
+		EXPECT_TRUE("async: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	int port;
+	siemens_plc_types_e plc;
+	int ok;
+} family_connector;
+
+static void* family_connector_main(void* arg) {
+	family_connector* connector = (family_connector*)arg;
+	int fd = -1;
+	int32 value = 0;
+	connector->ok = s7_connect("127.0.0.1", connector->port, connector->plc, &fd) &&
+		s7_read_int32(fd, "DB1.70", &value) == S7_ERROR_CODE_SUCCESS && value == 0x46474849;
+	if (fd >= 0) {
+		s7_disconnect(fd);
+	}
+	return NULL;
+}
+#endif
+
+// The set_plc_* template is rebuilt per PLC family; connects of different families must not see it half done.
+static void test_connect_families_in_parallel(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("connect-families: protocol packet tests skipped on Windows", true);
+#else
+	family_connector connectors[2] = { { 0, S1200, 0 }, { 0, S300, 0 } };
+	pid_t pids[2];
+	pthread_t threads[2];
+	for (int i = 0; i < 2; i++) {
+		pids[i] = run_fake_plc(480, serve_until_eof, &connectors[i].port);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_create(&threads[i], NULL, family_connector_main, &connectors[i]);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	EXPECT_TRUE("connect-families: both families connected and read", connectors[0].ok && connectors[1].ok);
+	EXPECT_TRUE("connect-families: negotiated PDU size reported", get_plc_PDU_size() == 480);
+	for (int i = 0; i < 2; i++) {
+		EXPECT_TRUE("connect-families: peer completed", pids[i] <= 0 || wait_child_success(pids[i]));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	pthread_t thread;
+	int calls;
+	s7_error_code_e result;
+} async_thread_probe;
+
+static void async_thread_callback(s7_error_code_e result, void* user_data) {
+	async_thread_probe* probe = (async_thread_probe*)user_data;
+	probe->result = result;
+	probe->thread = pthread_self();
+	__atomic_add_fetch(&probe->calls, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+static void test_async_shared_owner(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("async-owner: protocol packet tests skipped on Windows", true);
+#else
+	int ports[2] = { 0, 0 };
+	pid_t pids[2];
+	s7_conn_t* conns[2] = { NULL, NULL };
+	async_thread_probe probes[2];
+	byte values[2][4];
+	memset(probes, 0, sizeof(probes));
+	// Both PLCs fork before the first connect so neither child keeps the other's socket open.
+	for (int i = 0; i < 2; i++) {
+		pids[i] = run_fake_plc(480, serve_until_eof, &ports[i]);
+	}
+	int connected = 1;
+	for (int i = 0; i < 2; i++) {
+		conns[i] = s7_conn_create(S1200);
+		connected = connected && pids[i] > 0 && conns[i] != NULL && s7_conn_connect(conns[i], "127.0.0.1", ports[i], NULL);
+	}
+	EXPECT_TRUE("async-owner: connected", connected);
+	if (connected) {
+		int queued = 1;
+		for (int i = 0; i < 2; i++) {
+			queued = queued && s7_read_async(s7_conn_get_fd(conns[i]), "DB1.70", 4, values[i], async_thread_callback, &probes[i]) == S7_ERROR_CODE_SUCCESS;
+		}
+		EXPECT_TRUE("async-owner: reads queued", queued);
+		for (int i = 0; i < 500 && (__atomic_load_n(&probes[0].calls, __ATOMIC_ACQUIRE) == 0 ||
+			__atomic_load_n(&probes[1].calls, __ATOMIC_ACQUIRE) == 0); i++) {
+			usleep(10000);
+		}
+#ifdef __linux__
+		EXPECT_TRUE("async-owner: connections share one callback thread", probes[0].calls == 1 && probes[1].calls == 1 &&
+			pthread_equal(probes[0].thread, probes[1].thread) && !pthread_equal(probes[0].thread, pthread_self()));
+#endif
+		EXPECT_TRUE("async-owner: values delivered", probes[0].result == S7_ERROR_CODE_SUCCESS &&
+			probes[1].result == S7_ERROR_CODE_SUCCESS && values[0][0] == 70 && values[1][3] == 73);
+		int32 value = 0;
+		EXPECT_TRUE("async-owner: blocking call from the caller goes through the owner",
+			s7_read_int32(s7_conn_get_fd(conns[1]), "DB1.70", &value) == S7_ERROR_CODE_SUCCESS && value == 0x46474849);
+	}
+	for (int i = 0; i < 2; i++) {
+		s7_conn_destroy(conns[i]);
+		EXPECT_TRUE("async-owner: peer completed", pids[i] <= 0 || wait_child_success(pids[i]));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	int fd;
+	int calls;
+	s7_error_code_e result;
+} async_disconnect_probe;
+
+// Drops the connection from inside its own completion, the way an application gives up on a PLC.
+static void async_disconnect_callback(s7_error_code_e result, void* user_data) {
+	async_disconnect_probe* probe = (async_disconnect_probe*)user_data;
+	probe->result = result;
+	s7_disconnect(probe->fd);
+	__atomic_add_fetch(&probe->calls, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+static void test_async_disconnect_in_callback(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("async-disconnect: protocol packet tests skipped on Windows", true);
+#else
+	int ports[2] = { 0, 0 };
+	pid_t pids[2];
+	int fds[2] = { -1, -1 };
+	async_disconnect_probe probe = { -1, 0, S7_ERROR_CODE_UNKOWN };
+	for (int i = 0; i < 2; i++) {
+		pids[i] = run_fake_plc(480, serve_until_eof, &ports[i]);
+	}
+	int connected = pids[0] > 0 && pids[1] > 0 && s7_connect("127.0.0.1", ports[0], S1200, &fds[0]) &&
+		s7_connect("127.0.0.1", ports[1], S1200, &fds[1]);
+	EXPECT_TRUE("async-disconnect: connected", connected);
+	if (connected) {
+		byte value[4] = { 0 };
+		probe.fd = fds[0];
+		EXPECT_TRUE("async-disconnect: read queued",
+			s7_read_async(fds[0], "DB1.70", 4, value, async_disconnect_callback, &probe) == S7_ERROR_CODE_SUCCESS);
+		for (int i = 0; i < 500 && __atomic_load_n(&probe.calls, __ATOMIC_ACQUIRE) == 0; i++) {
+			usleep(10000);
+		}
+		EXPECT_TRUE("async-disconnect: callback ran and dropped its connection", probe.calls == 1 &&
+			probe.result == S7_ERROR_CODE_SUCCESS && value[0] == 70);
+
+		// The loop that ran the callback keeps serving its other connections.
+		async_thread_probe other = { pthread_self(), 0, S7_ERROR_CODE_UNKOWN };
+		byte other_value[4] = { 0 };
+		EXPECT_TRUE("async-disconnect: other connection queued",
+			s7_read_async(fds[1], "DB1.70", 4, other_value, async_thread_callback, &other) == S7_ERROR_CODE_SUCCESS);
+		for (int i = 0; i < 500 && __atomic_load_n(&other.calls, __ATOMIC_ACQUIRE) == 0; i++) {
+			usleep(10000);
+		}
+		EXPECT_TRUE("async-disconnect: other connection still served", other.calls == 1 &&
+			other.result == S7_ERROR_CODE_SUCCESS && other_value[3] == 73);
+	}
+	if (fds[0] >= 0 && __atomic_load_n(&probe.calls, __ATOMIC_ACQUIRE) == 0) {
+		s7_disconnect(fds[0]);
+	}
+	if (fds[1] >= 0) {
+		s7_disconnect(fds[1]);
+	}
+	for (int i = 0; i < 2; i++) {
+		EXPECT_TRUE("async-disconnect: peer completed", pids[i] <= 0 || wait_child_success(pids[i]));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	s7_conn_t* conn;
+	int destroy;
+	int calls;
+	s7_error_code_e result;
+} io_stop_probe;
+
+// Disconnects or destroys the connection from its own I/O thread, which cannot join itself.
+static void io_stop_callback(s7_error_code_e result, void* user_data) {
+	io_stop_probe* probe = (io_stop_probe*)user_data;
+	probe->result = result;
+	if (probe->destroy) {
+		s7_conn_destroy(probe->conn);
+	}
+	else {
+		s7_conn_disconnect(probe->conn);
+	}
+	__atomic_add_fetch(&probe->calls, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+static void test_io_stop_in_callback(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("io-stop: protocol packet tests skipped on Windows", true);
+#else
+	int ports[2] = { 0, 0 };
+	pid_t pids[2];
+	s7_conn_t* conns[2] = { NULL, NULL };
+	io_stop_probe probes[2];
+	memset(probes, 0, sizeof(probes));
+	for (int i = 0; i < 2; i++) {
+		pids[i] = run_fake_plc(480, serve_until_eof, &ports[i]);
+	}
+	int started = 1;
+	for (int i = 0; i < 2; i++) {
+		conns[i] = s7_conn_create(S1200);
+		started = started && pids[i] > 0 && conns[i] != NULL && s7_conn_connect(conns[i], "127.0.0.1", ports[i], NULL) &&
+			s7_conn_start_io(conns[i]);
+	}
+	EXPECT_TRUE("io-stop: connections started", started);
+	if (started) {
+		byte values[2][4];
+		int queued = 1;
+		for (int i = 0; i < 2; i++) {
+			probes[i].conn = conns[i];
+			probes[i].destroy = i;
+			queued = queued && s7_read_async(s7_conn_get_fd(conns[i]), "DB1.70", 4, values[i], io_stop_callback, &probes[i]) == S7_ERROR_CODE_SUCCESS;
+		}
+		EXPECT_TRUE("io-stop: reads queued", queued);
+		for (int i = 0; i < 500 && (__atomic_load_n(&probes[0].calls, __ATOMIC_ACQUIRE) == 0 ||
+			__atomic_load_n(&probes[1].calls, __ATOMIC_ACQUIRE) == 0); i++) {
+			usleep(10000);
+		}
+		EXPECT_TRUE("io-stop: callbacks ran", probes[0].calls == 1 && probes[1].calls == 1 &&
+			probes[0].result == S7_ERROR_CODE_SUCCESS && probes[1].result == S7_ERROR_CODE_SUCCESS);
+		EXPECT_TRUE("io-stop: disconnect from the I/O thread closed the socket", s7_conn_get_fd(conns[0]) < 0);
+		// The destroyed one is freed by its exiting I/O thread.
+		conns[1] = NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		s7_conn_destroy(conns[i]);
+		EXPECT_TRUE("io-stop: peer completed", pids[i] <= 0 || wait_child_success(pids[i]));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	int fd;
+	int ok;
+} loop_blocking_reader;
+
+// Plain blocking calls from another thread while the loop owns the connection.
+static void* loop_blocking_reader_main(void* arg) {
+	loop_blocking_reader* reader = (loop_blocking_reader*)arg;
+	byte buffer[4] = { 0 };
+	int ok = s7_read_bytes(reader->fd, "DB10.60", (int)sizeof(buffer), buffer) == S7_ERROR_CODE_SUCCESS &&
+		buffer[0] == 60 && buffer[3] == 63 && s7_write_uint64(reader->fd, "DB10.70", 0x0102030405060708ULL) == S7_ERROR_CODE_SUCCESS;
+	__atomic_store_n(&reader->ok, ok, __ATOMIC_RELEASE);
+	return NULL;
+}
+#endif
+
+static void test_event_loop(s7_loop_backend_e backend) {
+#ifdef _WIN32
+	EXPECT_TRUE("loop: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("loop: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Three PLCs in one process; the last one swallows requests without answering.
+			struct pollfd peers[3];
+			int ok = 1;
+			for (int i = 0; i < 3 && ok; i++) {
+				peers[i].fd = accept(listener, NULL, NULL);
+				peers[i].events = POLLIN;
+				ok = peers[i].fd >= 0 && serve_handshake(peers[i].fd, 2, 480, NULL, NULL);
+			}
+			int open_count = ok ? 3 : 0;
+			while (open_count > 0 && poll(peers, 3, 5000) > 0) {
+				for (int i = 0; i < 3; i++) {
+					if (peers[i].fd < 0 || peers[i].revents == 0) {
+						continue;
+					}
+					unsigned char request[1024];
+					unsigned char response[4096];
+					int request_len = read_tpkt_frame(peers[i].fd, request, (int)sizeof(request));
+					int response_len = 0;
+					if (request_len > 0 && i < 2) {
+						response_len = request[17] == 0x05 ? build_write_u64_ack(request, request_len, response) :
+							build_read_var_response(request, request_len, response);
+					}
+					if (request_len <= 0) {
+						close(peers[i].fd);
+						peers[i].fd = -1;
+						open_count--;
+					} else if (i < 2 && (response_len <= 0 || write_exact(peers[i].fd, response, response_len) != response_len)) {
+						ok = 0;
+					}
+				}
+			}
+			close(listener);
+			_exit(ok && open_count == 0 ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 480, 2, 2 };
+		s7_loop_options loop_options = { 200, backend, 8 };
+		s7_loop_t* loop = s7_loop_create_ex(&loop_options);
+		EXPECT_TRUE("loop: requested backend or the epoll fallback", loop != NULL &&
+			(s7_loop_get_backend(loop) == backend || s7_loop_get_backend(loop) == S7_LOOP_BACKEND_EPOLL));
+		s7_conn_t* conns[3] = { NULL, NULL, NULL };
+		bool added = loop != NULL;
+		for (int i = 0; i < 3; i++) {
+			conns[i] = s7_conn_create(S1500);
+			added = added && conns[i] != NULL && s7_conn_connect(conns[i], "127.0.0.1", port, &options) && s7_loop_add(loop, conns[i]);
+		}
+		EXPECT_TRUE("loop: connections added", added && s7_loop_get_connection_count(loop) == 3);
+		EXPECT_TRUE("loop: connection owned twice rejected", !s7_loop_add(loop, conns[0]));
+		if (added) {
+			byte data[3][8];
+			s7_completion done[3];
+			memset(data, 0, sizeof(data));
+			memset(done, 0, sizeof(done));
+			int queued = 1;
+			for (int i = 0; i < 3; i++) {
+				char address[16];
+				snprintf(address, sizeof(address), "DB10.%d", 10 * (i + 1));
+				queued = queued && s7_read_async(s7_conn_get_fd(conns[i]), address, 8, data[i], s7_completion_handler, &done[i]) == S7_ERROR_CODE_SUCCESS;
+			}
+			EXPECT_TRUE("loop: async reads queued", queued);
+
+			loop_blocking_reader reader = { s7_conn_get_fd(conns[1]), 0 };
+			pthread_t thread;
+			pthread_create(&thread, NULL, loop_blocking_reader_main, &reader);
+			for (int i = 0; i < 300 && (!s7_completion_done(&done[0]) || !s7_completion_done(&done[1]) ||
+				!s7_completion_done(&done[2]) || !__atomic_load_n(&reader.ok, __ATOMIC_ACQUIRE)); i++) {
+				s7_loop_run(loop, 10);
+			}
+			pthread_join(thread, NULL);
+
+			EXPECT_TRUE("loop: responses dispatched per connection", s7_completion_done(&done[0]) && done[0].result == S7_ERROR_CODE_SUCCESS &&
+				data[0][0] == 10 && data[0][7] == 17 && s7_completion_done(&done[1]) && done[1].result == S7_ERROR_CODE_SUCCESS &&
+				data[1][0] == 20 && data[1][7] == 27);
+			EXPECT_TRUE("loop: blocking call from another thread served by the loop", reader.ok);
+			EXPECT_TRUE("loop: silent PLC times out", s7_completion_done(&done[2]) && done[2].result == S7_ERROR_CODE_TIMEOUT);
+		}
+		s7_loop_destroy(loop);
+		for (int i = 0; i < 3; i++) {
+			s7_conn_destroy(conns[i]);
+		}
+		EXPECT_TRUE("loop: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	s7_loop_t* loop;
+	s7_conn_t* other;
+	int calls;
+	s7_error_code_e result;
+} loop_remove_probe;
+
+// Whichever read completes first takes the other connection off the loop, whose answer may already be waiting.
+static void loop_remove_callback(s7_error_code_e result, void* user_data) {
+	loop_remove_probe* probe = (loop_remove_probe*)user_data;
+	probe->result = result;
+	probe->calls++;
+	if (result == S7_ERROR_CODE_SUCCESS) {
+		s7_loop_remove(probe->loop, probe->other);
+	}
+}
+#endif
+
+static void test_loop_remove_in_callback(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("loop-remove: protocol packet tests skipped on Windows", true);
+#else
+	int ports[2] = { 0, 0 };
+	pid_t pids[2];
+	s7_conn_t* conns[2] = { NULL, NULL };
+	for (int i = 0; i < 2; i++) {
+		pids[i] = run_fake_plc(480, serve_until_eof, &ports[i]);
+	}
+	s7_loop_t* loop = s7_loop_create(1000);
+	int added = loop != NULL;
+	for (int i = 0; i < 2; i++) {
+		conns[i] = s7_conn_create(S1200);
+		added = added && pids[i] > 0 && conns[i] != NULL && s7_conn_connect(conns[i], "127.0.0.1", ports[i], NULL) && s7_loop_add(loop, conns[i]);
+	}
+	EXPECT_TRUE("loop-remove: connections added", added);
+	if (added) {
+		byte values[2][4];
+		loop_remove_probe probes[2] = {
+			{ loop, conns[1], 0, S7_ERROR_CODE_UNKOWN },
+			{ loop, conns[0], 0, S7_ERROR_CODE_UNKOWN },
+		};
+		int queued = 1;
+		for (int i = 0; i < 2; i++) {
+			queued = queued && s7_read_async(s7_conn_get_fd(conns[i]), "DB1.70", 4, values[i], loop_remove_callback, &probes[i]) == S7_ERROR_CODE_SUCCESS;
+		}
+		EXPECT_TRUE("loop-remove: reads queued", queued);
+		// Send both, then let both answers arrive so they come back from a single wait.
+		s7_loop_run(loop, 0);
+		usleep(50000);
+		for (int i = 0; i < 100 && probes[0].calls + probes[1].calls < 2; i++) {
+			s7_loop_run(loop, 10);
+		}
+		EXPECT_TRUE("loop-remove: one read served, the removed one closed", probes[0].calls == 1 && probes[1].calls == 1 &&
+			(probes[0].result == S7_ERROR_CODE_SUCCESS) != (probes[1].result == S7_ERROR_CODE_SUCCESS) &&
+			(probes[0].result == S7_ERROR_CODE_CONNECTION_CLOSED || probes[1].result == S7_ERROR_CODE_CONNECTION_CLOSED));
+		EXPECT_TRUE("loop-remove: removed connection left the loop", s7_loop_get_connection_count(loop) == 1);
+		int32 value = 0;
+		int removed = probes[0].result == S7_ERROR_CODE_SUCCESS ? 1 : 0;
+		EXPECT_TRUE("loop-remove: removed connection usable on its own",
+			s7_read_int32(s7_conn_get_fd(conns[removed]), "DB1.70", &value) == S7_ERROR_CODE_SUCCESS && value == 0x46474849);
+	}
+	s7_loop_destroy(loop);
+	for (int i = 0; i < 2; i++) {
+		s7_conn_destroy(conns[i]);
+		EXPECT_TRUE("loop-remove: peer completed", pids[i] <= 0 || wait_child_success(pids[i]));
+	}
+#endif
+}
+
+static void test_connect_many(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("connect many: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int silent_port = 0;
+	int refused_port = 0;
+	int listener = open_loopback_listener(&port);
+	int silent = open_loopback_listener(&silent_port);
+	int refused = open_loopback_listener(&refused_port);
+	EXPECT_TRUE("connect many: loopback listeners created", listener >= 0 && silent >= 0 && refused >= 0);
+	if (listener >= 0 && silent >= 0 && refused >= 0) {
+		close(refused);
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Both connections are accepted before either handshake is answered, the second one first:
+			// connecting them one after the other would never get past the first.
+			int first = accept(listener, NULL, NULL);
+			int second = accept(listener, NULL, NULL);
+			int ok = first >= 0 && second >= 0 && serve_handshake(second, 3, 480, NULL, NULL) && serve_handshake(first, 2, 480, NULL, NULL);
+			unsigned char byte_in = 0;
+			ok = ok && read(first, &byte_in, 1) == 0 && read(second, &byte_in, 1) == 0;
+			close(listener);
+			_exit(ok ? 0 : 1);
+		}
+
+		close(listener);
+		s7_connect_options options = { 480, 4, 4 };
+		s7_conn_t* conns[4];
+		s7_connect_target targets[4];
+		s7_error_code_e results[4];
+		for (int i = 0; i < 4; i++) {
+			conns[i] = s7_conn_create(S1500);
+			targets[i].conn = conns[i];
+			targets[i].ip_addr = "127.0.0.1";
+			targets[i].port = i < 2 ? port : (i == 2 ? silent_port : refused_port);
+			targets[i].options = &options;
+			targets[i].timeout_ms = 300;
+		}
+
+		long long started = socket_now_ms();
+		int connected = s7_connect_many(targets, 4, results);
+		long long elapsed = socket_now_ms() - started;
+		EXPECT_TRUE("connect many: answering PLCs connected", connected == 2 &&
+			results[0] == S7_ERROR_CODE_SUCCESS && results[1] == S7_ERROR_CODE_SUCCESS &&
+			s7_conn_get_fd(conns[0]) >= 0 && s7_conn_get_fd(conns[1]) >= 0);
+		EXPECT_TRUE("connect many: each handshake negotiated on its own",
+			s7_conn_get_parallel_jobs(conns[0]) + s7_conn_get_parallel_jobs(conns[1]) == 5 && s7_conn_get_PDU_size(conns[0]) == 480);
+		EXPECT_TRUE("connect many: silent PLC times out", results[2] == S7_ERROR_CODE_TIMEOUT && s7_conn_get_fd(conns[2]) < 0);
+		EXPECT_TRUE("connect many: refused PLC fails", results[3] == S7_ERROR_CODE_FAILED && s7_conn_get_fd(conns[3]) < 0);
+		EXPECT_TRUE("connect many: bounded by the per-PLC timeout", elapsed >= 250 && elapsed < 2000);
+
+		for (int i = 0; i < 4; i++) {
+			s7_conn_destroy(conns[i]);
+		}
+		close(silent);
+		EXPECT_TRUE("connect many: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	int dropped;
+	int restored;
+	int fd_kept;
+	int expected_fd;
+} reconnect_probe;
+
+// Runs on the I/O thread; the fd API goes straight to the restored socket from here.
+static void reconnect_state_callback(s7_conn_t* conn, bool is_online, void* user_data) {
+	reconnect_probe* probe = (reconnect_probe*)user_data;
+	if (is_online) {
+		probe->fd_kept = s7_conn_get_fd(conn) == probe->expected_fd;
+		__atomic_add_fetch(&probe->restored, 1, __ATOMIC_RELEASE);
+	}
+	else {
+		__atomic_add_fetch(&probe->dropped, 1, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
+static void test_managed_reconnect(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("reconnect: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("reconnect: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// One answered read, then the PLC drops the session on the next one and comes back
+			// a little later with a smaller PDU; the client has to replay its original Setup request.
+			unsigned char request[1024];
+			unsigned char setup[25] = { 0 };
+			int first = accept(listener, NULL, NULL);
+			int ok = first >= 0 && serve_handshake(first, 1, 480, NULL, NULL) && serve_read_var_request(first);
+			ok = ok && read_tpkt_frame(first, request, (int)sizeof(request)) > 0;
+			close(first);
+			usleep(300000);
+			int second = accept(listener, NULL, NULL);
+			ok = ok && second >= 0 && serve_handshake(second, 1, 240, NULL, setup) && setup[23] * 256 + setup[24] == 480;
+			int served = 0;
+			while (ok && serve_read_var_request(second)) {
+				served++;
+			}
+			close(second);
+			close(listener);
+			_exit(ok && served == 5 ? 0 : 1);
+		}
+
+		close(listener);
+		char addresses[60][16];
+		byte values[60] = { 0 };
+		s7_multi_item spread[60];
+		for (int i = 0; i < 60; i++) {
+			snprintf(addresses[i], sizeof(addresses[i]), "MB%d", i * 10);
+			spread[i].address = addresses[i];
+			spread[i].length = 1;
+			spread[i].is_bit = false;
+			spread[i].data = &values[i];
+		}
+		s7_read_plan* plan = s7_read_plan_create(spread, 60, 0);
+
+		s7_connect_options options = { 480, 1, 1 };
+		s7_conn_t* conn = s7_conn_create(S1500);
+		reconnect_probe probe = { 0, 0, 0, -1 };
+		s7_reconnect_options reconnect = { 50, 1000, reconnect_state_callback, &probe };
+		bool connected = s7_conn_connect(conn, "127.0.0.1", port, &options);
+		probe.expected_fd = s7_conn_get_fd(conn);
+		EXPECT_TRUE("reconnect: managed connection started", plan != NULL && connected && s7_conn_start_managed_io(conn, &reconnect));
+		if (plan != NULL && connected) {
+			int fd = s7_conn_get_fd(conn);
+			uint32 value = 0;
+			EXPECT_TRUE("reconnect: read before the drop", s7_read_uint32(fd, "DB10.0", &value) == S7_ERROR_CODE_SUCCESS && value == 0x00010203);
+			EXPECT_TRUE("reconnect: dropped session reported", s7_read_uint32(fd, "DB10.0", &value) != S7_ERROR_CODE_SUCCESS);
+
+			long long started = socket_now_ms();
+			s7_error_code_e ret = s7_read_uint32(fd, "DB10.0", &value);
+			long long elapsed = socket_now_ms() - started;
+			EXPECT_TRUE("reconnect: requests fail fast while offline", ret == S7_ERROR_CODE_CONNECTION_CLOSED && elapsed < 200);
+			EXPECT_TRUE("reconnect: offline until restored", !s7_conn_is_online(conn));
+
+			for (int i = 0; i < 300 && !s7_conn_is_online(conn); i++) {
+				usleep(10000);
+			}
+			EXPECT_TRUE("reconnect: session restored once", s7_conn_is_online(conn) && s7_conn_get_reconnect_count(conn) == 1 &&
+				__atomic_load_n(&probe.dropped, __ATOMIC_ACQUIRE) == 1 && __atomic_load_n(&probe.restored, __ATOMIC_ACQUIRE) == 1);
+			EXPECT_TRUE("reconnect: fd kept and PDU renegotiated", probe.fd_kept && s7_conn_get_fd(conn) == fd && s7_conn_get_PDU_size(conn) == 240);
+			EXPECT_TRUE("reconnect: plain read after restore", s7_read_uint32(fd, "DB10.4", &value) == S7_ERROR_CODE_SUCCESS && value == 0x04050607);
+
+			s7_error_code_e results[60];
+			ret = s7_read_plan_execute(fd, plan, results);
+			int all_match = ret == S7_ERROR_CODE_SUCCESS;
+			for (int i = 0; i < 60; i++) {
+				all_match = all_match && results[i] == S7_ERROR_CODE_SUCCESS && values[i] == (byte)(i * 10);
+			}
+			EXPECT_TRUE("reconnect: plan packed again for the smaller PDU", all_match && s7_read_plan_request_count(plan) == 4);
+		}
+		s7_conn_destroy(conn);
+		s7_read_plan_destroy(plan);
+		EXPECT_TRUE("reconnect: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
+#ifndef _WIN32
+// Submit one 4-byte read per address through the pool and wait for all; returns how many failed
+static int pool_read_round(s7_pool_t* pool, const char* const* addresses, int count, byte data[][4]) {
+	s7_multi_item items[6];
+	s7_error_code_e results[6];
+	s7_job_t* jobs[6];
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		s7_multi_item item = { addresses[i], 4, false, data[i] };
+		items[i] = item;
+		jobs[i] = s7_pool_submit_read(pool, &items[i], 1, &results[i]);
+	}
+	for (int i = 0; i < count; i++) {
+		failed += jobs[i] == NULL || s7_job_wait(jobs[i]) != S7_ERROR_CODE_SUCCESS;
+		s7_job_release(jobs[i]);
+	}
+	return failed;
+}
+#endif
+
+static void test_connection_pool(void) {
+#ifdef _WIN32
+	EXPECT_TRUE("pool: protocol packet tests skipped on Windows", true);
+#else
+	int port = 0;
+	int listener = open_loopback_listener(&port);
+	EXPECT_TRUE("pool: loopback listener created", listener >= 0);
+	if (listener >= 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Slow PLC with one connection per member plus one reconnect; the first member drops on its third request.
+			struct pollfd fds[5];
+			int served[5] = { 0 };
+			int accepted = 0;
+			int open_count = 0;
+			int ok = 1;
+			fds[0].fd = listener;
+			fds[0].events = POLLIN;
+			while (ok && (accepted < 4 || open_count > 0) && poll(fds, 1 + accepted, 5000) > 0) {
+				if (fds[0].fd >= 0 && fds[0].revents != 0) {
+					int fd = accept(listener, NULL, NULL);
+					accepted++;
+					open_count++;
+					fds[accepted].fd = fd;
+					fds[accepted].events = POLLIN;
+					fds[accepted].revents = 0;
+					ok = fd >= 0 && serve_handshake(fd, 1, 480, NULL, NULL);
+					if (accepted == 4) {
+						fds[0].fd = -1;
+					}
+				}
+				for (int i = 1; i <= accepted; i++) {
+					if (fds[i].fd < 0 || fds[i].revents == 0) {
+						continue;
+					}
+					unsigned char request[1024];
+					unsigned char response[4096];
+					int request_len = read_tpkt_frame(fds[i].fd, request, (int)sizeof(request));
+					if (request_len <= 0 || (i == 1 && served[i] == 2)) {
+						close(fds[i].fd);
+						fds[i].fd = -1;
+						open_count--;
+						continue;
+					}
+					usleep(20000);
+					int response_len = build_read_var_response(request, request_len, response);
+					ok = response_len > 0 && write_exact(fds[i].fd, response, response_len) == response_len;
+					served[i]++;
+				}
+			}
+			close(listener);
+			_exit(ok && accepted == 4 && open_count == 0 && served[1] == 2 && served[2] == 5 && served[3] == 5 && served[4] == 1 ? 0 : 1);
+		}
+
+		close(listener);
+		static const char* const addresses[6] = { "DB10.0", "DB10.4", "DB10.8", "DB10.12", "DB10.16", "DB10.20" };
+		byte data[6][4];
+		s7_connect_options options = { 480, 1, 1 };
+		s7_conn_t* settings = s7_conn_create(S1500);
+		s7_pool_t* pool = s7_pool_create(settings, 3);
+		EXPECT_TRUE("pool: created with three members", pool != NULL && s7_pool_get_size(pool) == 3);
+		EXPECT_TRUE("pool: every member connected", s7_pool_connect(pool, "127.0.0.1", port, &options) == 3);
+
+		memset(data, 0, sizeof(data));
+		EXPECT_TRUE("pool: reads spread over the members", pool_read_round(pool, addresses, 6, data) == 0 &&
+			data[0][0] == 0 && data[5][0] == 20 && data[5][3] == 23 && s7_pool_get_outstanding(pool) == 0);
+		EXPECT_TRUE("pool: only the dropped member fails", pool_read_round(pool, addresses, 3, data) == 1 &&
+			s7_pool_get_connected_count(pool) == 2);
+		EXPECT_TRUE("pool: healthy members keep serving", pool_read_round(pool, addresses, 2, data) == 0);
+		EXPECT_TRUE("pool: dropped member reconnected", s7_pool_maintain(pool) == 3);
+		memset(data, 0, sizeof(data));
+		EXPECT_TRUE("pool: reconnected member takes its share", pool_read_round(pool, addresses, 3, data) == 0 && data[2][0] == 8);
+
+		s7_pool_destroy(pool);
+		s7_conn_destroy(settings);
+		EXPECT_TRUE("pool: peer completed", wait_child_success(pid));
+	}
+#endif
+}
+
 int main(void) {
 	printf("Running minimal regression tests...\n");
 
 	test_address_parser();
+	test_bulk_endian();
+	test_bit_packing();
 	test_short_packet_guard();
 	test_malformed_header_guard();
+	test_receive_buffer();
 	test_remote_run_stop_packet_path();
+	test_read_multi_packet_path();
+	test_write_multi_packet_path();
+	test_large_read_split();
+	test_typed_arrays();
+	test_bit_arrays();
+	test_bit_batch();
+	test_tag_database();
+	test_read_plan();
+	test_prepared_handles();
+	test_read_plan_negotiated_pdu();
+	test_zero_allocation_path();
+	test_frame_allocators();
+	test_connect_options();
+	test_independent_connections();
+	test_pipelined_large_read();
+	test_shared_connection();
+	test_async_callbacks();
+	test_connect_families_in_parallel();
+	test_async_shared_owner();
+	test_async_disconnect_in_callback();
+	test_io_stop_in_callback();
+	test_event_loop(S7_LOOP_BACKEND_EPOLL);
+	test_event_loop(S7_LOOP_BACKEND_IO_URING);
+	test_loop_remove_in_callback();
+	test_connection_pool();
+	test_connect_many();
+	test_managed_reconnect();
 
 	if (g_failed == 0) {
 		printf("All tests passed.\n");